@@ -0,0 +1,66 @@
+#ifndef _LOGKV_ASYNCDURABLE_H_
+#define _LOGKV_ASYNCDURABLE_H_
+
+#include <logkv/store.h>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace logkv {
+
+/**
+ * Asynchronously wait until the event with sequence number `seq` is committed
+ * to disk by `store` (see `Store::asyncWaitDurable()`).
+ *
+ * The completion signature is `void(std::exception_ptr)`, and the completion
+ * is posted to the handler's associated executor (e.g. the executor of the
+ * calling coroutine), never run on the store's flusher thread. With group
+ * commit enabled, concurrent waiters share the flusher's fsyncs, so request
+ * handlers can e.g. `update()` and then
+ *
+ *  co_await logkv::asyncDurable(store, seq, boost::asio::use_awaitable);
+ *
+ * to acknowledge a write only once it's durable, without blocking a thread.
+ * Without group commit, the events file is synced by the calling thread
+ * before this returns.
+ *
+ * @param store A `logkv::Store` (or anything with `asyncWaitDurable()`).
+ * @param seq Sequence number returned by `update()`, `erase()` or `persist()`.
+ * @param token Asio completion token (a handler, `use_awaitable`,
+ * `use_future`, ...).
+ */
+template <typename S, typename CompletionToken>
+auto asyncDurable(S& store, uint64_t seq, CompletionToken&& token) {
+  return boost::asio::async_initiate<CompletionToken,
+                                     void(std::exception_ptr)>(
+    [&store, seq](auto handler) {
+      using Handler = decltype(handler);
+      // The store keeps the callback in a `std::function`, which must be
+      // copyable, so the (move-only) handler is shared.
+      auto work = boost::asio::make_work_guard(
+        boost::asio::get_associated_executor(handler));
+      auto shared = std::make_shared<std::pair<Handler, decltype(work)>>(
+        std::move(handler), std::move(work));
+      store.asyncWaitDurable(seq, [shared](std::exception_ptr error) {
+        auto executor = shared->second.get_executor();
+        boost::asio::post(executor,
+                          [shared = std::move(shared), error]() mutable {
+                            auto handler = std::move(shared->first);
+                            shared->second.reset();
+                            std::move(handler)(error);
+                          });
+      });
+    },
+    token);
+}
+
+} // namespace logkv
+
+#endif
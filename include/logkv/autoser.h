@@ -8,12 +8,24 @@
 #include <algorithm>
 #include <array>
 #include <bit>
+#include <concepts>
 #include <limits>
 #include <span>
 #include <string>
 #include <tuple>
 #include <variant>
 
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+  (defined(__GNUC__) || defined(__clang__))
+#define LOGKV_AUTOSER_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define LOGKV_AUTOSER_NEON
+#include <arm_neon.h>
+#elif defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 /**
  * Automatic serialization support.
  *
@@ -59,6 +71,7 @@
  * #include <logkv/partial.h>
  * - Supports a simple switch between a full and a partial serialization
  *   mode for composite types; integrated with logkv::Store snapshotting.
+ *   Updates can also log only the changed members (dirty member mask).
  *
  * Support for other types T can be added via serializable<T> or
  * composite_traits<T> template specializations.
@@ -78,6 +91,9 @@ const size_t MAX_AUTOSER_BYTES = 1024 * 1024 * 1024;
 // Protect against reading corrupted element count fields
 const size_t MAX_AUTOSER_ITEMS = 256 * 1024 * 1024;
 
+// Largest fixed-size object that is reserved from a Sink in one piece
+const size_t MAX_AUTOSER_FIXED_RESERVE = 4096;
+
 // ----------------------------------------------------------------------------
 // Template implemented for T types that are composites of serializable types.
 // The concept of a composite type is more general than std::is_aggregate_v.
@@ -149,6 +165,7 @@ private:
 
 template <typename T>
 struct serializer<T, std::enable_if_t<std::is_integral_v<T>>> {
+  static constexpr size_t fixed_size = sizeof(T);
   static size_t get_size(const T&) { return sizeof(T); }
   static bool is_empty(const T& val) { return val == T(); }
   static size_t write(char* dest, size_t size, const T& val) {
@@ -160,6 +177,10 @@ struct serializer<T, std::enable_if_t<std::is_integral_v<T>>> {
     std::memcpy(dest, &be, required_size);
     return required_size;
   }
+  static void write_to(Sink& sink, const T& val) {
+    T be = boost::endian::native_to_big(val);
+    sink.append(&be, sizeof(T));
+  }
   static size_t read(const char* src, size_t size, T& val) {
     constexpr size_t required_size = sizeof(T);
     if (size < required_size) {
@@ -172,12 +193,246 @@ struct serializer<T, std::enable_if_t<std::is_integral_v<T>>> {
   }
 };
 
+// ----------------------------------------------------------------------------
+// Fixed-size serializers
+// ----------------------------------------------------------------------------
+
+// A serializer whose values always take the same number of bytes declares it
+// as `static constexpr size_t fixed_size`. Composites of fixed-size types get
+// theirs at compile time, and are written and read with a single bounds
+// check followed by a straight-line sequence of member stores and loads.
+template <typename T>
+concept fixed_size_serializable = requires {
+  { serializer<T>::fixed_size } -> std::convertible_to<size_t>;
+};
+
+template <typename... Ts>
+inline constexpr bool all_fixed_size =
+  (fixed_size_serializable<std::decay_t<Ts>> && ...);
+
+// Sum of the fixed sizes of `Ts`, or 0 if any of them is not fixed-size.
+template <typename... Ts> constexpr size_t fixed_size_sum() {
+  if constexpr (all_fixed_size<Ts...>) {
+    return (serializer<std::decay_t<Ts>>::fixed_size + ... + 0);
+  } else {
+    return 0;
+  }
+}
+
+// Base for serializers that are fixed-size when `Fixed` is true.
+template <bool Fixed, size_t N> struct fixed_size_base {};
+template <size_t N> struct fixed_size_base<true, N> {
+  static constexpr size_t fixed_size = N;
+};
+
+template <typename... Ts>
+using fixed_size_members =
+  fixed_size_base<all_fixed_size<Ts...>, fixed_size_sum<Ts...>()>;
+
+template <typename Tuple> struct fixed_size_tuple;
+template <typename... Ts>
+struct fixed_size_tuple<std::tuple<Ts...>> : fixed_size_members<Ts...> {};
+
+// Writes fixed-size `val` at `dest` and moves `dest` past it.
+template <typename T> inline void store_fixed(char*& dest, const T& val) {
+  serializer<T>::write(dest, serializer<T>::fixed_size, val);
+  dest += serializer<T>::fixed_size;
+}
+
+// Reads fixed-size `val` from `src` and moves `src` past it.
+template <typename T> inline void load_fixed(const char*& src, T& val) {
+  serializer<T>::read(src, serializer<T>::fixed_size, val);
+  src += serializer<T>::fixed_size;
+}
+
+// ----------------------------------------------------------------------------
+// Bulk big-endian conversion of integral arrays
+// ----------------------------------------------------------------------------
+
+// Integral types whose arrays are serialized as one block of big-endian words.
+template <typename T>
+inline constexpr bool is_bulk_integral =
+  std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+  (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+// Copies `n` W-byte words from `src` to `dest`, reversing the bytes of each.
+template <size_t W>
+inline void bswap_copy_scalar(char* dest, const char* src, size_t n) {
+  using U = std::conditional_t<W == 2, uint16_t,
+                               std::conditional_t<W == 4, uint32_t, uint64_t>>;
+  for (size_t i = 0; i < n; ++i) {
+    U v;
+    std::memcpy(&v, src + i * W, W);
+    v = boost::endian::endian_reverse(v);
+    std::memcpy(dest + i * W, &v, W);
+  }
+}
+
+#if defined(LOGKV_AUTOSER_X86)
+
+// pshufb kernels: one shuffle reverses every word in a 16-byte vector (or in
+// both lanes of a 32-byte one, as words never cross a lane).
+#define LOGKV_AUTOSER_SSSE3 __attribute__((target("ssse3")))
+#define LOGKV_AUTOSER_AVX2 __attribute__((target("avx2")))
+
+template <size_t W>
+inline constexpr std::array<char, 16> bswap_shuffle = [] {
+  std::array<char, 16> mask{};
+  for (size_t i = 0; i < 16; ++i) {
+    mask[i] = static_cast<char>(i - i % W + (W - 1 - i % W));
+  }
+  return mask;
+}();
+
+template <size_t W> LOGKV_AUTOSER_SSSE3 inline __m128i bswap_mask128() {
+  return _mm_loadu_si128(
+    reinterpret_cast<const __m128i*>(bswap_shuffle<W>.data()));
+}
+
+template <size_t W>
+LOGKV_AUTOSER_SSSE3 inline void bswap_copy_ssse3(char* dest, const char* src,
+                                                 size_t n) {
+  const __m128i mask = bswap_mask128<W>();
+  const size_t bytes = n * W;
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    const __m128i v =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_shuffle_epi8(v, mask));
+  }
+  bswap_copy_scalar<W>(dest + i, src + i, (bytes - i) / W);
+}
+
+template <size_t W>
+LOGKV_AUTOSER_AVX2 inline void bswap_copy_avx2(char* dest, const char* src,
+                                               size_t n) {
+  const __m256i mask = _mm256_broadcastsi128_si256(bswap_mask128<W>());
+  const size_t bytes = n * W;
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    const __m256i a =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i b =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i + 32),
+                        _mm256_shuffle_epi8(b, mask));
+  }
+  for (; i + 32 <= bytes; i += 32) {
+    const __m256i v =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_shuffle_epi8(v, mask));
+  }
+  bswap_copy_scalar<W>(dest + i, src + i, (bytes - i) / W);
+}
+
+#undef LOGKV_AUTOSER_SSSE3
+#undef LOGKV_AUTOSER_AVX2
+
+enum class BswapKernel { Scalar, SSSE3, AVX2 };
+
+inline BswapKernel bswap_kernel() {
+  static const BswapKernel kernel = __builtin_cpu_supports("avx2")
+                                      ? BswapKernel::AVX2
+                                    : __builtin_cpu_supports("ssse3")
+                                      ? BswapKernel::SSSE3
+                                      : BswapKernel::Scalar;
+  return kernel;
+}
+
+#elif defined(LOGKV_AUTOSER_NEON)
+
+template <size_t W>
+inline void bswap_copy_neon(char* dest, const char* src, size_t n) {
+  const size_t bytes = n * W;
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(src + i));
+    uint8x16_t r;
+    if constexpr (W == 2) {
+      r = vrev16q_u8(v);
+    } else if constexpr (W == 4) {
+      r = vrev32q_u8(v);
+    } else {
+      r = vrev64q_u8(v);
+    }
+    vst1q_u8(reinterpret_cast<uint8_t*>(dest + i), r);
+  }
+  bswap_copy_scalar<W>(dest + i, src + i, (bytes - i) / W);
+}
+
+#endif
+
+// Arrays shorter than this (in bytes) stay on the scalar loop.
+constexpr size_t BswapSimdMinSize = 16;
+
+// Copies `n` values of integral T between native byte order (in memory) and
+// big-endian byte order (serialized); the conversion is the same both ways.
+// Uses SSSE3/AVX2 or NEON byte shuffles when available, and a plain memcpy
+// on big-endian hosts. `dest` and `src` may be equal, but not overlap
+// otherwise.
+template <typename T>
+inline void big_endian_copy(void* dest, const void* src, size_t n) {
+  static_assert(is_bulk_integral<T>);
+  constexpr size_t W = sizeof(T);
+  char* d = static_cast<char*>(dest);
+  const char* s = static_cast<const char*>(src);
+  if constexpr (std::endian::native == std::endian::big) {
+    if (n && d != s) {
+      std::memcpy(d, s, n * W);
+    }
+    return;
+  } else {
+    if (n * W >= BswapSimdMinSize) {
+#if defined(LOGKV_AUTOSER_X86)
+      switch (bswap_kernel()) {
+      case BswapKernel::AVX2:
+        bswap_copy_avx2<W>(d, s, n);
+        return;
+      case BswapKernel::SSSE3:
+        bswap_copy_ssse3<W>(d, s, n);
+        return;
+      case BswapKernel::Scalar:
+        break;
+      }
+#elif defined(LOGKV_AUTOSER_NEON)
+      bswap_copy_neon<W>(d, s, n);
+      return;
+#endif
+    }
+    bswap_copy_scalar<W>(d, s, n);
+  }
+}
+
+#undef LOGKV_AUTOSER_X86
+#undef LOGKV_AUTOSER_NEON
+
+// Writes `n` values of integral T from `src` to `sink` in big-endian byte
+// order, converting one block that fits in the sink at a time.
+template <typename T>
+inline void write_big_endian_to(Sink& sink, const T* src, size_t n) {
+  constexpr size_t block_size = MAX_AUTOSER_FIXED_RESERVE / sizeof(T);
+  while (n > 0) {
+    const size_t k = std::min(n, block_size);
+    if (char* dest = sink.reserve(k * sizeof(T))) {
+      big_endian_copy<T>(dest, src, k);
+    }
+    sink.advance(k * sizeof(T));
+    src += k;
+    n -= k;
+  }
+}
+
 // ----------------------------------------------------------------------------
 // logkv::VarUint
 // ----------------------------------------------------------------------------
 
 template <typename T> struct VarUint {
   static_assert(std::is_unsigned_v<T>, "VarUint must wrap an unsigned type");
+  using value_type = T;
   T value;
   VarUint(const T& val = 0)
       : value(val) {} // Forces `std::is_aggregate_v<T> == false`
@@ -192,6 +447,180 @@ template <typename T> struct VarUint {
   bool operator!=(const T& other) const { return value != other; }
 };
 
+// Word-at-a-time VarUint kernels: up to 8 encoded bytes are handled as one
+// little-endian 64-bit word, whose 7-bit groups are gathered or scattered
+// with BMI2 `pext`/`pdep` when available, or with three shift-and-mask steps.
+
+template <typename T>
+inline constexpr size_t varuint_max_size = (sizeof(T) * 8 + 6) / 7;
+
+// Packs the low 7 bits of each byte of `x` into a 56-bit value.
+inline uint64_t varuint_gather(uint64_t x) {
+#if defined(__BMI2__)
+  return _pext_u64(x, 0x7F7F7F7F7F7F7F7Full);
+#else
+  x &= 0x7F7F7F7F7F7F7F7Full;
+  x = ((x & 0x7F007F007F007F00ull) >> 1) | (x & 0x007F007F007F007Full);
+  x = ((x & 0x3FFF00003FFF0000ull) >> 2) | (x & 0x00003FFF00003FFFull);
+  x = ((x & 0x0FFFFFFF00000000ull) >> 4) | (x & 0x000000000FFFFFFFull);
+  return x;
+#endif
+}
+
+// Spreads a value below 2^56 into the low 7 bits of each byte.
+inline uint64_t varuint_scatter(uint64_t v) {
+#if defined(__BMI2__)
+  return _pdep_u64(v, 0x7F7F7F7F7F7F7F7Full);
+#else
+  v = (v & 0x000000000FFFFFFFull) | ((v & 0x00FFFFFFF0000000ull) << 4);
+  v = (v & 0x00003FFF00003FFFull) | ((v & 0x0FFFC0000FFFC000ull) << 2);
+  v = (v & 0x007F007F007F007Full) | ((v & 0x3F803F803F803F80ull) << 1);
+  return v;
+#endif
+}
+
+// Encodes `value` at `dest`, which must have room for 8 bytes (even if the
+// encoding is shorter) and for `varuint_max_size<T>` bytes.
+// Returns the encoded size.
+template <typename T> inline size_t varuint_encode(char* dest, T value) {
+  const uint64_t v = value;
+  if (sizeof(T) < 8 || v < (1ull << 56)) {
+    const size_t len = v ? (std::bit_width(v) + 6) / 7 : 1;
+    const uint64_t more = 0x8080808080808080ull & ((1ull << (len * 8 - 8)) - 1);
+    const uint64_t word = boost::endian::native_to_little(varuint_scatter(v) |
+                                                          more);
+    std::memcpy(dest, &word, 8);
+    return len;
+  }
+  char* ptr = dest;
+  T rest = value;
+  while (rest >= 0x80) {
+    *ptr++ = static_cast<char>((rest & 0x7F) | 0x80);
+    rest >>= 7;
+  }
+  *ptr++ = static_cast<char>(rest);
+  return ptr - dest;
+}
+
+// Decodes a VarUint from `src` with the `serializer<VarUint<T>>::read()`
+// contract: returns the bytes consumed, or more than `size` if `src` is
+// truncated. Throws `std::runtime_error` on overflow.
+// Single values are decoded a byte at a time: the loop is speculated past
+// by the CPU, which beats the word kernel's dependency on the value length
+// (see `varuint_decode_bulk()` for runs of values).
+template <typename T>
+inline size_t varuint_decode(const char* src, size_t size, T& val) {
+  constexpr size_t max_bytes_for_type = varuint_max_size<T>;
+  T result = 0;
+  unsigned int shift = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (i >= max_bytes_for_type) {
+      throw std::runtime_error("VarUint overflow: too many input bytes.");
+    }
+    const unsigned char byte = src[i];
+    const T part = static_cast<T>(byte & 0x7F);
+    if (part > (std::numeric_limits<T>::max() >> shift)) {
+      throw std::runtime_error("VarUint overflow: decoded value too large.");
+    }
+    result |= part << shift;
+    if ((byte & 0x80) == 0) {
+      val = result;
+      return i + 1;
+    }
+    shift += 7;
+  }
+  return size + 1;
+}
+
+// Room `varuint_encode_bulk()` needs for `n` values.
+template <typename T> inline constexpr size_t varuint_bulk_size(size_t n) {
+  return n * varuint_max_size<T> + 8;
+}
+
+// Encodes the values in [first, last) (convertible to T) back to back at
+// `dest`, which must have room for `varuint_bulk_size<T>(last - first)`
+// bytes. Returns the encoded size.
+template <typename T, typename It>
+inline size_t varuint_encode_bulk(char* dest, It first, It last) {
+  char* ptr = dest;
+  for (; first != last; ++first) {
+    ptr += varuint_encode<T>(ptr, static_cast<T>(*first));
+  }
+  return ptr - dest;
+}
+
+// Decodes `n` back-to-back VarUints from `src` into `out[0..n)`.
+// Returns the bytes consumed, or more than `size` if `src` is truncated.
+// Decodes every VarUint that ends in an 8-byte word from one load, so short
+// values don't wait on one another's length.
+template <typename T, typename Out>
+inline size_t varuint_decode_bulk(const char* src, size_t size, Out out,
+                                  size_t n) {
+  size_t off = 0;
+  size_t i = 0;
+  while (i < n && size - off >= 8) {
+    uint64_t word;
+    std::memcpy(&word, src + off, 8);
+    word = boost::endian::little_to_native(word);
+    uint64_t stops = ~word & 0x8080808080808080ull;
+    size_t start = 0; // bit offset of the next VarUint in `word`
+    bool ok = stops != 0;
+    while (stops && i < n) {
+      const size_t end = std::countr_zero(stops) + 1;
+      const uint64_t v =
+        varuint_gather((word & (stops ^ (stops - 1))) >> start);
+      if ((end - start) / 8 > varuint_max_size<T> ||
+          v > std::numeric_limits<T>::max()) {
+        ok = false; // let varuint_decode() report it
+        break;
+      }
+      *out = static_cast<T>(v);
+      ++out;
+      ++i;
+      start = end;
+      stops &= stops - 1;
+    }
+    off += start / 8;
+    if (!ok) {
+      break;
+    }
+  }
+  for (; i < n; ++i, ++out) {
+    T v;
+    const size_t used = varuint_decode(src + off, size - off, v);
+    if (used > size - off) {
+      return off + used;
+    }
+    *out = v;
+    off += used;
+  }
+  return off;
+}
+
+template <typename T> struct is_varuint : std::false_type {};
+template <typename T> struct is_varuint<VarUint<T>> : std::true_type {};
+
+// Writes `n` VarUint<T> values starting at `first` to `sink`, encoding each
+// block that fits in the sink buffer with `varuint_encode_bulk()`.
+template <typename T, typename It>
+inline void write_varuints_to(Sink& sink, It first, size_t n) {
+  constexpr size_t block_size = 256;
+  while (n > 0) {
+    const size_t k = std::min(n, block_size);
+    It last = std::next(first, k);
+    if (sink.available() >= varuint_bulk_size<T>(k)) {
+      char* dest = sink.reserve(varuint_bulk_size<T>(k));
+      sink.advance(varuint_encode_bulk<T>(dest, first, last));
+    } else {
+      for (It it = first; it != last; ++it) {
+        logkv::write_to(sink, VarUint<T>(*it));
+      }
+    }
+    first = last;
+    n -= k;
+  }
+}
+
 template <typename T> struct serializer<VarUint<T>> {
   static size_t get_size(const VarUint<T>& val) {
     if (val.value == 0) {
@@ -201,40 +630,19 @@ template <typename T> struct serializer<VarUint<T>> {
   }
   static bool is_empty(const VarUint<T>& val) { return val.value == T(); }
   static size_t write(char* dest, size_t size, const VarUint<T>& val) {
-    const size_t required_size = get_size(val);
-    if (size < required_size) {
-      return required_size;
-    }
-    T v = val.value;
-    char* ptr = dest;
-    while (v >= 0x80) {
-      *ptr++ = static_cast<char>((v & 0x7F) | 0x80);
-      v >>= 7;
+    char buf[varuint_max_size<T> + 8];
+    const size_t required_size = varuint_encode<T>(buf, val.value);
+    if (size >= required_size) {
+      std::memcpy(dest, buf, required_size);
     }
-    *ptr++ = static_cast<char>(v & 0x7F);
     return required_size;
   }
+  static void write_to(Sink& sink, const VarUint<T>& val) {
+    char buf[varuint_max_size<T> + 8];
+    sink.append(buf, varuint_encode<T>(buf, val.value));
+  }
   static size_t read(const char* src, size_t size, VarUint<T>& val) {
-    T result = 0;
-    unsigned int shift = 0;
-    constexpr size_t max_bytes_for_type = (sizeof(T) * 8 + 6) / 7;
-    for (size_t i = 0; i < size; ++i) {
-      if (i >= max_bytes_for_type) {
-        throw std::runtime_error("VarUint overflow: too many input bytes.");
-      }
-      const unsigned char byte = src[i];
-      const T part = static_cast<T>(byte & 0x7F);
-      if (part > (std::numeric_limits<T>::max() >> shift)) {
-        throw std::runtime_error("VarUint overflow: decoded value too large.");
-      }
-      result |= part << shift;
-      if ((byte & 0x80) == 0) {
-        val.value = result;
-        return i + 1;
-      }
-      shift += 7;
-    }
-    return size + 1;
+    return varuint_decode(src, size, val.value);
   }
 };
 
@@ -256,6 +664,9 @@ struct serializer<std::span<T>,
     std::memcpy(dest, span.data(), span.size());
     return span.size();
   }
+  static void write_to(Sink& sink, const std::span<T>& span) {
+    sink.append(span.data(), span.size());
+  }
 
   static size_t read(const char* src, size_t size, std::span<T>& span) {
     if (size < span.size()) {
@@ -275,6 +686,7 @@ struct serializer<std::span<T>,
 template <typename T, size_t N>
 struct serializer<std::array<T, N>,
                   std::enable_if_t<sizeof(T) == 1 && std::is_trivial_v<T>>> {
+  static constexpr size_t fixed_size = N;
   static size_t get_size(const std::array<T, N>&) { return N; }
   static bool is_empty(const std::array<T, N>& arr) {
     return std::all_of(arr.begin(), arr.end(),
@@ -287,6 +699,9 @@ struct serializer<std::array<T, N>,
     std::memcpy(dest, arr.data(), N);
     return N;
   }
+  static void write_to(Sink& sink, const std::array<T, N>& arr) {
+    sink.append(arr.data(), N);
+  }
   static size_t read(const char* src, size_t size, std::array<T, N>& arr) {
     if (size < N) {
       return N;
@@ -299,17 +714,24 @@ struct serializer<std::array<T, N>,
 // ----------------------------------------------------------------------------
 // std::array<T, N> for any type T with a logkv::serializer<T>
 // Empty state means all elements are in the empty state.
+// Arrays of integers are converted as one block; arrays of other fixed-size
+// types are bounds-checked once.
 // ----------------------------------------------------------------------------
 
 template <typename T, size_t N>
 struct serializer<std::array<T, N>,
-                  std::enable_if_t<!(sizeof(T) == 1 && std::is_trivial_v<T>)>> {
+                  std::enable_if_t<!(sizeof(T) == 1 && std::is_trivial_v<T>)>>
+    : fixed_size_base<fixed_size_serializable<T>, N * fixed_size_sum<T>()> {
   static size_t get_size(const std::array<T, N>& arr) {
-    size_t total_size = 0;
-    for (const auto& elem : arr) {
-      total_size += serializer<T>::get_size(elem);
+    if constexpr (fixed_size_serializable<T>) {
+      return N * serializer<T>::fixed_size;
+    } else {
+      size_t total_size = 0;
+      for (const auto& elem : arr) {
+        total_size += serializer<T>::get_size(elem);
+      }
+      return total_size;
     }
-    return total_size;
   }
   static bool is_empty(const std::array<T, N>& arr) {
     return std::all_of(arr.begin(), arr.end(), [](const T& val) {
@@ -317,26 +739,67 @@ struct serializer<std::array<T, N>,
     });
   }
   static size_t write(char* dest, size_t size, const std::array<T, N>& arr) {
-    Writer writer(dest, size);
-    try {
+    if constexpr (fixed_size_serializable<T>) {
+      constexpr size_t required = N * serializer<T>::fixed_size;
+      if (size < required) {
+        return required;
+      }
+      if constexpr (is_bulk_integral<T>) {
+        big_endian_copy<T>(dest, arr.data(), N);
+      } else {
+        for (const auto& elem : arr) {
+          store_fixed(dest, elem);
+        }
+      }
+      return required;
+    } else {
+      return write_with_sink(dest, size, arr);
+    }
+  }
+  static void write_to(Sink& sink, const std::array<T, N>& arr) {
+    if constexpr (is_bulk_integral<T>) {
+      write_big_endian_to(sink, arr.data(), N);
+    } else if constexpr (fixed_size_serializable<T> &&
+                         N * fixed_size_sum<T>() <=
+                           MAX_AUTOSER_FIXED_RESERVE) {
+      constexpr size_t required = N * serializer<T>::fixed_size;
+      if (char* dest = sink.reserve(required)) {
+        for (const auto& elem : arr) {
+          store_fixed(dest, elem);
+        }
+      }
+      sink.advance(required);
+    } else {
       for (const auto& elem : arr) {
-        writer.write(elem);
+        logkv::write_to(sink, elem);
       }
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
     }
-    return writer.bytes_processed();
   }
   static size_t read(const char* src, size_t size, std::array<T, N>& arr) {
-    Reader reader(src, size);
-    try {
-      for (auto& elem : arr) {
-        reader.read(elem);
+    if constexpr (fixed_size_serializable<T>) {
+      constexpr size_t required = N * serializer<T>::fixed_size;
+      if (size < required) {
+        return required;
       }
-    } catch (const insufficient_buffer& e) {
-      return reader.bytes_processed() + e.get_required_bytes();
+      if constexpr (is_bulk_integral<T>) {
+        big_endian_copy<T>(arr.data(), src, N);
+      } else {
+        for (auto& elem : arr) {
+          load_fixed(src, elem);
+        }
+      }
+      return required;
+    } else {
+      Reader reader(src, size);
+      try {
+        for (auto& elem : arr) {
+          reader.read(elem);
+        }
+      } catch (const insufficient_buffer& e) {
+        return reader.bytes_processed() + e.get_required_bytes();
+      }
+      return reader.bytes_processed();
     }
-    return reader.bytes_processed();
   }
 };
 
@@ -346,15 +809,19 @@ struct serializer<std::array<T, N>,
 
 template <typename... Args>
 inline size_t get_size_for_members(const std::tuple<Args...>& t) {
-  size_t total_size = 0;
-  std::apply(
-    [&](const auto&... member) {
-      total_size =
-        (logkv::serializer<std::decay_t<decltype(member)>>::get_size(member) +
-         ... + 0);
-    },
-    t);
-  return total_size;
+  if constexpr (all_fixed_size<Args...>) {
+    return fixed_size_sum<Args...>();
+  } else {
+    size_t total_size = 0;
+    std::apply(
+      [&](const auto&... member) {
+        total_size =
+          (logkv::serializer<std::decay_t<decltype(member)>>::get_size(member) +
+           ... + 0);
+      },
+      t);
+    return total_size;
+  }
 }
 
 template <typename... Args>
@@ -362,11 +829,75 @@ inline void write_members(Writer& writer, const std::tuple<Args...>& t) {
   std::apply([&](const auto&... member) { (writer.write(member), ...); }, t);
 }
 
+// Writes the members of `t`, which are all fixed-size, at `dest`.
+template <typename... Args>
+inline void store_fixed_members(char* dest, const std::tuple<Args...>& t) {
+  std::apply([&](const auto&... member) { (store_fixed(dest, member), ...); },
+             t);
+}
+
+// Reads the members of `t`, which are all fixed-size, from `src`.
+template <typename... Args>
+inline void load_fixed_members(const char* src, std::tuple<Args...>& t) {
+  std::apply([&](auto&... member) { (load_fixed(src, member), ...); }, t);
+}
+
+template <typename... Args>
+inline void write_members_to(Sink& sink, const std::tuple<Args...>& t) {
+  constexpr size_t n = fixed_size_sum<Args...>();
+  if constexpr (all_fixed_size<Args...> && n <= MAX_AUTOSER_FIXED_RESERVE) {
+    if (char* dest = sink.reserve(n)) {
+      store_fixed_members(dest, t);
+    }
+    sink.advance(n);
+  } else {
+    std::apply(
+      [&](const auto&... member) { (logkv::write_to(sink, member), ...); }, t);
+  }
+}
+
+// Implements `serializer<T>::write()` for a composite T with members `t`.
+template <typename T, typename... Args>
+inline size_t write_members_with_sink(char* dest, size_t size, const T& obj,
+                                      const std::tuple<Args...>& t) {
+  if constexpr (all_fixed_size<Args...>) {
+    constexpr size_t n = fixed_size_sum<Args...>();
+    if (size >= n) {
+      store_fixed_members(dest, t);
+    }
+    return n;
+  } else {
+    return write_with_sink(dest, size, obj);
+  }
+}
+
 template <typename... Args>
 inline void read_members(Reader& reader, std::tuple<Args...>& t) {
   std::apply([&](auto&... member) { (reader.read(member), ...); }, t);
 }
 
+// Implements `serializer<T>::read()` for a composite T with members `t`.
+template <typename... Args>
+inline size_t read_members_from(const char* src, size_t size,
+                                std::tuple<Args...>& t) {
+  if constexpr (all_fixed_size<Args...>) {
+    constexpr size_t n = fixed_size_sum<Args...>();
+    if (size < n) {
+      return n;
+    }
+    load_fixed_members(src, t);
+    return n;
+  } else {
+    Reader reader(src, size);
+    try {
+      read_members(reader, t);
+    } catch (const insufficient_buffer& e) {
+      return reader.bytes_processed() + e.get_required_bytes();
+    }
+    return reader.bytes_processed();
+  }
+}
+
 template <typename... Args>
 inline bool are_members_empty(const std::tuple<Args...>& t) {
   return std::apply(
@@ -382,7 +913,8 @@ inline bool are_members_empty(const std::tuple<Args...>& t) {
 // Serializer for std::tuple
 // ----------------------------------------------------------------------------
 
-template <typename... Args> struct serializer<std::tuple<Args...>> {
+template <typename... Args>
+struct serializer<std::tuple<Args...>> : fixed_size_members<Args...> {
   static size_t get_size(const std::tuple<Args...>& t) {
     return get_size_for_members(t);
   }
@@ -390,22 +922,13 @@ template <typename... Args> struct serializer<std::tuple<Args...>> {
     return are_members_empty(t);
   }
   static size_t write(char* dest, size_t size, const std::tuple<Args...>& t) {
-    Writer writer(dest, size);
-    try {
-      write_members(writer, t);
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
-    }
-    return writer.bytes_processed();
+    return write_members_with_sink(dest, size, t, t);
+  }
+  static void write_to(Sink& sink, const std::tuple<Args...>& t) {
+    write_members_to(sink, t);
   }
   static size_t read(const char* src, size_t size, std::tuple<Args...>& t) {
-    Reader reader(src, size);
-    try {
-      read_members(reader, t);
-    } catch (const insufficient_buffer& e) {
-      return reader.bytes_processed() + e.get_required_bytes();
-    }
-    return reader.bytes_processed();
+    return read_members_from(src, size, t);
   }
 };
 
@@ -413,9 +936,15 @@ template <typename... Args> struct serializer<std::tuple<Args...>> {
 // Serializer for std::pair
 // ----------------------------------------------------------------------------
 
-template <typename A, typename B> struct serializer<std::pair<A, B>> {
+template <typename A, typename B>
+struct serializer<std::pair<A, B>> : fixed_size_members<A, B> {
   static size_t get_size(const std::pair<A, B>& p) {
-    return serializer<A>::get_size(p.first) + serializer<B>::get_size(p.second);
+    if constexpr (all_fixed_size<A, B>) {
+      return fixed_size_sum<A, B>();
+    } else {
+      return serializer<A>::get_size(p.first) +
+             serializer<B>::get_size(p.second);
+    }
   }
 
   static bool is_empty(const std::pair<A, B>& p) {
@@ -424,25 +953,16 @@ template <typename A, typename B> struct serializer<std::pair<A, B>> {
   }
 
   static size_t write(char* dest, size_t size, const std::pair<A, B>& p) {
-    Writer writer(dest, size);
-    try {
-      writer.write(p.first);
-      writer.write(p.second);
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
-    }
-    return writer.bytes_processed();
+    return write_members_with_sink(dest, size, p, std::tie(p.first, p.second));
+  }
+
+  static void write_to(Sink& sink, const std::pair<A, B>& p) {
+    write_members_to(sink, std::tie(p.first, p.second));
   }
 
   static size_t read(const char* src, size_t size, std::pair<A, B>& p) {
-    Reader reader(src, size);
-    try {
-      reader.read(p.first);
-      reader.read(p.second);
-    } catch (const insufficient_buffer& e) {
-      return reader.bytes_processed() + e.get_required_bytes();
-    }
-    return reader.bytes_processed();
+    auto members = std::tie(p.first, p.second);
+    return read_members_from(src, size, members);
   }
 };
 
@@ -451,11 +971,15 @@ template <typename A, typename B> struct serializer<std::pair<A, B>> {
 // ----------------------------------------------------------------------------
 
 template <typename T>
-struct serializer<T, std::void_t<typename composite_traits<T>::member_types>> {
+struct serializer<T, std::void_t<typename composite_traits<T>::member_types>>
+    : fixed_size_tuple<typename composite_traits<T>::member_types> {
   static size_t get_size(const T& obj) {
-    if constexpr (requires {
-                    composite_traits<T>::get_members_by_const_reference(obj);
-                  }) {
+    if constexpr (fixed_size_serializable<T>) {
+      return serializer<T>::fixed_size;
+    } else if constexpr (requires {
+                           composite_traits<
+                             T>::get_members_by_const_reference(obj);
+                         }) {
       return get_size_for_members(
         composite_traits<T>::get_members_by_const_reference(obj));
     } else {
@@ -474,48 +998,51 @@ struct serializer<T, std::void_t<typename composite_traits<T>::member_types>> {
     }
   }
   static size_t write(char* dest, size_t size, const T& obj) {
-    Writer writer(dest, size);
-    try {
-      if constexpr (requires {
-                      composite_traits<T>::get_members_by_const_reference(obj);
-                    }) {
-        write_members(writer,
-                      composite_traits<T>::get_members_by_const_reference(obj));
-      } else {
-        write_members(writer, composite_traits<T>::get_members_by_value(obj));
-      }
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
+    if constexpr (requires {
+                    composite_traits<T>::get_members_by_const_reference(obj);
+                  }) {
+      return write_members_with_sink(
+        dest, size, obj,
+        composite_traits<T>::get_members_by_const_reference(obj));
+    } else {
+      return write_members_with_sink(
+        dest, size, obj, composite_traits<T>::get_members_by_value(obj));
+    }
+  }
+  static void write_to(Sink& sink, const T& obj) {
+    if constexpr (requires {
+                    composite_traits<T>::get_members_by_const_reference(obj);
+                  }) {
+      write_members_to(
+        sink, composite_traits<T>::get_members_by_const_reference(obj));
+    } else {
+      write_members_to(sink, composite_traits<T>::get_members_by_value(obj));
     }
-    return writer.bytes_processed();
   }
   static size_t read(const char* src, size_t size, T& obj) {
-    Reader reader(src, size);
-    try {
-      if constexpr (requires {
-                      composite_traits<T>::get_members_by_reference(obj);
-                    }) {
-        auto member_refs = composite_traits<T>::get_members_by_reference(obj);
-        read_members(reader, member_refs);
-      } else {
-        typename composite_traits<T>::member_types members;
-        auto check_constructible = []<typename... Args>(
-                                     const std::tuple<Args...>&) {
-          static_assert(
-            std::is_constructible_v<T, Args...>,
-            "\n\n>>> Serialization Error: The class is not constructible from "
-            "its members. <<<\n"
-            "    Must provide a constructor that matches the types in "
-            "composite_traits::member_types.\n");
-        };
-        check_constructible(members);
-        read_members(reader, members);
+    if constexpr (requires {
+                    composite_traits<T>::get_members_by_reference(obj);
+                  }) {
+      auto member_refs = composite_traits<T>::get_members_by_reference(obj);
+      return read_members_from(src, size, member_refs);
+    } else {
+      typename composite_traits<T>::member_types members;
+      auto check_constructible = []<typename... Args>(
+                                   const std::tuple<Args...>&) {
+        static_assert(
+          std::is_constructible_v<T, Args...>,
+          "\n\n>>> Serialization Error: The class is not constructible from "
+          "its members. <<<\n"
+          "    Must provide a constructor that matches the types in "
+          "composite_traits::member_types.\n");
+      };
+      check_constructible(members);
+      const size_t used = read_members_from(src, size, members);
+      if (used <= size) {
         obj = std::make_from_tuple<T>(members);
       }
-    } catch (const insufficient_buffer& e) {
-      return reader.bytes_processed() + e.get_required_bytes();
+      return used;
     }
-    return reader.bytes_processed();
   }
 };
 
@@ -524,11 +1051,13 @@ struct serializer<T, std::void_t<typename composite_traits<T>::member_types>> {
 // ----------------------------------------------------------------------------
 
 template <> struct serializer<std::monostate> {
+  static constexpr size_t fixed_size = 0;
   static size_t get_size(const std::monostate&) { return 0; }
   static bool is_empty(const std::monostate&) { return true; }
   static size_t write(char*, size_t, const std::monostate&) {
     return 0;
   }
+  static void write_to(Sink&, const std::monostate&) {}
   static size_t read(const char*, size_t, std::monostate&) {
     return 0;
   }
@@ -572,17 +1101,12 @@ template <typename... Ts> struct serializer<std::variant<Ts...>> {
       v);
   }
   static size_t write(char* dest, size_t size, const std::variant<Ts...>& v) {
-    size_t needed = get_size(v);
-    if (size < needed)
-      return needed;
-    dest[0] = static_cast<uint8_t>(v.index());
-    std::visit(
-      [&](const auto& value) {
-        serializer<std::decay_t<decltype(value)>>::write(dest + 1, size - 1,
-                                                         value);
-      },
-      v);
-    return needed;
+    return write_with_sink(dest, size, v);
+  }
+  static void write_to(Sink& sink, const std::variant<Ts...>& v) {
+    const char index = static_cast<char>(v.index());
+    sink.append(&index, 1);
+    std::visit([&](const auto& value) { logkv::write_to(sink, value); }, v);
   }
   static size_t read(const char* src, size_t size, std::variant<Ts...>& v) {
     if (size < 1)
@@ -55,6 +55,10 @@ template <> struct serializer<boost::asio::ip::address> {
     }
     return required;
   }
+  static void write_to(Sink& sink, const boost::asio::ip::address& addr) {
+    char buf[TYPE_SIZE + IPV6_SIZE];
+    sink.append(buf, write(buf, sizeof(buf), addr));
+  }
   static size_t read(const char* src, size_t size,
                      boost::asio::ip::address& addr) {
     if (size < TYPE_SIZE) {
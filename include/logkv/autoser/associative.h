@@ -37,28 +37,25 @@ template <typename T> struct DynamicAssociativeSerializer {
   }
   static bool is_empty(const T& container) { return container.size() == 0; }
   static size_t write(char* dest, size_t size, const T& container) {
+    return write_with_sink(dest, size, container);
+  }
+  static void write_to(Sink& sink, const T& container) {
     size_t container_size = container.size();
     if (container_size > MAX_AUTOSER_ITEMS) {
       throw std::runtime_error("autoser element count limit exceeded");
     }
-    Writer writer(dest, size);
-    try {
-      writer.write(VarUint<uint64_t>(container_size));
-      for (const auto& elem : container) {
-        if constexpr (requires {
-                        elem.first;
-                        elem.second;
-                      }) {
-          writer.write(elem.first);
-          writer.write(elem.second);
-        } else {
-          writer.write(elem);
-        }
+    logkv::write_to(sink, VarUint<uint64_t>(container_size));
+    for (const auto& elem : container) {
+      if constexpr (requires {
+                      elem.first;
+                      elem.second;
+                    }) {
+        logkv::write_to(sink, elem.first);
+        logkv::write_to(sink, elem.second);
+      } else {
+        logkv::write_to(sink, elem);
       }
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
     }
-    return writer.bytes_processed();
   }
   static size_t read(const char* src, size_t size, T& container) {
     Reader reader(src, size);
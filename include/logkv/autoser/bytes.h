@@ -2,6 +2,7 @@
 #define _LOGKV_AUTOSER_BYTES_H_
 
 #include <logkv/autoser.h>
+#include <logkv/bytes.h>
 
 #include <string>
 #include <vector>
@@ -9,11 +10,19 @@
 namespace logkv {
 
 // ----------------------------------------------------------------------------
-// std::string, std::vector<T> for sizeof(T) == 1 && std::is_trivial_v(T)
+// std::string, std::vector<T> for sizeof(T) == 1 && std::is_trivial_v(T),
+// logkv::SmallBytes<N>
 // ----------------------------------------------------------------------------
 
 // Template for all size(), data(), resize() contiguous-memory byte heaps
 template <typename T> struct DynamicBytesSerializer {
+  // read() replaces the whole contents, so a T can be reused as scratch space
+  // for reads (logkv::Store replay does that for keys).
+  static constexpr bool replaces_on_read = true;
+  // The contents are the bytes at data(), so logkv::Store can front-code
+  // keys in snapshots.
+  static constexpr bool byte_string = true;
+
   static size_t get_size(const T& container) {
     const size_t container_size = container.size();
     if (container_size > MAX_AUTOSER_BYTES) {
@@ -40,6 +49,14 @@ template <typename T> struct DynamicBytesSerializer {
     }
     return required;
   }
+  static void write_to(Sink& sink, const T& container) {
+    const size_t container_size = container.size();
+    if (container_size > MAX_AUTOSER_BYTES) {
+      throw std::runtime_error("autoser byte size limit exceeded");
+    }
+    logkv::write_to(sink, VarUint<uint64_t>(container_size));
+    sink.append(container.data(), container_size);
+  }
   static size_t read(const char* src, size_t size, T& container) {
     VarUint<uint64_t> len_var;
     size_t len_size = serializer<VarUint<uint64_t>>::read(src, size, len_var);
@@ -71,6 +88,10 @@ struct serializer<std::vector<T>,
                   std::enable_if_t<sizeof(T) == 1 && std::is_trivial_v<T>>>
     : public logkv::DynamicBytesSerializer<std::vector<T>> {};
 
+template <size_t N>
+struct serializer<SmallBytes<N>>
+    : public logkv::DynamicBytesSerializer<SmallBytes<N>> {};
+
 } // namespace logkv
 
 #endif
\ No newline at end of file
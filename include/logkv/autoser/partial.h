@@ -2,8 +2,10 @@
 #define _LOGKV_AUTOSER_PARTIAL_H_
 
 #include <logkv/autoser.h>
+#include <concepts>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 
 namespace logkv {
 
@@ -14,16 +16,115 @@ namespace logkv {
 // Calling _setFullSerialization() controls per-thread serialization mode.
 // _logkvStoreSnapshot(bool s) is called by logkv::Store to inform the type
 // being serialized of whether the deser context is Store snapshot or update.
+//
+// Updates can instead write only the members that changed (`mask` encoding),
+// either those set with _setDirtyMembers() (see `logkv::member_mask()`), or,
+// after _setDiffSerialization(true), those that differ from the value being
+// replaced in the Store, which logkv::Store passes via _logkvStoreBase().
+// logkv::Store clears the dirty members once it logged the next update of a
+// T on the thread (so in a write batch, only the first one uses them).
+// Replay patches the value in the map like it does for `part`.
 // ----------------------------------------------------------------------------
 
 struct ObjectEncoding {
   enum : uint8_t {
     full = 0x00, // full object follow encoded (all members)
     part = 0x01, // partial object follows encoded (partial members)
-    none = 0x02  // zero members encoded (no data; empty/erased object)
+    none = 0x02, // zero members encoded (no data; empty/erased object)
+    mask = 0x03  // VarUint bitmask of members follows (bit i for the i-th
+                 // AUTO_SERIALIZABLE_MEMBERS member), then those members
   };
 };
 
+// Maximum number of members of an object that uses `mask` encoding
+constexpr size_t MAX_MASKED_MEMBERS = 64;
+
+/**
+ * Get the `ObjectEncoding::mask` bits of the given members of `obj`, e.g.
+ * `T::_setDirtyMembers(member_mask(obj, obj.x, obj.y))`.
+ * @throws std::invalid_argument if one of them is not a serializable member.
+ */
+template <typename T, typename... Ms>
+uint64_t member_mask(const T& obj, const Ms&... members) {
+  const auto tie = obj._as_const_member_tie();
+  constexpr size_t n = std::tuple_size_v<decltype(tie)>;
+  static_assert(n <= MAX_MASKED_MEMBERS, "too many members for a mask");
+  auto bit = [&](const void* member) {
+    uint64_t b = 0;
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      ((b |= static_cast<const void*>(&std::get<I>(tie)) == member
+               ? uint64_t(1) << I
+               : 0),
+       ...);
+    }(std::make_index_sequence<n>{});
+    if (!b) {
+      throw std::invalid_argument("not a serializable member");
+    }
+    return b;
+  };
+  return (bit(&members) | ... | uint64_t(0));
+}
+
+/**
+ * Get the `ObjectEncoding::mask` bits of the members that differ between
+ * `a` and `b`. Members without `operator==` always differ.
+ */
+template <typename T> uint64_t diff_member_mask(const T& a, const T& b) {
+  const auto ta = a._as_const_member_tie();
+  const auto tb = b._as_const_member_tie();
+  constexpr size_t n = std::tuple_size_v<decltype(ta)>;
+  static_assert(n <= MAX_MASKED_MEMBERS, "too many members for a mask");
+  uint64_t mask = 0;
+  [&]<size_t... I>(std::index_sequence<I...>) {
+    auto differs = [](const auto& x, const auto& y) {
+      if constexpr (std::equality_comparable<std::decay_t<decltype(x)>>) {
+        return !(x == y);
+      } else {
+        return true;
+      }
+    };
+    ((mask |= differs(std::get<I>(ta), std::get<I>(tb)) ? uint64_t(1) << I
+                                                        : 0),
+     ...);
+  }(std::make_index_sequence<n>{});
+  return mask;
+}
+
+// Size, writer and reader of the members of `t` selected by `mask`.
+template <typename... Args>
+inline size_t get_size_for_masked_members(const std::tuple<Args...>& t,
+                                          uint64_t mask) {
+  size_t total_size = 0;
+  [&]<size_t... I>(std::index_sequence<I...>) {
+    ((total_size += (mask >> I & 1)
+                      ? serializer<std::decay_t<Args>>::get_size(std::get<I>(t))
+                      : 0),
+     ...);
+  }(std::index_sequence_for<Args...>{});
+  return total_size;
+}
+
+template <typename... Args>
+inline void write_masked_members_to(Sink& sink, const std::tuple<Args...>& t,
+                                    uint64_t mask) {
+  [&]<size_t... I>(std::index_sequence<I...>) {
+    (((mask >> I & 1) ? logkv::write_to(sink, std::get<I>(t)) : void()), ...);
+  }(std::index_sequence_for<Args...>{});
+}
+
+template <typename... Args>
+inline void read_masked_members(Reader& reader, std::tuple<Args...>& t,
+                                uint64_t mask) {
+  if constexpr (sizeof...(Args) < 64) {
+    if (mask >> sizeof...(Args)) {
+      throw std::runtime_error("Invalid PartialSerializableObject member mask");
+    }
+  }
+  [&]<size_t... I>(std::index_sequence<I...>) {
+    (((mask >> I & 1) ? reader.read(std::get<I>(t)) : void()), ...);
+  }(std::index_sequence_for<Args...>{});
+}
+
 template <typename Derived> class AutoPartialSerializableObject {
 public:
   auto operator<=>(const AutoPartialSerializableObject&) const = default;
@@ -38,82 +139,104 @@ struct serializer<
   }
 
   static size_t get_size(const T& obj) {
-    bool isSnapshot = T::_logkvStoreSnapshot();
-    bool full = isSnapshot || T::_getFullSerialization();
-    if (full) {
+    if (T::_logkvStoreSnapshot()) {
       return logkv::get_size_for_members(obj._as_const_member_tie());
     }
-    return logkv::get_size_for_members(obj._as_partial_const_member_tie()) +
-           (isSnapshot ? 0 : 1);
+    uint64_t mask = 0;
+    switch (encoding(obj, mask)) {
+    case ObjectEncoding::none:
+      return 1;
+    case ObjectEncoding::full:
+      return 1 + logkv::get_size_for_members(obj._as_const_member_tie());
+    case ObjectEncoding::mask:
+      return 1 + serializer<VarUint<uint64_t>>::get_size(mask) +
+             get_size_for_masked_members(obj._as_const_member_tie(), mask);
+    default:
+      return 1 +
+             logkv::get_size_for_members(obj._as_partial_const_member_tie());
+    }
   }
 
   static size_t write(char* dest, size_t size, const T& obj) {
-    Writer writer(dest, size);
-    bool isSnapshot = T::_logkvStoreSnapshot();
-    bool full = isSnapshot || T::_getFullSerialization();
-    bool objectIsEmptyForSure = false;
-
-    try {
-      if (!isSnapshot) {
-        objectIsEmptyForSure = is_empty(obj);
-        uint8_t header;
-        if (objectIsEmptyForSure) {
-          header = ObjectEncoding::none;
-        } else if (full) {
-          header = ObjectEncoding::full;
-        } else {
-          header = ObjectEncoding::part;
-        }
-        writer.write(header);
-      }
+    return write_with_sink(dest, size, obj);
+  }
 
-      if (!objectIsEmptyForSure) {
-        if (full) {
-          logkv::write_members(writer, obj._as_const_member_tie());
-        } else {
-          logkv::write_members(writer, obj._as_partial_const_member_tie());
-        }
-      }
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
+  static void write_to(Sink& sink, const T& obj) {
+    if (T::_logkvStoreSnapshot()) {
+      logkv::write_members_to(sink, obj._as_const_member_tie());
+      return;
+    }
+    uint64_t mask = 0;
+    const uint8_t header = encoding(obj, mask);
+    logkv::write_to(sink, header);
+    switch (header) {
+    case ObjectEncoding::none:
+      break;
+    case ObjectEncoding::full:
+      logkv::write_members_to(sink, obj._as_const_member_tie());
+      break;
+    case ObjectEncoding::mask:
+      logkv::write_to(sink, VarUint<uint64_t>(mask));
+      write_masked_members_to(sink, obj._as_const_member_tie(), mask);
+      break;
+    default:
+      logkv::write_members_to(sink, obj._as_partial_const_member_tie());
+      break;
     }
-    return writer.bytes_processed();
   }
 
   static size_t read(const char* src, size_t size, T& obj) {
     Reader reader(src, size);
     bool isSnapshot = T::_logkvStoreSnapshot();
-    bool full = isSnapshot;
-    bool objectIsEmptyForSure = false;
 
     try {
+      uint8_t header = ObjectEncoding::full;
       if (!isSnapshot) {
-        uint8_t header;
         reader.read(header);
-        if (header == ObjectEncoding::none)
-          objectIsEmptyForSure = true;
-        else if (header == ObjectEncoding::full)
-          full = true;
-        else if (header == ObjectEncoding::part)
-          full = false;
-        else
-          throw std::runtime_error("Invalid PartialSerializableObject header");
       }
 
-      if (objectIsEmptyForSure) {
+      if (header == ObjectEncoding::none) {
         obj = T();
-      } else if (full) {
+      } else if (header == ObjectEncoding::full) {
         auto members = obj._as_member_tie();
         logkv::read_members(reader, members);
-      } else {
+      } else if (header == ObjectEncoding::part) {
         auto members = obj._as_partial_member_tie();
         logkv::read_members(reader, members);
+      } else if (header == ObjectEncoding::mask) {
+        VarUint<uint64_t> mask;
+        reader.read(mask);
+        auto members = obj._as_member_tie();
+        read_masked_members(reader, members, mask.value);
+      } else {
+        throw std::runtime_error("Invalid PartialSerializableObject header");
       }
     } catch (const insufficient_buffer& e) {
       return reader.bytes_processed() + e.get_required_bytes();
     }
     return reader.bytes_processed();
   }
+
+private:
+  // Header of an update (non-snapshot) of `obj`, and its `mask` if any.
+  static uint8_t encoding(const T& obj, uint64_t& mask) {
+    if (is_empty(obj)) {
+      return ObjectEncoding::none;
+    }
+    if (T::_getFullSerialization()) {
+      return ObjectEncoding::full;
+    }
+    if (T::_getDirtyMembers()) {
+      mask = T::_getDirtyMembers();
+      return ObjectEncoding::mask;
+    }
+    if (T::_getDiffSerialization() && T::_logkvStoreBase()) {
+      mask = diff_member_mask(
+        obj, *static_cast<const T*>(T::_logkvStoreBase()));
+      return ObjectEncoding::mask;
+    }
+    return ObjectEncoding::part;
+  }
 };
 
 } // namespace logkv
@@ -123,9 +246,18 @@ struct serializer<
   auto _as_partial_member_tie() { return std::tie(__VA_ARGS__); }              \
   inline static thread_local bool _logkv_snapshot_flag = false;                \
   inline static thread_local bool _full_serialization_flag = false;            \
+  inline static thread_local bool _diff_serialization_flag = false;            \
+  inline static thread_local uint64_t _dirty_members = 0;                      \
+  inline static thread_local const void* _logkv_base = nullptr;                \
   static void _logkvStoreSnapshot(bool s) { _logkv_snapshot_flag = s; }        \
   static bool _logkvStoreSnapshot() { return _logkv_snapshot_flag; }           \
+  static void _logkvStoreBase(const void* b) { _logkv_base = b; }              \
+  static const void* _logkvStoreBase() { return _logkv_base; }                 \
   static void _setFullSerialization(bool f) { _full_serialization_flag = f; }  \
-  static bool _getFullSerialization() { return _full_serialization_flag; }
+  static bool _getFullSerialization() { return _full_serialization_flag; }     \
+  static void _setDiffSerialization(bool d) { _diff_serialization_flag = d; }  \
+  static bool _getDiffSerialization() { return _diff_serialization_flag; }     \
+  static void _setDirtyMembers(uint64_t m) { _dirty_members = m; }             \
+  static uint64_t _getDirtyMembers() { return _dirty_members; }
 
-  #endif
\ No newline at end of file
+  #endif
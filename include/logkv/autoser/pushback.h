@@ -15,6 +15,13 @@ namespace logkv {
 // T must be logkv::serializable<>
 // ----------------------------------------------------------------------------
 
+// std::vector of integers, which is converted to big-endian as one block
+template <typename T>
+inline constexpr bool is_contiguous_integral =
+  is_bulk_integral<typename T::value_type> &&
+  std::is_same_v<T, std::vector<typename T::value_type,
+                                typename T::allocator_type>>;
+
 template <typename T> struct DynamicPushBackSerializer {
   static size_t get_size(const T& container) {
     size_t container_size = container.size();
@@ -22,6 +29,10 @@ template <typename T> struct DynamicPushBackSerializer {
       throw std::runtime_error("autoser element count limit exceeded");
     }
     size_t total_size = serializer<VarUint<uint64_t>>::get_size(container_size);
+    if constexpr (fixed_size_serializable<typename T::value_type>) {
+      return total_size +
+             container_size * serializer<typename T::value_type>::fixed_size;
+    }
     for (const auto& elem : container) {
       total_size += serializer<typename T::value_type>::get_size(elem);
     }
@@ -29,42 +40,82 @@ template <typename T> struct DynamicPushBackSerializer {
   }
   static bool is_empty(const T& container) { return container.size() == 0; }
   static size_t write(char* dest, size_t size, const T& container) {
+    return write_with_sink(dest, size, container);
+  }
+  static void write_to(Sink& sink, const T& container) {
     size_t container_size = container.size();
     if (container_size > MAX_AUTOSER_ITEMS) {
       throw std::runtime_error("autoser element count limit exceeded");
     }
-    Writer writer(dest, size);
-    try {
-      writer.write(VarUint<uint64_t>(container_size));
+    logkv::write_to(sink, VarUint<uint64_t>(container_size));
+    if constexpr (is_varuint<typename T::value_type>::value) {
+      write_varuints_to<typename T::value_type::value_type>(
+        sink, container.begin(), container_size);
+    } else if constexpr (is_contiguous_integral<T>) {
+      write_big_endian_to(sink, container.data(), container_size);
+    } else {
       for (const auto& elem : container) {
-        writer.write(elem);
+        logkv::write_to(sink, elem);
       }
-    } catch (const insufficient_buffer& e) {
-      return writer.bytes_processed() + e.get_required_bytes();
     }
-    return writer.bytes_processed();
   }
   static size_t read(const char* src, size_t size, T& container) {
-    Reader reader(src, size);
-    try {
+    if constexpr (is_contiguous_integral<T>) {
+      using E = typename T::value_type;
       VarUint<uint64_t> len_var;
-      reader.read(len_var);
+      const size_t len_size =
+        serializer<VarUint<uint64_t>>::read(src, size, len_var);
+      if (len_size > size) {
+        return len_size;
+      }
       const uint64_t len = len_var.value;
       if (len > MAX_AUTOSER_ITEMS) {
         throw std::runtime_error("autoser element count limit exceeded");
       }
-      container.clear();
-      if constexpr (requires { container.reserve(len); }) {
-        container.reserve(len);
+      const size_t required = len_size + len * sizeof(E);
+      if (size < required) {
+        return required;
+      }
+      container.resize(len);
+      big_endian_copy<E>(container.data(), src + len_size, len);
+      return required;
+    } else if constexpr (is_varuint<typename T::value_type>::value) {
+      VarUint<uint64_t> len_var;
+      const size_t len_size =
+        serializer<VarUint<uint64_t>>::read(src, size, len_var);
+      if (len_size > size) {
+        return len_size;
+      }
+      const uint64_t len = len_var.value;
+      if (len > MAX_AUTOSER_ITEMS) {
+        throw std::runtime_error("autoser element count limit exceeded");
       }
-      for (uint64_t i = 0; i < len; ++i) {
-        auto& new_elem = container.emplace_back();
-        reader.read(new_elem);
+      container.resize(len);
+      return len_size +
+             varuint_decode_bulk<typename T::value_type::value_type>(
+               src + len_size, size - len_size, container.begin(), len);
+    } else {
+      Reader reader(src, size);
+      try {
+        VarUint<uint64_t> len_var;
+        reader.read(len_var);
+        const uint64_t len = len_var.value;
+        if (len > MAX_AUTOSER_ITEMS) {
+          throw std::runtime_error("autoser element count limit exceeded");
+        }
+        container.clear();
+        if constexpr (requires { container.reserve(len); }) {
+          container.reserve(len);
+        }
+        for (uint64_t i = 0; i < len; ++i) {
+          auto& new_elem = container.emplace_back();
+          reader.read(new_elem);
+        }
+      } catch (const insufficient_buffer& e) {
+        return reader.bytes_processed() + e.get_required_bytes();
       }
-    } catch (const insufficient_buffer& e) {
-      return reader.bytes_processed() + e.get_required_bytes();
+      return reader.bytes_processed();
     }
-    return reader.bytes_processed();
   }
 };
 
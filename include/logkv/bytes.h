@@ -1,10 +1,14 @@
 #ifndef _LOGKV_BYTES_H_
 #define _LOGKV_BYTES_H_
 
+#include <algorithm>
+#include <compare>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <span>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <logkv/hex.h>
@@ -28,6 +32,124 @@ inline size_t hash_value(const Bytes& b) {
   return hv;
 }
 
+} // namespace logkv
+
+namespace logkv_detail {
+
+// wyhash (final4) building blocks: 64x64->128 multiply folded to 64 bits.
+inline void wyMum(uint64_t& a, uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = a;
+  r *= b;
+  a = static_cast<uint64_t>(r);
+  b = static_cast<uint64_t>(r >> 64);
+#else
+  const uint64_t ha = a >> 32, hb = b >> 32;
+  const uint64_t la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+  const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  const uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  const uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  a = lo;
+#endif
+}
+
+inline uint64_t wyMix(uint64_t a, uint64_t b) {
+  wyMum(a, b);
+  return a ^ b;
+}
+
+inline uint64_t wyRead8(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint64_t wyRead4(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+inline uint64_t wyRead3(const uint8_t* p, size_t k) {
+  return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+}
+
+inline constexpr uint64_t wyP[4] = {
+  0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull,
+  0x4d5a2da51de1aa47ull};
+
+} // namespace logkv_detail
+
+namespace logkv {
+
+/**
+ * Hashes `len` bytes 8 or 16 at a time (wyhash). The result depends on the
+ * host byte order, so it must not be persisted.
+ */
+inline uint64_t hashBytes(const void* data, size_t len, uint64_t seed = 0) {
+  using namespace logkv_detail;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  seed ^= wyMix(seed ^ wyP[0], wyP[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      const size_t mid = (len >> 3) << 2;
+      a = (wyRead4(p) << 32) | wyRead4(p + mid);
+      b = (wyRead4(p + len - 4) << 32) | wyRead4(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = wyRead3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i >= 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wyMix(wyRead8(p) ^ wyP[1], wyRead8(p + 8) ^ seed);
+        see1 = wyMix(wyRead8(p + 16) ^ wyP[2], wyRead8(p + 24) ^ see1);
+        see2 = wyMix(wyRead8(p + 32) ^ wyP[3], wyRead8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i >= 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wyMix(wyRead8(p) ^ wyP[1], wyRead8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wyRead8(p + i - 16);
+    b = wyRead8(p + i - 8);
+  }
+  a ^= wyP[1];
+  b ^= seed;
+  wyMum(a, b);
+  return wyMix(a ^ wyP[0] ^ len, b ^ wyP[1]);
+}
+
+/**
+ * An alternative to the FNV-1a `hash_value(const Bytes&)` for long keys,
+ * which reads the key a word at a time (see `hashBytes()`). The result is
+ * well mixed, so `boost::unordered_flat_map` uses it without post-mixing.
+ * To use it in a Store, pass a map template that names it, e.g.:
+ *
+ *   template <typename K, typename V>
+ *   using FastMap = boost::unordered_flat_map<K, V, logkv::FastBytesHash>;
+ *   logkv::Store<FastMap, logkv::Bytes, V> store(...);
+ */
+struct FastBytesHash {
+  using is_avalanching = std::true_type;
+
+  size_t operator()(const Bytes& b) const noexcept {
+    return static_cast<size_t>(hashBytes(b.data(), b.size()));
+  }
+};
+
 /**
  * A version of logkv::Bytes that swaps the FNV container hashing operation with
  * simply copying a part of its own contents (which is already a hash of some
@@ -45,6 +167,177 @@ inline size_t hash_value(const Hash& h) {
   return hv;
 }
 
+/**
+ * A byte array like logkv::Bytes that stores up to `N` bytes inline, and only
+ * allocates when it grows beyond that. Use it as K or V when most keys or
+ * values are small, to avoid one heap allocation per entry. Copies and moves
+ * of inline contents are `memcpy`s; a moved-from object is empty.
+ *
+ * Ordering compares bytes as unsigned (`memcmp`), unlike `std::vector<char>`.
+ */
+template <size_t N> class SmallBytes {
+  static_assert(N > 0, "SmallBytes needs inline capacity");
+
+public:
+  using value_type = char;
+  using size_type = size_t;
+  using iterator = char*;
+  using const_iterator = const char*;
+
+  SmallBytes() noexcept {}
+
+  explicit SmallBytes(size_t count) { resize(count); }
+
+  SmallBytes(const char* data, size_t len) { assign(data, len); }
+
+  SmallBytes(const char* first, const char* last) {
+    assign(first, static_cast<size_t>(last - first));
+  }
+
+  explicit SmallBytes(std::span<const char> s) { assign(s.data(), s.size()); }
+
+  SmallBytes(const SmallBytes& other) { assign(other.data(), other.size()); }
+
+  SmallBytes(SmallBytes&& other) noexcept { steal(other); }
+
+  ~SmallBytes() { release(); }
+
+  SmallBytes& operator=(const SmallBytes& other) {
+    if (this != &other) {
+      assign(other.data(), other.size());
+    }
+    return *this;
+  }
+
+  SmallBytes& operator=(SmallBytes&& other) noexcept {
+    if (this != &other) {
+      release();
+      steal(other);
+    }
+    return *this;
+  }
+
+  char* data() noexcept { return isInline() ? inline_ : heap_; }
+  const char* data() const noexcept { return isInline() ? inline_ : heap_; }
+  size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+  size_t capacity() const noexcept { return capacity_; }
+  static constexpr size_t inline_capacity() noexcept { return N; }
+
+  char& operator[](size_t i) noexcept { return data()[i]; }
+  const char& operator[](size_t i) const noexcept { return data()[i]; }
+
+  iterator begin() noexcept { return data(); }
+  iterator end() noexcept { return data() + size_; }
+  const_iterator begin() const noexcept { return data(); }
+  const_iterator end() const noexcept { return data() + size_; }
+
+  void reserve(size_t cap) {
+    if (cap <= capacity_) {
+      return;
+    }
+    char* p = new char[cap];
+    if (size_) {
+      std::memcpy(p, data(), size_);
+    }
+    release();
+    heap_ = p;
+    capacity_ = cap;
+  }
+
+  /**
+   * Resizes to `count` bytes; new bytes are zero.
+   */
+  void resize(size_t count) {
+    if (count > capacity_) {
+      reserve(std::max(count, capacity_ * 2));
+    }
+    if (count > size_) {
+      std::memset(data() + size_, 0, count - size_);
+    }
+    size_ = count;
+  }
+
+  void clear() noexcept { size_ = 0; }
+
+  void assign(const char* src, size_t len) {
+    if (len > capacity_) {
+      size_ = 0;
+      reserve(len);
+    }
+    if (len) {
+      std::memmove(data(), src, len);
+    }
+    size_ = len;
+  }
+
+  void append(const char* src, size_t len) {
+    if (size_ + len > capacity_) {
+      reserve(std::max(size_ + len, capacity_ * 2));
+    }
+    if (len) {
+      std::memcpy(data() + size_, src, len);
+    }
+    size_ += len;
+  }
+
+  void push_back(char c) { append(&c, 1); }
+
+  friend bool operator==(const SmallBytes& a, const SmallBytes& b) noexcept {
+    return a.size_ == b.size_ &&
+           (a.size_ == 0 || std::memcmp(a.data(), b.data(), a.size_) == 0);
+  }
+
+  friend std::strong_ordering operator<=>(const SmallBytes& a,
+                                          const SmallBytes& b) noexcept {
+    const size_t n = std::min(a.size_, b.size_);
+    const int c = n ? std::memcmp(a.data(), b.data(), n) : 0;
+    if (c != 0) {
+      return c < 0 ? std::strong_ordering::less : std::strong_ordering::greater;
+    }
+    return a.size_ <=> b.size_;
+  }
+
+private:
+  bool isInline() const noexcept { return capacity_ == N; }
+
+  void release() noexcept {
+    if (!isInline()) {
+      delete[] heap_;
+      capacity_ = N;
+    }
+  }
+
+  void steal(SmallBytes& other) noexcept {
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    if (other.isInline()) {
+      std::memcpy(inline_, other.inline_, size_);
+    } else {
+      heap_ = other.heap_;
+      other.capacity_ = N;
+    }
+    other.size_ = 0;
+  }
+
+  size_t size_ = 0;
+  size_t capacity_ = N;
+  union {
+    char* heap_;
+    char inline_[N];
+  };
+};
+
+template <size_t N> inline size_t hash_value(const SmallBytes<N>& b) {
+  return static_cast<size_t>(hashBytes(b.data(), b.size()));
+}
+
+template <size_t N>
+inline std::ostream& operator<<(std::ostream& os, const SmallBytes<N>& b) {
+  os.write(b.data(), b.size());
+  return os;
+}
+
 inline Bytes hashToBytes(const Hash& h) {
   const char* data = reinterpret_cast<const char*>(h.data());
   return Bytes(data, data + h.size());
@@ -130,6 +423,12 @@ template <> struct hash<logkv::Hash> {
   }
 };
 
+template <size_t N> struct hash<logkv::SmallBytes<N>> {
+  size_t operator()(const logkv::SmallBytes<N>& b) const noexcept {
+    return logkv::hash_value(b);
+  }
+};
+
 } // namespace std
 
 #endif
\ No newline at end of file
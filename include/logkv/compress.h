@@ -0,0 +1,252 @@
+#ifndef _LOGKV_COMPRESS_H_
+#define _LOGKV_COMPRESS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(LOGKV_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace logkv {
+
+/**
+ * Frame compression codecs. The value is stored in compressed frame headers.
+ */
+enum CompressionCodec {
+  noCompression = 0,
+  lz4Compression = 1, // LZ4 block format (built-in, no dependency).
+  zstdCompression = 2 // Zstandard; requires building with `LOGKV_ZSTD`.
+};
+
+namespace lz4 {
+
+/**
+ * @return Worst-case compressed size for `n` input bytes.
+ */
+inline size_t compressBound(size_t n) { return n + n / 255 + 16; }
+
+/**
+ * Compresses `src` into `dst` in the LZ4 block format (greedy matching with
+ * a single-probe 4-byte hash table, similar to LZ4's fast mode).
+ * @return Compressed size, or 0 if it wouldn't fit in `capacity` bytes.
+ */
+inline size_t compress(const char* src, size_t n, char* dst, size_t capacity) {
+  constexpr size_t MinMatch = 4;
+  constexpr size_t LastLiterals = 5;   // the block ends with literals
+  constexpr size_t MatchStartLimit = 12; // no match starts in the last bytes
+  constexpr unsigned HashLog = 12;
+  const uint8_t* const base = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* const end = base + n;
+  const uint8_t* ip = base;
+  const uint8_t* anchor = base;
+  uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+  uint8_t* const oend = op + capacity;
+
+  auto read32 = [](const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+  };
+  auto putLength = [&](size_t len) {
+    for (; len >= 255; len -= 255) {
+      *op++ = 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+  };
+  // Emits `anchor..ip` as literals, then the match (if `matchLen > 0`).
+  auto emit = [&](size_t litLen, size_t offset, size_t matchLen) {
+    size_t need = 1 + litLen + litLen / 255 + 1 + 2 + matchLen / 255 + 1;
+    if (static_cast<size_t>(oend - op) < need) {
+      return false;
+    }
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((litLen >= 15 ? 15 : litLen) << 4);
+    if (litLen >= 15) {
+      putLength(litLen - 15);
+    }
+    std::memcpy(op, anchor, litLen);
+    op += litLen;
+    if (matchLen > 0) {
+      *op++ = static_cast<uint8_t>(offset);
+      *op++ = static_cast<uint8_t>(offset >> 8);
+      const size_t m = matchLen - MinMatch;
+      *token |= static_cast<uint8_t>(m >= 15 ? 15 : m);
+      if (m >= 15) {
+        putLength(m - 15);
+      }
+    }
+    return true;
+  };
+
+  if (n > MatchStartLimit) {
+    uint32_t table[1 << HashLog] = {};
+    const uint8_t* const matchStartEnd = end - MatchStartLimit;
+    const uint8_t* const matchEnd = end - LastLiterals;
+    while (ip < matchStartEnd) {
+      const uint32_t seq = read32(ip);
+      const uint32_t h = (seq * 2654435761u) >> (32 - HashLog);
+      const uint8_t* ref = base + table[h];
+      table[h] = static_cast<uint32_t>(ip - base);
+      if (ref < ip && ip - ref <= 65535 && read32(ref) == seq) {
+        const uint8_t* mp = ip + MinMatch;
+        const uint8_t* rp = ref + MinMatch;
+        while (mp < matchEnd && *mp == *rp) {
+          ++mp;
+          ++rp;
+        }
+        if (!emit(ip - anchor, ip - ref, mp - ip)) {
+          return 0;
+        }
+        ip = mp;
+        anchor = ip;
+      } else {
+        ++ip;
+      }
+    }
+  }
+  if (!emit(end - anchor, 0, 0)) {
+    return 0;
+  }
+  return op - reinterpret_cast<uint8_t*>(dst);
+}
+
+/**
+ * Decompresses an LZ4 block, rejecting malformed input.
+ * @return `true` if `src` decodes to exactly `rawSize` bytes.
+ */
+inline bool decompress(const char* src, size_t n, char* dst, size_t rawSize) {
+  const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* const iend = ip + n;
+  uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+  uint8_t* const obase = op;
+  uint8_t* const oend = op + rawSize;
+  auto getLength = [&](size_t& len) {
+    uint8_t b;
+    do {
+      if (ip >= iend) {
+        return false;
+      }
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return true;
+  };
+  while (ip < iend) {
+    const uint8_t token = *ip++;
+    size_t litLen = token >> 4;
+    if (litLen == 15 && !getLength(litLen)) {
+      return false;
+    }
+    if (litLen > static_cast<size_t>(iend - ip) ||
+        litLen > static_cast<size_t>(oend - op)) {
+      return false;
+    }
+    std::memcpy(op, ip, litLen);
+    op += litLen;
+    ip += litLen;
+    if (ip == iend) {
+      break; // last sequence has no match
+    }
+    if (iend - ip < 2) {
+      return false;
+    }
+    const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t matchLen = token & 15;
+    if (matchLen == 15 && !getLength(matchLen)) {
+      return false;
+    }
+    matchLen += 4;
+    if (offset == 0 || offset > static_cast<size_t>(op - obase) ||
+        matchLen > static_cast<size_t>(oend - op)) {
+      return false;
+    }
+    const uint8_t* match = op - offset;
+    if (offset >= matchLen) {
+      std::memcpy(op, match, matchLen);
+      op += matchLen;
+    } else {
+      while (matchLen--) { // overlapping copy repeats the last bytes
+        *op++ = *match++;
+      }
+    }
+  }
+  return op == oend;
+}
+
+} // namespace lz4
+
+/**
+ * @return `true` if the codec is available in this build.
+ */
+inline bool isCompressionSupported(int codec) {
+  switch (codec) {
+  case noCompression:
+  case lz4Compression:
+    return true;
+#if defined(LOGKV_ZSTD)
+  case zstdCompression:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+/**
+ * @return Worst-case compressed size for `n` input bytes.
+ */
+inline size_t compressBound(int codec, size_t n) {
+#if defined(LOGKV_ZSTD)
+  if (codec == zstdCompression) {
+    return ZSTD_compressBound(n);
+  }
+#endif
+  (void)codec;
+  return lz4::compressBound(n);
+}
+
+/**
+ * Compresses `n` bytes from `src` into `dst`.
+ * @return Compressed size, or 0 on failure (including unsupported codecs).
+ */
+inline size_t compress(int codec, const char* src, size_t n, char* dst,
+                       size_t capacity) {
+  switch (codec) {
+  case lz4Compression:
+    return lz4::compress(src, n, dst, capacity);
+#if defined(LOGKV_ZSTD)
+  case zstdCompression: {
+    size_t r = ZSTD_compress(dst, capacity, src, n, 1);
+    return ZSTD_isError(r) ? 0 : r;
+  }
+#endif
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Decompresses `n` bytes from `src` into `rawSize` bytes at `dst`.
+ * @return `true` on success, `false` if the input is malformed, doesn't
+ * decompress to exactly `rawSize` bytes, or the codec is unsupported.
+ */
+inline bool decompress(int codec, const char* src, size_t n, char* dst,
+                       size_t rawSize) {
+  switch (codec) {
+  case lz4Compression:
+    return lz4::decompress(src, n, dst, rawSize);
+#if defined(LOGKV_ZSTD)
+  case zstdCompression:
+    return ZSTD_decompress(dst, rawSize, src, n) == rawSize;
+#endif
+  default:
+    return false;
+  }
+}
+
+} // namespace logkv
+
+#endif
@@ -41,6 +41,13 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+  (defined(__GNUC__) || defined(__clang__))
+#define LOGKV_CRC16_CLMUL
+#include <immintrin.h>
+#endif
 
 namespace logkv::crc16 {
 
@@ -66,13 +73,10 @@ inline const uint16_t* getTable() {
   crc = table[(crc & 0xff) + 0x300] ^ table[((crc >> 8) & 0xff) + 0x200] ^     \
         table[((data >> 16) & 0xff) + 0x100] ^ table[data >> 24];
 
-/** XMODEM
- * Alias ZMODEM, CRC-16/ACORN
- * @param data Pointer to Data
- * @param datalen Length of Data
- * @return CRC value
- */
-inline uint16_t xmodem_upd(const uint8_t* data, size_t len, uint16_t seed) {
+namespace detail {
+
+// Table-driven XMODEM. `seed` is the byte-swapped CRC of the preceding data.
+inline uint16_t xmodem_table(const uint8_t* data, size_t len, uint16_t seed) {
   uint16_t crc = seed;
   const uint16_t* crc_table_xmodem = detail::getTable();
 
@@ -94,11 +98,123 @@ inline uint16_t xmodem_upd(const uint8_t* data, size_t len, uint16_t seed) {
     crc = (crc >> 8) ^ crc_table_xmodem[(crc & 0xff) ^ *data++];
   }
 
-  seed = crc;
-  crc = detail::REV16(crc);
+  crc = REV16(crc);
   return crc;
 }
 
+#if defined(LOGKV_CRC16_CLMUL)
+
+// x^n mod P for P = x^16 + 0x1021, as a 16-bit polynomial.
+constexpr uint64_t xpow_mod(unsigned n) {
+  uint32_t r = 1;
+  for (unsigned i = 0; i < n; ++i) {
+    r <<= 1;
+    if (r & 0x10000) {
+      r ^= 0x11021;
+    }
+  }
+  return r;
+}
+
+// Buffers shorter than this go to the table, which is faster for them.
+constexpr size_t ClmulMinSize = 32;
+
+/**
+ * Carry-less multiplication folding (Intel's "Fast CRC Computation Using
+ * PCLMULQDQ"). 16-byte blocks are loaded byte-reversed so that bit 127 is
+ * the highest-degree message bit; a block A followed by 128 bits is congruent
+ * to `A.hi * (x^192 mod P) + A.lo * (x^128 mod P)`, which fits in 128 bits and
+ * is added to the following block. Four blocks are folded in parallel, then
+ * into one, whose CRC (and the CRC of the tail) is finished with the table.
+ */
+#define LOGKV_CRC16_TARGET __attribute__((target("pclmul,ssse3")))
+
+LOGKV_CRC16_TARGET inline __m128i clmul_reverse() {
+  return _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+LOGKV_CRC16_TARGET inline __m128i clmul_load(const uint8_t* p) {
+  return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)),
+                          clmul_reverse());
+}
+
+// Constant that shifts a block by `n` blocks: the low half multiplies the low
+// 64 bits, the high half the high 64 bits.
+LOGKV_CRC16_TARGET inline __m128i clmul_shift(unsigned n) {
+  static constexpr uint64_t k[8] = {
+    xpow_mod(128), xpow_mod(192), xpow_mod(256), xpow_mod(320),
+    xpow_mod(384), xpow_mod(448), xpow_mod(512), xpow_mod(576)};
+  return _mm_set_epi64x(k[2 * n - 1], k[2 * n - 2]);
+}
+
+LOGKV_CRC16_TARGET inline __m128i clmul_fold(__m128i a, __m128i k) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x00),
+                       _mm_clmulepi64_si128(a, k, 0x11));
+}
+
+LOGKV_CRC16_TARGET inline uint16_t
+xmodem_clmul(const uint8_t* data, size_t len, uint16_t seed) {
+  const uint8_t* const end = data + (len & ~size_t(15));
+  __m128i x0 = _mm_xor_si128(
+    clmul_load(data), _mm_set_epi64x(uint64_t(REV16(seed)) << 48, 0));
+  data += 16;
+  if (end - data >= 48) {
+    const __m128i k512 = clmul_shift(4);
+    __m128i x1 = clmul_load(data), x2 = clmul_load(data + 16),
+            x3 = clmul_load(data + 32);
+    data += 48;
+    for (; end - data >= 64; data += 64) {
+      x0 = _mm_xor_si128(clmul_fold(x0, k512), clmul_load(data));
+      x1 = _mm_xor_si128(clmul_fold(x1, k512), clmul_load(data + 16));
+      x2 = _mm_xor_si128(clmul_fold(x2, k512), clmul_load(data + 32));
+      x3 = _mm_xor_si128(clmul_fold(x3, k512), clmul_load(data + 48));
+    }
+    x0 = _mm_xor_si128(clmul_fold(x0, clmul_shift(3)),
+                       clmul_fold(x1, clmul_shift(2)));
+    x0 = _mm_xor_si128(x0, _mm_xor_si128(clmul_fold(x2, clmul_shift(1)), x3));
+  }
+  const __m128i k128 = clmul_shift(1);
+  for (; data < end; data += 16) {
+    x0 = _mm_xor_si128(clmul_fold(x0, k128), clmul_load(data));
+  }
+
+  uint8_t block[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(block),
+                   _mm_shuffle_epi8(x0, clmul_reverse()));
+  uint16_t crc = xmodem_table(block, sizeof(block), 0);
+  return xmodem_table(data, len & 15, REV16(crc));
+}
+
+inline bool hasClmul() {
+  static const bool has =
+    __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+  return has;
+}
+
+#undef LOGKV_CRC16_TARGET
+
+#endif
+
+} // namespace detail
+
+/** XMODEM
+ * Alias ZMODEM, CRC-16/ACORN
+ * Uses carry-less multiplication (PCLMULQDQ) when the CPU supports it, and
+ * the lookup table otherwise.
+ * @param data Pointer to Data
+ * @param datalen Length of Data
+ * @param seed Byte-swapped CRC of the preceding data (0 to start)
+ * @return CRC value
+ */
+inline uint16_t xmodem_upd(const uint8_t* data, size_t len, uint16_t seed) {
+#if defined(LOGKV_CRC16_CLMUL)
+  if (len >= detail::ClmulMinSize && detail::hasClmul()) {
+    return detail::xmodem_clmul(data, len, seed);
+  }
+#endif
+  return detail::xmodem_table(data, len, seed);
+}
+
 inline uint16_t xmodem(const void* data, size_t datalen) {
   // width=16 poly=0x1021 init=0x0000 refin=false refout=false xorout=0x0000
   // check=0x31c3
@@ -108,5 +224,6 @@ inline uint16_t xmodem(const void* data, size_t datalen) {
 } // namespace logkv::crc16
 
 #undef crc_n4
+#undef LOGKV_CRC16_CLMUL
 
 #endif
\ No newline at end of file
@@ -0,0 +1,685 @@
+#ifndef _LOGKV_FILE_H_
+#define _LOGKV_FILE_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define LOGKV_WINDOWS 1
+#else
+#define LOGKV_WINDOWS 0
+#endif
+
+#if defined(__linux__)
+#define LOGKV_URING 1
+#else
+#define LOGKV_URING 0
+#endif
+
+#if LOGKV_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <stdio.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if LOGKV_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace logkv {
+
+/**
+ * Read-only memory mapping of a whole open file.
+ * `isMapped()` is `false` if the file could not be mapped.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(FILE* f) {
+#if LOGKV_WINDOWS
+    HANDLE file = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(f)));
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+      return;
+    }
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    if (size_ == 0) {
+      mapped_ = true;
+      return;
+    }
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_) {
+      size_ = 0;
+      return;
+    }
+    void* view = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+      CloseHandle(mapping_);
+      mapping_ = nullptr;
+      size_ = 0;
+      return;
+    }
+#else
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0) {
+      return;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) {
+      mapped_ = true;
+      return;
+    }
+    void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (view == MAP_FAILED) {
+      size_ = 0;
+      return;
+    }
+    madvise(view, size_, MADV_SEQUENTIAL);
+#endif
+    data_ = static_cast<const char*>(view);
+    mapped_ = true;
+  }
+
+  ~MappedFile() {
+    if (!data_) {
+      return;
+    }
+#if LOGKV_WINDOWS
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+#else
+    munmap(const_cast<char*>(data_), size_);
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool isMapped() const { return mapped_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+#if LOGKV_WINDOWS
+  HANDLE mapping_ = nullptr;
+#endif
+};
+
+/**
+ * Allocates disk space for the first `size` bytes of the open file `fd`,
+ * extending it with zeros, so that writes within them don't change the file
+ * size or allocate blocks. Falls back to extending the file without
+ * allocating (a sparse tail) where `fallocate()` is unavailable.
+ * @return `false` if the file could not be extended.
+ */
+inline bool preallocateFile(int fd, uint64_t size) {
+#if LOGKV_WINDOWS
+  (void)fd;
+  (void)size;
+  return false;
+#else
+#if defined(__linux__)
+  if (fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) {
+    return true;
+  }
+#endif
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  return static_cast<uint64_t>(st.st_size) >= size ||
+         ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+/**
+ * Append-only file writer backend used by `logkv::Store` for events and
+ * snapshot files. All methods throw `std::runtime_error` on I/O errors.
+ *
+ * A writer opened with a preallocation size extends the file with zeros up
+ * to that size (see `logkv::preallocateFile()`) and writes over them, so
+ * appends don't change the file size; `close()` truncates the unused tail.
+ */
+class FileWriter {
+public:
+  virtual ~FileWriter() = default;
+
+  /**
+   * Append bytes to the file. The data may be buffered or written
+   * asynchronously until `flush()` is called.
+   */
+  virtual void write(const char* data, size_t size) = 0;
+
+  /**
+   * Hand all appended data to the operating system and wait for it to reach
+   * the file, so that syncing `handle()` afterwards covers it.
+   */
+  virtual void flush() = 0;
+
+  /**
+   * Flush and commit all appended data to stable storage.
+   */
+  virtual void sync() = 0;
+
+  /**
+   * Flush and close the file. Further calls are no-ops.
+   */
+  virtual void close() = 0;
+
+  /**
+   * @return Native file descriptor.
+   */
+  virtual int handle() const = 0;
+
+  /**
+   * @return Logical size of the file in bytes (existing plus appended data).
+   */
+  virtual uint64_t size() const = 0;
+
+  /**
+   * @return `true` if writes are submitted asynchronously, in which case the
+   * store calls `flush()` only when it needs the data to reach the file
+   * instead of after every frame.
+   */
+  virtual bool isAsync() const { return false; }
+};
+
+/**
+ * Portable `FILE*` writer.
+ */
+class StdioFileWriter : public FileWriter {
+public:
+  /**
+   * Open a file for writing.
+   * @param path File path.
+   * @param append `true` to append to an existing file, `false` to truncate.
+   * @param preallocate Size to preallocate the file to, or 0 (not supported
+   * on Windows, where it is ignored).
+   * @return The writer, or `nullptr` if the file can't be opened.
+   */
+  static std::unique_ptr<StdioFileWriter>
+  open(const std::filesystem::path& path, bool append,
+       uint64_t preallocate = 0) {
+#if !LOGKV_WINDOWS
+    if (preallocate > 0) {
+      return openPreallocated(path, append, preallocate);
+    }
+#endif
+    FILE* f = fopen(path.string().c_str(), append ? "ab+" : "wb");
+    if (!f) {
+      return nullptr;
+    }
+    // The position of a file opened for appending is only moved to the end
+    // by the first write, so seek there to get the size.
+    long pos = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    return std::unique_ptr<StdioFileWriter>(
+      new StdioFileWriter(f, (pos >= 0) ? static_cast<uint64_t>(pos) : 0));
+  }
+
+  ~StdioFileWriter() override {
+    if (f_) {
+      fclose(f_);
+    }
+  }
+
+  void write(const char* data, size_t size) override {
+    if (fwrite(data, 1, size, f_) != size) {
+      throw std::runtime_error("file write error");
+    }
+    size_ += size;
+  }
+
+  void flush() override {
+    if (fflush(f_) != 0) {
+      throw std::runtime_error("file write error");
+    }
+  }
+
+  void sync() override {
+    flush();
+#if LOGKV_WINDOWS
+    const int rc = _commit(_fileno(f_));
+#else
+    const int rc = fsync(fileno(f_));
+#endif
+    if (rc != 0) {
+      throw std::runtime_error("file sync error");
+    }
+  }
+
+  void close() override {
+    if (f_) {
+      FILE* f = f_;
+      f_ = nullptr;
+      bool ok = true;
+#if !LOGKV_WINDOWS
+      if (preallocated_) {
+        ok = fflush(f) == 0 &&
+             ftruncate(fileno(f), static_cast<off_t>(size_)) == 0;
+      }
+#endif
+      if (fclose(f) != 0 || !ok) {
+        throw std::runtime_error("cannot close file");
+      }
+    }
+  }
+
+#if LOGKV_WINDOWS
+  int handle() const override { return _fileno(f_); }
+#else
+  int handle() const override { return fileno(f_); }
+#endif
+
+  uint64_t size() const override { return size_; }
+
+private:
+  StdioFileWriter(FILE* f, uint64_t size) : f_(f), size_(size) {}
+
+#if !LOGKV_WINDOWS
+  /**
+   * Opens the file for writing at its end without `O_APPEND`, since writes
+   * go over the preallocated tail.
+   */
+  static std::unique_ptr<StdioFileWriter>
+  openPreallocated(const std::filesystem::path& path, bool append,
+                   uint64_t preallocate) {
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC);
+    int fd = ::open(path.string().c_str(), flags, 0644);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    FILE* f = nullptr;
+    if (fstat(fd, &st) != 0 || !(f = fdopen(fd, "rb+"))) {
+      ::close(fd);
+      return nullptr;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (fseek(f, static_cast<long>(size), SEEK_SET) != 0) {
+      fclose(f);
+      return nullptr;
+    }
+    std::unique_ptr<StdioFileWriter> w(new StdioFileWriter(f, size));
+    w->preallocated_ = size < preallocate && preallocateFile(fd, preallocate);
+    return w;
+  }
+#endif
+
+  FILE* f_;
+  uint64_t size_;
+  bool preallocated_ = false; // `close()` truncates the zero tail
+};
+
+#if LOGKV_URING
+
+/**
+ * Linux io_uring writer that bypasses the page cache (O_DIRECT, if the
+ * filesystem supports it).
+ *
+ * Appended data is staged in block-aligned buffers (registered with the ring
+ * when the memlock limit allows). Each full buffer is submitted as soon as it
+ * fills, so several buffers can be in flight while the next one is filled.
+ * `flush()` also submits the partially filled buffer (zero-padded up to the
+ * block size) and waits for all writes to complete; the partial tail block is
+ * rewritten in place by the next flush. `close()` truncates the padding.
+ *
+ * NOTE: After a crash, the file can end in zero padding; `logkv::Store` treats
+ * an all-zero file tail as the end of the log.
+ */
+class UringFileWriter : public FileWriter {
+public:
+  static constexpr size_t Alignment = 4096;
+  static constexpr size_t StagingBufferSize = 1 << 20;
+  static constexpr unsigned StagingBuffers = 4;
+
+  /**
+   * Open a file for writing.
+   * @param path File path.
+   * @param append `true` to append to an existing file, `false` to truncate.
+   * @param preallocate Size to preallocate the file to, or 0.
+   * @return The writer, or `nullptr` if io_uring or the file are unavailable.
+   */
+  static std::unique_ptr<UringFileWriter>
+  open(const std::filesystem::path& path, bool append,
+       uint64_t preallocate = 0) {
+    std::unique_ptr<UringFileWriter> w(new UringFileWriter());
+    if (!w->setup(path, append)) {
+      w->release(); // leaves the file as it was, not truncated to `size_`
+      return nullptr;
+    }
+    if (preallocate > w->size_) {
+      preallocateFile(w->fd_, preallocate); // `close()` truncates the tail
+    }
+    return w;
+  }
+
+  ~UringFileWriter() override {
+    try {
+      close();
+    } catch (...) {
+    }
+    release();
+  }
+
+  void write(const char* data, size_t size) override {
+    checkError();
+    while (size > 0) {
+      Buffer& b = buffers_[cur_];
+      size_t n = std::min(size, StagingBufferSize - b.used);
+      std::memcpy(b.data + b.used, data, n);
+      b.used += n;
+      data += n;
+      size -= n;
+      size_ += n;
+      if (b.used == StagingBufferSize) {
+        submit(cur_, StagingBufferSize);
+        unsigned next = (cur_ + 1) % StagingBuffers;
+        while (buffers_[next].inFlight) {
+          reap(true);
+        }
+        checkError();
+        buffers_[next].offset = b.offset + StagingBufferSize;
+        buffers_[next].used = 0;
+        buffers_[next].flushed = 0;
+        cur_ = next;
+      }
+    }
+  }
+
+  void flush() override {
+    if (fd_ < 0) {
+      return;
+    }
+    Buffer& b = buffers_[cur_];
+    if (b.used > b.flushed) {
+      size_t len = alignUp(b.used);
+      std::memset(b.data + b.used, 0, len - b.used);
+      submit(cur_, len);
+    }
+    while (inFlight_ > 0) {
+      reap(true);
+    }
+    checkError();
+    // Keep only the partial tail block, which the next flush will rewrite.
+    size_t full = b.used - (b.used % Alignment);
+    if (full > 0) {
+      std::memmove(b.data, b.data + full, b.used - full);
+      b.offset += full;
+      b.used -= full;
+    }
+    b.flushed = b.used;
+  }
+
+  void sync() override {
+    flush();
+    if (fsync(fd_) != 0) {
+      throw std::runtime_error("file sync error");
+    }
+  }
+
+  void close() override {
+    if (fd_ < 0) {
+      return;
+    }
+    flush();
+    int fd = fd_;
+    fd_ = -1;
+    bool ok = ftruncate(fd, static_cast<off_t>(size_)) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok) {
+      throw std::runtime_error("cannot close file");
+    }
+  }
+
+  int handle() const override { return fd_; }
+
+  uint64_t size() const override { return size_; }
+
+  bool isAsync() const override { return true; }
+
+private:
+  struct Buffer {
+    char* data = nullptr;
+    uint64_t offset = 0; // file offset of data[0] (block-aligned)
+    size_t used = 0;
+    size_t flushed = 0; // bytes already covered by the last flush
+    size_t expected = 0;
+    bool inFlight = false;
+  };
+
+  static size_t alignUp(size_t n) {
+    return (n + Alignment - 1) & ~(Alignment - 1);
+  }
+
+  UringFileWriter() = default;
+
+  bool setup(const std::filesystem::path& path, bool append) {
+    // Appending also reads back the partial tail block.
+    int flags = O_CREAT | O_CLOEXEC | (append ? O_RDWR : O_WRONLY | O_TRUNC);
+    fd_ = ::open(path.string().c_str(), flags | O_DIRECT, 0644);
+    if (fd_ < 0 && errno == EINVAL) {
+      fd_ = ::open(path.string().c_str(), flags, 0644); // no O_DIRECT support
+    }
+    if (fd_ < 0) {
+      return false;
+    }
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    ring_ = static_cast<int>(syscall(__NR_io_uring_setup, 8, &p));
+    if (ring_ < 0) {
+      return false;
+    }
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+      sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+      sqRing_ = nullptr;
+      return false;
+    }
+    if (single) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+      if (cqRing_ == MAP_FAILED) {
+        cqRing_ = nullptr;
+        return false;
+      }
+    }
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    char* sq = static_cast<char*>(sqRing_);
+    char* cq = static_cast<char*>(cqRing_);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    struct iovec iov[StagingBuffers];
+    for (unsigned i = 0; i < StagingBuffers; ++i) {
+      void* mem = nullptr;
+      if (posix_memalign(&mem, Alignment, StagingBufferSize) != 0) {
+        return false;
+      }
+      buffers_[i].data = static_cast<char*>(mem);
+      iov[i].iov_base = mem;
+      iov[i].iov_len = StagingBufferSize;
+    }
+    registered_ = syscall(__NR_io_uring_register, ring_,
+                          IORING_REGISTER_BUFFERS, iov, StagingBuffers) == 0;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+    Buffer& b = buffers_[cur_];
+    b.offset = size_ - (size_ % Alignment);
+    b.used = static_cast<size_t>(size_ - b.offset);
+    b.flushed = b.used;
+    if (b.used > 0) {
+      // Reload the partial tail block so that it can be rewritten.
+      if (pread(fd_, b.data, Alignment, static_cast<off_t>(b.offset)) <
+          static_cast<ssize_t>(b.used)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Frees the ring and buffers and closes the file without flushing or
+   * truncating it. Further calls (and `close()`) are no-ops.
+   */
+  void release() {
+    for (auto& b : buffers_) {
+      free(b.data);
+      b.data = nullptr;
+    }
+    if (sqes_) {
+      munmap(sqes_, sqesSize_);
+      sqes_ = nullptr;
+    }
+    if (cqRing_ && cqRing_ != sqRing_) {
+      munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = nullptr;
+    if (sqRing_) {
+      munmap(sqRing_, sqRingSize_);
+      sqRing_ = nullptr;
+    }
+    if (ring_ >= 0) {
+      ::close(ring_);
+      ring_ = -1;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  void submit(unsigned index, size_t len) {
+    Buffer& b = buffers_[index];
+    unsigned tail = *sqTail_;
+    unsigned slot = tail & sqMask_;
+    io_uring_sqe& sqe = sqes_[slot];
+    std::memset(&sqe, 0, sizeof(sqe));
+    if (registered_) {
+      sqe.opcode = IORING_OP_WRITE_FIXED;
+      sqe.addr = reinterpret_cast<uint64_t>(b.data);
+      sqe.len = static_cast<uint32_t>(len);
+      sqe.buf_index = static_cast<uint16_t>(index);
+    } else {
+      iovs_[index].iov_base = b.data;
+      iovs_[index].iov_len = len;
+      sqe.opcode = IORING_OP_WRITEV;
+      sqe.addr = reinterpret_cast<uint64_t>(&iovs_[index]);
+      sqe.len = 1;
+    }
+    sqe.fd = fd_;
+    sqe.off = b.offset;
+    sqe.user_data = index;
+    sqArray_[slot] = slot;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    b.expected = len;
+    b.inFlight = true;
+    ++inFlight_;
+    while (syscall(__NR_io_uring_enter, ring_, 1, 0, 0, nullptr, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        throw std::runtime_error("file write error");
+      }
+    }
+  }
+
+  void reap(bool wait) {
+    while (true) {
+      unsigned head = *cqHead_;
+      if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe& cqe = cqes_[head & cqMask_];
+        Buffer& b = buffers_[cqe.user_data];
+        if (cqe.res < 0 || static_cast<size_t>(cqe.res) != b.expected) {
+          error_ = true;
+        }
+        b.inFlight = false;
+        --inFlight_;
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        return;
+      }
+      if (!wait) {
+        return;
+      }
+      if (syscall(__NR_io_uring_enter, ring_, 0, 1, IORING_ENTER_GETEVENTS,
+                  nullptr, 0) < 0 &&
+          errno != EINTR) {
+        throw std::runtime_error("file write error");
+      }
+    }
+  }
+
+  void checkError() {
+    if (error_) {
+      throw std::runtime_error("file write error");
+    }
+  }
+
+  int fd_ = -1;
+  int ring_ = -1;
+  void* sqRing_ = nullptr;
+  void* cqRing_ = nullptr;
+  size_t sqRingSize_ = 0;
+  size_t cqRingSize_ = 0;
+  size_t sqesSize_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  unsigned* sqTail_ = nullptr;
+  unsigned* sqArray_ = nullptr;
+  unsigned* cqHead_ = nullptr;
+  unsigned* cqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned cqMask_ = 0;
+  bool registered_ = false;
+  bool error_ = false;
+  Buffer buffers_[StagingBuffers];
+  struct iovec iovs_[StagingBuffers];
+  unsigned cur_ = 0;
+  unsigned inFlight_ = 0;
+  uint64_t size_ = 0;
+};
+
+#endif
+
+} // namespace logkv
+
+#endif
@@ -6,6 +6,15 @@
 #include <cstdint>
 #include <stdexcept>
 
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+  (defined(__GNUC__) || defined(__clang__))
+#define LOGKV_HEX_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define LOGKV_HEX_NEON
+#include <arm_neon.h>
+#endif
+
 namespace logkv_detail {
 constexpr std::array<int, 256> createHexLookup() {
   std::array<int, 256> lookup{};
@@ -23,10 +32,264 @@ constexpr std::array<int, 256> createHexLookup() {
 inline const char hexEncodeLookupUpper[] = "0123456789ABCDEF";
 inline const char hexEncodeLookupLower[] = "0123456789abcdef";
 inline constexpr std::array<int, 256> hexLookup = createHexLookup();
+
+// Scalar kernels, used directly for short inputs and on CPUs without SIMD,
+// and for the tail that the SIMD kernels leave behind. `i` is the index of
+// the first source byte (encode) or destination byte (decode) to process.
+
+inline void encodeHexScalar(char* dest, const char* src, size_t src_len,
+                            size_t i, bool upper) {
+  const char* lookup = upper ? hexEncodeLookupUpper : hexEncodeLookupLower;
+  for (; i < src_len; ++i) {
+    const uint8_t byte = static_cast<uint8_t>(src[i]);
+    dest[i * 2] = lookup[byte >> 4];
+    dest[i * 2 + 1] = lookup[byte & 0x0F];
+  }
+}
+
+inline bool decodeHexScalar(char* dest, const char* src, size_t len,
+                            size_t i) {
+  for (; i < len; ++i) {
+    const unsigned char hchar = src[2 * i];
+    const unsigned char lchar = src[2 * i + 1];
+    const int hval = hexLookup[hchar];
+    const int lval = hexLookup[lchar];
+    if (hval == -1 || lval == -1) {
+      return false;
+    }
+    dest[i] = static_cast<char>((hval << 4) | lval);
+  }
+  return true;
+}
+
+#if defined(LOGKV_HEX_X86)
+
+/**
+ * pshufb kernels. Encoding splits each byte into nibbles and looks up both
+ * digits with one shuffle, then interleaves high and low digits. Decoding
+ * maps '0'-'9' and (case-folded) 'a'-'f' to their values with saturating
+ * range checks; any lane that is neither rejects the whole block. Adjacent
+ * nibbles are joined with pmaddubsw (high * 16 + low) and packed to bytes.
+ * The AVX2 kernels do the same on 32-byte vectors, fixing up the in-lane
+ * unpack/pack order with a cross-lane permute.
+ */
+#define LOGKV_HEX_SSSE3 __attribute__((target("ssse3")))
+#define LOGKV_HEX_AVX2 __attribute__((target("avx2")))
+
+LOGKV_HEX_SSSE3 inline __m128i hexDigitsLut128(bool upper) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+    upper ? hexEncodeLookupUpper : hexEncodeLookupLower));
+}
+
+LOGKV_HEX_SSSE3 inline void encodeHex16(char* dest, const char* src,
+                                        __m128i lut) {
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  const __m128i hi =
+    _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+  const __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_unpacklo_epi8(hi, lo));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 16),
+                   _mm_unpackhi_epi8(hi, lo));
+}
+
+// Returns the nibble values of 16 hex characters; clears `ok` if any lane is
+// not a hex digit.
+LOGKV_HEX_SSSE3 inline __m128i decodeNibbles16(__m128i c, __m128i& ok) {
+  const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  const __m128i letter =
+    _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  const __m128i isDigit =
+    _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  const __m128i isLetter =
+    _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+  ok = _mm_and_si128(ok, _mm_or_si128(isDigit, isLetter));
+  return _mm_or_si128(
+    _mm_and_si128(isDigit, digit),
+    _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+LOGKV_HEX_SSSE3 inline bool decodeHex16(char* dest, const char* src) {
+  __m128i ok = _mm_set1_epi8(-1);
+  const __m128i n0 = decodeNibbles16(
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), ok);
+  const __m128i n1 = decodeNibbles16(
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), ok);
+  if (_mm_movemask_epi8(ok) != 0xFFFF) {
+    return false;
+  }
+  const __m128i weights = _mm_set1_epi16(0x0110);
+  const __m128i b0 = _mm_maddubs_epi16(n0, weights);
+  const __m128i b1 = _mm_maddubs_epi16(n1, weights);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_packus_epi16(b0, b1));
+  return true;
+}
+
+LOGKV_HEX_SSSE3 inline void encodeHexSSSE3(char* dest, const char* src,
+                                           size_t src_len, bool upper) {
+  const __m128i lut = hexDigitsLut128(upper);
+  size_t i = 0;
+  for (; i + 16 <= src_len; i += 16) {
+    encodeHex16(dest + i * 2, src + i, lut);
+  }
+  encodeHexScalar(dest, src, src_len, i, upper);
+}
+
+LOGKV_HEX_SSSE3 inline bool decodeHexSSSE3(char* dest, const char* src,
+                                           size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    if (!decodeHex16(dest + i, src + i * 2)) {
+      return false;
+    }
+  }
+  return decodeHexScalar(dest, src, len, i);
+}
+
+LOGKV_HEX_AVX2 inline void encodeHexAVX2(char* dest, const char* src,
+                                         size_t src_len, bool upper) {
+  const __m128i lut128 = hexDigitsLut128(upper);
+  const __m256i lut = _mm256_broadcastsi128_si256(lut128);
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+  size_t i = 0;
+  for (; i + 32 <= src_len; i += 32) {
+    const __m256i v =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    const __m256i hi = _mm256_shuffle_epi8(
+      lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+    const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+    const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 2),
+                        _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 2 + 32),
+                        _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  if (i + 16 <= src_len) {
+    encodeHex16(dest + i * 2, src + i, lut128);
+    i += 16;
+  }
+  encodeHexScalar(dest, src, src_len, i, upper);
+}
+
+LOGKV_HEX_AVX2 inline __m256i decodeNibbles32(__m256i c, __m256i& ok) {
+  const __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  const __m256i letter = _mm256_sub_epi8(
+    _mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  const __m256i isDigit =
+    _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+  const __m256i isLetter =
+    _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+  ok = _mm256_and_si256(ok, _mm256_or_si256(isDigit, isLetter));
+  return _mm256_or_si256(
+    _mm256_and_si256(isDigit, digit),
+    _mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+LOGKV_HEX_AVX2 inline bool decodeHexAVX2(char* dest, const char* src,
+                                         size_t len) {
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i ok = _mm256_set1_epi8(-1);
+    const __m256i n0 = decodeNibbles32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2)), ok);
+    const __m256i n1 = decodeNibbles32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2 + 32)),
+      ok);
+    if (_mm256_movemask_epi8(ok) != -1) {
+      return false;
+    }
+    const __m256i packed =
+      _mm256_packus_epi16(_mm256_maddubs_epi16(n0, weights),
+                          _mm256_maddubs_epi16(n1, weights));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  if (i + 16 <= len) {
+    if (!decodeHex16(dest + i, src + i * 2)) {
+      return false;
+    }
+    i += 16;
+  }
+  return decodeHexScalar(dest, src, len, i);
+}
+
+#undef LOGKV_HEX_SSSE3
+#undef LOGKV_HEX_AVX2
+
+enum class HexKernel { Scalar, SSSE3, AVX2 };
+
+inline HexKernel hexKernel() {
+  static const HexKernel kernel = __builtin_cpu_supports("avx2")
+                                    ? HexKernel::AVX2
+                                  : __builtin_cpu_supports("ssse3")
+                                    ? HexKernel::SSSE3
+                                    : HexKernel::Scalar;
+  return kernel;
+}
+
+#elif defined(LOGKV_HEX_NEON)
+
+// NEON is baseline on AArch64, so there is no runtime check. vst2q/vld2q do
+// the digit interleaving and de-interleaving for free.
+
+inline void encodeHexNEON(char* dest, const char* src, size_t src_len,
+                          bool upper) {
+  const uint8x16_t lut = vld1q_u8(reinterpret_cast<const uint8_t*>(
+    upper ? hexEncodeLookupUpper : hexEncodeLookupLower));
+  const uint8x16_t mask = vdupq_n_u8(0x0F);
+  size_t i = 0;
+  for (; i + 16 <= src_len; i += 16) {
+    const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(src + i));
+    uint8x16x2_t out;
+    out.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(v, 4));
+    out.val[1] = vqtbl1q_u8(lut, vandq_u8(v, mask));
+    vst2q_u8(reinterpret_cast<uint8_t*>(dest + i * 2), out);
+  }
+  encodeHexScalar(dest, src, src_len, i, upper);
+}
+
+inline uint8x16_t decodeNibblesNEON(uint8x16_t c, uint8x16_t& ok) {
+  const uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+  const uint8x16_t letter =
+    vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+  const uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+  const uint8x16_t isLetter = vcltq_u8(letter, vdupq_n_u8(6));
+  ok = vandq_u8(ok, vorrq_u8(isDigit, isLetter));
+  return vbslq_u8(isDigit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+}
+
+inline bool decodeHexNEON(char* dest, const char* src, size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const uint8x16x2_t c =
+      vld2q_u8(reinterpret_cast<const uint8_t*>(src + i * 2));
+    uint8x16_t ok = vdupq_n_u8(0xFF);
+    const uint8x16_t hi = decodeNibblesNEON(c.val[0], ok);
+    const uint8x16_t lo = decodeNibblesNEON(c.val[1], ok);
+    if (vminvq_u8(ok) == 0) {
+      return false;
+    }
+    vst1q_u8(reinterpret_cast<uint8_t*>(dest + i),
+             vorrq_u8(vshlq_n_u8(hi, 4), lo));
+  }
+  return decodeHexScalar(dest, src, len, i);
+}
+
+#endif
+
+// Inputs shorter than this (in source bytes) stay on the scalar loop.
+constexpr size_t HexSimdMinSize = 16;
+
 } // namespace logkv_detail
 
 namespace logkv {
 
+/**
+ * Encodes `src_len` bytes as `2 * src_len` hex digits. Uses SSSE3/AVX2 or
+ * NEON kernels when available, and a lookup table otherwise.
+ */
 inline void encodeHex(char* dest, size_t dest_len, const char* src,
                       size_t src_len, bool upper = false) {
   if (!src_len) {
@@ -39,15 +302,31 @@ inline void encodeHex(char* dest, size_t dest_len, const char* src,
   if (dest_len < len) {
     throw std::invalid_argument("Destination buffer too small.");
   }
-  const char* lookup = upper ? logkv_detail::hexEncodeLookupUpper
-                             : logkv_detail::hexEncodeLookupLower;
-  for (size_t i = 0; i < src_len; ++i) {
-    const uint8_t byte = static_cast<uint8_t>(src[i]);
-    dest[i * 2] = lookup[byte >> 4];
-    dest[i * 2 + 1] = lookup[byte & 0x0F];
+  if (src_len >= logkv_detail::HexSimdMinSize) {
+#if defined(LOGKV_HEX_X86)
+    switch (logkv_detail::hexKernel()) {
+    case logkv_detail::HexKernel::AVX2:
+      logkv_detail::encodeHexAVX2(dest, src, src_len, upper);
+      return;
+    case logkv_detail::HexKernel::SSSE3:
+      logkv_detail::encodeHexSSSE3(dest, src, src_len, upper);
+      return;
+    case logkv_detail::HexKernel::Scalar:
+      break;
+    }
+#elif defined(LOGKV_HEX_NEON)
+    logkv_detail::encodeHexNEON(dest, src, src_len, upper);
+    return;
+#endif
   }
+  logkv_detail::encodeHexScalar(dest, src, src_len, 0, upper);
 }
 
+/**
+ * Decodes `src_len` hex digits (either case) into `src_len / 2` bytes.
+ * Throws on an odd length or any non-hex character; `dest` may have been
+ * partially written in that case.
+ */
 inline void decodeHex(char* dest, size_t dest_len, const char* src,
                       size_t src_len) {
   if (!src_len) {
@@ -64,18 +343,38 @@ inline void decodeHex(char* dest, size_t dest_len, const char* src,
   if (dest_len < len) {
     throw std::invalid_argument("Destination buffer too small.");
   }
-  for (size_t i = 0; i < len; ++i) {
-    const unsigned char hchar = src[2 * i];
-    const unsigned char lchar = src[2 * i + 1];
-    const int hval = logkv_detail::hexLookup[hchar];
-    const int lval = logkv_detail::hexLookup[lchar];
-    if (hval == -1 || lval == -1) {
-      throw std::invalid_argument("Hex string has invalid characters");
+  bool ok = false;
+  bool done = false;
+  if (len >= logkv_detail::HexSimdMinSize) {
+#if defined(LOGKV_HEX_X86)
+    switch (logkv_detail::hexKernel()) {
+    case logkv_detail::HexKernel::AVX2:
+      ok = logkv_detail::decodeHexAVX2(dest, src, len);
+      done = true;
+      break;
+    case logkv_detail::HexKernel::SSSE3:
+      ok = logkv_detail::decodeHexSSSE3(dest, src, len);
+      done = true;
+      break;
+    case logkv_detail::HexKernel::Scalar:
+      break;
     }
-    dest[i] = static_cast<char>((hval << 4) | lval);
+#elif defined(LOGKV_HEX_NEON)
+    ok = logkv_detail::decodeHexNEON(dest, src, len);
+    done = true;
+#endif
+  }
+  if (!done) {
+    ok = logkv_detail::decodeHexScalar(dest, src, len, 0);
+  }
+  if (!ok) {
+    throw std::invalid_argument("Hex string has invalid characters");
   }
 }
 
 } // namespace logkv
 
-#endif
\ No newline at end of file
+#undef LOGKV_HEX_X86
+#undef LOGKV_HEX_NEON
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef _LOGKV_LAZY_H_
+#define _LOGKV_LAZY_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include <logkv/autoser.h>
+#include <logkv/file.h>
+
+namespace logkv {
+
+/**
+ * Bounded LRU cache of the values decoded by `logkv::Lazy<V>::get()`, shared
+ * by all `Lazy<V>` objects of the same V. Cached values hold on to the mapped
+ * file they were decoded from.
+ */
+template <typename V> class LazyCache {
+public:
+  /**
+   * Default maximum number of cached values.
+   */
+  static constexpr size_t DefaultCapacity = 1024;
+
+  static LazyCache& instance() {
+    static LazyCache cache;
+    return cache;
+  }
+
+  /**
+   * Set the maximum number of cached values, evicting the least recently
+   * used ones if needed. 0 disables caching.
+   */
+  void setCapacity(size_t capacity) {
+    std::lock_guard lock(mutex_);
+    capacity_ = capacity;
+    evict();
+  }
+
+  size_t getCapacity() const {
+    std::lock_guard lock(mutex_);
+    return capacity_;
+  }
+
+  size_t size() const {
+    std::lock_guard lock(mutex_);
+    return lru_.size();
+  }
+
+  void clear() {
+    std::lock_guard lock(mutex_);
+    index_.clear();
+    lru_.clear();
+  }
+
+  std::shared_ptr<const V> find(const MappedFile* file, size_t offset) {
+    std::lock_guard lock(mutex_);
+    auto it = index_.find({file, offset});
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->value;
+  }
+
+  void insert(const std::shared_ptr<const MappedFile>& file, size_t offset,
+              std::shared_ptr<const V> value) {
+    std::lock_guard lock(mutex_);
+    if (!capacity_ || index_.count({file.get(), offset})) {
+      return;
+    }
+    lru_.push_front({file, offset, std::move(value)});
+    index_[{file.get(), offset}] = lru_.begin();
+    evict();
+  }
+
+private:
+  struct Entry {
+    std::shared_ptr<const MappedFile> file;
+    size_t offset;
+    std::shared_ptr<const V> value;
+  };
+  using Key = std::pair<const MappedFile*, size_t>;
+  struct KeyHash {
+    size_t operator()(const Key& k) const noexcept {
+      return std::hash<const void*>()(k.first) ^
+             (k.second * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  void evict() {
+    while (lru_.size() > capacity_) {
+      index_.erase({lru_.back().file.get(), lru_.back().offset});
+      lru_.pop_back();
+    }
+  }
+
+  mutable std::mutex mutex_;
+  size_t capacity_ = DefaultCapacity;
+  std::list<Entry> lru_;
+  std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> index_;
+};
+
+/**
+ * A value V that `logkv::Store` loads lazily, for data sets whose values
+ * don't fit in memory. Use `Store<M, K, Lazy<V>>`.
+ *
+ * When the store replays a snapshot or events file, it maps the file and a
+ * `Lazy<V>` only records where its serialized V is (see
+ * `_logkvReplaySource()`), so `load()` costs O(keys) instead of O(bytes).
+ * `get()` decodes the V on first access through the `LazyCache<V>`. Writing
+ * a `Lazy<V>` that was loaded this way copies its bytes from the file
+ * without decoding, so snapshots don't re-serialize unchanged values.
+ *
+ * Values assigned in memory (e.g. by `update()`) stay resident until the
+ * next `load()`, as do values replayed from frames that are not in the
+ * mapped file as is (compressed frames, frame chains, pipelined replay
+ * workers), which are decoded eagerly.
+ *
+ * The serialized form is a VarUint length followed by the serialized V, so
+ * files written with `Lazy<V>` values can't be read as plain V values.
+ * NOTE: Replayed values keep their file mapped after it is deleted by
+ * `save()`, until they are reassigned or evicted from the cache.
+ */
+template <typename V> class Lazy {
+  static_assert(!requires { V::_logkvStoreSnapshot(false); },
+                "partial-serializable values can't be loaded lazily");
+
+public:
+  Lazy() = default;
+
+  Lazy(V value) : value_(std::make_shared<const V>(std::move(value))) {}
+
+  /**
+   * Get the value, decoding it from its file on first access.
+   * @return Shared pointer to the value, valid after eviction from the cache.
+   * @throws std::runtime_error if the value can't be decoded.
+   */
+  std::shared_ptr<const V> get() const {
+    if (value_) {
+      return value_;
+    }
+    if (!file_) {
+      static const auto empty = std::make_shared<const V>();
+      return empty;
+    }
+    auto& cache = LazyCache<V>::instance();
+    if (auto v = cache.find(file_.get(), offset_)) {
+      return v;
+    }
+    auto v = std::make_shared<V>();
+    size_t used = serializer<V>::read(file_->data() + offset_, length_, *v);
+    if (used != length_) {
+      throw std::runtime_error("corrupted lazy value");
+    }
+    cache.insert(file_, offset_, v);
+    return v;
+  }
+
+  /**
+   * @return `true` if the value is in memory, `false` if it's in a file.
+   */
+  bool isResident() const { return !file_; }
+
+  /**
+   * Set (or, with `nullptr`, clear) the mapped file that serializer reads on
+   * this thread are from. Called by `logkv::Store` around replay.
+   */
+  static void _logkvReplaySource(std::shared_ptr<const MappedFile> file) {
+    replaySource() = std::move(file);
+  }
+
+private:
+  friend struct serializer<Lazy<V>>;
+
+  static std::shared_ptr<const MappedFile>& replaySource() {
+    thread_local std::shared_ptr<const MappedFile> source;
+    return source;
+  }
+
+  std::shared_ptr<const V> value_;         // resident value
+  std::shared_ptr<const MappedFile> file_; // or its serialized bytes
+  size_t offset_ = 0;
+  size_t length_ = 0;
+};
+
+template <typename V> struct serializer<Lazy<V>> {
+  static bool is_empty(const Lazy<V>& obj) {
+    if (obj.file_) {
+      return false; // empty values are written as a zero length
+    }
+    return !obj.value_ || serializer<V>::is_empty(*obj.value_);
+  }
+
+  static size_t get_size(const Lazy<V>& obj) {
+    const size_t len = length(obj);
+    return serializer<VarUint<uint64_t>>::get_size(len) + len;
+  }
+
+  static size_t write(char* dest, size_t size, const Lazy<V>& obj) {
+    return write_with_sink(dest, size, obj);
+  }
+
+  static void write_to(Sink& sink, const Lazy<V>& obj) {
+    const size_t len = length(obj);
+    logkv::write_to(sink, VarUint<uint64_t>(len));
+    if (obj.file_) {
+      sink.append(obj.file_->data() + obj.offset_, len);
+    } else if (len) {
+      logkv::write_to(sink, *obj.value_);
+    }
+  }
+
+  static size_t read(const char* src, size_t size, Lazy<V>& obj) {
+    VarUint<uint64_t> len_var;
+    const size_t len_size =
+      serializer<VarUint<uint64_t>>::read(src, size, len_var);
+    if (len_size > size) {
+      return len_size;
+    }
+    const uint64_t len = len_var.value;
+    if (len > MAX_AUTOSER_BYTES) {
+      throw std::runtime_error("autoser byte size limit exceeded");
+    }
+    const size_t required = len_size + len;
+    if (size < required) {
+      return required;
+    }
+    const char* p = src + len_size;
+    const auto& file = Lazy<V>::replaySource();
+    if (!len) {
+      obj = Lazy<V>();
+    } else if (file && p >= file->data() &&
+               p + len <= file->data() + file->size()) {
+      obj.value_.reset();
+      obj.file_ = file;
+      obj.offset_ = p - file->data();
+      obj.length_ = len;
+    } else {
+      V value;
+      if (serializer<V>::read(p, len, value) != len) {
+        throw std::runtime_error("corrupted lazy value");
+      }
+      obj = Lazy<V>(std::move(value));
+    }
+    return required;
+  }
+
+private:
+  static size_t length(const Lazy<V>& obj) {
+    if (obj.file_) {
+      return obj.length_;
+    }
+    if (!obj.value_ || serializer<V>::is_empty(*obj.value_)) {
+      return 0;
+    }
+    return serializer<V>::get_size(*obj.value_);
+  }
+};
+
+} // namespace logkv
+
+#endif
@@ -0,0 +1,565 @@
+#ifndef _LOGKV_PERSISTENTMAP_H_
+#define _LOGKV_PERSISTENTMAP_H_
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace logkv {
+
+/**
+ * Unordered K,V map implemented as a hash array mapped trie with structural
+ * sharing, usable as the `M` map type of `logkv::Store`.
+ *
+ * Copying a `PersistentMap` (e.g. `snapshot()`) is O(1): the copies share all
+ * trie nodes and entries, and a node or entry is only copied when it is about
+ * to be modified while shared (copy-on-write). So the memory cost of keeping
+ * a copy is proportional to the entries mutated after the copy was taken
+ * (times the trie depth, which is logarithmic in the map size).
+ *
+ * Different copies can be used by different threads at the same time, e.g. a
+ * frozen `snapshot()` that is serialized by a background thread while the
+ * original map is being updated; a single copy is not thread-safe.
+ *
+ * Iteration order is unspecified. Inserting or erasing entries invalidates
+ * iterators, except for the iterator returned by `erase()`. Dereferencing a
+ * non-const iterator unshares the entry, so mutating an entry through it does
+ * not affect copies.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class PersistentMap {
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<const K, V>;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+
+private:
+  static constexpr unsigned Bits = 5;
+  static constexpr unsigned HashBits = sizeof(size_t) * 8;
+  // Hash levels plus one level of full-hash collision nodes.
+  static constexpr unsigned MaxDepth = (HashBits + Bits - 1) / Bits + 1;
+
+  struct Leaf {
+    template <typename... Args>
+    explicit Leaf(size_t h, Args&&... args)
+        : hash(h), kv(std::forward<Args>(args)...) {}
+    Leaf(const Leaf& o) : hash(o.hash), kv(o.kv) {}
+    std::atomic<size_t> refs{1};
+    size_t hash;
+    value_type kv;
+  };
+
+  /**
+   * Trie node. Entries and child nodes are indexed by 5-bit hash chunks in
+   * `leafMap` and `nodeMap`, and stored in bit order, leaves first.
+   * Collision nodes hold leaves with identical full hashes, in no order.
+   */
+  struct Node {
+    Node() = default;
+    Node(const Node& o)
+        : nodeMap(o.nodeMap), leafMap(o.leafMap), collision(o.collision),
+          nodes(o.nodes), leaves(o.leaves) {
+      for (Node* n : nodes) {
+        n->refs.fetch_add(1, std::memory_order_relaxed);
+      }
+      for (Leaf* l : leaves) {
+        l->refs.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    std::atomic<size_t> refs{1};
+    uint32_t nodeMap = 0;
+    uint32_t leafMap = 0;
+    bool collision = false;
+    std::vector<Node*> nodes;
+    std::vector<Leaf*> leaves;
+  };
+
+  struct Frame {
+    Node* node;
+    size_t pos; // index in leaves, then in nodes (offset by leaves.size())
+  };
+
+public:
+  template <bool Const> class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = PersistentMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer =
+      std::conditional_t<Const, const value_type*, value_type*>;
+    using reference =
+      std::conditional_t<Const, const value_type&, value_type&>;
+
+    Iterator() = default;
+
+    template <bool C, typename = std::enable_if_t<Const && !C>>
+    Iterator(const Iterator<C>& o) : map_(o.map_), depth_(o.depth_) {
+      std::copy(o.stack_, o.stack_ + depth_, stack_);
+    }
+
+    reference operator*() const {
+      if constexpr (Const) {
+        const Frame& f = stack_[depth_ - 1];
+        return f.node->leaves[f.pos]->kv;
+      } else {
+        return map_->unsharePath(stack_, depth_, true)->kv;
+      }
+    }
+
+    pointer operator->() const { return &**this; }
+
+    Iterator& operator++() {
+      ++stack_[depth_ - 1].pos;
+      settle();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    /**
+     * Iterators are compared by trie position, which is the same in copies
+     * of the map that were not structurally modified.
+     */
+    bool operator==(const Iterator& o) const {
+      if (depth_ != o.depth_) {
+        return false;
+      }
+      for (unsigned d = 0; d < depth_; ++d) {
+        if (stack_[d].pos != o.stack_[d].pos) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool operator!=(const Iterator& o) const { return !(*this == o); }
+
+  private:
+    friend class PersistentMap;
+    template <bool> friend class Iterator;
+    using map_pointer =
+      std::conditional_t<Const, const PersistentMap*, PersistentMap*>;
+
+    explicit Iterator(map_pointer map) : map_(map) {}
+
+    /**
+     * Moves to the first leaf at or after the current position.
+     */
+    void settle() {
+      while (depth_ > 0) {
+        Frame& f = stack_[depth_ - 1];
+        const size_t leafCount = f.node->leaves.size();
+        if (f.pos < leafCount) {
+          return;
+        }
+        const size_t child = f.pos - leafCount;
+        if (child < f.node->nodes.size()) {
+          stack_[depth_++] = {f.node->nodes[child], 0};
+          continue;
+        }
+        if (--depth_ > 0) {
+          ++stack_[depth_ - 1].pos;
+        }
+      }
+    }
+
+    map_pointer map_ = nullptr;
+    mutable Frame stack_[MaxDepth];
+    unsigned depth_ = 0; // 0 is end()
+  };
+
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  PersistentMap() = default;
+
+  PersistentMap(const PersistentMap& o) : root_(o.root_), size_(o.size_) {
+    if (root_) {
+      root_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  PersistentMap(PersistentMap&& o) noexcept : root_(o.root_), size_(o.size_) {
+    o.root_ = nullptr;
+    o.size_ = 0;
+  }
+
+  PersistentMap& operator=(const PersistentMap& o) {
+    if (this != &o) {
+      PersistentMap tmp(o);
+      swap(tmp);
+    }
+    return *this;
+  }
+
+  PersistentMap& operator=(PersistentMap&& o) noexcept {
+    if (this != &o) {
+      clear();
+      swap(o);
+    }
+    return *this;
+  }
+
+  ~PersistentMap() { clear(); }
+
+  /**
+   * Take an O(1) copy of the map that is unaffected by later updates.
+   * @return The frozen copy.
+   */
+  PersistentMap snapshot() const { return *this; }
+
+  void swap(PersistentMap& o) noexcept {
+    std::swap(root_, o.root_);
+    std::swap(size_, o.size_);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void clear() {
+    if (root_) {
+      release(root_);
+      root_ = nullptr;
+    }
+    size_ = 0;
+  }
+
+  iterator begin() { return first<false>(this); }
+  iterator end() { return iterator(this); }
+  const_iterator begin() const { return first<true>(this); }
+  const_iterator end() const { return const_iterator(this); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  iterator find(const K& key) {
+    iterator it(this);
+    locate(key, hasher{}(key), it);
+    return it;
+  }
+
+  const_iterator find(const K& key) const {
+    const_iterator it(this);
+    locate(key, hasher{}(key), it);
+    return it;
+  }
+
+  size_t count(const K& key) const { return find(key) != end() ? 1 : 0; }
+  bool contains(const K& key) const { return find(key) != end(); }
+
+  V& at(const K& key) {
+    auto it = find(key);
+    if (it == end()) {
+      throw std::out_of_range("PersistentMap::at");
+    }
+    return it->second;
+  }
+
+  const V& at(const K& key) const {
+    auto it = find(key);
+    if (it == end()) {
+      throw std::out_of_range("PersistentMap::at");
+    }
+    return it->second;
+  }
+
+  V& operator[](const K& key) {
+    return emplaceLeaf(key, [&](size_t h) {
+             return new Leaf(h, std::piecewise_construct,
+                             std::forward_as_tuple(key), std::tuple<>());
+           }).first->kv.second;
+  }
+
+  V& operator[](K&& key) {
+    return emplaceLeaf(key, [&](size_t h) {
+             return new Leaf(h, std::piecewise_construct,
+                             std::forward_as_tuple(std::move(key)),
+                             std::tuple<>());
+           }).first->kv.second;
+  }
+
+  template <typename KK, typename... Args>
+  std::pair<iterator, bool> try_emplace(KK&& key, Args&&... args) {
+    auto r = emplaceLeaf(key, [&](size_t h) {
+      return new Leaf(h, std::piecewise_construct,
+                      std::forward_as_tuple(std::forward<KK>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+    });
+    return {find(r.first->kv.first), r.second};
+  }
+
+  template <typename KK, typename VV>
+  std::pair<iterator, bool> insert_or_assign(KK&& key, VV&& value) {
+    bool assigned = false;
+    auto r = emplaceLeaf(key, [&](size_t h) {
+      assigned = true;
+      return new Leaf(h, std::forward<KK>(key), std::forward<VV>(value));
+    });
+    if (!assigned) {
+      r.first->kv.second = std::forward<VV>(value);
+    }
+    return {find(r.first->kv.first), r.second};
+  }
+
+  std::pair<iterator, bool> insert(const value_type& kv) {
+    return try_emplace(kv.first, kv.second);
+  }
+
+  std::pair<iterator, bool> insert(value_type&& kv) {
+    return try_emplace(kv.first, std::move(kv.second));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  iterator erase(iterator it) {
+    unsharePath(it.stack_, it.depth_, false);
+    Node* n = it.stack_[it.depth_ - 1].node;
+    const size_t pos = it.stack_[it.depth_ - 1].pos;
+    Leaf* l = n->leaves[pos];
+    if (!n->collision) {
+      n->leafMap &= ~bitFor(l->hash, (it.depth_ - 1) * Bits);
+    }
+    n->leaves.erase(n->leaves.begin() + pos);
+    release(l);
+    --size_;
+    // Drop emptied nodes; the parent position then refers to the next child.
+    while (it.depth_ > 1 && n->leaves.empty() && n->nodes.empty()) {
+      --it.depth_;
+      Node* p = it.stack_[it.depth_ - 1].node;
+      const size_t child = it.stack_[it.depth_ - 1].pos - p->leaves.size();
+      uint32_t m = p->nodeMap;
+      for (size_t i = 0; i < child; ++i) {
+        m &= m - 1;
+      }
+      p->nodeMap &= ~(m & (~m + 1));
+      p->nodes.erase(p->nodes.begin() + child);
+      release(n);
+      n = p;
+    }
+    if (size_ == 0) {
+      clear();
+      return end();
+    }
+    it.settle();
+    return it;
+  }
+
+  size_t erase(const K& key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    erase(it);
+    return 1;
+  }
+
+  bool operator==(const PersistentMap& o) const {
+    if (size_ != o.size_) {
+      return false;
+    }
+    if (root_ == o.root_) {
+      return true;
+    }
+    for (const auto& kv : *this) {
+      auto it = o.find(kv.first);
+      if (it == o.end() || !(it->second == kv.second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool operator!=(const PersistentMap& o) const { return !(*this == o); }
+
+private:
+  static uint32_t bitFor(size_t h, unsigned shift) {
+    return uint32_t(1) << ((h >> shift) & ((1u << Bits) - 1));
+  }
+
+  static size_t indexOf(uint32_t map, uint32_t bit) {
+    return static_cast<size_t>(std::popcount(map & (bit - 1)));
+  }
+
+  static void release(Leaf* l) {
+    if (l->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete l;
+    }
+  }
+
+  static void release(Node* n) {
+    if (n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      for (Node* c : n->nodes) {
+        release(c);
+      }
+      for (Leaf* l : n->leaves) {
+        release(l);
+      }
+      delete n;
+    }
+  }
+
+  /**
+   * Replaces a shared node or leaf with a private copy.
+   */
+  template <typename T> static T* unique(T*& p) {
+    if (p->refs.load(std::memory_order_acquire) != 1) {
+      T* copy = new T(*p);
+      release(p);
+      p = copy;
+    }
+    return p;
+  }
+
+  template <bool C, typename P> static Iterator<C> first(P map) {
+    Iterator<C> it(map);
+    if (map->root_) {
+      it.stack_[0] = {map->root_, 0};
+      it.depth_ = 1;
+      it.settle();
+    }
+    return it;
+  }
+
+  template <bool C>
+  bool locate(const K& key, size_t h, Iterator<C>& it) const {
+    Node* n = root_;
+    unsigned d = 0;
+    while (n) {
+      if (n->collision) {
+        for (size_t i = 0; i < n->leaves.size(); ++i) {
+          if (key_equal{}(n->leaves[i]->kv.first, key)) {
+            it.stack_[d] = {n, i};
+            it.depth_ = d + 1;
+            return true;
+          }
+        }
+        return false;
+      }
+      const uint32_t bit = bitFor(h, d * Bits);
+      if (n->leafMap & bit) {
+        const size_t i = indexOf(n->leafMap, bit);
+        const Leaf* l = n->leaves[i];
+        if (l->hash == h && key_equal{}(l->kv.first, key)) {
+          it.stack_[d] = {n, i};
+          it.depth_ = d + 1;
+          return true;
+        }
+        return false;
+      }
+      if (!(n->nodeMap & bit)) {
+        return false;
+      }
+      const size_t i = indexOf(n->nodeMap, bit);
+      it.stack_[d++] = {n, n->leaves.size() + i};
+      n = n->nodes[i];
+    }
+    return false;
+  }
+
+  /**
+   * Unshares the nodes on an iterator path (and its leaf, if `leaf`), then
+   * updates the path to point at the private copies.
+   */
+  Leaf* unsharePath(Frame* stack, unsigned depth, bool leaf) {
+    Node* n = unique(root_);
+    stack[0].node = n;
+    for (unsigned d = 1; d < depth; ++d) {
+      n = unique(n->nodes[stack[d - 1].pos - n->leaves.size()]);
+      stack[d].node = n;
+    }
+    Leaf*& l = n->leaves[stack[depth - 1].pos];
+    return leaf ? unique(l) : l;
+  }
+
+  /**
+   * Finds the (unshared) leaf for `key`, or inserts `make(hash)` for it.
+   * @return The leaf, and `true` if it was inserted.
+   */
+  template <typename Make>
+  std::pair<Leaf*, bool> emplaceLeaf(const K& key, Make&& make) {
+    const size_t h = hasher{}(key);
+    if (!root_) {
+      root_ = new Node();
+    }
+    Node** slot = &root_;
+    unsigned shift = 0;
+    while (true) {
+      Node* n = unique(*slot);
+      if (n->collision) {
+        for (Leaf*& l : n->leaves) {
+          if (key_equal{}(l->kv.first, key)) {
+            return {unique(l), false};
+          }
+        }
+        std::unique_ptr<Leaf> nl(make(h));
+        n->leaves.push_back(nl.get());
+        ++size_;
+        return {nl.release(), true};
+      }
+      const uint32_t bit = bitFor(h, shift);
+      if (n->nodeMap & bit) {
+        slot = &n->nodes[indexOf(n->nodeMap, bit)];
+        shift += Bits;
+        continue;
+      }
+      const size_t li = indexOf(n->leafMap, bit);
+      if (n->leafMap & bit) {
+        Leaf* old = n->leaves[li];
+        if (old->hash == h && key_equal{}(old->kv.first, key)) {
+          return {unique(n->leaves[li]), false};
+        }
+        // Push the existing leaf down into a new child node.
+        const unsigned childShift = shift + Bits;
+        std::unique_ptr<Node> child(new Node());
+        if (childShift >= HashBits) {
+          child->collision = true;
+        } else {
+          child->leafMap = bitFor(old->hash, childShift);
+        }
+        child->leaves.push_back(old);
+        const size_t ni = indexOf(n->nodeMap, bit);
+        n->nodes.insert(n->nodes.begin() + ni, child.get());
+        child.release();
+        n->leaves.erase(n->leaves.begin() + li);
+        n->leafMap &= ~bit;
+        n->nodeMap |= bit;
+        slot = &n->nodes[ni];
+        shift = childShift;
+        continue;
+      }
+      std::unique_ptr<Leaf> nl(make(h));
+      n->leaves.insert(n->leaves.begin() + li, nl.get());
+      n->leafMap |= bit;
+      ++size_;
+      return {nl.release(), true};
+    }
+  }
+
+  Node* root_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace logkv
+
+#endif
@@ -0,0 +1,1211 @@
+#ifndef _LOGKV_REPLICATION_H_
+#define _LOGKV_REPLICATION_H_
+
+#include <logkv/autoser.h>
+#include <logkv/stats.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace logkv {
+
+/**
+ * Position in a replication stream: byte `offset` of events file `time`.
+ */
+struct ReplicationPosition {
+  uint64_t time = 0;
+  uint64_t offset = 0;
+
+  auto operator<=>(const ReplicationPosition&) const = default;
+};
+
+/**
+ * A follower connected to a `logkv::ReplicationLeader`.
+ */
+struct ReplicaInfo {
+  std::string endpoint;        // remote address and port
+  ReplicationPosition applied; // last position the follower reported
+  bool bootstrapping = false;  // still receiving the bootstrap files
+};
+
+} // namespace logkv
+
+namespace logkv_detail {
+
+/**
+ * Replication protocol messages. Each message is the message type byte, the
+ * 4-byte size of its body, and the body: the autoser-encoded fields listed
+ * here, followed by raw bytes for file data and events.
+ */
+enum ReplicationMessage : uint8_t {
+  ReplHello = 1,        // follower: magic, generation, time, offset
+  ReplAck = 2,          // follower: applied time, offset
+  ReplBootstrap = 3,    // leader: generation; store files follow
+  ReplFile = 4,         // leader: file kind, time, shard
+  ReplFileData = 5,     // leader: bytes of the last `ReplFile`
+  ReplBootstrapEnd = 6, // leader: time, offset at the end of the files
+  ReplEpoch = 7,        // leader: time, offset of the new events file
+  ReplEvents = 8        // leader: time, offset; events file bytes
+};
+
+enum ReplicationFileKind : uint8_t {
+  ReplSnapshotFile = 0, // `NNNN.snapshot`, or `NNNN.snapshot.S` if shard S
+  ReplDeltaFile = 1,    // `NNNN.delta`
+  ReplEventsFile = 2    // `NNNN.events`, or `NNNN.events.S` if segment S
+};
+
+constexpr uint64_t ReplMagic = 0x6c6f676b76726570ULL; // "logkvrep"
+constexpr size_t ReplHeaderSize = 5;
+constexpr size_t ReplMaxBodySize = size_t(1) << 30;
+constexpr size_t ReplChunkSize = size_t(1) << 20;
+
+inline std::string replFileName(uint8_t kind, uint64_t time, uint64_t shard) {
+  std::ostringstream oss;
+  oss << std::setw(20) << std::setfill('0') << time;
+  if (kind == ReplSnapshotFile) {
+    oss << ".snapshot";
+    if (shard) {
+      oss << "." << shard;
+    }
+  } else if (kind == ReplDeltaFile) {
+    oss << ".delta";
+  } else if (kind == ReplEventsFile) {
+    oss << ".events";
+    if (shard) {
+      oss << "." << shard;
+    }
+  } else {
+    throw std::runtime_error("invalid replication file kind");
+  }
+  return oss.str();
+}
+
+/**
+ * Parses a store data file name (see `ReplicationFileKind`).
+ * @return `false` if `path` isn't one.
+ */
+inline bool replParseFileName(const std::filesystem::path& path, uint8_t& kind,
+                              uint64_t& time, uint64_t& shard) {
+  auto isNumber = [](const std::string& s) {
+    return !s.empty() && s.size() <= 20 &&
+           std::all_of(s.begin(), s.end(), ::isdigit);
+  };
+  auto ext = path.extension().string();
+  auto stem = path.stem();
+  shard = 0;
+  if (stem.has_extension() &&
+      (stem.extension() == ".snapshot" || stem.extension() == ".events")) {
+    if (!isNumber(stem.stem().string()) || !isNumber(ext.substr(1))) {
+      return false;
+    }
+    kind = stem.extension() == ".snapshot" ? ReplSnapshotFile : ReplEventsFile;
+    time = std::stoull(stem.stem().string());
+    shard = std::stoull(ext.substr(1));
+    return shard > 0;
+  }
+  if (!isNumber(stem.string())) {
+    return false;
+  }
+  if (ext == ".snapshot") {
+    kind = ReplSnapshotFile;
+  } else if (ext == ".delta") {
+    kind = ReplDeltaFile;
+  } else if (ext == ".events") {
+    kind = ReplEventsFile;
+  } else {
+    return false;
+  }
+  time = std::stoull(stem.string());
+  return true;
+}
+
+/**
+ * Appends a message with the given fields and `size` raw bytes to `out`.
+ * @return Pointer to the raw bytes in `out`, which the caller fills in.
+ */
+template <typename... Ts>
+char* replMessage(std::vector<char>& out, uint8_t type, size_t size,
+                  const Ts&... fields) {
+  const std::tuple<Ts...> t(fields...);
+  const size_t fieldsSize = logkv::serializer<std::tuple<Ts...>>::get_size(t);
+  if (fieldsSize + size > ReplMaxBodySize) {
+    throw std::runtime_error("replication message too large");
+  }
+  const uint32_t bodySize = static_cast<uint32_t>(fieldsSize + size);
+  const size_t base = out.size();
+  out.resize(base + ReplHeaderSize + bodySize);
+  char* p = out.data() + base;
+  p[0] = static_cast<char>(type);
+  std::memcpy(p + 1, &bodySize, 4);
+  logkv::serializer<std::tuple<Ts...>>::write(p + ReplHeaderSize, fieldsSize,
+                                              t);
+  return p + ReplHeaderSize + fieldsSize;
+}
+
+/**
+ * Reads the fields at the start of a message body.
+ * @return Size of the fields; the raw bytes follow them.
+ * @throws std::runtime_error if the body is truncated.
+ */
+template <typename... Ts>
+size_t replFields(const std::vector<char>& body, Ts&... fields) {
+  std::tuple<Ts...> t;
+  size_t used =
+    logkv::serializer<std::tuple<Ts...>>::read(body.data(), body.size(), t);
+  if (used > body.size()) {
+    throw std::runtime_error("truncated replication message");
+  }
+  std::tie(fields...) = std::move(t);
+  return used;
+}
+
+} // namespace logkv_detail
+
+namespace logkv {
+
+/**
+ * `logkv::ReplicationLeader` streams the events frames of a `logkv::Store` to
+ * `logkv::ReplicationFollower`s over TCP, so that read replicas on other
+ * machines serve the same map.
+ *
+ * The leader is a `logkv::StoreObserver`; install it with
+ * `store.setObserver(leader)`. It keeps the frames that the store seals (on
+ * `flush()`, or when the buffer fills up) in an in-memory backlog, and sends
+ * them to the followers as they are sealed. A follower that connects for the
+ * first time, or that fell behind the backlog, is bootstrapped with the
+ * snapshot, delta snapshot and events files in the store's directory, and
+ * then streams from the backlog. Followers report the position that they
+ * applied (see `getReplicas()`).
+ *
+ * NOTE: Followers only see logged changes, so changes made directly to the
+ * map must be logged with `persist()` (a `save()` is not replicated).
+ * `load()` and `clear()` make all followers bootstrap again.
+ * NOTE: Bootstrapping reads the events that are no longer in the backlog
+ * from the events file, up to where the store flushed it (see
+ * `StoreObserver::onEventsFlushed()`): with group commit or
+ * `StoreWriteMode::uringWrite`, the store should be flushed regularly.
+ */
+class ReplicationLeader : public StoreObserver {
+public:
+  /**
+   * Default maximum size of the backlog (64MB).
+   */
+  static constexpr size_t DefaultMaxBacklogBytes = size_t(64) << 20;
+
+  /**
+   * Start listening for followers.
+   * @param dir Data directory of the store that the leader will observe.
+   * @param endpoint Address and port to listen on (port 0 picks a free one;
+   * see `getPort()`).
+   * @throws boost::system::system_error if the endpoint can't be bound.
+   */
+  ReplicationLeader(const std::string& dir,
+                    const boost::asio::ip::tcp::endpoint& endpoint)
+      : dir_(dir), acceptor_(io_, endpoint),
+        port_(acceptor_.local_endpoint().port()),
+        generation_(std::chrono::steady_clock::now()
+                      .time_since_epoch()
+                      .count() |
+                    1) {
+    accept();
+    thread_ = std::thread([this]() { io_.run(); });
+  }
+
+  ~ReplicationLeader() override { stop(); }
+
+  /**
+   * Stop serving followers and close their connections.
+   */
+  void stop() {
+    if (thread_.joinable()) {
+      work_.reset();
+      io_.stop();
+      thread_.join();
+      boost::system::error_code ec;
+      acceptor_.close(ec);
+      std::lock_guard lock(mutex_);
+      for (const auto& s : sessions_) {
+        s->socket_.close(ec);
+      }
+      sessions_.clear();
+    }
+  }
+
+  /**
+   * @return Port the leader listens on.
+   */
+  uint16_t getPort() const { return port_; }
+
+  /**
+   * Set the maximum size of the frames kept for followers; a follower that
+   * falls further behind is bootstrapped again.
+   * @param bytes Backlog size in bytes.
+   */
+  void setMaxBacklogBytes(size_t bytes) {
+    std::lock_guard lock(mutex_);
+    maxBacklogBytes_ = bytes;
+    trimBacklog();
+  }
+
+  /**
+   * @return Position after the last frame that the store sealed.
+   */
+  ReplicationPosition getPosition() const {
+    std::lock_guard lock(mutex_);
+    return cur_;
+  }
+
+  /**
+   * @return The connected followers.
+   */
+  std::vector<ReplicaInfo> getReplicas() const {
+    std::lock_guard lock(mutex_);
+    std::vector<ReplicaInfo> replicas;
+    for (const auto& s : sessions_) {
+      if (s->started_) {
+        replicas.push_back({s->endpoint_, s->applied_, s->bootstrapping_});
+      }
+    }
+    return replicas;
+  }
+
+  void onEventsFile(uint64_t time, uint64_t offset, bool reset) override {
+    {
+      std::lock_guard lock(mutex_);
+      if (reset || !known_) {
+        resetBacklog();
+      } else {
+        backlog_.push_back({cur_, {time, offset}, true, {}});
+      }
+      cur_ = {time, offset};
+      flushed_ = cur_;
+      known_ = true;
+    }
+    notify();
+  }
+
+  void onEventsFrame(uint64_t time, uint64_t offset, const char* header,
+                     size_t headerSize, const char* payload,
+                     size_t payloadSize) override {
+    {
+      std::lock_guard lock(mutex_);
+      if (!known_ || cur_.time != time || cur_.offset != offset) {
+        resetBacklog(); // not the stream we've seen so far
+      }
+      known_ = true;
+      Entry e{{time, offset}, {time, offset}, false, {}};
+      e.bytes.reserve(headerSize + payloadSize);
+      e.bytes.append(header, headerSize).append(payload, payloadSize);
+      backlogBytes_ += e.bytes.size();
+      backlog_.push_back(std::move(e));
+      cur_ = {time, offset + headerSize + payloadSize};
+      trimBacklog();
+    }
+    notify();
+  }
+
+  void onEventsFlushed(uint64_t time, uint64_t offset) override {
+    std::lock_guard lock(mutex_);
+    flushed_ = {time, offset}; // sessions waiting for it poll
+  }
+
+private:
+  /**
+   * A backlog entry: events file bytes (one frame or chain segment) or, if
+   * `epoch`, the switch to a new events file. `before` is the stream position
+   * before the entry and `at` the position where it starts.
+   */
+  struct Entry {
+    ReplicationPosition before;
+    ReplicationPosition at;
+    bool epoch;
+    std::string bytes;
+  };
+
+  /**
+   * A store file being sent to a bootstrapping follower, up to `limit` bytes
+   * (the end of the file if `UINT64_MAX`). `start` is the offset of an events
+   * segment in its events file.
+   */
+  struct BootstrapFile {
+    uint8_t kind;
+    uint64_t time;
+    uint64_t shard;
+    uint64_t limit;
+    uint64_t start = 0;
+    FILE* f = nullptr;
+    uint64_t sent = 0;
+    bool started = false;
+
+    BootstrapFile(uint8_t kind, uint64_t time, uint64_t shard, uint64_t limit)
+        : kind(kind), time(time), shard(shard), limit(limit) {}
+    BootstrapFile(BootstrapFile&& o) noexcept
+        : kind(o.kind), time(o.time), shard(o.shard), limit(o.limit),
+          start(o.start), f(std::exchange(o.f, nullptr)), sent(o.sent),
+          started(o.started) {}
+    ~BootstrapFile() {
+      if (f) {
+        fclose(f);
+      }
+    }
+  };
+
+  /**
+   * A follower connection. All methods run on the leader's I/O thread.
+   */
+  class Session : public std::enable_shared_from_this<Session> {
+  public:
+    Session(ReplicationLeader& leader, boost::asio::ip::tcp::socket socket)
+        : leader_(leader), socket_(std::move(socket)),
+          timer_(leader.io_) {
+      boost::system::error_code ec;
+      socket_.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+      auto remote = socket_.remote_endpoint(ec);
+      if (!ec) {
+        std::ostringstream oss;
+        oss << remote;
+        endpoint_ = oss.str();
+      }
+    }
+
+    void start() { readHeader(); }
+
+    /**
+     * Sends the next message, unless a write is in flight.
+     */
+    void pump() {
+      if (closed_ || writing_ || waiting_ || !started_) {
+        return;
+      }
+      writeBuf_.clear();
+      try {
+        if (bootstrapping_ ? !nextBootstrapMessage() : !nextStreamMessage()) {
+          return;
+        }
+      } catch (...) {
+        close();
+        return;
+      }
+      writing_ = true;
+      boost::asio::async_write(
+        socket_, boost::asio::buffer(writeBuf_),
+        [self = shared_from_this()](boost::system::error_code ec, size_t) {
+          self->writing_ = false;
+          if (ec) {
+            self->close();
+          } else {
+            self->pump();
+          }
+        });
+    }
+
+    void close() {
+      if (closed_) {
+        return;
+      }
+      closed_ = true;
+      boost::system::error_code ec;
+      socket_.close(ec);
+      timer_.cancel();
+      files_.clear();
+      std::lock_guard lock(leader_.mutex_);
+      leader_.sessions_.erase(shared_from_this());
+    }
+
+  private:
+    friend class ReplicationLeader;
+
+    void readHeader() {
+      boost::asio::async_read(
+        socket_, boost::asio::buffer(header_),
+        [self = shared_from_this()](boost::system::error_code ec, size_t) {
+          if (ec) {
+            self->close();
+            return;
+          }
+          uint32_t size;
+          std::memcpy(&size, self->header_ + 1, 4);
+          if (size > logkv_detail::ReplMaxBodySize) {
+            self->close();
+            return;
+          }
+          self->body_.resize(size);
+          self->readBody();
+        });
+    }
+
+    void readBody() {
+      boost::asio::async_read(
+        socket_, boost::asio::buffer(body_),
+        [self = shared_from_this()](boost::system::error_code ec, size_t) {
+          if (ec) {
+            self->close();
+            return;
+          }
+          try {
+            self->handle(static_cast<uint8_t>(self->header_[0]));
+          } catch (...) {
+            self->close();
+            return;
+          }
+          self->readHeader();
+        });
+    }
+
+    void handle(uint8_t type) {
+      using namespace logkv_detail;
+      if (type == ReplHello && !started_) {
+        uint64_t magic, generation;
+        ReplicationPosition pos;
+        replFields(body_, magic, generation, pos.time, pos.offset);
+        if (magic != ReplMagic) {
+          throw std::runtime_error("not a logkv replication follower");
+        }
+        startStream(generation, pos);
+        started_ = true;
+        pump();
+      } else if (type == ReplAck && started_) {
+        ReplicationPosition pos;
+        replFields(body_, pos.time, pos.offset);
+        std::lock_guard lock(leader_.mutex_);
+        applied_ = pos;
+      } else {
+        throw std::runtime_error("unexpected replication message");
+      }
+    }
+
+    /**
+     * Resumes the follower's stream at `pos` if it's in the backlog, or else
+     * opens the store files to bootstrap it with. The files are opened
+     * without the leader's `mutex_`, which the store's writers take to log
+     * frames; a stream that fell behind meanwhile fails and reconnects.
+     */
+    void startStream(uint64_t generation, ReplicationPosition pos) {
+      for (int attempt = 0; attempt < 10; ++attempt) {
+        {
+          std::lock_guard lock(leader_.mutex_);
+          if (!leader_.known_) {
+            throw std::runtime_error("leader isn't observing a store");
+          }
+          generation_ = leader_.generation_;
+          const auto& backlog = leader_.backlog_;
+          const uint64_t endSeq = leader_.firstSeq_ + backlog.size();
+          if (generation == generation_) {
+            if (pos == leader_.cur_) {
+              nextSeq_ = endSeq;
+              applied_ = pos;
+              return;
+            }
+            for (size_t i = 0; i < backlog.size(); ++i) {
+              if (backlog[i].before == pos) {
+                nextSeq_ = leader_.firstSeq_ + i;
+                applied_ = pos;
+                return;
+              }
+            }
+          }
+          // The files end where the frames of the current events file that
+          // are in the backlog begin.
+          const uint64_t time = leader_.cur_.time;
+          size_t k = backlog.size();
+          while (k > 0 && !backlog[k - 1].epoch &&
+                 backlog[k - 1].at.time == time) {
+            --k;
+          }
+          nextSeq_ = leader_.firstSeq_ + k;
+          end_ = {time, k < backlog.size() ? backlog[k].at.offset
+                                           : leader_.cur_.offset};
+        }
+        if (openFiles()) {
+          bootstrapping_ = true;
+          return;
+        }
+      }
+      throw std::runtime_error("cannot open the store files");
+    }
+
+    /**
+     * Opens the latest snapshot up to `end_`, its shards and deltas, and the
+     * events files after them, like `Store::load()` finds them.
+     * @return `false` if a file was deleted before it could be opened.
+     */
+    bool openFiles() {
+      using namespace logkv_detail;
+      files_.clear();
+      std::vector<std::tuple<uint8_t, uint64_t, uint64_t>> found;
+      for (const auto& entry :
+           std::filesystem::directory_iterator(leader_.dir_)) {
+        uint8_t kind;
+        uint64_t time, shard;
+        if (entry.is_regular_file() &&
+            replParseFileName(entry.path(), kind, time, shard) &&
+            time <= end_.time) {
+          found.emplace_back(kind, time, shard);
+        }
+      }
+      std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        return std::tie(std::get<1>(a), std::get<0>(a), std::get<2>(a)) <
+               std::tie(std::get<1>(b), std::get<0>(b), std::get<2>(b));
+      });
+      std::optional<uint64_t> snapshot;
+      for (const auto& [kind, time, shard] : found) {
+        if (kind == ReplSnapshotFile && !shard) {
+          snapshot = time;
+        }
+      }
+      uint64_t base = snapshot.value_or(0);
+      for (const auto& [kind, time, shard] : found) {
+        if (kind == ReplDeltaFile && time > base) {
+          base = time;
+        }
+      }
+      // The segments of the current events file are sent up to `end_`.
+      uint64_t start = 0;
+      for (const auto& [kind, time, shard] : found) {
+        const bool events = kind == ReplEventsFile;
+        if ((kind == ReplSnapshotFile && time == snapshot) ||
+            (kind == ReplDeltaFile && snapshot && time > *snapshot) ||
+            (kind == ReplDeltaFile && !snapshot) ||
+            (events && time >= base)) {
+          uint64_t limit = UINT64_MAX;
+          if (events && time == end_.time) {
+            limit = end_.offset - std::min(start, end_.offset);
+            if (std::get<1>(found.back()) != time ||
+                std::get<2>(found.back()) != shard) {
+              std::error_code ec;
+              auto size = std::filesystem::file_size(
+                std::filesystem::path(leader_.dir_) /
+                  replFileName(kind, time, shard),
+                ec);
+              if (ec) {
+                return false;
+              }
+              limit = std::min(limit, size);
+            }
+          }
+          files_.emplace_back(kind, time, shard, limit);
+          files_.back().start = start;
+          if (events && time == end_.time) {
+            start += limit;
+          }
+        }
+      }
+      if (files_.empty() || files_.back().kind != ReplEventsFile ||
+          files_.back().time != end_.time) {
+        if (end_.offset > 0) {
+          return false; // the current events file is missing
+        }
+        files_.emplace_back(ReplEventsFile, end_.time, 0, 0);
+        return true;
+      }
+      for (auto& file : files_) {
+        if (file.limit == 0) {
+          continue;
+        }
+        auto path = std::filesystem::path(leader_.dir_) /
+                    replFileName(file.kind, file.time, file.shard);
+        file.f = fopen(path.string().c_str(), "rb");
+        if (!file.f) {
+          files_.clear();
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Fills `writeBuf_` with the next bootstrap message.
+     * @return `false` if waiting for the store to write the events file.
+     */
+    bool nextBootstrapMessage() {
+      using namespace logkv_detail;
+      if (!bootstrapStarted_) {
+        replMessage(writeBuf_, ReplBootstrap, 0, generation_);
+        bootstrapStarted_ = true;
+        return true;
+      }
+      while (!files_.empty()) {
+        auto& file = files_.front();
+        if (!file.started) {
+          replMessage(writeBuf_, ReplFile, 0, file.kind, file.time,
+                      file.shard);
+          file.started = true;
+          return true;
+        }
+        size_t want = static_cast<size_t>(
+          std::min<uint64_t>(ReplChunkSize, file.limit - file.sent));
+        if (want == 0) {
+          files_.pop_front();
+          continue;
+        }
+        if (file.kind == ReplEventsFile && file.limit != UINT64_MAX) {
+          // Past the flushed events, a preallocated segment reads as zeros.
+          const uint64_t flushed = flushedOffset(file.time);
+          const uint64_t pos = file.start + file.sent;
+          if (flushed <= pos) {
+            waitForFile();
+            return false;
+          }
+          want = static_cast<size_t>(std::min<uint64_t>(want, flushed - pos));
+        }
+        char* data = replMessage(writeBuf_, ReplFileData, want);
+        const size_t got = fread(data, 1, want, file.f);
+        if (got < want) {
+          writeBuf_.resize(writeBuf_.size() - (want - got));
+          const uint32_t bodySize = static_cast<uint32_t>(got);
+          std::memcpy(writeBuf_.data() + 1, &bodySize, 4);
+        }
+        if (got == 0) {
+          writeBuf_.clear();
+          if (ferror(file.f)) {
+            throw std::runtime_error("cannot read store file");
+          }
+          if (file.limit == UINT64_MAX) {
+            files_.pop_front();
+            continue;
+          }
+          waitForFile();
+          return false;
+        }
+        file.sent += got;
+        waitStart_.reset();
+        return true;
+      }
+      replMessage(writeBuf_, ReplBootstrapEnd, 0, end_.time, end_.offset);
+      bootstrapping_ = false;
+      return true;
+    }
+
+    /**
+     * @return Offset up to which the store flushed events file `time`.
+     */
+    uint64_t flushedOffset(uint64_t time) const {
+      std::lock_guard lock(leader_.mutex_);
+      const auto& flushed = leader_.flushed_;
+      return flushed.time > time ? UINT64_MAX
+             : flushed.time == time ? flushed.offset
+                                    : 0;
+    }
+
+    /**
+     * Retries reading the current events file, which the store has written
+     * but maybe not yet flushed, after a while.
+     */
+    void waitForFile() {
+      auto now = std::chrono::steady_clock::now();
+      if (!waitStart_) {
+        waitStart_ = now;
+      } else if (now - *waitStart_ > std::chrono::seconds(10)) {
+        throw std::runtime_error("events file is not being flushed");
+      }
+      clearerr(files_.front().f);
+      waiting_ = true;
+      timer_.expires_after(std::chrono::milliseconds(10));
+      timer_.async_wait(
+        [self = shared_from_this()](boost::system::error_code ec) {
+          self->waiting_ = false;
+          if (!ec) {
+            self->pump();
+          }
+        });
+    }
+
+    /**
+     * Fills `writeBuf_` with the next frames or events file switch from the
+     * backlog.
+     * @return `false` if there is nothing to send.
+     */
+    bool nextStreamMessage() {
+      using namespace logkv_detail;
+      std::lock_guard lock(leader_.mutex_);
+      if (generation_ != leader_.generation_ ||
+          nextSeq_ < leader_.firstSeq_) {
+        throw std::runtime_error("follower fell behind the backlog");
+      }
+      const auto& backlog = leader_.backlog_;
+      const size_t i = nextSeq_ - leader_.firstSeq_;
+      if (i >= backlog.size()) {
+        return false;
+      }
+      if (backlog[i].epoch) {
+        replMessage(writeBuf_, ReplEpoch, 0, backlog[i].at.time,
+                    backlog[i].at.offset);
+        ++nextSeq_;
+        return true;
+      }
+      size_t j = i;
+      size_t size = 0;
+      while (j < backlog.size() && !backlog[j].epoch &&
+             (j == i || size + backlog[j].bytes.size() <= ReplChunkSize)) {
+        size += backlog[j++].bytes.size();
+      }
+      char* data = replMessage(writeBuf_, ReplEvents, size,
+                               backlog[i].at.time, backlog[i].at.offset);
+      for (size_t k = i; k < j; ++k) {
+        std::memcpy(data, backlog[k].bytes.data(), backlog[k].bytes.size());
+        data += backlog[k].bytes.size();
+      }
+      nextSeq_ += j - i;
+      return true;
+    }
+
+    ReplicationLeader& leader_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    std::string endpoint_;
+    char header_[logkv_detail::ReplHeaderSize];
+    std::vector<char> body_;
+    std::vector<char> writeBuf_;
+    bool writing_ = false;
+    bool waiting_ = false;
+    bool closed_ = false;
+    std::atomic<bool> started_ = false;
+    std::atomic<bool> bootstrapping_ = false;
+    bool bootstrapStarted_ = false;
+    uint64_t generation_ = 0;
+    uint64_t nextSeq_ = 0;
+    ReplicationPosition end_;
+    ReplicationPosition applied_; // guarded by the leader's `mutex_`
+    std::deque<BootstrapFile> files_;
+    std::optional<std::chrono::steady_clock::time_point> waitStart_;
+  };
+
+  void accept() {
+    acceptor_.async_accept(
+      [this](boost::system::error_code ec,
+             boost::asio::ip::tcp::socket socket) {
+        if (!acceptor_.is_open()) {
+          return;
+        }
+        if (!ec) {
+          auto s = std::make_shared<Session>(*this, std::move(socket));
+          {
+            std::lock_guard lock(mutex_);
+            sessions_.insert(s);
+          }
+          s->start();
+        }
+        accept();
+      });
+  }
+
+  /**
+   * Has the sessions send the new backlog entries.
+   */
+  void notify() {
+    if (!notifyPending_.exchange(true)) {
+      boost::asio::post(io_, [this]() {
+        notifyPending_ = false;
+        std::vector<std::shared_ptr<Session>> sessions;
+        {
+          std::lock_guard lock(mutex_);
+          sessions.assign(sessions_.begin(), sessions_.end());
+        }
+        for (const auto& s : sessions) {
+          s->pump();
+        }
+      });
+    }
+  }
+
+  /**
+   * Starts a new stream that followers can't resume, e.g. after `load()`.
+   */
+  void resetBacklog() {
+    ++generation_;
+    firstSeq_ += backlog_.size();
+    backlog_.clear();
+    backlogBytes_ = 0;
+  }
+
+  void trimBacklog() {
+    while (backlogBytes_ > maxBacklogBytes_ && !backlog_.empty()) {
+      backlogBytes_ -= backlog_.front().bytes.size();
+      backlog_.pop_front();
+      ++firstSeq_;
+    }
+  }
+
+  std::string dir_;
+  boost::asio::io_context io_;
+  std::optional<boost::asio::executor_work_guard<
+    boost::asio::io_context::executor_type>>
+    work_{io_.get_executor()};
+  boost::asio::ip::tcp::acceptor acceptor_;
+  const uint16_t port_;
+  std::thread thread_;
+  std::atomic<bool> notifyPending_ = false;
+  mutable std::mutex mutex_;
+  std::set<std::shared_ptr<Session>> sessions_;
+  uint64_t generation_;
+  bool known_ = false; // the store reported its events file
+  ReplicationPosition cur_;
+  ReplicationPosition flushed_; // end of the events the store flushed
+  std::deque<Entry> backlog_;
+  uint64_t firstSeq_ = 0; // sequence number of `backlog_.front()`
+  size_t backlogBytes_ = 0;
+  size_t maxBacklogBytes_ = DefaultMaxBacklogBytes;
+};
+
+/**
+ * `logkv::ReplicationFollower` keeps a read-only `logkv::Store` (a read
+ * replica) in sync with the store of a `logkv::ReplicationLeader`.
+ *
+ * The follower connects to the leader, and reconnects whenever the connection
+ * fails. It is bootstrapped by copying the leader's store files into the
+ * replica's directory and loading them, and then applies the frames that the
+ * leader streams to the replica's map with `Store::applyEvents()`, without
+ * writing them to disk. It reports the position it applied to the leader.
+ *
+ * The replica's map is updated on the follower's thread; read it with
+ * `read()`, or through a `Store::Reader` if the replica has concurrent reads
+ * enabled (`Store::setConcurrentReads()`). The replica must not be written
+ * to, and its directory must not be used by another store.
+ */
+template <typename S> class ReplicationFollower {
+public:
+  /**
+   * Start following a leader.
+   * @param store Read replica store.
+   * @param host Leader host name or address.
+   * @param port Leader port.
+   */
+  ReplicationFollower(S& store, const std::string& host, uint16_t port)
+      : store_(store), host_(host), port_(port), socket_(io_),
+        resolver_(io_), timer_(io_) {
+    boost::asio::post(io_, [this]() { connect(); });
+    thread_ = std::thread([this]() { io_.run(); });
+  }
+
+  ~ReplicationFollower() { stop(); }
+
+  /**
+   * Stop following the leader. The replica keeps its current state.
+   */
+  void stop() {
+    if (thread_.joinable()) {
+      work_.reset();
+      io_.stop();
+      thread_.join();
+      boost::system::error_code ec;
+      socket_.close(ec);
+      discardFile();
+    }
+  }
+
+  /**
+   * Call `f(store)` with the replica locked against updates from the leader.
+   * @param f Callable taking a `const S&`.
+   * @return The result of `f`.
+   */
+  template <typename F> decltype(auto) read(F&& f) const {
+    std::lock_guard lock(mutex_);
+    return std::forward<F>(f)(std::as_const(store_));
+  }
+
+  /**
+   * @return `true` if the replica was bootstrapped from the leader.
+   */
+  bool isBootstrapped() const {
+    std::lock_guard lock(mutex_);
+    return generation_ != 0;
+  }
+
+  /**
+   * @return Position of the leader's stream that the replica applied.
+   */
+  ReplicationPosition getPosition() const {
+    std::lock_guard lock(mutex_);
+    return pos_;
+  }
+
+  /**
+   * Wait until the replica applied the leader's stream up to `pos` (e.g. the
+   * leader's `getPosition()`).
+   * @return `false` on timeout.
+   */
+  template <typename Rep, typename Period>
+  bool waitForPosition(ReplicationPosition pos,
+                       std::chrono::duration<Rep, Period> timeout) const {
+    std::unique_lock lock(mutex_);
+    return cv_.wait_for(lock, timeout,
+                        [&]() { return generation_ != 0 && pos_ >= pos; });
+  }
+
+private:
+  void connect() {
+    resolver_.async_resolve(
+      host_, std::to_string(port_),
+      [this](boost::system::error_code ec,
+             boost::asio::ip::tcp::resolver::results_type results) {
+        if (ec) {
+          retry();
+          return;
+        }
+        boost::asio::async_connect(
+          socket_, results,
+          [this](boost::system::error_code ec,
+                 const boost::asio::ip::tcp::endpoint&) {
+            if (ec) {
+              retry();
+              return;
+            }
+            socket_.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+            {
+              std::lock_guard lock(mutex_);
+              logkv_detail::replMessage(outbox_, logkv_detail::ReplHello, 0,
+                                        logkv_detail::ReplMagic, generation_,
+                                        pos_.time, pos_.offset);
+            }
+            flushWrites();
+            readHeader();
+          });
+      });
+  }
+
+  /**
+   * Drops the connection and reconnects after a while.
+   */
+  void retry() {
+    boost::system::error_code ec;
+    socket_.close(ec);
+    discardFile();
+    pending_.clear();
+    outbox_.clear();
+    ackDue_ = false;
+    ++connection_; // ignore the completions of the old connection's writes
+    writing_ = false;
+    timer_.expires_after(std::chrono::milliseconds(100));
+    timer_.async_wait([this](boost::system::error_code ec) {
+      if (!ec) {
+        connect();
+      }
+    });
+  }
+
+  void flushWrites() {
+    if (writing_) {
+      return;
+    }
+    if (ackDue_) {
+      std::lock_guard lock(mutex_);
+      logkv_detail::replMessage(outbox_, logkv_detail::ReplAck, 0, pos_.time,
+                                pos_.offset);
+      ackDue_ = false;
+    }
+    if (outbox_.empty()) {
+      return;
+    }
+    writing_ = true;
+    writeBuf_.swap(outbox_);
+    outbox_.clear();
+    boost::asio::async_write(
+      socket_, boost::asio::buffer(writeBuf_),
+      [this, connection = connection_](boost::system::error_code ec, size_t) {
+        if (connection != connection_) {
+          return;
+        }
+        writing_ = false;
+        if (ec) {
+          retry();
+        } else {
+          flushWrites();
+        }
+      });
+  }
+
+  void readHeader() {
+    boost::asio::async_read(
+      socket_, boost::asio::buffer(header_),
+      [this, connection = connection_](boost::system::error_code ec, size_t) {
+        if (connection != connection_) {
+          return;
+        }
+        uint32_t size;
+        std::memcpy(&size, header_ + 1, 4);
+        if (ec || size > logkv_detail::ReplMaxBodySize) {
+          retry();
+          return;
+        }
+        body_.resize(size);
+        boost::asio::async_read(
+          socket_, boost::asio::buffer(body_),
+          [this, connection](boost::system::error_code ec, size_t) {
+            if (connection != connection_) {
+              return;
+            }
+            if (ec) {
+              retry();
+              return;
+            }
+            try {
+              handle(static_cast<uint8_t>(header_[0]));
+            } catch (...) {
+              retry();
+              return;
+            }
+            flushWrites();
+            readHeader();
+          });
+      });
+  }
+
+  void handle(uint8_t type) {
+    using namespace logkv_detail;
+    if (type == ReplEvents) {
+      ReplicationPosition at;
+      size_t used = replFields(body_, at.time, at.offset);
+      std::unique_lock lock(mutex_);
+      if (!generation_ || at.time != pos_.time ||
+          at.offset != pos_.offset + pending_.size()) {
+        throw std::runtime_error("replication stream gap");
+      }
+      pending_.insert(pending_.end(), body_.begin() + used, body_.end());
+      size_t applied = store_.applyEvents(pending_.data(), pending_.size());
+      pending_.erase(pending_.begin(), pending_.begin() + applied);
+      pos_.offset += applied;
+      lock.unlock();
+      cv_.notify_all();
+      ackDue_ = applied > 0;
+    } else if (type == ReplEpoch) {
+      ReplicationPosition at;
+      replFields(body_, at.time, at.offset);
+      std::unique_lock lock(mutex_);
+      if (!generation_ || !pending_.empty() || at.time <= pos_.time) {
+        throw std::runtime_error("replication stream gap");
+      }
+      pos_ = at;
+      lock.unlock();
+      cv_.notify_all();
+      ackDue_ = true;
+    } else if (type == ReplBootstrap) {
+      replFields(body_, bootstrapGeneration_);
+      std::lock_guard lock(mutex_);
+      generation_ = 0; // the files in the directory are being replaced
+      pending_.clear();
+      std::vector<std::filesystem::path> toDelete;
+      for (const auto& entry :
+           std::filesystem::directory_iterator(store_.getDirectory())) {
+        uint8_t kind;
+        uint64_t time, shard;
+        if (entry.is_regular_file() &&
+            replParseFileName(entry.path(), kind, time, shard)) {
+          toDelete.push_back(entry.path());
+        }
+      }
+      for (const auto& path : toDelete) {
+        std::filesystem::remove(path);
+      }
+    } else if (type == ReplFile) {
+      uint8_t kind;
+      uint64_t time, shard;
+      replFields(body_, kind, time, shard);
+      closeFile();
+      auto path = std::filesystem::path(store_.getDirectory()) /
+                  replFileName(kind, time, shard);
+      file_ = fopen(path.string().c_str(), "wb");
+      if (!file_) {
+        throw std::runtime_error("cannot open replica file for writing");
+      }
+    } else if (type == ReplFileData) {
+      if (!file_ ||
+          fwrite(body_.data(), 1, body_.size(), file_) != body_.size()) {
+        throw std::runtime_error("cannot write replica file");
+      }
+    } else if (type == ReplBootstrapEnd) {
+      ReplicationPosition end;
+      replFields(body_, end.time, end.offset);
+      closeFile();
+      std::unique_lock lock(mutex_);
+      if (!store_.load() || store_.getTime() != end.time) {
+        throw std::runtime_error("cannot load replica files");
+      }
+      generation_ = bootstrapGeneration_;
+      pos_ = end;
+      lock.unlock();
+      cv_.notify_all();
+      ackDue_ = true;
+    } else {
+      throw std::runtime_error("unexpected replication message");
+    }
+  }
+
+  void closeFile() {
+    if (file_) {
+      int rc = fclose(file_);
+      file_ = nullptr;
+      if (rc != 0) {
+        throw std::runtime_error("cannot close replica file");
+      }
+    }
+  }
+
+  /**
+   * Closes the bootstrap file being received when the connection is dropped,
+   * ignoring errors: the next connection bootstraps the replica again, and
+   * `retry()` runs in completion handlers (and `stop()` in the destructor),
+   * which must not throw.
+   */
+  void discardFile() noexcept {
+    if (file_) {
+      fclose(file_);
+      file_ = nullptr;
+    }
+  }
+
+  S& store_;
+  std::string host_;
+  uint16_t port_;
+  boost::asio::io_context io_;
+  std::optional<boost::asio::executor_work_guard<
+    boost::asio::io_context::executor_type>>
+    work_{io_.get_executor()};
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::ip::tcp::resolver resolver_;
+  boost::asio::steady_timer timer_;
+  std::thread thread_;
+  char header_[logkv_detail::ReplHeaderSize];
+  std::vector<char> body_;
+  std::vector<char> outbox_;
+  std::vector<char> writeBuf_;
+  bool writing_ = false;
+  bool ackDue_ = false;
+  uint64_t connection_ = 0;
+  FILE* file_ = nullptr; // bootstrap file being received
+  uint64_t bootstrapGeneration_ = 0;
+  std::vector<char> pending_; // received bytes of an incomplete frame
+  mutable std::mutex mutex_;
+  mutable std::condition_variable cv_;
+  uint64_t generation_ = 0; // stream of the leader, 0 if not bootstrapped
+  ReplicationPosition pos_;
+};
+
+} // namespace logkv
+
+#endif
@@ -1,9 +1,12 @@
 #ifndef _LOGKV_SERIALIZATION_H_
 #define _LOGKV_SERIALIZATION_H_
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
 
 namespace logkv {
 
@@ -37,9 +40,219 @@ namespace logkv {
  * `val` is not updated, or the number of bytes consumed from `src` to read
  * (deserialize) the object into `val` (if `size` is sufficient). May throw a
  * `std::runtime_exception` if `val` is too large.
+ *
+ * A serializer may also provide a single-pass writer:
+ *
+ *  static void write_to(Sink& sink, const T& val) { ... }
+ *
+ * `write_to()` must append exactly the bytes `write()` would produce to
+ * `sink` (see `logkv::Sink`), without computing the size first. Composite
+ * serializers call `logkv::write_to()` on their members, and `logkv::Store`
+ * uses it to serialize K,V pairs into its growable frame buffer, so every
+ * object is traversed once and no exception is thrown when a buffer is full.
+ * Serializers without `write_to()` still work through `write()`.
+ *
+ * A serializer of a type whose values always take N bytes may declare it:
+ *
+ *  static constexpr size_t fixed_size = N;
+ *
+ * Composite serializers then size, write and read fixed-size members without
+ * per-member bounds checks (see `logkv::fixed_size_serializable`).
+ *
+ * A serializer whose encoding changes incompatibly may version it:
+ *
+ *  static constexpr uint32_t format_version = N;
+ *
+ * `logkv::Store` records the K and V versions in snapshot files and rejects
+ * snapshots written with other versions (0 if none was declared).
+ *
+ * A serializer of a contiguous byte string type (with `data()`, `size()` and
+ * `resize()`, and 1-byte elements) may declare it:
+ *
+ *  static constexpr bool byte_string = true;
+ *
+ * `logkv::Store` can then front-code the keys of snapshots, storing only what
+ * each key doesn't share with the previous one (see
+ * `Store::setSnapshotFrontCoding()`).
  */
 template <typename T, typename Enable = void> struct serializer;
 
+/**
+ * Byte sink for `serializer<T>::write_to()`.
+ *
+ * A fixed sink writes into a caller buffer; once a write doesn't fit there,
+ * it and all later writes are only counted, so `size()` is the required size,
+ * like the return value of `serializer<T>::write()`. A growable sink appends
+ * to a `std::vector<char>`, resizing it as needed.
+ *
+ * Subclasses can instead drain the buffer when it fills up by overriding
+ * `overflow()`; with `split_` set, `append()` then splits large writes over
+ * several buffer loads, so e.g. a huge string never needs a huge buffer.
+ */
+class Sink {
+public:
+  /**
+   * Fixed sink over `size` bytes at `dest`.
+   */
+  Sink(char* dest, size_t size) : dest_(dest), capacity_(size) {}
+
+  /**
+   * Growable sink that writes to `buf` starting at `offset`.
+   * @param limit Maximum number of contiguous bytes in the sink buffer.
+   */
+  Sink(std::vector<char>& buf, size_t offset,
+       size_t limit = static_cast<size_t>(-1))
+      : buf_(&buf), offset_(offset), limit_(limit) {
+    if (offset_ > buf.size()) {
+      buf.resize(offset_);
+    }
+    dest_ = buf.data() + offset_;
+    capacity_ = buf.size() - offset_;
+  }
+
+  virtual ~Sink() = default;
+
+  /**
+   * Get the storage for the next `n` bytes written.
+   * Callers write into it (if not null) and then call `advance(n)`.
+   * @return Pointer to `n` writable bytes, or `nullptr` if a fixed sink is
+   * out of space (the write is then only counted by `advance()`).
+   * @throws std::runtime_error if a growable sink would exceed its limit.
+   */
+  char* reserve(size_t n) {
+    if (pos_ + n > capacity_ && !overflow(n)) {
+      return nullptr;
+    }
+    return dest_ + pos_;
+  }
+
+  /**
+   * Count `n` bytes as written.
+   */
+  void advance(size_t n) { pos_ += n; }
+
+  /**
+   * Write `n` bytes from `src`.
+   */
+  void append(const void* src, size_t n) {
+    const char* p = static_cast<const char*>(src);
+    if (split_) {
+      while (pos_ + n > capacity_) {
+        const size_t k = capacity_ - pos_;
+        if (k > 0) {
+          std::memcpy(dest_ + pos_, p, k);
+        }
+        pos_ += k;
+        p += k;
+        n -= k;
+        if (!overflow(std::min(n, capacity_))) {
+          break;
+        }
+      }
+    }
+    if (n > 0) {
+      if (char* d = reserve(n)) {
+        std::memcpy(d, p, n);
+      }
+      pos_ += n;
+    }
+  }
+
+  /**
+   * @return Bytes that can be written without overflowing or growing.
+   */
+  size_t available() const { return pos_ < capacity_ ? capacity_ - pos_ : 0; }
+
+  /**
+   * @return Bytes written (or, for an overflowed fixed sink, required).
+   */
+  size_t size() const { return drained_ + pos_; }
+
+protected:
+  char* dest_;          // start of the buffered bytes
+  size_t capacity_;     // buffer size at `dest_`
+  size_t pos_ = 0;      // bytes buffered at `dest_` (or counted past it)
+  size_t drained_ = 0;  // bytes written and no longer buffered
+  bool split_ = false;  // `overflow()` drains, so appends can be split
+  std::vector<char>* buf_ = nullptr;
+  size_t offset_ = 0;   // offset of `dest_` in `*buf_`
+  size_t limit_ = 0;
+
+  /**
+   * Called when the next `n` bytes don't fit in the buffer.
+   * Draining sinks write out (part of) the buffer, then move the rest with
+   * `drain()`.
+   * @return `true` if `n` bytes are now available.
+   */
+  virtual bool overflow(size_t n) { return grow(pos_ + n); }
+
+  /**
+   * Grows the buffer of a growable sink to hold `needed` bytes at `dest_`.
+   * @return `false` for a fixed sink.
+   */
+  bool grow(size_t needed) {
+    if (!buf_) {
+      return false;
+    }
+    if (needed > limit_) {
+      throw std::runtime_error("serialized object too large");
+    }
+    const size_t target = std::max(buf_->size() * 2, offset_ + needed);
+    buf_->resize(target);
+    dest_ = buf_->data() + offset_;
+    capacity_ = buf_->size() - offset_;
+    return true;
+  }
+
+  /**
+   * Drops the first `n` buffered bytes, which were written out, and moves
+   * the buffer to `offset` in `*buf_`.
+   */
+  void drain(size_t n, size_t offset) {
+    char* dest = buf_->data() + offset;
+    if (n < pos_) {
+      std::memmove(dest, dest_ + n, pos_ - n);
+    }
+    drained_ += n;
+    pos_ -= n;
+    offset_ = offset;
+    dest_ = dest;
+    capacity_ = buf_->size() - offset;
+  }
+};
+
+/**
+ * Serializes `val` into `sink`, using `serializer<T>::write_to()` if T's
+ * serializer provides it, or else `serializer<T>::write()`.
+ */
+template <typename T> void write_to(Sink& sink, const T& val) {
+  if constexpr (requires { serializer<T>::write_to(sink, val); }) {
+    serializer<T>::write_to(sink, val);
+  } else {
+    size_t avail = sink.available();
+    char* dest = sink.reserve(0);
+    size_t n = dest ? serializer<T>::write(dest, avail, val)
+                    : serializer<T>::get_size(val);
+    if (dest && n > avail) {
+      dest = sink.reserve(n);
+      if (dest) {
+        serializer<T>::write(dest, n, val);
+      }
+    }
+    sink.advance(n);
+  }
+}
+
+/**
+ * Implements `serializer<T>::write()` with `serializer<T>::write_to()`.
+ */
+template <typename T>
+size_t write_with_sink(char* dest, size_t size, const T& val) {
+  Sink sink(dest, size);
+  serializer<T>::write_to(sink, val);
+  return sink.size();
+}
+
 #define LOGKV_IS_EMPTY(val)                                                    \
   logkv::serializer<std::decay_t<decltype(val)>>::is_empty(val)
 
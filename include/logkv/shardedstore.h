@@ -0,0 +1,253 @@
+#ifndef _LOGKV_SHARDEDSTORE_H_
+#define _LOGKV_SHARDEDSTORE_H_
+
+#include <logkv/store.h>
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace logkv {
+
+/**
+ * `logkv::ShardedStore` partitions a K,V store into `N` independent
+ * `logkv::Store` shards by key hash, so that writers on different cores
+ * contend only when they hit the same shard.
+ *
+ * Each shard has its own subdirectory (`dir/shardI`), map, I/O buffer,
+ * events file and mutex; `update()`, `erase()`, `get()` and `withShard()`
+ * lock only the key's shard, and `flush()`, `save()` and `load()` run on all
+ * shards in parallel. Each shard is saved and loaded independently, so there
+ * is no snapshot or atomicity across shards.
+ *
+ * NOTE: Keys are assigned to shards with `Hash` and `N`, which must therefore
+ * be stable across runs: reopening a directory with a different `N` (or a
+ * hash function that isn't deterministic across processes) loses keys.
+ * Configuration methods of the shard stores (see `shard()`) must not be
+ * called concurrently with other methods.
+ */
+template <template <typename...> class M, typename K, typename V, size_t N,
+          typename Hash = std::hash<K>>
+class ShardedStore {
+  static_assert(N > 0, "ShardedStore needs at least one shard");
+
+public:
+  using store_type = Store<M, K, V>;
+  using map_type = typename store_type::map_type;
+  using key_type = K;
+  using mapped_type = V;
+
+  /**
+   * Construct a sharded store that will operate in the given data directory.
+   * Shard stores are created with the same flags and loaded in parallel
+   * (unless `StoreFlags::deferLoad` is given; then call `load()`).
+   * @param dir Backing data directory for the store.
+   * @param flags Store options (see `logkv::StoreFlags` enum).
+   * @param bufferSize Initial size of each shard's I/O buffer.
+   * @throws std::runtime_error if the directory has more shards than `N`.
+   */
+  ShardedStore(const std::string& dir, int flags = StoreFlags::none,
+               size_t bufferSize = store_type::DefaultBufferSize)
+      : dir_(dir) {
+    if ((flags & StoreFlags::createDir) && !std::filesystem::exists(dir)) {
+      std::filesystem::create_directories(dir);
+    }
+    if (!std::filesystem::is_directory(dir)) {
+      throw std::runtime_error("directory not found");
+    }
+    if (std::filesystem::exists(shardPath(N))) {
+      throw std::runtime_error("sharded store directory has more shards");
+    }
+    for (size_t i = 0; i < N; ++i) {
+      shards_[i].store = std::make_unique<store_type>(
+        shardPath(i).string(), flags | StoreFlags::deferLoad, bufferSize);
+    }
+    if (!(flags & StoreFlags::deferLoad)) {
+      forEachShard([](size_t, store_type& s) {
+        if (!s.isLoaded()) {
+          s.load();
+        }
+      });
+    }
+  }
+
+  /**
+   * Get the number of shards.
+   * @return `N`.
+   */
+  static constexpr size_t shardCount() { return N; }
+
+  /**
+   * Get the shard that stores a key.
+   * @param key Key.
+   * @return Shard index in [0, N).
+   */
+  static size_t shardIndex(const key_type& key) {
+    // Mix the hash before reducing it, so that the keys of a shard don't all
+    // share the low hash bits that hashed maps use to pick buckets.
+    uint64_t h = static_cast<uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>((h >> 32) % N);
+  }
+
+  /**
+   * Get a shard store, e.g. to configure it.
+   * Not synchronized; see `withShard()` to access a shard concurrently.
+   * @param i Shard index.
+   * @return Reference to the shard store.
+   */
+  store_type& shard(size_t i) { return *shards_.at(i).store; }
+
+  /**
+   * Get the data directory.
+   * @return The data directory.
+   */
+  std::string getDirectory() const { return dir_; }
+
+  /**
+   * Update a K,V mapping in the key's shard, writing an event to its log.
+   * @param key Key to set
+   * @param value Value to associate with the given key
+   * @return Sequence number of the written event in the shard's log.
+   */
+  uint64_t update(const key_type& key, const mapped_type& value) {
+    auto& s = shards_[shardIndex(key)];
+    std::lock_guard lock(s.mutex);
+    return s.store->update(key, value);
+  }
+
+  /**
+   * Erase a K,V mapping in the key's shard, writing an event to its log.
+   * @param key Key to erase
+   * @return Sequence number of the last written event in the shard's log.
+   */
+  uint64_t erase(const key_type& key) {
+    auto& s = shards_[shardIndex(key)];
+    std::lock_guard lock(s.mutex);
+    return s.store->erase(key);
+  }
+
+  /**
+   * Get a copy of the value mapped to a key.
+   * @param key Key to look up
+   * @return The value, or `std::nullopt` if the key is absent.
+   */
+  std::optional<mapped_type> get(const key_type& key) {
+    auto& s = shards_[shardIndex(key)];
+    std::lock_guard lock(s.mutex);
+    auto it = s.store->find(key);
+    if (it == s.store->end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  /**
+   * Call `f(store)` with the key's shard store locked, e.g. to modify a value
+   * in place and `persist()` it.
+   * @param key Key that selects the shard.
+   * @param f Callable taking a `store_type&`.
+   * @return The result of `f`.
+   */
+  template <typename F> decltype(auto) withShard(const key_type& key, F&& f) {
+    auto& s = shards_[shardIndex(key)];
+    std::lock_guard lock(s.mutex);
+    return std::forward<F>(f)(*s.store);
+  }
+
+  /**
+   * Get the number of K,V entries in all shards.
+   * @return Entry count.
+   */
+  size_t size() {
+    size_t total = 0;
+    for (auto& s : shards_) {
+      std::lock_guard lock(s.mutex);
+      total += s.store->getObjects().size();
+    }
+    return total;
+  }
+
+  /**
+   * Flush the buffered writes of all shards in parallel.
+   * @param sync `true` to commit to disk, `false` otherwise.
+   */
+  void flush(bool sync = false) {
+    forEachShard([sync](size_t, store_type& s) { s.flush(sync); });
+  }
+
+  /**
+   * Save every shard in parallel (see `Store::save()`).
+   * @param mode Save mode (see `logkv::StoreSaveMode` enum).
+   * @throws std::exception if saving any shard failed (the other shards are
+   * still saved).
+   */
+  void save(int mode = StoreSaveMode::syncSave) {
+    forEachShard([mode](size_t, store_type& s) { s.save(mode); });
+  }
+
+  /**
+   * Load every shard in parallel (see `Store::load()`).
+   * @return `false` if the latest events file of any shard was corrupted.
+   * @throws std::exception if loading any shard failed.
+   */
+  bool load() {
+    std::array<char, N> oks{};
+    forEachShard([&oks](size_t i, store_type& s) { oks[i] = s.load(); });
+    return std::find(oks.begin(), oks.end(), 0) == oks.end();
+  }
+
+private:
+  struct Shard {
+    std::unique_ptr<store_type> store;
+    std::mutex mutex;
+  };
+
+  std::string dir_;
+  std::array<Shard, N> shards_;
+
+  std::filesystem::path shardPath(size_t i) const {
+    return std::filesystem::path(dir_) / ("shard" + std::to_string(i));
+  }
+
+  /**
+   * Calls `f(i, store)` for every shard, each on its own thread with the
+   * shard locked, and rethrows the first error after all of them finished.
+   */
+  template <typename F> void forEachShard(F&& f) {
+    std::array<std::exception_ptr, N> errors;
+    auto run = [&](size_t i) {
+      try {
+        std::lock_guard lock(shards_[i].mutex);
+        f(i, *shards_[i].store);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(N - 1);
+    for (size_t i = 1; i < N; ++i) {
+      workers.emplace_back(run, i);
+    }
+    run(0);
+    for (auto& w : workers) {
+      w.join();
+    }
+    for (const auto& e : errors) {
+      if (e) {
+        std::rethrow_exception(e);
+      }
+    }
+  }
+};
+
+} // namespace logkv
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef _LOGKV_STATS_H_
+#define _LOGKV_STATS_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace logkv {
+
+using StatsClock = std::chrono::steady_clock;
+
+/**
+ * @return Nanoseconds elapsed since `start`.
+ */
+inline uint64_t elapsedNanos(StatsClock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           StatsClock::now() - start)
+    .count();
+}
+
+/**
+ * Latency histogram with power-of-two nanosecond buckets: bucket 0 counts
+ * samples of 0-1ns and bucket i > 0 counts samples in [2^i, 2^(i+1)) ns.
+ * Samples are recorded with relaxed atomics, so any number of threads can
+ * record and read concurrently; reads are not a consistent snapshot.
+ */
+class LatencyHistogram {
+public:
+  static constexpr size_t Buckets = 64;
+
+  void record(uint64_t nanos) {
+    buckets_[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (nanos > max && !max_.compare_exchange_weak(
+                            max, nanos, std::memory_order_relaxed)) {
+    }
+  }
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+  /**
+   * @return Sum of all samples in nanoseconds.
+   */
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  /**
+   * @return Largest sample in nanoseconds.
+   */
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  uint64_t bucketCount(size_t i) const {
+    return buckets_[i].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @return Exclusive upper bound in nanoseconds of the samples in bucket `i`
+   * (e.g. the `le` label of a Prometheus histogram bucket, minus one).
+   */
+  static uint64_t bucketUpperBound(size_t i) {
+    return i + 1 < Buckets ? uint64_t(2) << i : UINT64_MAX;
+  }
+
+  /**
+   * Estimate a percentile.
+   * @param q Quantile in [0, 1] (e.g. 0.99).
+   * @return Upper bound in nanoseconds of the bucket holding the `q` quantile,
+   * capped by `max()`, or 0 if there are no samples.
+   */
+  uint64_t percentile(double q) const {
+    uint64_t total = 0;
+    for (const auto& b : buckets_) {
+      total += b.load(std::memory_order_relaxed);
+    }
+    if (!total) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * total);
+    rank = std::max<uint64_t>(1, std::min(rank, total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Buckets; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        return std::min(bucketUpperBound(i), max());
+      }
+    }
+    return max();
+  }
+
+  void reset() {
+    for (auto& b : buckets_) {
+      b.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  static size_t bucketOf(uint64_t nanos) {
+    return nanos < 2 ? 0 : std::bit_width(nanos) - 1;
+  }
+
+  std::array<std::atomic<uint64_t>, Buckets> buckets_{};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> sum_ = 0;
+  std::atomic<uint64_t> max_ = 0;
+};
+
+/**
+ * Counters and latency histograms of a `logkv::Store`, enabled with
+ * `Store::setStats()`. A stats object can be shared by several stores (e.g.
+ * the shards of a `logkv::ShardedStore`) and read from any thread while they
+ * run; all fields are relaxed atomics.
+ * NOTE: Snapshots written by a `StoreSaveMode::forkSave` child process are
+ * not counted.
+ */
+struct StoreStats {
+  std::atomic<uint64_t> frames = 0;           // frames written (any file)
+  std::atomic<uint64_t> frameBytes = 0;       // header plus payload bytes
+  std::atomic<uint64_t> crc16Frames = 0;      // frames protected by CRC16
+  std::atomic<uint64_t> crc32Frames = 0;      // frames protected by CRC32
+  std::atomic<uint64_t> compressedFrames = 0; // frames written compressed
+  std::atomic<uint64_t> chainSegments = 0;    // frame chain segments written
+  std::atomic<uint64_t> syncs = 0;            // file fsyncs
+  std::atomic<uint64_t> bufferResizes = 0;    // buffer grown to fit a frame
+  std::atomic<uint64_t> snapshots = 0;        // full snapshots written
+  std::atomic<uint64_t> deltaSnapshots = 0;   // delta snapshots written
+  std::atomic<uint64_t> replayedFiles = 0;    // files replayed
+  std::atomic<uint64_t> corruptedFiles = 0;   // corrupted events files
+  std::atomic<uint64_t> deletedFiles = 0;     // obsolete files deleted
+  std::atomic<uint64_t> eventsSegments = 0;   // events segments rotated
+  std::atomic<uint64_t> scheduledSaves = 0;   // saves started by the policy
+  std::atomic<uint64_t> saveStalls = 0;       // writers that waited for one
+
+  LatencyHistogram writeFrame;    // frame compress, encode and write
+  LatencyHistogram syncFlush;     // fsyncs of events and snapshot files
+  LatencyHistogram writeSnapshot; // snapshot or delta snapshot writes
+  LatencyHistogram replay;        // replay of a single file
+  LatencyHistogram deleteOld;     // `deleteOldSnapshotsAndEvents()` passes
+
+  void reset() {
+    for (auto* c : {&frames, &frameBytes, &crc16Frames, &crc32Frames,
+                    &compressedFrames, &chainSegments, &syncs, &bufferResizes,
+                    &snapshots, &deltaSnapshots, &replayedFiles,
+                    &corruptedFiles, &deletedFiles, &eventsSegments,
+                    &scheduledSaves, &saveStalls}) {
+      c->store(0, std::memory_order_relaxed);
+    }
+    for (auto* h : {&writeFrame, &syncFlush, &writeSnapshot, &replay,
+                    &deleteOld}) {
+      h->reset();
+    }
+  }
+};
+
+/**
+ * Callbacks of a `logkv::Store`, set with `Store::setObserver()`. Override
+ * the ones of interest. Callbacks run on the thread doing the work, which can
+ * be a background save thread, so they must be thread-safe and must not call
+ * back into the store. Events file callbacks run with the store locked (see
+ * `Store::setGroupCommit()`), in the order of the events.
+ */
+class StoreObserver {
+public:
+  virtual ~StoreObserver() = default;
+
+  /**
+   * A snapshot (or a delta snapshot, if `delta`) numbered `snapshotTime`
+   * is about to be written. Not called for `StoreSaveMode::forkSave`.
+   */
+  virtual void onSnapshotStart(uint64_t /*snapshotTime*/, bool /*delta*/) {}
+
+  /**
+   * The snapshot write that `onSnapshotStart()` announced is done.
+   * @param nanos Duration of the write.
+   * @param ok `false` if it failed (the error is thrown after the call).
+   */
+  virtual void onSnapshotFinish(uint64_t /*snapshotTime*/, bool /*delta*/,
+                                uint64_t /*nanos*/, bool /*ok*/) {}
+
+  /**
+   * `load()` found a corrupted events file and will delete it.
+   */
+  virtual void onCorruptedEvents(const std::filesystem::path& /*path*/) {}
+
+  /**
+   * The store opened events file `time` to append to it at `offset` (its
+   * size). `reset` is `true` if the map was loaded or cleared (`load()`,
+   * `clear()`) rather than derived from the events logged before.
+   */
+  virtual void onEventsFile(uint64_t /*time*/, uint64_t /*offset*/,
+                            bool /*reset*/) {}
+
+  /**
+   * A frame or frame chain segment, `header` followed by `payload`, was
+   * written to events file `time` at `offset` (counted across its segments,
+   * see `Store::setEventsSegmentSize()`). Pending events are sealed
+   * into a frame before `save()` switches events files, so the frames of
+   * consecutive events files replay to the state of the map, as long as
+   * all changes to the map are logged.
+   */
+  virtual void onEventsFrame(uint64_t /*time*/, uint64_t /*offset*/,
+                             const char* /*header*/, size_t /*headerSize*/,
+                             const char* /*payload*/,
+                             size_t /*payloadSize*/) {}
+
+  /**
+   * The frames written to events file `time` up to `offset` were handed to
+   * the OS, so reading the file returns them (rather than, e.g., the zeros
+   * of a preallocated segment). Frames are flushed as they are written,
+   * except with group commit or asynchronous writes (see `Store::flush()`).
+   */
+  virtual void onEventsFlushed(uint64_t /*time*/, uint64_t /*offset*/) {}
+};
+
+} // namespace logkv
+
+#endif
@@ -2,31 +2,37 @@
 #define _LOGKV_STORE_H_
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <thread>
 #include <vector>
 
-#if defined(_WIN32) || defined(_WIN64)
-#define LOGKV_WINDOWS 1
-#else
-#define LOGKV_WINDOWS 0
-#endif
+#include <logkv/autoser/bytes.h>
+#include <logkv/compress.h>
+#include <logkv/crc.h>
+#include <logkv/file.h>
+#include <logkv/stats.h>
 
 #if LOGKV_WINDOWS
-#include <io.h>
 #include <process.h>
-#include <stdio.h>
 #else
 #include <sys/wait.h>
-#include <unistd.h>
 #endif
 
-#include <logkv/autoser/bytes.h>
-#include <logkv/crc.h>
-
 #define IF_CONSTEXPR_REQUIRES_EXPR_EXPR(expr)                                  \
   if constexpr (requires { expr; }) {                                          \
     expr;                                                                      \
@@ -49,10 +55,60 @@ enum StoreFlags {
  */
 enum StoreSaveMode {
   asyncClear = 0, // Write snapshot synchronously but clean up old files
-                  // asynchronously (detached threads).
+                  // asynchronously (in a background thread).
   syncSave = 1,   // Fully serial (synchronous) mode.
-  forkSave = 2    // Fork the process to write new snapshot and clean up old
-                  // files afterwards. If no POSIX, reverts to `threaded`.
+  forkSave = 2,   // Fork the process to write new snapshot and clean up old
+                  // files afterwards; a background thread reaps the child.
+                  // If no POSIX, reverts to `threaded`.
+  backgroundSave = 3, // Write the snapshot of an O(1) copy of the map (see
+                      // `M::snapshot()`, e.g. `logkv::PersistentMap`) and
+                      // clean up old files in a background thread while
+                      // updates continue. If no `M::snapshot()`, reverts to
+                      // `asyncClear`.
+  deltaSave = 4       // Write a delta snapshot of the keys changed since the
+                      // last snapshot (see `setMaxDeltaSnapshots()`). Reverts
+                      // to `syncSave` when a full snapshot is due.
+};
+
+/**
+ * Store file write mode (`logkv::FileWriter` backend).
+ */
+enum StoreWriteMode {
+  stdioWrite = 0, // Buffered stdio writes (portable default).
+  uringWrite = 1  // Linux io_uring writes from aligned O_DIRECT buffers, up
+                  // to several frames in flight. If unavailable, reverts to
+                  // `stdioWrite`.
+};
+
+/**
+ * Metadata of a snapshot or delta snapshot file, recorded in its header and
+ * footer (see `Store::readSnapshotInfo()`).
+ */
+struct SnapshotInfo {
+  uint32_t version = 0;      // snapshot format version
+  uint64_t entries = 0;      // K,V entries (expected ones, in the header)
+  uint64_t payloadBytes = 0; // uncompressed frame payload bytes
+  uint32_t maxFrameSize = 0; // largest uncompressed frame payload
+  uint32_t keyVersion = 0;   // `serializer<K>::format_version`, or 0
+  uint32_t valueVersion = 0; // `serializer<V>::format_version`, or 0
+  uint32_t keyRestart = 0;   // front-coded keys restart interval, or 0
+};
+
+/**
+ * When `logkv::Store` saves on its own (see `Store::setSnapshotPolicy()`).
+ * A save is due once any enabled trigger fires; triggers count the events
+ * logged since the last snapshot, delta snapshot or compaction.
+ */
+struct SnapshotPolicy {
+  uint64_t eventsBytes = 0; // events log size that triggers a save, or 0
+  double replayRatio = 0;   // events log size, relative to the size of the
+                            // last full snapshot, that triggers a save, or 0
+  std::chrono::milliseconds interval{0}; // age of the oldest event not
+                                         // saved that triggers a save, or 0
+  uint64_t minEventsBytes = 0; // events log size below which none trigger
+  uint64_t stallBytes = 0; // events log size at which writers wait for a
+                           // running save to start the next one, or 0
+  int mode = StoreSaveMode::backgroundSave; // see `logkv::StoreSaveMode`
 };
 
 /**
@@ -64,19 +120,53 @@ enum StoreSaveMode {
  * There is built-in serialization for several types; see `logkv/autoser.h`.
  *
  * When implementing a custom serializer, `logkv::Store` will notify the
- * serializer of snapshot events via `_logkvStoreSnapshot(bool)`; see
- * `logkv/partial.h` for a concrete example.
+ * serializer of snapshot events via `_logkvStoreSnapshot(bool)`, and, in
+ * `update()`, of the value being replaced via `_logkvStoreBase(const V*)`;
+ * see `logkv/partial.h` for a concrete example.
  *
  * NOTE: An absent key K is equivalent to a key K mapped to an empty value V.
  * `update()` keeps K,V mappings with an empty value V, but keys K with an empty
  * value V are _not_ stored in snapshots (`save()`).
  *
  * NOTE: To guarantee that a sequence of updates will be applied atomically,
- * they must all be written within the same frame (buffer flush cycle). There's
- * no transactional API to guarantee that, but `getBufferWriteRemaining()` plus
- * application knowledge of the serialization overhead of its own objects can be
- * used to decide when to `flush()` to start a new frame and guarantee the
- * following object writes will end up on the same frame and thus be atomic.
+ * they must all be written within the same frame (buffer flush cycle). Collect
+ * them in a `Store::WriteBatch` and `write()` it to get that guarantee.
+ *
+ * NOTE: `Store` is single-threaded by default. `setGroupCommit(true)` starts a
+ * background flusher thread and makes the event-writing methods (`update()`,
+ * `erase()`, `persist()`, `flush()`, `save()`, `load()`) safe to call from
+ * multiple threads. Each logged event gets a sequence number that can be passed
+ * to `waitDurable()`, or to `asyncWaitDurable()` to be called back instead of
+ * blocking; the flusher seals the current frame and issues a single fsync for
+ * all pending waiters. Direct access to the K,V map still requires
+ * external synchronization.
+ *
+ * NOTE: With a map type that has an O(1) `snapshot()` (e.g.
+ * `logkv::PersistentMap`), `setConcurrentReads(true)` lets any number of
+ * threads read through `Store::Reader` without locking, while the writer
+ * keeps using the store.
+ *
+ * NOTE: `setStats()` enables counters and latency histograms of frame writes,
+ * fsyncs, snapshots, replays and file deletions, and `setObserver()` sets
+ * callbacks on snapshot writes and corrupted events files; see
+ * `logkv/stats.h`. Both are disabled by default.
+ *
+ * NOTE: Snapshot and delta snapshot files start with a header and end with a
+ * footer that record their entry count, payload size, largest frame and
+ * format version (see `logkv::SnapshotInfo`), which `load()` uses to reserve
+ * the map and size the buffer up front. A file with a header but no footer
+ * is incomplete. Files written by older versions have neither and still
+ * load. A serializer can declare `static constexpr uint32_t format_version`
+ * (see `logkv/serializer.h`); snapshots written with a different version of
+ * the K or V serializer are rejected as corrupted.
+ *
+ * NOTE: `setSnapshotPolicy()` makes the store save on its own, by events log
+ * size, replay cost or time, one save at a time; `getSaveFuture()` tracks
+ * the completion of saves, including their background work.
+ *
+ * NOTE: `setEventsSegmentSize()` splits the events log of each snapshot into
+ * preallocated segments (`NNNN.events`, `NNNN.events.1`, ...) that are
+ * rotated as they fill up and replayed in order by `load()`.
  */
 template <template <typename...> class M, typename K, typename V> class Store {
 public:
@@ -93,7 +183,9 @@ public:
   static constexpr size_t DefaultBufferSize = 1 << 19;
 
   /**
-   * Maximum size of a single object, frame, and internal buffer (512MB).
+   * Maximum size of a frame and of the internal buffer (512MB), and so of a
+   * single object unless frame chaining is enabled (see
+   * `setFrameChaining()`).
    */
   static constexpr size_t MaxBufferSize = 1 << 29;
 
@@ -107,6 +199,12 @@ public:
    */
   static constexpr size_t MinCRC32PayloadSize = 512;
 
+  /**
+   * Default minimum payload size in bytes of frames compressed when
+   * compression is enabled with `setCompression()`.
+   */
+  static constexpr size_t DefaultCompressionThreshold = 4096;
+
   /**
    * Constuct a Store that will operate in the given data directory.
    * If `StoreFlags::deferLoad` is specified without specifying both
@@ -118,7 +216,7 @@ public:
    */
   Store(const std::string& dir, int flags = StoreFlags::none,
         size_t bufferSize = DefaultBufferSize)
-      : flags_(flags), buffer_(bufferSize) {
+      : flags_(flags), buffer_(bufferSize), bufferSize_(bufferSize) {
     if (!logkv::serializer<mapped_type>::is_empty(emptyValue_)) {
       throw std::runtime_error(
         std::string("detected a non-empty default-constructed value for a "
@@ -135,8 +233,14 @@ public:
    * before the store object is destroyed to persist buffered events.
    */
   virtual ~Store() {
+    joinSave();
+    setGroupCommit(false);
     if (events_) {
-      closeFile(events_);
+      events_->close();
+    }
+    delete readView_.load();
+    for (const map_type* view : retiredViews_) {
+      delete view;
     }
   }
 
@@ -144,7 +248,7 @@ public:
    * Get internal buffer size.
    * @return Buffer size.
    */
-  size_t getBufferSize() const { return buffer_.size(); }
+  size_t getBufferSize() const { return buffer_.data.size(); }
 
   /**
    * Resizes internal buffer.
@@ -154,39 +258,43 @@ public:
     if (!size || size > MaxBufferSize) {
       throw std::runtime_error("invalid buffer size");
     }
-    if (writeOffset_ > 0) {
+    auto lock = lockGroupCommit();
+    if (buffer_.writeOffset > 0) {
       if (!events_) {
         throw std::runtime_error("event file handle is null");
       }
-      writeFrame(events_);
+      writeFrame(events_.get());
     }
-    buffer_.resize(size);
+    buffer_.data.resize(size);
+    bufferSize_ = size;
   }
 
   /**
    * Get internal buffer read offset.
    * @return Buffer read offset.
    */
-  size_t getBufferReadOffset() const { return readOffset_; }
+  size_t getBufferReadOffset() const { return buffer_.readOffset; }
 
   /**
    * Get internal buffer write offset.
    * @return Buffer write offset.
    */
-  size_t getBufferWriteOffset() const { return writeOffset_; }
+  size_t getBufferWriteOffset() const { return buffer_.writeOffset; }
 
   /**
    * Get remaining read capacity.
    * @return Remaining readable bytes in the buffer.
    */
-  size_t getBufferReadRemaining() const { return writeOffset_ - readOffset_; }
+  size_t getBufferReadRemaining() const {
+    return buffer_.writeOffset - buffer_.readOffset;
+  }
 
   /**
    * Get remaining write capacity.
    * @return Remaining buffer space to write before it will auto-flush.
    */
   size_t getBufferWriteRemaining() const {
-    return buffer_.size() - writeOffset_;
+    return buffer_.data.size() - buffer_.writeOffset;
   }
 
   /**
@@ -194,7 +302,274 @@ public:
    * @param force If true, all frames will use CRC32 regardless of size.
    * If false (default), CRC16 is used for frames smaller than 512 bytes.
    */
-  void setForceCRC32(bool force) { forceCRC32_ = force; }
+  void setForceCRC32(bool force) {
+    joinSave();
+    forceCRC32_ = force;
+  }
+
+  /**
+   * Compress frames whose payload is at least `threshold` bytes when writing
+   * events and snapshot files; frames that don't shrink are written as is.
+   * A compressed frame has a codec prefix before a regular frame header, and
+   * its CRC covers the compressed bytes, so corruption is detected before
+   * decompressing. Files without compressed frames keep the original format.
+   * @param codec Codec (see `logkv::CompressionCodec` enum).
+   * @param threshold Minimum payload size to compress.
+   * @throws std::runtime_error if the codec is not supported by this build.
+   */
+  void setCompression(int codec,
+                      size_t threshold = DefaultCompressionThreshold) {
+    if (!logkv::isCompressionSupported(codec)) {
+      throw std::runtime_error("unsupported compression codec");
+    }
+    joinSave();
+    auto lock = lockGroupCommit();
+    compression_ = codec;
+    compressionThreshold_ = threshold;
+  }
+
+  /**
+   * Get the frame compression codec.
+   * @return Codec (see `logkv::CompressionCodec` enum).
+   */
+  int getCompression() const { return compression_; }
+
+  /**
+   * Get the minimum payload size of compressed frames.
+   * @return Threshold in bytes.
+   */
+  size_t getCompressionThreshold() const { return compressionThreshold_; }
+
+  /**
+   * Configure how objects larger than the internal buffer are written.
+   * When enabled (default), a K,V pair that doesn't fit in the buffer is
+   * streamed as a chain of buffer-sized frames, each with its own CRC, and
+   * reassembled when read, so the buffer keeps its configured size. When
+   * disabled, the buffer grows (up to `MaxBufferSize`) to write the pair as
+   * a single frame, which older versions can read.
+   * @param enable `true` to chain frames, `false` to grow the buffer.
+   */
+  void setFrameChaining(bool enable) {
+    joinSave();
+    auto lock = lockGroupCommit();
+    frameChaining_ = enable;
+  }
+
+  /**
+   * Get frame chaining mode.
+   * @return `true` if large objects are written as frame chains.
+   */
+  bool isFrameChaining() const { return frameChaining_; }
+
+  /**
+   * Configure whether `load()` replays files through memory mappings.
+   * When enabled, snapshot and events files are mapped (`mmap()` with
+   * `MADV_SEQUENTIAL`, or `MapViewOfFile()` on Windows) and frames are
+   * verified and deserialized directly from the mapped bytes instead of being
+   * read and copied into the internal buffer. Files that cannot be mapped are
+   * read through stdio as usual. Stores of `logkv::Lazy<V>` values always
+   * replay mapped files, which the values keep referencing.
+   * @param mapped `true` to replay mapped files, `false` (default) for stdio.
+   */
+  void setMappedReplay(bool mapped) {
+    joinSave(); // `compact()` replays on the save thread
+    mappedReplay_ = mapped;
+  }
+
+  /**
+   * Get mapped replay mode.
+   * @return `true` if `load()` replays memory-mapped files.
+   */
+  bool isMappedReplay() const { return mappedReplay_; }
+
+  /**
+   * Set the backend used to write events and snapshot files.
+   * With `StoreWriteMode::uringWrite`, sealed frames are written
+   * asynchronously and are only waited on by `flush()`, `save()` and group
+   * commit syncs, instead of being handed to the OS as each frame is sealed.
+   * An open events file is synced and reopened with the new backend.
+   * @param mode Write mode (see `logkv::StoreWriteMode` enum).
+   */
+  void setWriteMode(int mode) {
+    joinSave();
+    auto lock = lockGroupCommit();
+    if (mode == writeMode_) {
+      return;
+    }
+    writeMode_ = mode;
+    if (events_) {
+      closeEventsFile();
+      openEventsFile();
+    }
+  }
+
+  /**
+   * Get the file write mode.
+   * @return Write mode (see `logkv::StoreWriteMode` enum).
+   */
+  int getWriteMode() const { return writeMode_; }
+
+  /**
+   * Configure pipelined replay for `load()`.
+   * With `workers > 0`, each replayed file is processed in three stages: an
+   * I/O thread splits the file into frames, `workers` threads verify frame
+   * checksums and deserialize them into K,V batches, and the loading thread
+   * applies the batches to the map in file order (last write wins).
+   * Requires `serializer<V>::read()` to fully overwrite the value it reads
+   * into; events for partial-serializable value types (which patch values
+   * in place) are always replayed serially.
+   * @param workers Number of decoder threads (default: 0, serial replay).
+   */
+  void setReplayWorkers(size_t workers) {
+    joinSave(); // `compact()` replays on the save thread
+    replayWorkers_ = workers;
+  }
+
+  /**
+   * Get the number of pipelined replay decoder threads.
+   * @return Decoder thread count (0 means serial replay).
+   */
+  size_t getReplayWorkers() const { return replayWorkers_; }
+
+  /**
+   * Set the number of snapshot shard files written by `save()`.
+   * With more than one shard, the map is split into contiguous ranges that are
+   * serialized in parallel, each by its own thread into its own file. Shard 0
+   * is `NNNN.snapshot` and is renamed into place last, after all the other
+   * `NNNN.snapshot.S` shards, so the latest complete snapshot still wins.
+   * `load()` detects shard files and replays them in parallel regardless of
+   * this setting.
+   * @param shards Number of snapshot shards (default: 1, no sharding).
+   */
+  void setSnapshotShards(size_t shards) {
+    if (!shards) {
+      throw std::runtime_error("invalid snapshot shard count");
+    }
+    joinSave();
+    snapshotShards_ = shards;
+  }
+
+  /**
+   * Get the number of snapshot shard files written by `save()`.
+   * @return Snapshot shard count.
+   */
+  size_t getSnapshotShards() const { return snapshotShards_; }
+
+  /**
+   * Front-code the keys of snapshot and delta snapshot files: each key is
+   * stored as the length of the prefix it shares with the previous key plus
+   * the rest of its bytes, which shrinks snapshots of ordered maps (e.g.
+   * `std::map`) whose keys share long prefixes, such as paths. Every
+   * `restartInterval` keys, and the first key of every frame, are stored in
+   * full, so frames still decode independently (see `setReplayWorkers()`),
+   * and so do snapshot shards. Front-coded snapshots can't be loaded by
+   * versions that predate this setting; `load()` reads both encodings.
+   * Requires a key serializer that declares `byte_string` (see
+   * `logkv::serializer`), e.g. that of `Bytes` or `std::string`.
+   * @param restartInterval Keys per restart point (default: 0, keys are
+   * stored in full).
+   * @throws std::runtime_error if the key type can't be front-coded.
+   */
+  void setSnapshotFrontCoding(size_t restartInterval) {
+    if (restartInterval &&
+        (!frontCodableKeys ||
+         restartInterval > std::numeric_limits<uint32_t>::max())) {
+      throw std::runtime_error("invalid snapshot front coding");
+    }
+    joinSave();
+    keyRestart_ = static_cast<uint32_t>(restartInterval);
+  }
+
+  /**
+   * Get the restart interval of front-coded snapshot keys.
+   * @return Keys per restart point (0 means keys are stored in full).
+   */
+  size_t getSnapshotFrontCoding() const { return keyRestart_; }
+
+  /**
+   * Split the events log into segments of about `size` bytes: `NNNN.events`,
+   * then `NNNN.events.1`, `NNNN.events.2`, ... When a sealed frame fills the
+   * current segment, the segment is synced and closed and the log continues
+   * in the next one. Frames and frame chains never span segments, so a
+   * segment can exceed `size` by its last frame or frame chain. With
+   * `preallocate`, each new segment is preallocated to `size` bytes (see
+   * `logkv::preallocateFile()`), so appends don't change its size and fsyncs
+   * don't have to update file size metadata; closing it truncates the unused
+   * tail, and `load()` drops the zero tail left by a crash. `load()` replays
+   * the segments in order, and `save()`, `compact()` and replication handle
+   * them as one events file, whose offsets run across the segments.
+   * @param size Segment size in bytes (default: 0, a single events file).
+   * @param preallocate `true` to preallocate new segments.
+   */
+  void setEventsSegmentSize(uint64_t size, bool preallocate = true) {
+    auto lock = lockGroupCommit();
+    segmentSize_ = size;
+    preallocateSegments_ = preallocate;
+  }
+
+  /**
+   * Get the events log segment size.
+   * @return Segment size in bytes (0 means segments are disabled).
+   */
+  uint64_t getEventsSegmentSize() const { return segmentSize_; }
+
+  /**
+   * Enable delta snapshots, tracking the keys changed by `update()`, `erase()`
+   * and `persist()` (and by events replayed by `load()`).
+   * `save(StoreSaveMode::deltaSave)` then writes only those keys (erased keys
+   * as empty values) to a `NNNN.delta` file layered on the last full
+   * snapshot, and deletes the events files it supersedes. A full snapshot is
+   * written instead, folding the deltas, when there is no base snapshot to
+   * layer on, when `maxDeltas` deltas are already layered on it, or when at
+   * least half of the keys changed. `load()` applies the base snapshot, then
+   * its deltas in order, then replays the events log.
+   * NOTE: Changes made directly to the map are not tracked; call
+   * `markDirty()` for them or they'll only be persisted by a full snapshot.
+   * Enabling this after `load()` (see `StoreFlags::deferLoad`) leaves the
+   * replayed events untracked, so the next delta save writes a full snapshot.
+   * @param maxDeltas Maximum deltas per base snapshot (default: 0, disabled).
+   */
+  void setMaxDeltaSnapshots(size_t maxDeltas) {
+    auto lock = lockGroupCommit();
+    if (maxDeltas && !maxDeltas_) {
+      deltaBase_ = false; // earlier changes weren't tracked
+    }
+    maxDeltas_ = maxDeltas;
+    if (!maxDeltas_) {
+      dirty_.clear();
+    }
+  }
+
+  /**
+   * Get the maximum number of delta snapshots per full snapshot.
+   * @return Maximum delta count (0 means delta snapshots are disabled).
+   */
+  size_t getMaxDeltaSnapshots() const { return maxDeltas_; }
+
+  /**
+   * Get the number of delta snapshots layered on the last full snapshot.
+   * @return Delta snapshot count.
+   */
+  size_t getDeltaSnapshotCount() const { return deltaCount_; }
+
+  /**
+   * Get the number of keys changed since the last (full or delta) snapshot.
+   * @return Dirty key count (always 0 if delta snapshots are disabled).
+   */
+  size_t getDirtyKeyCount() const {
+    auto lock = lockGroupCommit();
+    return dirty_.size();
+  }
+
+  /**
+   * Include a key in the next delta snapshot, e.g. after modifying the map
+   * directly. Does nothing if delta snapshots are disabled.
+   * @param key Key of the changed (or erased) entry.
+   */
+  void markDirty(const key_type& key) {
+    auto lock = lockGroupCommit();
+    trackDirty(key);
+  }
 
   /**
    * Get internal time counter.
@@ -203,11 +578,200 @@ public:
   uint64_t getTime() const { return time_; }
 
   /**
-   * Get the current events file size in bytes on disk.
+   * Get the current events file size in bytes on disk, summed over its
+   * segments (see `setEventsSegmentSize()`).
    * @return Events file size in bytes.
    */
   uint64_t getEventsFileSize() const { return eventsFileSize_; }
 
+  /**
+   * Read the header and footer of a snapshot or delta snapshot file, without
+   * scanning its frames.
+   * @param path Path of the file.
+   * @return The metadata in the footer, or `std::nullopt` if the file has no
+   * header (it was written by an older version).
+   * @throws std::runtime_error if the file cannot be read, or has a header
+   * but no valid footer (it is incomplete or corrupted).
+   */
+  static std::optional<SnapshotInfo>
+  readSnapshotInfo(const std::filesystem::path& path) {
+    FILE* f = fopen(path.string().c_str(), "rb");
+    if (!f) {
+      throw std::runtime_error("cannot open snapshot file for reading");
+    }
+    std::optional<SnapshotInfo> info;
+    int rs = readSnapshotInfo(f, info);
+    fclose(f);
+    if (rs != RR_Success) {
+      throw std::runtime_error(rs == RR_Frame_Underflow
+                                 ? "incomplete snapshot"
+                                 : "corrupted snapshot");
+    }
+    return info;
+  }
+
+  /**
+   * Set the counters and latency histograms that the store updates, or
+   * disable them with `nullptr` (the default), in which case the store skips
+   * all bookkeeping, clock reads included.
+   * @param stats Stats to update (see `logkv::StoreStats`).
+   */
+  void setStats(std::shared_ptr<StoreStats> stats) {
+    waitSave();
+    auto lock = lockGroupCommit();
+    stats_ = std::move(stats);
+  }
+
+  /**
+   * Get the stats set by `setStats()`.
+   * @return Stats, or `nullptr` if disabled.
+   */
+  const std::shared_ptr<StoreStats>& getStats() const { return stats_; }
+
+  /**
+   * Set the callbacks that the store calls, or remove them with `nullptr`.
+   * The observer is told about the open events file right away.
+   * @param observer Callbacks (see `logkv::StoreObserver`).
+   */
+  void setObserver(std::shared_ptr<StoreObserver> observer) {
+    waitSave();
+    auto lock = lockGroupCommit();
+    observer_ = std::move(observer);
+    if (observer_ && events_) {
+      observer_->onEventsFile(time_, eventsFileSize_, true);
+      if (eventsFlushed_ != eventsFileSize_) {
+        observer_->onEventsFlushed(time_, eventsFlushed_);
+      }
+    }
+  }
+
+  /**
+   * Get the sequence number of the last event written to the events log.
+   * @return Write sequence number (zero if no events were written yet).
+   */
+  uint64_t getWriteSequence() const {
+    auto lock = lockGroupCommit();
+    return writeSeq_;
+  }
+
+  /**
+   * Get the sequence number of the last event known to be committed to disk.
+   * @return Durable sequence number.
+   */
+  uint64_t getDurableSequence() const {
+    auto lock = lockGroupCommit();
+    return durableSeq_;
+  }
+
+  /**
+   * Enable or disable group commit mode.
+   * When enabled, a background flusher thread serves `waitDurable()` calls by
+   * sealing the current frame and issuing one fsync that covers all events
+   * written so far, so concurrent writers waiting on durability share fsyncs.
+   * Event-writing methods are serialized by an internal mutex in this mode.
+   * Disabling it makes pending waiters durable and joins the flusher thread.
+   * The mode itself isn't switched under the mutex, so it must not be toggled
+   * while other threads are calling into the store.
+   * @param enable `true` to start the flusher thread, `false` to stop it.
+   */
+  void setGroupCommit(bool enable) {
+    if (enable == groupCommit_) {
+      return;
+    }
+    joinSave();
+    if (enable) {
+      std::unique_lock lock(mutex_);
+      stopGroupCommit_ = false;
+      groupCommitError_ = nullptr;
+      groupCommit_ = true;
+      flusher_ = std::thread([this]() { groupCommitLoop(); });
+    } else {
+      {
+        std::unique_lock lock(mutex_);
+        stopGroupCommit_ = true;
+      }
+      commitCv_.notify_all();
+      flusher_.join();
+      groupCommit_ = false;
+    }
+  }
+
+  /**
+   * Get group commit mode.
+   * @return `true` if group commit mode is enabled, `false` otherwise.
+   */
+  bool isGroupCommit() const { return groupCommit_; }
+
+  /**
+   * Block until the event with the given sequence number is committed to disk.
+   * In group commit mode, this waits for the background flusher; otherwise it
+   * calls `flush(true)` if the event isn't durable yet.
+   * @param seq Sequence number returned by `update()`, `erase()` or
+   * `persist()`, or obtained from `getWriteSequence()`.
+   * @throws std::exception if the flusher failed to write or sync the log.
+   */
+  void waitDurable(uint64_t seq) {
+    if (!groupCommit_) {
+      if (seq > durableSeq_) {
+        flush(true);
+      }
+      return;
+    }
+    std::unique_lock lock(mutex_);
+    seq = std::min<uint64_t>(seq, writeSeq_);
+    while (durableSeq_ < seq) {
+      if (groupCommitError_) {
+        std::rethrow_exception(groupCommitError_);
+      }
+      if (syncRequestSeq_ < seq) {
+        syncRequestSeq_ = seq;
+        commitCv_.notify_one();
+      }
+      durableCv_.wait(lock);
+    }
+  }
+
+  /**
+   * Call `callback` once the event with the given sequence number is
+   * committed to disk, without blocking on it. In group commit mode, the
+   * callback runs on the flusher thread after the fsync that covers the event
+   * (or right away if it's durable already), so it must be quick, must not
+   * throw and must not call into the store: e.g. post the completion to an
+   * executor, as `logkv::asyncDurable()` does. Otherwise, the events file is
+   * synced as by `waitDurable()` and the callback runs before this returns.
+   * @param seq Sequence number returned by `update()`, `erase()` or
+   * `persist()`, or obtained from `getWriteSequence()`.
+   * @param callback Called with `nullptr` once the event is durable, or with
+   * the error of the flusher if it failed to write or sync the log.
+   */
+  void asyncWaitDurable(uint64_t seq,
+                        std::function<void(std::exception_ptr)> callback) {
+    std::exception_ptr error;
+    if (groupCommit_) {
+      std::unique_lock lock(mutex_);
+      seq = std::min<uint64_t>(seq, writeSeq_);
+      if (durableSeq_ < seq && !groupCommitError_ && !stopGroupCommit_) {
+        durableWaiters_.emplace(seq, std::move(callback));
+        if (syncRequestSeq_ < seq) {
+          syncRequestSeq_ = seq;
+          commitCv_.notify_one();
+        }
+        return;
+      }
+      if (durableSeq_ < seq) {
+        error = groupCommitError_;
+      }
+    }
+    if (!error && seq > getDurableSequence()) {
+      try {
+        flush(true); // the flusher is stopping or off
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    callback(error);
+  }
+
   /**
    * Get loaded status.
    * @return `true` if `load()` was already called for the current data
@@ -230,6 +794,8 @@ public:
    * @param dir Backing data directory for the store.
    */
   void setDirectory(const std::string& dir) {
+    joinSave();
+    auto lock = lockGroupCommit();
     if (dir == dir_) {
       return;
     }
@@ -247,8 +813,13 @@ public:
             const auto& path = entry.path();
             auto ext = path.extension();
             auto stem = path.stem().string();
-            if ((ext == ".events" || ext == ".snapshot") &&
-                std::all_of(stem.begin(), stem.end(), ::isdigit)) {
+            uint64_t fileNum;
+            size_t shard;
+            if (((ext == ".events" || ext == ".snapshot" ||
+                  ext == ".delta") &&
+                 std::all_of(stem.begin(), stem.end(), ::isdigit)) ||
+                isSnapshotShard(path, fileNum, shard) ||
+                isEventsSegment(path, fileNum, shard)) {
               std::filesystem::remove(path);
             }
           }
@@ -291,6 +862,12 @@ public:
    */
   map_type& getObjects() { return objects_; }
 
+  /**
+   * Get the underlying K,V map for reading.
+   * @return Const reference to the underlying K,V map.
+   */
+  const map_type& getObjects() const { return objects_; }
+
   /**
    * Forward `operator[]` to backing K,V map for convenience.
    * @param key Key to access
@@ -301,22 +878,164 @@ public:
    * Update a K,V mapping, writing an event to the events log.
    * @param key Key to set
    * @param value Value to associate with the given key
+   * @return Sequence number of the written event.
    */
-  void update(const key_type& key, const mapped_type& value) {
-    writeUpdate(events_, key, value);
+  uint64_t update(const key_type& key, const mapped_type& value) {
+    auto lock = lockGroupCommit();
+    if constexpr (diffsUpdates) {
+      auto it = objects_.find(key);
+      writeUpdate(events_.get(), key, value,
+                  it != objects_.end() ? &it->second : &emptyValue_);
+    } else {
+      writeUpdate(events_.get(), key, value);
+    }
+    trackDirty(key);
     objects_[key] = value;
+    publishReads();
+    const uint64_t seq = writeSeq_;
+    checkSnapshotPolicy(lock);
+    return seq;
   }
 
   /**
    * Erase a K,V mapping, writing an event to the events log.
    * @param key Key to erase
+   * @return Sequence number of the last written event.
    */
-  void erase(const key_type& key) {
+  uint64_t erase(const key_type& key) {
+    auto lock = lockGroupCommit();
     auto it = objects_.find(key);
     if (it != objects_.end()) {
-      writeErase(events_, key);
+      writeErase(events_.get(), key);
+      trackDirty(key);
       objects_.erase(it);
+      publishReads();
+      const uint64_t seq = writeSeq_;
+      checkSnapshotPolicy(lock);
+      return seq;
+    }
+    return writeSeq_;
+  }
+
+  /**
+   * A sequence of updates and erases that `write()` logs within a single frame,
+   * so that replay applies either all or none of them.
+   */
+  class WriteBatch {
+  public:
+    /**
+     * Add an update of a K,V mapping to the batch.
+     * @param key Key to set
+     * @param value Value to associate with the given key
+     */
+    void update(const key_type& key, const mapped_type& value) {
+      ops_.push_back({key, value, false});
+    }
+
+    /**
+     * Add an erase of a K,V mapping to the batch.
+     * @param key Key to erase
+     */
+    void erase(const key_type& key) { ops_.push_back({key, {}, true}); }
+
+    /**
+     * @return Number of updates and erases in the batch.
+     */
+    size_t size() const { return ops_.size(); }
+
+    /**
+     * @return `true` if the batch has no updates or erases.
+     */
+    bool empty() const { return ops_.empty(); }
+
+    /**
+     * Remove all updates and erases from the batch.
+     */
+    void clear() { ops_.clear(); }
+
+  private:
+    friend class Store;
+    struct Op {
+      key_type key;
+      mapped_type value;
+      bool erase; // an update to an empty value keeps the key
+    };
+    std::vector<Op> ops_;
+  };
+
+  /**
+   * Write a batch of updates and erases to the events log within one frame
+   * and apply it to the K,V map in order. The batch size is computed with
+   * `serializer<T>::get_size()`; if it doesn't fit in the current frame, that
+   * frame is sealed first, and the buffer grows if the batch doesn't fit in it.
+   * As with `update()`, the frame reaches the file when it's sealed or flushed,
+   * except that a batch that grew the buffer is sealed right away, and the
+   * buffer shrinks back to its configured size.
+   * @param batch Batch to write.
+   * @return Sequence number of the last written event.
+   * @throws std::runtime_error if the batch doesn't fit in a frame (see
+   * `MaxBufferSize`); nothing is written or applied in that case.
+   */
+  uint64_t write(const WriteBatch& batch) {
+    auto lock = lockGroupCommit();
+    if (batch.empty()) {
+      return writeSeq_;
+    }
+    size_t total = 0;
+    for (const auto& op : batch.ops_) {
+      total += logkv::serializer<key_type>::get_size(op.key) +
+               logkv::serializer<mapped_type>::get_size(op.value);
+      if (total >= MaxBufferSize) {
+        throw std::runtime_error("write batch is too large for a frame");
+      }
+    }
+    if (total > getBufferWriteRemaining()) {
+      writeFrame(events_.get());
+      if (buffer_.data.size() < total) {
+        size_t targetSz = buffer_.data.size() * 2;
+        while (targetSz < total) {
+          targetSz *= 2;
+        }
+        buffer_.data.resize(std::min(targetSz, MaxBufferSize));
+        if (stats_) {
+          stats_->bufferResizes.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+    const size_t frameOffset = buffer_.writeOffset;
+    const uint64_t fileSize = eventsFileSize_;
+    const uint64_t seq = writeSeq_;
+    try {
+      for (const auto& op : batch.ops_) {
+        writeUpdate(events_.get(), op.key, op.value);
+      }
+      if (buffer_.writeOffset - frameOffset != total) {
+        throw std::runtime_error("write batch spans frames");
+      }
+      if (buffer_.data.size() > bufferSize_) {
+        writeFrame(events_.get());
+        buffer_.data.resize(bufferSize_);
+        buffer_.data.shrink_to_fit();
+      }
+    } catch (...) {
+      if (eventsFileSize_ == fileSize) {
+        buffer_.writeOffset = frameOffset; // not sealed yet, so drop it
+        writeSeq_ = seq;
+      }
+      throw;
+    }
+    for (const auto& op : batch.ops_) {
+      trackDirty(op.key);
+      if (op.erase) {
+        objects_.erase(op.key);
+      } else {
+        objects_[op.key] = op.value;
+      }
     }
+    publishReads();
+    const uint64_t lastSeq = writeSeq_;
+    checkSnapshotPolicy(lock);
+    return lastSeq;
   }
 
   /**
@@ -335,10 +1054,18 @@ public:
    * Update a K,V mapping, writing an event to the events log.
    * @param it Pointer to the entry to modify
    * @param value Value to write at the entry
+   * @return Sequence number of the written event.
    */
-  void update(iterator it, const mapped_type& value) {
-    writeUpdate(events_, it->first, value);
+  uint64_t update(iterator it, const mapped_type& value) {
+    auto lock = lockGroupCommit();
+    writeUpdate(events_.get(), it->first, value,
+                &value != &it->second ? &it->second : nullptr);
+    trackDirty(it->first);
     it->second = value;
+    publishReads();
+    const uint64_t seq = writeSeq_;
+    checkSnapshotPolicy(lock);
+    return seq;
   }
 
   /**
@@ -346,38 +1073,63 @@ public:
    * @param it The entry to erase.
    */
   iterator erase(iterator it) {
-    writeErase(events_, it->first);
-    return objects_.erase(it);
+    auto lock = lockGroupCommit();
+    writeErase(events_.get(), it->first);
+    trackDirty(it->first);
+    auto next = objects_.erase(it);
+    publishReads();
+    checkSnapshotPolicy(lock);
+    return next;
   }
 
   /**
    * Write an event in the events log for the given K,V entry.
    * The caller has already modified the value for the key in place.
    * @param it The entry to persist.
+   * @return Sequence number of the written event.
    */
-  void persist(iterator it) { writeUpdate(events_, it->first, it->second); }
+  uint64_t persist(iterator it) {
+    auto lock = lockGroupCommit();
+    writeUpdate(events_.get(), it->first, it->second);
+    trackDirty(it->first);
+    publishReads();
+    const uint64_t seq = writeSeq_;
+    checkSnapshotPolicy(lock);
+    return seq;
+  }
 
   /**
    * Flush any buffered writes to the events file.
    * @param sync `true` to commit to disk, `false` otherwise.
    */
-  void flush(bool sync = false) { flush(events_, sync); }
+  void flush(bool sync = false) {
+    auto lock = lockGroupCommit();
+    flush(events_.get(), sync);
+    checkSnapshotPolicy(lock);
+  }
 
   /**
    * Clear the underlying K,V map, saving an empty snapshot.
    */
   void clear() {
+    auto lock = lockGroupCommit();
     objects_.clear();
+    publishReads();
+    eventsReset_ = true;
     save(StoreSaveMode::syncSave);
   }
 
   /**
    * Load state from the store's directory, discarding any current state.
-   * Loads most recent snapshot, if any. Replays relevant event log, if any.
+   * Loads most recent snapshot, if any, and the delta snapshots layered on it.
+   * Replays relevant event log, if any.
    * @return `false` if latest events file was corrupted, `true` otherwise.
    * @throws std::runtime_error if corrupted snapshot or a filesystem error.
    */
   bool load() {
+    waitSave();
+    auto lock = lockGroupCommit();
+    waitSaveLocked();
     std::vector<std::filesystem::path> snapshots;
     for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
       if (!entry.is_regular_file()) {
@@ -400,99 +1152,173 @@ public:
       }
     }
     objects_.clear();
+    dirty_.clear();
+    deltaCount_ = 0;
+    deltaBase_ = sf != nullptr;
     if (sf) {
-      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
-      bool ok = replay(sf);
-      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(false));
+      std::vector<std::filesystem::path> shards;
+      try {
+        shards = findSnapshotShards(time_);
+      } catch (...) {
+        closeFile(sf);
+        throw;
+      }
+      bool ok;
+      if (shards.empty()) {
+        IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
+        ok = replay(sf, true);
+        IF_CONSTEXPR_REQUIRES_EXPR_EXPR(
+          mapped_type::_logkvStoreSnapshot(false));
+      } else {
+        ok = replaySnapshotShards(sf, shards);
+      }
       closeFile(sf);
       if (!ok) {
         throw std::runtime_error("corrupted snapshot");
       }
+      snapshotBytes_ = snapshotSize(time_);
     } else {
       time_ = 0;
+      snapshotBytes_ = 0;
     }
+    loadDeltaSnapshots();
+    logBytes_ = 0;
+    logStart_ = time_;
     uint64_t expectedTime = time_;
     std::vector<uint64_t> eventTimes;
     for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
       if (!entry.is_regular_file())
         continue;
       auto path = entry.path();
-      if (path.extension() != ".events")
-        continue;
       auto stem = path.stem().string();
-      if (!std::all_of(stem.begin(), stem.end(), ::isdigit))
+      uint64_t fileNum;
+      size_t segment;
+      if (path.extension() == ".events" &&
+          std::all_of(stem.begin(), stem.end(), ::isdigit)) {
+        fileNum = std::stoull(stem);
+      } else if (!isEventsSegment(path, fileNum, segment)) {
         continue;
-      uint64_t fileNum = std::stoull(stem);
+      }
       if (fileNum >= time_) {
         eventTimes.push_back(fileNum);
       }
     }
     std::sort(eventTimes.begin(), eventTimes.end());
+    eventTimes.erase(std::unique(eventTimes.begin(), eventTimes.end()),
+                     eventTimes.end());
     bool corrupted = false;
     for (uint64_t eventTime : eventTimes) {
       if (eventTime != expectedTime) {
         corrupted = true;
       }
-      auto eventsPath =
-        std::filesystem::path(dir_) / (pad(eventTime) + ".events");
-      FILE* ef = fopen(eventsPath.string().c_str(), "rb");
-      if (!ef) {
-        throw std::runtime_error("cannot open events file for reading");
-      } else {
-        bool replayOk = replay(ef);
+      auto segments = findEventsSegments(eventTime);
+      for (size_t i = 0; i < segments.size(); ++i) {
+        if (segments[i].first != i) {
+          corrupted = true; // a segment is missing
+        }
+        const auto& path = segments[i].second;
+        FILE* ef = fopen(path.string().c_str(), "rb");
+        if (!ef) {
+          throw std::runtime_error("cannot open events file for reading");
+        }
+        bool replayOk =
+          replay(ef, objects_, buffer_, false, maxDeltas_ ? &dirty_ : nullptr);
         closeFile(ef);
         if (!replayOk) {
-          std::filesystem::remove(eventsPath);
+          if (stats_) {
+            stats_->corruptedFiles.fetch_add(1, std::memory_order_relaxed);
+          }
+          if (observer_) {
+            observer_->onCorruptedEvents(path);
+          }
+          std::filesystem::remove(path);
           corrupted = true;
         } else {
+          if (buffer_.padding) {
+            // Drop the zero tail so that appending resumes at the log end.
+            std::filesystem::resize_file(path, *buffer_.padding);
+          }
+          logBytes_ += std::filesystem::file_size(path);
           time_ = eventTime;
         }
       }
       expectedTime = eventTime + 1;
     }
     loaded_ = true;
+    logSince_ = StatsClock::now();
+    publishReads();
     if (corrupted) {
       save(StoreSaveMode::syncSave);
     }
     closeEventsFile();
+    eventsReset_ = true;
     openEventsFile();
     return !corrupted;
   }
 
   /**
    * Save state to the store's directory.
-   * Deletes any and all snapshots and event logs and writes a fresh snapshot.
+   * Deletes any and all snapshots and event logs and writes a fresh snapshot,
+   * or writes a delta snapshot and deletes the event logs it supersedes.
    * @param mode Save mode (see `logkv::StoreSaveMode` enum).
-   * @throws std::exception on any filesystem, write or serialization error.
+   * @throws std::exception on any filesystem, write or serialization error,
+   * including those of a previous `StoreSaveMode::backgroundSave`.
    */
   int save(int mode = StoreSaveMode::syncSave) {
     if (!loaded_) {
       throw std::runtime_error("cannot save() without calling load() first");
     }
+    waitSave();
+    auto lock = lockGroupCommit();
+    waitSaveLocked();
+    if constexpr (!requires(const map_type& m) { m.snapshot(); }) {
+      if (mode == StoreSaveMode::backgroundSave) {
+        mode = StoreSaveMode::asyncClear;
+      }
+    }
+    if (mode == StoreSaveMode::deltaSave &&
+        (!maxDeltas_ || !deltaBase_ || deltaCount_ >= maxDeltas_ ||
+         dirty_.size() * 2 >= std::max<size_t>(objects_.size(), 1))) {
+      mode = StoreSaveMode::syncSave;
+    }
     if (events_) {
-      fclose(events_);
-      events_ = nullptr;
+      if (groupCommit_ || mode == StoreSaveMode::backgroundSave) {
+        flush(events_.get(), true);
+      } else {
+        // Observers see every logged event, and a failed save loses none.
+        writeFrame(events_.get());
+      }
+      events_->close();
+      events_.reset();
       eventsFileSize_ = 0;
     }
+    logBytes_ = 0;
 #if !LOGKV_WINDOWS
     if (mode == StoreSaveMode::forkSave) {
-      int status;
-      while (waitpid(-1, &status, WNOHANG) > 0) {
-      }
       uint64_t snapshotTime = time_ + 1;
       pid_t pid = fork();
       if (pid == -1) {
+        openEventsFile();
         throw std::runtime_error("fork() failed");
       } else if (pid == 0) { // Child
         try {
-          writeSnapshot(snapshotTime);
+          writeSnapshot(snapshotTime, objects_, buffer_);
           deleteOldSnapshotsAndEvents(snapshotTime);
         } catch (...) {
           _exit(1);
         }
         _exit(0);
       } else { // Parent
+        // The child may still fail, so deltas can't be layered on its base.
+        resetDirty(false);
+        logStart_.reset();
         time_ = snapshotTime;
+        startSave(snapshotTime, [this, pid, snapshotTime]() {
+          waitChild(pid);
+          if (uint64_t size = snapshotSize(snapshotTime)) {
+            snapshotBytes_ = size;
+          }
+        });
         openEventsFile();
         return pid;
       }
@@ -500,39 +1326,534 @@ public:
 #endif
 
     uint64_t snapshotTime = time_ + 1;
-    writeSnapshot(snapshotTime);
+    if (mode == StoreSaveMode::deltaSave) {
+      try {
+        traceSnapshot(snapshotTime, true,
+                      [&]() { writeDeltaSnapshot(snapshotTime); });
+      } catch (...) {
+        openEventsFile(); // keep logging to the current events file
+        throw;
+      }
+      setDurable(writeSeq_);
+      dirty_.clear();
+      ++deltaCount_;
+      logStart_ = snapshotTime;
+      time_ = snapshotTime;
+      openEventsFile();
+      deleteOldSnapshotsAndEvents(snapshotTime, true);
+      finishSave(snapshotTime);
+      return 0;
+    }
+    if constexpr (requires(const map_type& m) { m.snapshot(); }) {
+      if (mode == StoreSaveMode::backgroundSave) {
+        // Until the new snapshot is in place, `load()` recovers from the old
+        // snapshot plus the (synced) old and new events files.
+        setDurable(writeSeq_);
+        resetDirty(true);
+        logStart_ = snapshotTime;
+        FrameBuffer fb(buffer_.data.size());
+        startSave(snapshotTime, [this, snapshotTime,
+                                 view = objects_.snapshot(),
+                                 fb = std::move(fb)]() mutable {
+          traceSnapshot(snapshotTime, false,
+                        [&]() { writeSnapshot(snapshotTime, view, fb); });
+          snapshotBytes_ = snapshotSize(snapshotTime);
+          deleteOldSnapshotsAndEvents(snapshotTime);
+        });
+        time_ = snapshotTime;
+        openEventsFile();
+        return 0;
+      }
+    }
+    try {
+      traceSnapshot(snapshotTime, false,
+                    [&]() { writeSnapshot(snapshotTime, objects_, buffer_); });
+    } catch (...) {
+      openEventsFile(); // keep logging to the current events file
+      throw;
+    }
+    snapshotBytes_ = snapshotSize(snapshotTime);
+    setDurable(writeSeq_);
+    resetDirty(true);
+    logStart_ = snapshotTime;
     time_ = snapshotTime;
     openEventsFile();
     if (mode == StoreSaveMode::syncSave) {
       deleteOldSnapshotsAndEvents(snapshotTime);
+      finishSave(snapshotTime);
     } else {
-      std::thread([this, snapshotTime]() {
+      startSave(snapshotTime, [this, snapshotTime]() {
         deleteOldSnapshotsAndEvents(snapshotTime);
-      }).detach();
+      });
     }
     return 0;
   }
 
+  /**
+   * Lock-free read access to the K,V map from any thread, for stores with
+   * `setConcurrentReads(true)`. A reader holds an immutable snapshot of the
+   * map as of the last write published by the store and only swaps it for
+   * the latest one when `view()` sees that it's stale, announcing it in a
+   * hazard slot so the writer doesn't free it: lookups neither lock nor write
+   * to any shared state. A `Reader` is used by one thread at a time, and must
+   * not outlive the store.
+   * NOTE: A held view keeps the map entries replaced since it was published
+   * alive; call `release()` if the reader will idle for a while.
+   */
+  class Reader {
+  public:
+    explicit Reader(const Store& store)
+        : store_(&store), slot_(store.acquireReadSlot()) {}
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+    ~Reader() { store_->releaseReadSlot(slot_); }
+
+    /**
+     * Get the latest published snapshot of the map.
+     * @return Reference valid until the next `view()` or `release()` call.
+     * @throws std::runtime_error if concurrent reads are disabled.
+     */
+    const map_type& view() {
+      const map_type* view = store_->readView_.load(std::memory_order_acquire);
+      if (view != view_) {
+        // Until it's announced, the writer may replace and free the view, so
+        // it's only used if it's still the published one afterwards.
+        const map_type* announced;
+        do {
+          announced = view;
+          slot_->store(announced);
+          view = store_->readView_.load();
+        } while (view != announced);
+        view_ = view;
+      }
+      if (!view_) {
+        throw std::runtime_error("concurrent reads are not enabled");
+      }
+      return *view_;
+    }
+
+    /**
+     * Look up a key in the latest published snapshot of the map.
+     * @param key Key to find
+     * @return Pointer to the value valid until the next `view()`, `find()`
+     * or `release()` call, or `nullptr` if the key is absent.
+     */
+    const mapped_type* find(const key_type& key) {
+      const map_type& m = view();
+      auto it = m.find(key);
+      return it != m.end() ? &it->second : nullptr;
+    }
+
+    /**
+     * Drop the held snapshot.
+     */
+    void release() {
+      slot_->store(nullptr, std::memory_order_release);
+      view_ = nullptr;
+    }
+
+  private:
+    const Store* store_;
+    std::atomic<const map_type*>* slot_; // hazard slot announcing `view_`
+    const map_type* view_ = nullptr;
+  };
+
+  /**
+   * Enable or disable lock-free concurrent reads through `Store::Reader`.
+   * When enabled, every `update()`, `erase()`, `persist()`, `load()` and
+   * `clear()` publishes an O(1) `snapshot()` of the map for readers with an
+   * atomic pointer swap; replaced snapshots are freed by a later publication
+   * once no reader holds them (hazard pointers), and entries shared with a
+   * published snapshot are copied on write.
+   * Changes made directly to the map are published by `publishReads()`.
+   * @param enable `true` to publish snapshots for readers.
+   * @throws std::runtime_error if the map type has no `snapshot()`.
+   */
+  void setConcurrentReads(bool enable) {
+    auto lock = lockGroupCommit();
+    if constexpr (requires(const map_type& m) { m.snapshot(); }) {
+      concurrentReads_ = enable;
+      if (enable) {
+        publishReads();
+      } else {
+        retireReadView(readView_.exchange(nullptr));
+      }
+    } else if (enable) {
+      throw std::runtime_error("concurrent reads require M::snapshot()");
+    }
+  }
+
+  /**
+   * Get concurrent read mode.
+   * @return `true` if snapshots are published for `Store::Reader`.
+   */
+  bool isConcurrentReads() const { return concurrentReads_; }
+
+  /**
+   * Publish the current state of the map to `Store::Reader`s, e.g. after
+   * modifying it directly. Does nothing if concurrent reads are disabled.
+   */
+  void publishReads() {
+    if constexpr (requires(const map_type& m) { m.snapshot(); }) {
+      auto lock = lockGroupCommit();
+      if (concurrentReads_) {
+        auto view = std::make_unique<const map_type>(objects_.snapshot());
+        retireReadView(readView_.exchange(view.release()));
+      }
+    }
+  }
+
+  /**
+   * Compact the events log in the background instead of writing a snapshot.
+   * The current events file is synced and closed, a new one is started, and
+   * a background thread replays the closed file (all its segments, see
+   * `setEventsSegmentSize()`) into a temporary map (not the store's map) and
+   * writes the latest value of each key it touched, erased keys as empty
+   * values, to a delta snapshot (see `setMaxDeltaSnapshots()`). The delta
+   * then replaces the events file, so a restart replays one record per key
+   * instead of every update.
+   * Runs as a background save: see `isSaving()` and `waitSave()`.
+   * @return `true` if a compaction was started, `false` if there was nothing
+   * to compact or the events log spans several files (e.g. after a failed
+   * background save), which only a full snapshot folds.
+   * @throws std::runtime_error if `V` is partial-serializable, since its
+   * events patch values in place and can't be merged without the map.
+   */
+  bool compact() {
+    if constexpr (requires { mapped_type::_logkvStoreSnapshot(false); }) {
+      throw std::runtime_error("cannot compact partial-serializable events");
+    }
+    if (!loaded_) {
+      throw std::runtime_error("cannot compact() without calling load() "
+                               "first");
+    }
+    waitSave();
+    auto lock = lockGroupCommit();
+    waitSaveLocked();
+    if (!events_ || logStart_ != time_ ||
+        (eventsFileSize_ == 0 && buffer_.writeOffset == 0)) {
+      return false;
+    }
+    flush(events_.get(), true);
+    events_->close();
+    events_.reset();
+    eventsFileSize_ = 0;
+    logBytes_ = 0;
+    uint64_t eventsTime = time_;
+    uint64_t deltaTime = time_ + 1;
+    ++deltaCount_;
+    logStart_ = deltaTime;
+    FrameBuffer fb(buffer_.data.size());
+    startSave(deltaTime, [this, eventsTime, deltaTime,
+                          fb = std::move(fb)]() mutable {
+      compactEvents(eventsTime, deltaTime, fb);
+    });
+    time_ = deltaTime;
+    openEventsFile();
+    return true;
+  }
+
+  /**
+   * Apply events frames that another store logged (e.g. received from a
+   * `logkv::ReplicationLeader`) to the map, without logging them. Only the
+   * complete frames (and frame chains) at the start of `data` are applied;
+   * the caller passes the rest again once more bytes arrive.
+   * @param data Events file bytes, starting at a frame.
+   * @param size Size of `data` in bytes.
+   * @return Number of bytes applied.
+   * @throws std::runtime_error if a frame or object is corrupted, in which
+   * case the objects before it in the same frame may have been applied.
+   */
+  size_t applyEvents(const char* data, size_t size) {
+    auto lock = lockGroupCommit();
+    FrameBuffer fb;
+    fb.mapped = data ? data : "";
+    fb.mappedSize = size;
+    size_t applied = 0;
+    bool ok = true;
+    key_type key;
+    try {
+      while (ok) {
+        int rf = readFrame(nullptr, fb);
+        if (rf == RR_Frame_EOF || rf == RR_Frame_Underflow) {
+          break; // incomplete frame or chain
+        } else if (rf != RR_Success) {
+          ok = false;
+          break;
+        }
+        while (ok && fb.readOffset < fb.writeOffset) {
+          ok = replayObject(nullptr, objects_, fb, key,
+                            maxDeltas_ ? &dirty_ : nullptr);
+        }
+        applied = fb.mappedOffset;
+      }
+    } catch (...) {
+      ok = false;
+    }
+    releaseChain(fb);
+    if (applied) {
+      publishReads();
+    }
+    if (!ok || fb.padding) {
+      throw std::runtime_error("corrupted events");
+    }
+    return applied;
+  }
+
+  /**
+   * Check whether the background work of a save is running: a
+   * `StoreSaveMode::backgroundSave` writing a snapshot, a
+   * `StoreSaveMode::forkSave` child process, the cleanup of a
+   * `StoreSaveMode::asyncClear`, or a `compact()`. A save waits for the
+   * previous one to finish, so they never overlap.
+   * @return `true` if the background save is in progress.
+   */
+  bool isSaving() const { return saving_; }
+
+  /**
+   * Wait for the background work of a save or `compact()` to finish.
+   * @throws std::exception if the background save failed (including a
+   * `StoreSaveMode::forkSave` child process that exited with an error).
+   */
+  void waitSave() {
+    joinSave();
+    auto lock = lockGroupCommit();
+    if (auto e = saveError_ ? saveError_ : scheduleError_) {
+      saveError_ = nullptr;
+      scheduleError_ = nullptr;
+      deltaBase_ = false;
+      logStart_.reset();
+      std::rethrow_exception(e);
+    }
+  }
+
+  /**
+   * Get a future for the last `save()` or `compact()` that returned. It
+   * becomes ready, with the time of the snapshot (or delta snapshot) that
+   * was written, once the background work of the save is done too (see
+   * `isSaving()`), or holds the error that `waitSave()` throws.
+   * @return Future, or an invalid one if nothing was saved yet.
+   */
+  std::shared_future<uint64_t> getSaveFuture() const {
+    auto lock = lockGroupCommit();
+    return saveFuture_;
+  }
+
+  /**
+   * Make the store save on its own when `policy` says a save is due, or
+   * stop it with a default `SnapshotPolicy` (the default). The policy is
+   * checked by the event-writing methods (`update()`, `erase()`,
+   * `persist()`, `write()`, `flush()`) after they seal a frame, and by
+   * `scheduleSave()`. A due save is started on the calling thread with
+   * `policy.mode`, unless the previous save is still running (see
+   * `isSaving()`): then the check is repeated after the next frame, and only
+   * once `policy.stallBytes` are logged does the writer wait for it (without
+   * holding up other writers or the group commit flusher). The event-writing
+   * methods never throw the errors of the saves they start, since their
+   * events are already logged: the errors are reported by `waitSave()` and
+   * `getSaveFuture()`, and no more saves are started until `waitSave()`
+   * reported them.
+   * NOTE: Without `M::snapshot()`, `StoreSaveMode::backgroundSave` writes the
+   * snapshot on the calling thread; `StoreSaveMode::forkSave` doesn't.
+   * @param policy Save triggers (see `logkv::SnapshotPolicy`).
+   */
+  void setSnapshotPolicy(const SnapshotPolicy& policy) {
+    auto lock = lockGroupCommit();
+    policy_ = policy;
+    scheduling_ = policy.eventsBytes || policy.replayRatio > 0 ||
+                  policy.interval.count() > 0;
+    logSince_ = StatsClock::now();
+    snapshotCheck_ = scheduling_;
+  }
+
+  /**
+   * Get the policy set by `setSnapshotPolicy()`.
+   * @return Save triggers.
+   */
+  const SnapshotPolicy& getSnapshotPolicy() const { return policy_; }
+
+  /**
+   * Start a save if the snapshot policy says one is due, e.g. from a timer,
+   * so that `SnapshotPolicy::interval` also fires while nothing is written.
+   * @return `true` if a save was started.
+   */
+  bool scheduleSave() {
+    auto lock = lockGroupCommit();
+    return scheduleSave(lock);
+  }
+
+  /**
+   * Get the size of the events logged since the last snapshot, delta
+   * snapshot or compaction, which `load()` would replay.
+   * @return Events log size in bytes.
+   */
+  uint64_t getUnsavedEventsBytes() const { return logBytes_; }
+
 private:
+  /**
+   * Frame I/O buffer and its read/write offsets. The store uses `buffer_` for
+   * the events log and for snapshots; snapshot shard workers use their own.
+   * When replaying, `frame` points to the payload of the last frame read,
+   * which is either in `data` or, for mapped replay, in the `mapped` file.
+   */
+  struct FrameBuffer {
+    explicit FrameBuffer(size_t size = 0) : data(size) {}
+    std::vector<char> data;
+    size_t writeOffset = 0;
+    size_t readOffset = 0;
+    const char* frame = nullptr;
+    const char* mapped = nullptr;
+    size_t mappedSize = 0;
+    size_t mappedOffset = 0;
+    uint8_t frameControl = 0;
+    uint32_t frameCRC = 0;
+    uint8_t frameCodec = 0;
+    uint32_t frameRawSize = 0;
+    std::vector<char> compressed; // compressed payload scratch
+    std::vector<char> chain; // reassembled frame chain payload
+    std::optional<uint64_t> padding; // offset of the zero tail, if any
+    uint64_t entries = 0;      // K,V pairs written (see `SnapshotInfo`)
+    uint64_t payloadBytes = 0; // uncompressed payload bytes written
+    uint32_t maxFrameSize = 0; // largest uncompressed frame written
+    uint32_t keyRestart = 0;   // front-coding the keys written, if not 0
+    uint32_t restartKeys = 0;  // keys written since the last full key
+    bool frontCoded = false;   // front-coded keys are read
+    std::vector<char> lastKey; // previous front-coded key written or read
+  };
+
+  /**
+   * Events file writer that forwards to the writer of the current segment,
+   * so that pointers to it (e.g. in `FrameSink`) stay valid when
+   * `writeFrame()` rotates segments.
+   */
+  class EventsWriter : public FileWriter {
+  public:
+    explicit EventsWriter(std::unique_ptr<FileWriter> f) : f_(std::move(f)) {}
+    void write(const char* data, size_t size) override {
+      f_->write(data, size);
+    }
+    void flush() override { f_->flush(); }
+    void sync() override { f_->sync(); }
+    void close() override { f_->close(); }
+    int handle() const override { return f_->handle(); }
+    uint64_t size() const override { return f_->size(); }
+    bool isAsync() const override { return f_->isAsync(); }
+    void setSegment(std::unique_ptr<FileWriter> f) { f_ = std::move(f); }
+
+  private:
+    std::unique_ptr<FileWriter> f_;
+  };
+
+  using dirty_map_type = M<K, bool>;
+
   map_type objects_;
-  FILE* events_ = nullptr;
+  std::unique_ptr<EventsWriter> events_;
   int flags_ = StoreFlags::none;
-  std::vector<char> buffer_;
-  size_t writeOffset_ = 0;
-  size_t readOffset_ = 0;
+  FrameBuffer buffer_;
+  size_t bufferSize_; // configured size of `buffer_`
   bool forceCRC32_ = false;
+  bool frameChaining_ = true;
+  int compression_ = CompressionCodec::noCompression;
+  size_t compressionThreshold_ = DefaultCompressionThreshold;
+  bool mappedReplay_ = false;
+  int writeMode_ = StoreWriteMode::stdioWrite;
+  size_t replayWorkers_ = 0;
+  size_t snapshotShards_ = 1;
+  uint32_t keyRestart_ = 0; // see `setSnapshotFrontCoding()`
+  dirty_map_type dirty_; // keys changed since the last snapshot or delta
+  size_t maxDeltas_ = 0;
+  size_t deltaCount_ = 0;
+  bool deltaBase_ = false; // last full snapshot can take deltas
+  std::optional<uint64_t> logStart_; // first events file after the last
+                                     // snapshot or delta, if known
   bool loaded_ = false;
+  bool eventsReset_ = false; // map not derived from the logged frames
   uint64_t time_ = 0;
   std::string dir_;
-  uint64_t eventsFileSize_ = 0;
+  uint64_t eventsFileSize_ = 0; // across segments
+  uint64_t eventsFlushed_ = 0;  // events handed to the OS, across segments
+  uint64_t segmentSize_ = 0;
+  bool preallocateSegments_ = true;
+  size_t eventsSegment_ = 0;       // current segment index
+  uint64_t eventsSegmentBase_ = 0; // offset of the current segment
   mapped_type emptyValue_{};
+  uint64_t writeSeq_ = 0;
+  uint64_t durableSeq_ = 0;
+  uint64_t syncRequestSeq_ = 0;
+  std::atomic<bool> groupCommit_ = false; // read without `mutex_`
+  bool stopGroupCommit_ = false;
+  std::exception_ptr groupCommitError_;
+  mutable std::recursive_mutex mutex_;
+  std::condition_variable_any commitCv_;
+  std::condition_variable_any durableCv_;
+  std::multimap<uint64_t, std::function<void(std::exception_ptr)>>
+    durableWaiters_; // `asyncWaitDurable()` callbacks by sequence number
+  std::thread flusher_;
+  struct SaveThread {
+    std::thread thread;
+    std::exception_ptr error; // of its work, read once it's joined
+  };
+  // Guarded by `mutex_` in group commit mode, like the save members below.
+  std::unique_ptr<SaveThread> saveThread_;
+  std::exception_ptr saveError_;
+  std::exception_ptr scheduleError_; // of a save started by a writer
+  std::atomic<bool> saving_ = false;
+  std::shared_future<uint64_t> saveFuture_;
+  SnapshotPolicy policy_;
+  bool scheduling_ = false;    // `policy_` has a trigger
+  bool snapshotCheck_ = false; // a frame was logged since the last check
+  uint64_t logBytes_ = 0;      // events logged since the last snapshot
+  StatsClock::time_point logSince_; // time of the first of them
+  std::atomic<uint64_t> snapshotBytes_ = 0; // size of the last snapshot
+  bool concurrentReads_ = false;
+  std::atomic<const map_type*> readView_ = nullptr; // published snapshot
+  std::vector<const map_type*> retiredViews_; // replaced, maybe still read
+  // Hazard slots of the `Reader`s (and free ones, left null), guarded by
+  // `readMutex_`; readers only lock it when they're created or destroyed.
+  mutable std::deque<std::atomic<const map_type*>> readSlots_;
+  mutable std::vector<std::atomic<const map_type*>*> freeReadSlots_;
+  mutable std::mutex readMutex_;
+  std::shared_ptr<StoreStats> stats_;
+  std::shared_ptr<StoreObserver> observer_;
+
+  /**
+   * Control byte of an empty CRC32 frame (never written), which marks the
+   * start of a compressed frame or of a frame chain segment.
+   */
+  static constexpr uint8_t CompressedFrame = 0x20;
+
+  /**
+   * Frame chain segment kinds, written after `CompressedFrame` in place of a
+   * codec (see `writeChainSegment()`).
+   */
+  enum ChainSegmentKind : uint8_t {
+    ChainSegment = 0x80, // more segments follow
+    ChainEnd = 0x81,     // last segment
+    ChainAbort = 0x82    // the chain is discarded (serialization failed)
+  };
+
+  /**
+   * Snapshot record kinds, written after `CompressedFrame` in place of a
+   * codec (see `writeSnapshotRecord()`).
+   */
+  enum SnapshotRecordKind : uint8_t {
+    SnapshotHeader = 0x90, // first record of a snapshot or delta file
+    SnapshotFooter = 0x91  // last record of a complete file
+  };
+
+  // 1: keys stored in full; 2: front-coded keys (`SnapshotInfo::keyRestart`).
+  static constexpr uint32_t SnapshotFormatVersion = 2;
+  static constexpr size_t SnapshotInfoSize = 32;
+  // Prefix, CRC32 frame header with one extra size byte, `SnapshotInfo`.
+  static constexpr size_t SnapshotRecordSize = 6 + 6 + SnapshotInfoSize;
 
   enum ReadResult {
     RR_Success = 0,
     RR_Frame_EOF = 1,
     RR_Frame_Underflow = 2,
     RR_Frame_Corrupted = 3,
-    RR_Object_Corrupted = 4
+    RR_Object_Corrupted = 4,
+    RR_Chain_Aborted = 5
   };
 
   std::string pad(uint64_t n) {
@@ -541,306 +1862,2406 @@ private:
     return oss.str();
   }
 
-  void flush(FILE* f, bool sync = false) {
-    writeFrame(f);
-    if (sync) {
-#if LOGKV_WINDOWS
-      _commit(_fileno(f));
-#else
-      fsync(fileno(f));
-#endif
+  void trackDirty(const key_type& key) {
+    if (maxDeltas_) {
+      dirty_[key] = true;
     }
   }
-  void closeFile(FILE* f) {
-    if (fclose(f) != 0) {
-      throw std::runtime_error("cannot close file");
+
+  /**
+   * Starts a new delta chain after a full snapshot was written (`base`) or
+   * when deltas can't be layered on the last one.
+   */
+  void resetDirty(bool base) {
+    dirty_.clear();
+    deltaCount_ = 0;
+    deltaBase_ = base;
+  }
+
+  std::atomic<const map_type*>* acquireReadSlot() const {
+    std::lock_guard lock(readMutex_);
+    if (freeReadSlots_.empty()) {
+      return &readSlots_.emplace_back(nullptr);
     }
+    auto slot = freeReadSlots_.back();
+    freeReadSlots_.pop_back();
+    return slot;
   }
 
-  void closeEventsFile() {
-    if (events_) {
-      flush(events_, true);
-      closeFile(events_);
-      events_ = nullptr;
-      eventsFileSize_ = 0;
+  void releaseReadSlot(std::atomic<const map_type*>* slot) const {
+    slot->store(nullptr, std::memory_order_release);
+    std::lock_guard lock(readMutex_);
+    freeReadSlots_.push_back(slot);
+  }
+
+  /**
+   * Retires `view`, which was just replaced as the published snapshot, and
+   * frees the retired snapshots that no reader announced in its slot. A
+   * reader that loaded one of them before it was replaced sees it changed
+   * when it checks its announcement (see `Reader::view()`), and retries.
+   */
+  void retireReadView(const map_type* view) {
+    std::lock_guard lock(readMutex_);
+    if (view) {
+      retiredViews_.push_back(view);
     }
+    std::erase_if(retiredViews_, [&](const map_type* retired) {
+      for (const auto& slot : readSlots_) {
+        if (slot.load() == retired) {
+          return false;
+        }
+      }
+      delete retired;
+      return true;
+    });
   }
 
-  void openEventsFile() {
-    writeOffset_ = 0;
-    auto eventsPath = std::filesystem::path(dir_) / (pad(time_) + ".events");
-    events_ = fopen(eventsPath.string().c_str(), "ab+");
-    if (!events_) {
-      throw std::runtime_error("cannot open events file for writing");
+  /**
+   * Joins the background save thread, if any, and keeps its error for
+   * `waitSave()`. The thread is taken under `mutex_` and joined after
+   * releasing it (the save thread never locks it); if another thread took
+   * it, this waits for the save to finish instead. Its snapshot writer reads
+   * the store's file and frame settings, so they aren't changed while it
+   * runs.
+   */
+  void joinSave() {
+    std::unique_ptr<SaveThread> save;
+    {
+      auto lock = lockGroupCommit();
+      save = std::move(saveThread_);
+    }
+    if (!save) {
+      saving_.wait(true);
+      return;
+    }
+    save->thread.join();
+    if (save->error) {
+      auto lock = lockGroupCommit();
+      saveError_ = save->error;
     }
-    long pos = ftell(events_);
-    eventsFileSize_ = (pos >= 0) ? static_cast<uint64_t>(pos) : 0;
   }
 
-  void writeSnapshot(uint64_t snapshotTime) {
-    auto snapshotStem = pad(snapshotTime);
-    auto snapshotName = snapshotStem + ".snapshot";
-    auto snapshotPath = std::filesystem::path(dir_) / snapshotName;
-    std::ostringstream tempNameStream;
-    uint64_t nanosEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                            std::chrono::system_clock::now().time_since_epoch())
-                            .count();
-    int pid = 0;
-#if LOGKV_WINDOWS
-    pid = _getpid();
-#else
-    pid = getpid();
+  /**
+   * Waits, with `mutex_` held, for a save that another writer started (see
+   * `setSnapshotPolicy()`) between the caller's `waitSave()` and its lock,
+   * so saves never overlap.
+   */
+  void waitSaveLocked() {
+    if (saving_ || saveThread_) {
+      waitSave();
+    }
+  }
+
+  /**
+   * Runs `work`, the background part of the save of `snapshotTime` (or of a
+   * compaction into delta `snapshotTime`), on the save thread, and fulfills
+   * `saveFuture_` when it's done. Called with `mutex_` held.
+   */
+  template <typename F> void startSave(uint64_t snapshotTime, F&& work) {
+    joinSave(); // never replaces a save thread that wasn't joined
+    std::promise<uint64_t> done;
+    saveFuture_ = done.get_future().share();
+    saving_ = true;
+    auto save = std::make_unique<SaveThread>();
+    try {
+      save->thread = std::thread([this, snapshotTime, error = &save->error,
+                                  done = std::move(done),
+                                  work = std::forward<F>(work)]() mutable {
+        {
+          auto run = std::move(work); // releases e.g. a map snapshot
+          try {
+            run();
+          } catch (...) {
+            *error = std::current_exception();
+          }
+        }
+        saving_ = false;
+        saving_.notify_all();
+        if (*error) {
+          done.set_exception(*error);
+        } else {
+          done.set_value(snapshotTime);
+        }
+      });
+    } catch (...) {
+      saving_ = false;
+      throw;
+    }
+    saveThread_ = std::move(save);
+  }
+
+  /**
+   * Fulfills `saveFuture_` for a save of `snapshotTime` that is complete.
+   */
+  void finishSave(uint64_t snapshotTime) {
+    std::promise<uint64_t> done;
+    done.set_value(snapshotTime);
+    saveFuture_ = done.get_future().share();
+  }
+
+#if !LOGKV_WINDOWS
+  /**
+   * Reaps the snapshot child process `pid`.
+   * @throws std::runtime_error if it didn't exit successfully.
+   */
+  static void waitChild(pid_t pid) {
+    int status;
+    pid_t rs;
+    while ((rs = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {
+    }
+    // ECHILD: the application reaped it, so its status is unknown.
+    if (rs == pid && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+      throw std::runtime_error("forked snapshot failed");
+    }
+  }
 #endif
-    tempNameStream << "tmp_snapshot_" << pid << "_" << nanosEpoch << "_"
-                   << snapshotStem;
-    auto tempPath = std::filesystem::path(dir_) / tempNameStream.str();
-    FILE* sf = fopen(tempPath.string().c_str(), "wb");
-    if (!sf) {
-      throw std::runtime_error("cannot open temp snapshot file for writing");
+
+  /**
+   * @return Size in bytes of snapshot `snapshotTime` and its shards, or 0
+   * if it can't be found.
+   */
+  uint64_t snapshotSize(uint64_t snapshotTime) {
+    std::error_code ec;
+    auto path = std::filesystem::path(dir_) / (pad(snapshotTime) + ".snapshot");
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+      return 0;
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+      uint64_t fileNum;
+      size_t shard;
+      if (isSnapshotShard(entry.path(), fileNum, shard) &&
+          fileNum == snapshotTime) {
+        size += std::filesystem::file_size(entry.path(), ec);
+      }
+    }
+    return size;
+  }
+
+  /**
+   * Counts `bytes` logged to the events file for the snapshot policy.
+   */
+  void logged(uint64_t bytes) {
+    if (!logBytes_) {
+      logSince_ = StatsClock::now();
+    }
+    logBytes_ += bytes;
+    snapshotCheck_ = scheduling_;
+  }
+
+  /**
+   * Starts a save if a frame was logged since the last check and the
+   * snapshot policy says one is due. Called by the event-writing methods with
+   * their `lock`; a save that fails is reported by `waitSave()` instead.
+   */
+  void checkSnapshotPolicy(std::unique_lock<std::recursive_mutex>& lock) {
+    if (!snapshotCheck_ || scheduleError_) {
+      return;
+    }
+    try {
+      scheduleSave(lock);
+    } catch (...) {
+      scheduleError_ = std::current_exception();
+      std::promise<uint64_t> failed;
+      failed.set_exception(scheduleError_);
+      saveFuture_ = failed.get_future().share();
+    }
+  }
+
+  /**
+   * Implements `scheduleSave()`. A writer that stalls waits for the running
+   * save with `lock` (the caller's only lock on `mutex_`) released.
+   */
+  bool scheduleSave(std::unique_lock<std::recursive_mutex>& lock) {
+    snapshotCheck_ = false;
+    if (!scheduling_ || !loaded_ || !isSaveDue()) {
+      return false;
+    }
+    while (saving_) {
+      if (!policy_.stallBytes || logBytes_ < policy_.stallBytes) {
+        return false;
+      }
+      if (stats_) {
+        stats_->saveStalls.fetch_add(1, std::memory_order_relaxed);
+      }
+      auto running = saveFuture_;
+      if (lock.owns_lock()) {
+        lock.unlock();
+        running.wait();
+        lock.lock();
+      } else {
+        running.wait();
+      }
+      if (!scheduling_ || !isSaveDue()) {
+        return false; // another writer saved meanwhile
+      }
+    }
+    save(policy_.mode);
+    if (stats_) {
+      stats_->scheduledSaves.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  bool isSaveDue() const {
+    if (!logBytes_ || logBytes_ < policy_.minEventsBytes) {
+      return false;
+    }
+    return (policy_.eventsBytes && logBytes_ >= policy_.eventsBytes) ||
+           (policy_.replayRatio > 0 &&
+            logBytes_ >= policy_.replayRatio *
+                           snapshotBytes_.load(std::memory_order_relaxed)) ||
+           (policy_.interval.count() > 0 &&
+            StatsClock::now() - logSince_ >= policy_.interval);
+  }
+
+  std::unique_lock<std::recursive_mutex> lockGroupCommit() const {
+    if (groupCommit_) {
+      return std::unique_lock(mutex_);
+    }
+    return std::unique_lock<std::recursive_mutex>();
+  }
+
+  void flush(FileWriter* f, bool sync = false) { flush(f, buffer_, sync); }
+
+  void flush(FileWriter* f, FrameBuffer& fb, bool sync) {
+    writeFrame(f, fb);
+    if (sync) {
+      StatsClock::time_point start;
+      if (stats_) {
+        start = StatsClock::now();
+      }
+      f->sync();
+      if (stats_) {
+        stats_->syncs.fetch_add(1, std::memory_order_relaxed);
+        stats_->syncFlush.record(elapsedNanos(start));
+      }
+      if (isEventsFile(f, fb)) {
+        setDurable(writeSeq_);
+      }
+    } else if (deferFlush(f, fb)) {
+      f->flush();
+    }
+    if (isEventsFile(f, fb)) {
+      eventsFlushed();
+    }
+  }
+
+  /**
+   * Tells the observer that the events written so far reached the file.
+   */
+  void eventsFlushed() {
+    if (eventsFlushed_ != eventsFileSize_) {
+      eventsFlushed_ = eventsFileSize_;
+      if (observer_) {
+        observer_->onEventsFlushed(time_, eventsFlushed_);
+      }
+    }
+  }
+
+  /**
+   * Frames written to `f` are only flushed by `flush()`, not by `writeFrame()`,
+   * when group commit is flushing the events file or `f` is asynchronous.
+   */
+  bool deferFlush(FileWriter* f, const FrameBuffer& fb) const {
+    return (groupCommit_ && isEventsFile(f, fb)) || f->isAsync();
+  }
+
+  /**
+   * Events are only written through `buffer_`, so checking it first keeps
+   * background snapshot writers from reading `events_`.
+   */
+  bool isEventsFile(FileWriter* f, const FrameBuffer& fb) const {
+    return &fb == &buffer_ && f == events_.get();
+  }
+
+  void setDurable(uint64_t seq) {
+    if (seq > durableSeq_) {
+      durableSeq_ = seq;
+      if (groupCommit_) {
+        durableCv_.notify_all();
+        if (durableWaitersReady()) {
+          commitCv_.notify_one(); // the flusher runs their callbacks
+        }
+      }
+    }
+  }
+
+  bool durableWaitersReady() const {
+    return !durableWaiters_.empty() &&
+           durableWaiters_.begin()->first <= durableSeq_;
+  }
+
+  /**
+   * Runs the callbacks of the `asyncWaitDurable()` waiters that are durable,
+   * or of all of them with `error`, without holding `lock`.
+   */
+  void runDurableCallbacks(std::unique_lock<std::recursive_mutex>& lock,
+                           std::exception_ptr error) {
+    auto end = error ? durableWaiters_.end()
+                     : durableWaiters_.upper_bound(durableSeq_);
+    std::vector<std::function<void(std::exception_ptr)>> callbacks;
+    for (auto it = durableWaiters_.begin(); it != end; ++it) {
+      callbacks.push_back(std::move(it->second));
+    }
+    durableWaiters_.erase(durableWaiters_.begin(), end);
+    lock.unlock();
+    for (auto& callback : callbacks) {
+      callback(error);
+    }
+    lock.lock();
+  }
+
+  /**
+   * Group commit flusher thread. Seals the current frame under the lock, then
+   * syncs a duplicate of the events file descriptor without holding the lock,
+   * so writers can keep filling the next frame (and `save()` can close the
+   * events file) while the fsync is in progress. Runs the callbacks of the
+   * `asyncWaitDurable()` waiters once they are durable.
+   */
+  void groupCommitLoop() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      commitCv_.wait(lock, [this]() {
+        return stopGroupCommit_ || syncRequestSeq_ > durableSeq_ ||
+               durableWaitersReady();
+      });
+      if (durableWaitersReady()) {
+        runDurableCallbacks(lock, nullptr);
+        continue;
+      }
+      if (syncRequestSeq_ <= durableSeq_) {
+        break; // stopping, and no pending waiters
+      }
+      uint64_t target = writeSeq_;
+      int fd = -1;
+      auto fail = [&](std::exception_ptr error) {
+        groupCommitError_ = error;
+        durableCv_.notify_all();
+        runDurableCallbacks(lock, groupCommitError_);
+      };
+      try {
+        if (events_) {
+          flush(events_.get(), false);
+#if LOGKV_WINDOWS
+          fd = _dup(events_->handle());
+#else
+          fd = dup(events_->handle());
+#endif
+          if (fd < 0) {
+            throw std::runtime_error("cannot duplicate events file handle");
+          }
+        }
+      } catch (...) {
+        fail(std::current_exception());
+        break;
+      }
+      auto stats = stats_;
+      lock.unlock();
+      bool synced = true;
+      if (fd >= 0) {
+        StatsClock::time_point start;
+        if (stats) {
+          start = StatsClock::now();
+        }
+#if LOGKV_WINDOWS
+        synced = _commit(fd) == 0;
+        _close(fd);
+#else
+        synced = fsync(fd) == 0;
+        close(fd);
+#endif
+        if (stats) {
+          stats->syncs.fetch_add(1, std::memory_order_relaxed);
+          stats->syncFlush.record(elapsedNanos(start));
+        }
+      }
+      lock.lock();
+      if (!synced) {
+        // The events are not durable, and a later fsync can't tell whether
+        // the pages that failed to write back were lost, so stop here.
+        fail(std::make_exception_ptr(std::runtime_error("file sync error")));
+        break;
+      }
+      setDurable(target);
+    }
+  }
+  void closeFile(FILE* f) {
+    if (fclose(f) != 0) {
+      throw std::runtime_error("cannot close file");
+    }
+  }
+
+  std::unique_ptr<FileWriter> openFileWriter(const std::filesystem::path& path,
+                                             bool append,
+                                             uint64_t preallocate = 0) {
+#if LOGKV_URING
+    if (writeMode_ == StoreWriteMode::uringWrite) {
+      if (auto w = UringFileWriter::open(path, append, preallocate)) {
+        return w;
+      }
+    }
+#endif
+    return StdioFileWriter::open(path, append, preallocate);
+  }
+
+  void closeEventsFile() {
+    if (events_) {
+      flush(events_.get(), true);
+      events_->close();
+      events_.reset();
+      eventsFileSize_ = 0;
+    }
+  }
+
+  /**
+   * Opens the events file of `time_` to append to its last segment.
+   */
+  void openEventsFile() {
+    buffer_.writeOffset = 0;
+    auto segments = findEventsSegments(time_);
+    eventsSegment_ = segments.empty() ? 0 : segments.back().first;
+    eventsSegmentBase_ = 0;
+    for (size_t i = 0; i + 1 < segments.size(); ++i) {
+      eventsSegmentBase_ += std::filesystem::file_size(segments[i].second);
+    }
+    auto f = openFileWriter(eventsPath(time_, eventsSegment_), true,
+                            segmentPreallocation());
+    if (!f) {
+      throw std::runtime_error("cannot open events file for writing");
+    }
+    events_ = std::make_unique<EventsWriter>(std::move(f));
+    eventsFileSize_ = eventsSegmentBase_ + events_->size();
+    eventsFlushed_ = eventsFileSize_;
+    if (observer_) {
+      observer_->onEventsFile(time_, eventsFileSize_, eventsReset_);
+    }
+    eventsReset_ = false;
+  }
+
+  /**
+   * Syncs and closes the full current events segment, truncating its
+   * preallocated tail, and continues the events file in the next segment.
+   */
+  void rotateEventsFile() {
+    flush(events_.get(), true);
+    events_->close();
+    eventsSegmentBase_ = eventsFileSize_;
+    ++eventsSegment_;
+    auto f = openFileWriter(eventsPath(time_, eventsSegment_), false,
+                            segmentPreallocation());
+    if (!f) {
+      throw std::runtime_error("cannot open events file for writing");
+    }
+    events_->setSegment(std::move(f));
+    if (stats_) {
+      stats_->eventsSegments.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t segmentPreallocation() const {
+    return preallocateSegments_ ? segmentSize_ : 0;
+  }
+
+  /**
+   * @return Path of segment `segment` of events file `time`.
+   */
+  std::filesystem::path eventsPath(uint64_t time, size_t segment) {
+    auto name = pad(time) + ".events";
+    if (segment) {
+      name += "." + std::to_string(segment);
+    }
+    return std::filesystem::path(dir_) / name;
+  }
+
+  /**
+   * Runs `write`, which writes snapshot (or delta, if `delta`) `snapshotTime`,
+   * between the observer's snapshot callbacks and times it.
+   */
+  template <typename F>
+  void traceSnapshot(uint64_t snapshotTime, bool delta, F&& write) {
+    if (!stats_ && !observer_) {
+      write();
+      return;
+    }
+    if (observer_) {
+      observer_->onSnapshotStart(snapshotTime, delta);
+    }
+    const auto start = StatsClock::now();
+    try {
+      write();
+    } catch (...) {
+      if (observer_) {
+        observer_->onSnapshotFinish(snapshotTime, delta, elapsedNanos(start),
+                                    false);
+      }
+      throw;
+    }
+    const uint64_t nanos = elapsedNanos(start);
+    if (stats_) {
+      (delta ? stats_->deltaSnapshots : stats_->snapshots)
+        .fetch_add(1, std::memory_order_relaxed);
+      stats_->writeSnapshot.record(nanos);
+    }
+    if (observer_) {
+      observer_->onSnapshotFinish(snapshotTime, delta, nanos, true);
+    }
+  }
+
+  void writeSnapshot(uint64_t snapshotTime, const map_type& objects,
+                     FrameBuffer& fb) {
+    auto snapshotPath =
+      std::filesystem::path(dir_) / (pad(snapshotTime) + ".snapshot");
+    size_t shards =
+      std::min(snapshotShards_, std::max<size_t>(objects.size(), 1));
+    if (shards <= 1) {
+      auto tempPath = writeSnapshotFile(snapshotTime, 0, objects.begin(),
+                                        objects.end(), objects.size(), fb);
+      renameSnapshotFile(tempPath, snapshotPath);
+      return;
+    }
+    deleteSnapshotShards(snapshotTime); // leftovers of an interrupted save
+    std::vector<const_iterator> bounds;
+    bounds.reserve(shards + 1);
+    auto it = objects.begin();
+    size_t count = objects.size();
+    auto shardSize = [&](size_t i) {
+      return count * (i + 1) / shards - count * i / shards;
+    };
+    for (size_t i = 0; i < shards; ++i) {
+      bounds.push_back(it);
+      std::advance(it, shardSize(i));
+    }
+    bounds.push_back(objects.end());
+    std::vector<std::filesystem::path> tempPaths(shards);
+    std::vector<std::exception_ptr> errors(shards);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < shards; ++i) {
+      workers.emplace_back([&, i]() {
+        try {
+          FrameBuffer shardBuffer(fb.data.size());
+          tempPaths[i] = writeSnapshotFile(snapshotTime, i, bounds[i],
+                                           bounds[i + 1], shardSize(i),
+                                           shardBuffer);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+    auto removeTempFiles = [&]() {
+      for (const auto& p : tempPaths) {
+        try {
+          if (!p.empty()) {
+            std::filesystem::remove(p);
+          }
+        } catch (...) {
+        }
+      }
+    };
+    for (const auto& e : errors) {
+      if (e) {
+        removeTempFiles();
+        std::rethrow_exception(e);
+      }
+    }
+    // Shard 0 is renamed to `NNNN.snapshot` last, so its presence means that
+    // all the other `NNNN.snapshot.S` shard files are in place.
+    for (size_t i = 1; i < shards; ++i) {
+      auto shardPath = std::filesystem::path(dir_) /
+                       (pad(snapshotTime) + ".snapshot." + std::to_string(i));
+      try {
+        std::filesystem::rename(tempPaths[i], shardPath);
+        tempPaths[i].clear();
+      } catch (const std::exception& e) {
+        removeTempFiles();
+        deleteSnapshotShards(snapshotTime);
+        throw std::runtime_error(std::string("failed to rename snapshot: ") +
+                                 e.what());
+      }
+    }
+    renameSnapshotFile(tempPaths[0], snapshotPath);
+  }
+
+  /**
+   * Writes the `count` K,V entries in [first, last) to a new temp snapshot
+   * file.
+   * @return Path of the temp file, to be renamed by the caller.
+   */
+  std::filesystem::path writeSnapshotFile(uint64_t snapshotTime, size_t shard,
+                                          const_iterator first,
+                                          const_iterator last, size_t count,
+                                          FrameBuffer& fb) {
+    return writeSnapshotFile(snapshotTime, shard, count, fb,
+                             [&](FileWriter* sf) {
+                               for (; first != last; ++first) {
+                                 writeUpdate(sf, fb, first->first,
+                                             first->second);
+                               }
+                             });
+  }
+
+  /**
+   * Writes the entries written by `writeEntries(FileWriter*)`, `count` of
+   * them expected, between a snapshot header and footer to a new temp
+   * snapshot file.
+   * @return Path of the temp file, to be renamed by the caller.
+   */
+  template <typename F>
+  std::filesystem::path writeSnapshotFile(uint64_t snapshotTime, size_t shard,
+                                          size_t count, FrameBuffer& fb,
+                                          F&& writeEntries) {
+    auto snapshotStem = pad(snapshotTime);
+    std::ostringstream tempNameStream;
+    uint64_t nanosEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    int pid = 0;
+#if LOGKV_WINDOWS
+    pid = _getpid();
+#else
+    pid = getpid();
+#endif
+    tempNameStream << "tmp_snapshot_" << pid << "_" << nanosEpoch << "_"
+                   << snapshotStem;
+    if (shard > 0) {
+      tempNameStream << "_" << shard;
+    }
+    auto tempPath = std::filesystem::path(dir_) / tempNameStream.str();
+    auto sf = openFileWriter(tempPath, false);
+    if (!sf) {
+      throw std::runtime_error("cannot open temp snapshot file for writing");
+    }
+    fb.writeOffset = 0;
+    fb.entries = 0;
+    fb.payloadBytes = 0;
+    fb.maxFrameSize = 0;
+    try {
+      SnapshotInfo info = snapshotInfo();
+      info.entries = count;
+      if (keyRestart_) {
+        info.version = SnapshotFormatVersion;
+        info.keyRestart = keyRestart_;
+      }
+      writeSnapshotRecord(sf.get(), SnapshotHeader, info);
+      fb.keyRestart = keyRestart_;
+      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
+      writeEntries(sf.get());
+      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(false));
+      fb.keyRestart = 0;
+      writeFrame(sf.get(), fb);
+      info.entries = fb.entries;
+      info.payloadBytes = fb.payloadBytes;
+      info.maxFrameSize = fb.maxFrameSize;
+      writeSnapshotRecord(sf.get(), SnapshotFooter, info);
+      flush(sf.get(), fb, true);
+      sf->close();
+    } catch (std::exception& ex) {
+      fb.keyRestart = 0;
+      sf.reset();
+      try {
+        std::filesystem::remove(tempPath);
+      } catch (...) {
+      }
+      throw ex;
+    }
+    return tempPath;
+  }
+
+  /**
+   * Writes the current values of the dirty keys (erased keys as empty values)
+   * to the `NNNN.delta` file of `snapshotTime`.
+   */
+  void writeDeltaSnapshot(uint64_t snapshotTime) {
+    auto writeEntries = [&](FileWriter* sf) {
+      for (const auto& entry : dirty_) {
+        auto it = objects_.find(entry.first);
+        writeUpdate(sf, buffer_, entry.first,
+                    it != objects_.end() ? it->second : emptyValue_);
+      }
+    };
+    auto tempPath =
+      writeSnapshotFile(snapshotTime, 0, dirty_.size(), buffer_, writeEntries);
+    renameSnapshotFile(tempPath, std::filesystem::path(dir_) /
+                                   (pad(snapshotTime) + ".delta"));
+  }
+
+  /**
+   * Applies the delta snapshots layered on the loaded snapshot (or on an empty
+   * map if there's none), which must be numbered consecutively after it, and
+   * advances `time_` to the last one.
+   * @throws std::runtime_error if a delta is missing or corrupted.
+   */
+  void loadDeltaSnapshots() {
+    std::vector<uint64_t> deltaTimes;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      auto stem = entry.path().stem().string();
+      if (entry.is_regular_file() && entry.path().extension() == ".delta" &&
+          std::all_of(stem.begin(), stem.end(), ::isdigit) &&
+          std::stoull(stem) > time_) {
+        deltaTimes.push_back(std::stoull(stem));
+      }
+    }
+    std::sort(deltaTimes.begin(), deltaTimes.end());
+    for (uint64_t deltaTime : deltaTimes) {
+      if (deltaTime != time_ + 1) {
+        throw std::runtime_error("corrupted snapshot (missing delta)");
+      }
+      auto deltaPath =
+        std::filesystem::path(dir_) / (pad(deltaTime) + ".delta");
+      FILE* df = fopen(deltaPath.string().c_str(), "rb");
+      if (!df) {
+        throw std::runtime_error("cannot open delta file for reading");
+      }
+      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
+      bool ok = replay(df, true);
+      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(false));
+      closeFile(df);
+      if (!ok) {
+        throw std::runtime_error("corrupted snapshot (delta)");
+      }
+      time_ = deltaTime;
+      ++deltaCount_;
+    }
+  }
+
+  /**
+   * Merges events file `eventsTime` into delta `deltaTime` (latest value
+   * wins) and deletes it. Runs on the background save thread.
+   */
+  void compactEvents(uint64_t eventsTime, uint64_t deltaTime,
+                     FrameBuffer& fb) {
+    map_type latest;
+    dirty_map_type touched;
+    for (const auto& segment : findEventsSegments(eventsTime)) {
+      FILE* ef = fopen(segment.second.string().c_str(), "rb");
+      if (!ef) {
+        throw std::runtime_error("cannot open events file for reading");
+      }
+      bool ok = replay(ef, latest, fb, false, &touched);
+      fclose(ef);
+      if (!ok) {
+        throw std::runtime_error("corrupted events file");
+      }
+    }
+    auto writeEntries = [&](FileWriter* sf) {
+      for (const auto& entry : touched) {
+        auto it = latest.find(entry.first);
+        writeUpdate(sf, fb, entry.first,
+                    it != latest.end() ? it->second : emptyValue_);
+      }
+    };
+    auto tempPath =
+      writeSnapshotFile(deltaTime, 0, touched.size(), fb, writeEntries);
+    renameSnapshotFile(tempPath, std::filesystem::path(dir_) /
+                                   (pad(deltaTime) + ".delta"));
+    deleteOldSnapshotsAndEvents(deltaTime, true);
+  }
+
+  void renameSnapshotFile(const std::filesystem::path& tempPath,
+                          const std::filesystem::path& snapshotPath) {
+    try {
+      std::filesystem::rename(tempPath, snapshotPath);
+    } catch (const std::exception& e) {
+      try {
+        std::filesystem::remove(tempPath);
+      } catch (...) {
+      }
+      throw std::runtime_error(std::string("failed to rename snapshot: ") +
+                               e.what());
+    }
+  }
+
+  /**
+   * Checks for a `NNNN<kind>.I` file name (e.g. a snapshot shard).
+   */
+  static bool isIndexedFile(const std::filesystem::path& path,
+                            const char* kind, uint64_t& fileNum,
+                            size_t& index) {
+    auto ext = path.extension().string();
+    auto baseName = path.stem();
+    auto stem = baseName.stem().string();
+    if (ext.size() < 2 || baseName.extension() != kind || stem.empty() ||
+        !std::all_of(stem.begin(), stem.end(), ::isdigit) ||
+        !std::all_of(ext.begin() + 1, ext.end(), ::isdigit)) {
+      return false;
+    }
+    fileNum = std::stoull(stem);
+    index = std::stoull(ext.substr(1));
+    return true;
+  }
+
+  /**
+   * Checks for a `NNNN.snapshot.S` snapshot shard file name.
+   */
+  static bool isSnapshotShard(const std::filesystem::path& path,
+                              uint64_t& fileNum, size_t& shard) {
+    return isIndexedFile(path, ".snapshot", fileNum, shard);
+  }
+
+  /**
+   * Checks for a `NNNN.events.S` events segment file name.
+   */
+  static bool isEventsSegment(const std::filesystem::path& path,
+                              uint64_t& fileNum, size_t& segment) {
+    return isIndexedFile(path, ".events", fileNum, segment) && segment > 0;
+  }
+
+  /**
+   * Finds the segments of events file `time`, ordered by segment index.
+   * @return Indexes and paths of the existing segments, including segment 0
+   * (the `NNNN.events` file).
+   */
+  std::vector<std::pair<size_t, std::filesystem::path>>
+  findEventsSegments(uint64_t time) {
+    std::vector<std::pair<size_t, std::filesystem::path>> found;
+    const auto first = eventsPath(time, 0);
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      uint64_t fileNum;
+      size_t segment;
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      if (entry.path().filename() == first.filename()) {
+        found.emplace_back(0, entry.path());
+      } else if (isEventsSegment(entry.path(), fileNum, segment) &&
+                 fileNum == time) {
+        found.emplace_back(segment, entry.path());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+  }
+
+  /**
+   * Finds the shard files of snapshot `snapshotTime`, ordered by shard index.
+   * @return Paths of shards 1..N-1 (shard 0 is the `NNNN.snapshot` file).
+   * @throws std::runtime_error if the shard set has gaps.
+   */
+  std::vector<std::filesystem::path> findSnapshotShards(uint64_t snapshotTime) {
+    std::vector<std::pair<size_t, std::filesystem::path>> found;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      uint64_t fileNum;
+      size_t shard;
+      if (entry.is_regular_file() &&
+          isSnapshotShard(entry.path(), fileNum, shard) &&
+          fileNum == snapshotTime) {
+        found.emplace_back(shard, entry.path());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<std::filesystem::path> paths;
+    for (size_t i = 0; i < found.size(); ++i) {
+      if (found[i].first != i + 1) {
+        throw std::runtime_error("corrupted snapshot (missing shard)");
+      }
+      paths.push_back(found[i].second);
+    }
+    return paths;
+  }
+
+  void deleteSnapshotShards(uint64_t snapshotTime) {
+    std::vector<std::filesystem::path> toDelete;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      uint64_t fileNum;
+      size_t shard;
+      if (entry.is_regular_file() &&
+          isSnapshotShard(entry.path(), fileNum, shard) &&
+          fileNum == snapshotTime) {
+        toDelete.push_back(entry.path());
+      }
+    }
+    for (const auto& p : toDelete) {
+      try {
+        std::filesystem::remove(p);
+      } catch (...) {
+      }
+    }
+  }
+
+  /**
+   * Replays snapshot shard 0 (`sf`) into `objects_` on the calling thread and
+   * every other shard into its own map on its own thread, then merges them.
+   */
+  bool replaySnapshotShards(FILE* sf,
+                            const std::vector<std::filesystem::path>& paths) {
+    std::vector<map_type> maps(paths.size());
+    std::vector<char> oks(paths.size(), 0);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      workers.emplace_back([&, i]() {
+        FILE* f = fopen(paths[i].string().c_str(), "rb");
+        if (!f) {
+          return;
+        }
+        FrameBuffer fb;
+        IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
+        oks[i] = replay(f, maps[i], fb, true);
+        IF_CONSTEXPR_REQUIRES_EXPR_EXPR(
+          mapped_type::_logkvStoreSnapshot(false));
+        fclose(f);
+      });
+    }
+    IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
+    bool ok = replay(sf, true);
+    IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(false));
+    for (auto& w : workers) {
+      w.join();
+    }
+    if (!ok || std::find(oks.begin(), oks.end(), 0) != oks.end()) {
+      return false;
+    }
+    if constexpr (requires { objects_.reserve(size_t()); }) {
+      size_t total = objects_.size();
+      for (const auto& m : maps) {
+        total += m.size();
+      }
+      objects_.reserve(total);
+    }
+    for (auto& m : maps) {
+      if constexpr (requires { objects_.merge(m); }) {
+        objects_.merge(m);
+      } else {
+        for (auto& entry : m) {
+          objects_.insert(std::move(entry));
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Deletes the events files, snapshots and delta snapshots older than
+   * `keepSnapshotTime`, or only the events files if `eventsOnly` (the delta
+   * written at `keepSnapshotTime` supersedes them, not the snapshots).
+   */
+  void deleteOldSnapshotsAndEvents(uint64_t keepSnapshotTime,
+                                   bool eventsOnly = false) {
+    StatsClock::time_point start;
+    if (stats_) {
+      start = StatsClock::now();
+    }
+    auto snapshotStem = pad(keepSnapshotTime);
+    std::vector<std::filesystem::path> toDelete;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      if (!entry.is_regular_file())
+        continue;
+      const auto& path = entry.path();
+      auto stem = path.stem().string();
+      if (!std::all_of(stem.begin(), stem.end(), ::isdigit))
+        continue;
+      auto ext = path.extension().string();
+      uint64_t fileNum = std::stoull(stem);
+      if (ext == ".events") {
+        if (fileNum < keepSnapshotTime) {
+          toDelete.push_back(path);
+        }
+      } else if (ext == ".snapshot" || ext == ".delta") {
+        if (fileNum < keepSnapshotTime && !eventsOnly) {
+          toDelete.push_back(path);
+        }
+      }
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      uint64_t fileNum;
+      size_t index;
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      if ((!eventsOnly && isSnapshotShard(entry.path(), fileNum, index) &&
+           fileNum < keepSnapshotTime) ||
+          (isEventsSegment(entry.path(), fileNum, index) &&
+           fileNum < keepSnapshotTime)) {
+        toDelete.push_back(entry.path());
+      }
+    }
+    uint64_t deleted = 0;
+    for (const auto& p : toDelete) {
+      try {
+        deleted += std::filesystem::remove(p);
+      } catch (...) {
+      }
+    }
+    if (stats_) {
+      stats_->deletedFiles.fetch_add(deleted, std::memory_order_relaxed);
+      stats_->deleteOld.record(elapsedNanos(start));
+    }
+  }
+
+  void writeFrame(FileWriter* f) { writeFrame(f, buffer_); }
+
+  void writeFrame(FileWriter* f, FrameBuffer& fb) {
+    if (fb.writeOffset == 0)
+      return;
+    StatsClock::time_point start;
+    if (stats_) {
+      start = StatsClock::now();
+    }
+    const char* payload = fb.data.data();
+    uint32_t payloadSize = static_cast<uint32_t>(fb.writeOffset);
+    fb.payloadBytes += payloadSize;
+    fb.maxFrameSize = std::max(fb.maxFrameSize, payloadSize);
+    char headerBuf[16];
+    size_t controlIdx = 0;
+    /**
+     * Compressed frames start with a 6-byte prefix: `CompressedFrame` (the
+     * control byte of an empty CRC32 frame, which is never written), the
+     * codec, and the 4-byte uncompressed size. A regular frame header
+     * follows, whose size and CRC refer to the compressed payload.
+     */
+    if (compression_ != CompressionCodec::noCompression &&
+        payloadSize >= compressionThreshold_) {
+      fb.compressed.resize(logkv::compressBound(compression_, payloadSize));
+      size_t compressedSize =
+        logkv::compress(compression_, payload, payloadSize,
+                        fb.compressed.data(), fb.compressed.size());
+      if (compressedSize > 0 && compressedSize < payloadSize) {
+        headerBuf[0] = static_cast<char>(CompressedFrame);
+        headerBuf[1] = static_cast<char>(compression_);
+        std::memcpy(headerBuf + 2, &payloadSize, 4);
+        controlIdx = 6;
+        payload = fb.compressed.data();
+        payloadSize = static_cast<uint32_t>(compressedSize);
+      }
+    }
+    const size_t headerSize =
+      controlIdx + encodeFrameHeader(headerBuf + controlIdx, payload,
+                                      payloadSize);
+    f->write(headerBuf, headerSize);
+    f->write(payload, payloadSize);
+    const bool flushed = !deferFlush(f, fb);
+    if (flushed) {
+      f->flush();
+    }
+    const bool events = isEventsFile(f, fb);
+    if (events) {
+      if (observer_) {
+        observer_->onEventsFrame(time_, eventsFileSize_, headerBuf, headerSize,
+                                 payload, payloadSize);
+      }
+      eventsFileSize_ += headerSize + payloadSize;
+      logged(headerSize + payloadSize);
+      if (flushed) {
+        eventsFlushed();
+      }
+    }
+    fb.writeOffset = 0;
+    if (stats_) {
+      countFrame(headerBuf[controlIdx], headerSize + payloadSize);
+      if (controlIdx) {
+        stats_->compressedFrames.fetch_add(1, std::memory_order_relaxed);
+      }
+      stats_->writeFrame.record(elapsedNanos(start));
+    }
+    if (events && segmentSize_ &&
+        eventsFileSize_ - eventsSegmentBase_ >= segmentSize_) {
+      rotateEventsFile(); // frame chains are only written after a frame
+    }
+  }
+
+  /**
+   * Counts a written frame with the given control byte and total size.
+   */
+  void countFrame(uint8_t control, size_t size) {
+    stats_->frames.fetch_add(1, std::memory_order_relaxed);
+    stats_->frameBytes.fetch_add(size, std::memory_order_relaxed);
+    ((control & 0x20) ? stats_->crc32Frames : stats_->crc16Frames)
+      .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Encodes the header of a frame with the given payload into `headerBuf`,
+   * with a CRC32 if `crc32` or required by the store's settings.
+   * @return Header size (at most 8 bytes).
+   */
+  size_t encodeFrameHeader(char* headerBuf, const char* payload,
+                           uint32_t payloadSize, bool crc32 = false) const {
+    size_t headerIdx = 1;
+    /**
+     * First byte is the control byte:
+     * Bits 0-4: first 5 bits of the frame size.
+     * Bit 5: 1 = CRC32 (4 bytes), 0 = CRC16 (2 bytes).
+     * Bits 6-7: extra size bytes (0 to 3 bytes).
+     */
+    uint8_t control = payloadSize & 0x1F;
+    uint32_t extra = payloadSize >> 5;
+    bool isCRC32 =
+      crc32 || forceCRC32_ || (payloadSize >= MinCRC32PayloadSize);
+    if (isCRC32) {
+      control |= 0x20;
+    }
+    if (extra > 0) {
+      if (extra <= 0xFF) {
+        control |= 0x40; // 01 (1 extra byte)
+        headerBuf[headerIdx++] = static_cast<char>(extra);
+      } else if (extra <= 0xFFFF) {
+        control |= 0x80; // 10 (2 extra bytes)
+        uint16_t e = static_cast<uint16_t>(extra);
+        std::memcpy(headerBuf + headerIdx, &e, 2);
+        headerIdx += 2;
+      } else {
+        control |= 0xC0; // 11 (3 extra bytes)
+        std::memcpy(headerBuf + headerIdx, &extra, 3);
+        headerIdx += 3;
+      }
+    }
+    headerBuf[0] = control;
+    if (isCRC32) {
+      uint32_t checksum = logkv::computeCRC32(payload, payloadSize);
+      std::memcpy(headerBuf + headerIdx, &checksum, 4);
+      headerIdx += 4;
+    } else {
+      uint16_t checksum = logkv::computeCRC16(payload, payloadSize);
+      std::memcpy(headerBuf + headerIdx, &checksum, 2);
+      headerIdx += 2;
+    }
+    return headerIdx;
+  }
+
+  /**
+   * Writes `size` bytes at `offset` of a serialized object as a frame chain
+   * segment. A frame chain carries an object (e.g. a K,V pair) that is
+   * larger than the buffer: each segment is a regular, uncompressed frame
+   * with a 6-byte prefix: `CompressedFrame`, the segment kind (see
+   * `ChainSegmentKind`; never a valid codec) and the 4-byte offset of the
+   * segment in the chain payload. Readers concatenate the segment payloads
+   * up to the `ChainEnd` segment into the payload of one logical frame.
+   */
+  void writeChainSegment(FileWriter* f, FrameBuffer& fb, uint8_t kind,
+                         size_t offset, const char* data, size_t size) {
+    if (offset + size > std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error("object too large for a frame chain");
+    }
+    fb.payloadBytes += size;
+    char headerBuf[16];
+    const uint32_t chainOffset = static_cast<uint32_t>(offset);
+    headerBuf[0] = static_cast<char>(CompressedFrame);
+    headerBuf[1] = static_cast<char>(kind);
+    std::memcpy(headerBuf + 2, &chainOffset, 4);
+    const size_t headerSize =
+      6 + encodeFrameHeader(headerBuf + 6, data, static_cast<uint32_t>(size));
+    f->write(headerBuf, headerSize);
+    f->write(data, size);
+    const bool flushed = !deferFlush(f, fb);
+    if (flushed) {
+      f->flush();
+    }
+    if (isEventsFile(f, fb)) {
+      if (observer_) {
+        observer_->onEventsFrame(time_, eventsFileSize_, headerBuf, headerSize,
+                                 data, size);
+      }
+      eventsFileSize_ += headerSize + size;
+      logged(headerSize + size);
+      if (flushed) {
+        eventsFlushed();
+      }
+    }
+    if (stats_) {
+      countFrame(headerBuf[6], headerSize + size);
+      stats_->chainSegments.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Serializer format version of `T` recorded in snapshots: its
+   * `serializer<T>::format_version`, or 0 if it declares none.
+   */
+  template <typename T> static constexpr uint32_t serializerVersion() {
+    if constexpr (requires { logkv::serializer<T>::format_version; }) {
+      return logkv::serializer<T>::format_version;
+    } else {
+      return 0;
+    }
+  }
+
+  /**
+   * @return A `SnapshotInfo` of the serializer versions, and of the oldest
+   * format version that has no front-coded keys, so that older versions can
+   * still load snapshots that don't use them.
+   */
+  static SnapshotInfo snapshotInfo() {
+    SnapshotInfo info;
+    info.version = 1;
+    info.keyVersion = serializerVersion<key_type>();
+    info.valueVersion = serializerVersion<mapped_type>();
+    return info;
+  }
+
+  /**
+   * Writes a snapshot header or footer record (see `SnapshotRecordKind`).
+   * A record has a 6-byte prefix like that of a compressed frame:
+   * `CompressedFrame`, the record kind (never a valid codec) and the 4-byte
+   * format version. A CRC32 frame with the fixed-size `SnapshotInfo`
+   * payload follows, so every record takes `SnapshotRecordSize` bytes and
+   * the footer can be read at a fixed offset from the end of the file.
+   * Replay skips records.
+   */
+  void writeSnapshotRecord(FileWriter* f, uint8_t kind,
+                           const SnapshotInfo& info) {
+    char buf[SnapshotRecordSize];
+    char* payload = buf + SnapshotRecordSize - SnapshotInfoSize;
+    std::memcpy(payload, &info.entries, 8);
+    std::memcpy(payload + 8, &info.payloadBytes, 8);
+    std::memcpy(payload + 16, &info.maxFrameSize, 4);
+    std::memcpy(payload + 20, &info.keyVersion, 4);
+    std::memcpy(payload + 24, &info.valueVersion, 4);
+    std::memcpy(payload + 28, &info.keyRestart, 4); // 0 (reserved) before 2
+    buf[0] = static_cast<char>(CompressedFrame);
+    buf[1] = static_cast<char>(kind);
+    std::memcpy(buf + 2, &info.version, 4);
+    encodeFrameHeader(buf + 6, payload, SnapshotInfoSize, true);
+    f->write(buf, SnapshotRecordSize);
+    if (!f->isAsync()) { // never an events file, so not `deferFlush()`
+      f->flush();
+    }
+  }
+
+  static bool isSnapshotRecord(uint8_t codec) {
+    return codec == SnapshotHeader || codec == SnapshotFooter;
+  }
+
+  /**
+   * Parses and verifies the snapshot record at `ptr`.
+   * @return A `ReadResult`.
+   */
+  static int parseSnapshotRecord(const char* ptr, size_t avail, uint8_t& kind,
+                                 SnapshotInfo& info) {
+    if (avail < SnapshotRecordSize) {
+      return RR_Frame_Underflow;
+    }
+    kind = static_cast<uint8_t>(ptr[1]);
+    const uint8_t control = static_cast<uint8_t>(ptr[6]);
+    if (static_cast<uint8_t>(ptr[0]) != CompressedFrame ||
+        !isSnapshotRecord(kind) || !(control & 0x20)) {
+      return RR_Frame_Corrupted;
+    }
+    uint32_t payloadSize, crc;
+    const size_t headerSize =
+      7 + decodeFrameHeader(control, ptr + 7, payloadSize, crc);
+    const char* payload = ptr + headerSize;
+    if (headerSize + SnapshotInfoSize != SnapshotRecordSize ||
+        payloadSize != SnapshotInfoSize ||
+        !checkFrameCRC(control, payload, payloadSize, crc)) {
+      return RR_Frame_Corrupted;
+    }
+    std::memcpy(&info.version, ptr + 2, 4);
+    if (info.version == 0 || info.version > SnapshotFormatVersion) {
+      return RR_Frame_Corrupted; // unknown format
+    }
+    std::memcpy(&info.entries, payload, 8);
+    std::memcpy(&info.payloadBytes, payload + 8, 8);
+    std::memcpy(&info.maxFrameSize, payload + 16, 4);
+    std::memcpy(&info.keyVersion, payload + 20, 4);
+    std::memcpy(&info.valueVersion, payload + 24, 4);
+    if (info.version >= 2) {
+      std::memcpy(&info.keyRestart, payload + 28, 4);
+    }
+    return RR_Success;
+  }
+
+  /**
+   * Verifies and skips the snapshot record at the current mapped position
+   * or, if not mapped, at the record's control byte and prefix just read
+   * from `f`.
+   */
+  static int skipSnapshotRecord(FILE* f, FrameBuffer& fb) {
+    char buf[SnapshotRecordSize];
+    const char* ptr = buf;
+    size_t avail;
+    if (fb.mapped) {
+      ptr = fb.mapped + fb.mappedOffset;
+      avail = fb.mappedSize - fb.mappedOffset;
+    } else {
+      if (fseek(f, -7, SEEK_CUR) != 0) {
+        return RR_Frame_Corrupted;
+      }
+      avail = fread(buf, 1, SnapshotRecordSize, f);
+    }
+    uint8_t kind;
+    SnapshotInfo info;
+    int rs = parseSnapshotRecord(ptr, avail, kind, info);
+    if (rs == RR_Success && fb.mapped) {
+      fb.mappedOffset += SnapshotRecordSize;
+    }
+    return rs;
+  }
+
+  /**
+   * Reads the header and footer of the snapshot file `f` and seeks back to
+   * its start.
+   * @param info Set to the footer's metadata, or reset if `f` has no header.
+   * @return A `ReadResult`; `RR_Frame_Underflow` if `f` has a header but no
+   * footer.
+   */
+  static int readSnapshotInfo(FILE* f, std::optional<SnapshotInfo>& info) {
+    info.reset();
+    if (fseek(f, 0, SEEK_SET) != 0) {
+      return RR_Frame_Corrupted;
+    }
+    char buf[SnapshotRecordSize];
+    size_t n = fread(buf, 1, SnapshotRecordSize, f);
+    int rs = RR_Success;
+    if (n >= 2 && static_cast<uint8_t>(buf[0]) == CompressedFrame &&
+        isSnapshotRecord(static_cast<uint8_t>(buf[1]))) {
+      uint8_t kind;
+      SnapshotInfo header, footer;
+      rs = parseSnapshotRecord(buf, n, kind, header);
+      if (rs == RR_Success && kind != SnapshotHeader) {
+        rs = RR_Frame_Corrupted;
+      }
+      if (rs == RR_Success) {
+        const long offset = -static_cast<long>(SnapshotRecordSize);
+        if (fseek(f, offset, SEEK_END) != 0 ||
+            fread(buf, 1, SnapshotRecordSize, f) != SnapshotRecordSize ||
+            static_cast<uint8_t>(buf[0]) != CompressedFrame ||
+            static_cast<uint8_t>(buf[1]) != SnapshotFooter) {
+          rs = RR_Frame_Underflow; // no footer
+        } else {
+          rs = parseSnapshotRecord(buf, SnapshotRecordSize, kind, footer);
+        }
+      }
+      if (rs == RR_Success) {
+        info = footer;
+      }
+    }
+    if (fseek(f, 0, SEEK_SET) != 0) {
+      return RR_Frame_Corrupted;
+    }
+    return rs;
+  }
+
+  /**
+   * Decodes the frame header that follows the control byte.
+   * @return Size of the frame header after the control byte.
+   */
+  static size_t decodeFrameHeader(uint8_t control, const char* headerBuf,
+                                  uint32_t& payloadSize, uint32_t& crc) {
+    const int extraLenBytes = (control >> 6) & 0x03;
+    const int crcBytes = (control & 0x20) ? 4 : 2;
+    payloadSize = (control & 0x1F);
+    if (extraLenBytes > 0) {
+      uint32_t extraValue = 0;
+      std::memcpy(&extraValue, headerBuf, extraLenBytes);
+      payloadSize |= (extraValue << 5);
+    }
+    crc = 0;
+    std::memcpy(&crc, headerBuf + extraLenBytes, crcBytes);
+    return extraLenBytes + crcBytes;
+  }
+
+  static size_t frameHeaderSize(uint8_t control) {
+    return ((control >> 6) & 0x03) + ((control & 0x20) ? 4 : 2);
+  }
+
+  static bool checkFrameCRC(uint8_t control, const char* payload,
+                            uint32_t payloadSize, uint32_t crc) {
+    if (control & 0x20) {
+      return logkv::computeCRC32(payload, payloadSize) == crc;
+    }
+    return logkv::computeCRC16(payload, payloadSize) ==
+           static_cast<uint16_t>(crc);
+  }
+
+  /**
+   * Reads a frame from disk into the buffer and verifies integrity.
+   * Returns a `ReadResult` enum value, where 0 is success and any
+   * non-zero indicates failure.
+   */
+  int readFrame(FILE* f, FrameBuffer& fb) {
+    releaseChain(fb);
+    if (fb.mapped) {
+      return readMappedFrame(fb);
+    }
+    uint8_t control = 0;
+    if (fread(&control, 1, 1, f) != 1) {
+      return RR_Frame_EOF;
+    }
+    if (control == 0) {
+      return readPadding(f, fb);
+    }
+    uint8_t codec;
+    uint32_t rawSize;
+    int rp = readCompressedPrefix(f, control, codec, rawSize);
+    if (rp != RR_Success) {
+      return rp;
+    }
+    if (isSnapshotRecord(codec)) {
+      int rs = skipSnapshotRecord(f, fb);
+      return rs == RR_Success ? readFrame(f, fb) : rs;
+    }
+    if (codec >= ChainSegment) {
+      if (fseek(f, -7, SEEK_CUR) != 0) {
+        return RR_Frame_Corrupted;
+      }
+      int rc = readChain(f, fb, fb.chain);
+      if (rc == RR_Chain_Aborted) {
+        return readFrame(f, fb);
+      }
+      fb.frame = fb.chain.data();
+      fb.writeOffset = fb.chain.size();
+      fb.readOffset = 0;
+      return rc;
+    }
+    const size_t remainingHeaderSize = frameHeaderSize(control);
+    char headerBuf[8];
+    if (fread(headerBuf, 1, remainingHeaderSize, f) != remainingHeaderSize) {
+      return RR_Frame_Underflow; // truncated frame header
+    }
+    uint32_t payloadSize, diskCRC;
+    decodeFrameHeader(control, headerBuf, payloadSize, diskCRC);
+    std::vector<char>& dest = codec ? fb.compressed : fb.data;
+    if (dest.size() < payloadSize) {
+      dest.resize(payloadSize);
+      if (stats_ && !codec) {
+        stats_->bufferResizes.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (fread(dest.data(), 1, payloadSize, f) != payloadSize) {
+      return RR_Frame_Underflow; // truncated frame payload
+    }
+    if (!checkFrameCRC(control, dest.data(), payloadSize, diskCRC)) {
+      return RR_Frame_Corrupted;
+    }
+    if (codec) {
+      if (!decompressFrame(codec, dest.data(), payloadSize, rawSize,
+                           fb.data)) {
+        return RR_Frame_Corrupted;
+      }
+      payloadSize = rawSize;
+    }
+    fb.frame = fb.data.data();
+    fb.writeOffset = payloadSize;
+    fb.readOffset = 0;
+    return RR_Success;
+  }
+
+  /**
+   * If `control` is the `CompressedFrame` marker, reads the rest of the
+   * compressed frame prefix and replaces `control` with the control byte of
+   * the frame that follows it; otherwise sets `codec` to 0.
+   */
+  static int readCompressedPrefix(FILE* f, uint8_t& control, uint8_t& codec,
+                                  uint32_t& rawSize) {
+    codec = CompressionCodec::noCompression;
+    rawSize = 0;
+    if (control != CompressedFrame) {
+      return RR_Success;
+    }
+    char prefix[6];
+    if (fread(prefix, 1, sizeof(prefix), f) != sizeof(prefix)) {
+      return RR_Frame_Underflow;
+    }
+    codec = static_cast<uint8_t>(prefix[0]);
+    std::memcpy(&rawSize, prefix + 1, 4);
+    control = static_cast<uint8_t>(prefix[5]);
+    if (codec == CompressionCodec::noCompression || control == 0 ||
+        control == CompressedFrame) {
+      return RR_Frame_Corrupted;
+    }
+    return RR_Success;
+  }
+
+  /**
+   * Reads a frame chain (see `writeChainSegment()`) from the current file or
+   * mapped position, verifying each segment, into `out`.
+   * @return A `ReadResult`; `RR_Chain_Aborted` if the chain was discarded by
+   * the writer (the next frame follows it).
+   */
+  static int readChain(FILE* f, FrameBuffer& fb, std::vector<char>& out) {
+    out.clear();
+    uint8_t kind;
+    do {
+      int rs = readChainSegment(f, fb, kind, out);
+      if (rs != RR_Success) {
+        return rs;
+      }
+    } while (kind == ChainSegment);
+    if (kind == ChainAbort) {
+      out.clear();
+      return RR_Chain_Aborted;
+    }
+    return RR_Success;
+  }
+
+  /**
+   * Reads the next frame chain segment, appending its payload to `out`.
+   */
+  static int readChainSegment(FILE* f, FrameBuffer& fb, uint8_t& kind,
+                              std::vector<char>& out) {
+    constexpr size_t prefixSize = 7; // including the segment's control byte
+    char headerBuf[prefixSize + 8];
+    const char* ptr = fb.mapped ? fb.mapped + fb.mappedOffset : nullptr;
+    const size_t avail = fb.mapped ? fb.mappedSize - fb.mappedOffset : 0;
+    auto readBytes = [&](char* dest, size_t offset, size_t n) {
+      if (ptr) {
+        if (avail < offset + n) {
+          return false;
+        }
+        std::memcpy(dest, ptr + offset, n);
+        return true;
+      }
+      return fread(dest, 1, n, f) == n;
+    };
+    if (!readBytes(headerBuf, 0, prefixSize)) {
+      return RR_Frame_Underflow; // truncated chain
+    }
+    kind = static_cast<uint8_t>(headerBuf[1]);
+    uint32_t offset;
+    std::memcpy(&offset, headerBuf + 2, 4);
+    const uint8_t control = static_cast<uint8_t>(headerBuf[6]);
+    if (static_cast<uint8_t>(headerBuf[0]) != CompressedFrame ||
+        kind < ChainSegment || kind > ChainAbort || offset != out.size() ||
+        control == 0 || control == CompressedFrame) {
+      return RR_Frame_Corrupted;
+    }
+    const size_t headerSize = frameHeaderSize(control);
+    if (!readBytes(headerBuf + prefixSize, prefixSize, headerSize)) {
+      return RR_Frame_Underflow;
+    }
+    uint32_t payloadSize, diskCRC;
+    decodeFrameHeader(control, headerBuf + prefixSize, payloadSize, diskCRC);
+    if (payloadSize > std::numeric_limits<uint32_t>::max() - out.size()) {
+      return RR_Frame_Corrupted;
+    }
+    const size_t base = out.size();
+    out.resize(base + payloadSize);
+    if (!readBytes(out.data() + base, prefixSize + headerSize, payloadSize)) {
+      return RR_Frame_Underflow;
+    }
+    if (!checkFrameCRC(control, out.data() + base, payloadSize, diskCRC)) {
+      return RR_Frame_Corrupted;
+    }
+    if (ptr) {
+      fb.mappedOffset += prefixSize + headerSize + payloadSize;
+    }
+    return RR_Success;
+  }
+
+  /**
+   * Frees the payload of the last frame chain read, so a huge object
+   * doesn't keep its memory after it has been deserialized.
+   */
+  static void releaseChain(FrameBuffer& fb) {
+    if (fb.chain.capacity() > 0) {
+      std::vector<char>().swap(fb.chain);
+    }
+  }
+
+  /**
+   * Decompresses a verified frame payload into `out`.
+   * @return `false` if the payload doesn't decompress to `rawSize` bytes.
+   */
+  static bool decompressFrame(uint8_t codec, const char* payload,
+                              uint32_t payloadSize, uint32_t rawSize,
+                              std::vector<char>& out) {
+    if (rawSize > MaxBufferSize) {
+      return false;
+    }
+    if (out.size() < rawSize) {
+      out.resize(rawSize);
+    }
+    return logkv::decompress(codec, payload, payloadSize, out.data(), rawSize);
+  }
+
+  /**
+   * Called after reading a zero control byte, which no frame has since frames
+   * are never empty. If the rest of the file is all zeros, it is padding left
+   * by a direct I/O writer that wasn't closed (see `logkv::UringFileWriter`)
+   * and marks the end of the log; otherwise the frame is corrupted.
+   */
+  static int readPadding(FILE* f, FrameBuffer& fb) {
+    long pos = ftell(f);
+    if (pos <= 0) {
+      return RR_Frame_Corrupted;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      if (!std::all_of(buf, buf + n, [](char c) { return c == 0; })) {
+        return RR_Frame_Corrupted;
+      }
+    }
+    fb.padding = static_cast<uint64_t>(pos - 1);
+    return RR_Frame_EOF;
+  }
+
+  /**
+   * Verifies the next frame in the mapped file and points `fb.frame` at its
+   * payload, without copying it.
+   * Returns a `ReadResult` enum value, where 0 is success and any
+   * non-zero indicates failure.
+   */
+  int readMappedFrame(FrameBuffer& fb, bool verify = true) {
+    const size_t avail = fb.mappedSize - fb.mappedOffset;
+    if (avail == 0) {
+      return RR_Frame_EOF;
+    }
+    const char* ptr = fb.mapped + fb.mappedOffset;
+    uint8_t control = static_cast<uint8_t>(ptr[0]);
+    if (control == 0) {
+      if (!std::all_of(ptr, ptr + avail, [](char c) { return c == 0; })) {
+        return RR_Frame_Corrupted;
+      }
+      fb.padding = fb.mappedOffset;
+      return RR_Frame_EOF;
+    }
+    size_t prefixSize = 0;
+    uint8_t codec = CompressionCodec::noCompression;
+    uint32_t rawSize = 0;
+    if (control == CompressedFrame) {
+      prefixSize = 6;
+      if (avail <= prefixSize) {
+        return RR_Frame_Underflow; // truncated compressed frame prefix
+      }
+      codec = static_cast<uint8_t>(ptr[1]);
+      if (isSnapshotRecord(codec)) {
+        int rs = skipSnapshotRecord(nullptr, fb);
+        return rs == RR_Success ? readMappedFrame(fb, verify) : rs;
+      }
+      if (codec >= ChainSegment) {
+        int rc = readChain(nullptr, fb, fb.chain);
+        if (rc == RR_Chain_Aborted) {
+          return readMappedFrame(fb, verify);
+        }
+        fb.frame = fb.chain.data();
+        fb.frameCodec = ChainEnd; // verified chain payload in `fb.chain`
+        fb.writeOffset = fb.chain.size();
+        fb.readOffset = 0;
+        return rc;
+      }
+      std::memcpy(&rawSize, ptr + 2, 4);
+      control = static_cast<uint8_t>(ptr[prefixSize]);
+      if (codec == CompressionCodec::noCompression || control == 0 ||
+          control == CompressedFrame) {
+        return RR_Frame_Corrupted;
+      }
+    }
+    if (avail - prefixSize - 1 < frameHeaderSize(control)) {
+      return RR_Frame_Underflow; // truncated frame header
+    }
+    uint32_t payloadSize, diskCRC;
+    const size_t headerSize =
+      prefixSize + 1 +
+      decodeFrameHeader(control, ptr + prefixSize + 1, payloadSize, diskCRC);
+    if (avail - headerSize < payloadSize) {
+      return RR_Frame_Underflow; // truncated frame payload
+    }
+    const char* payload = ptr + headerSize;
+    fb.frame = payload;
+    fb.frameControl = control;
+    fb.frameCRC = diskCRC;
+    fb.frameCodec = codec;
+    fb.frameRawSize = rawSize;
+    fb.writeOffset = payloadSize;
+    if (verify) {
+      if (!checkFrameCRC(control, payload, payloadSize, diskCRC)) {
+        return RR_Frame_Corrupted;
+      }
+      if (codec) {
+        if (!decompressFrame(codec, payload, payloadSize, rawSize, fb.data)) {
+          return RR_Frame_Corrupted;
+        }
+        fb.frame = fb.data.data();
+        fb.writeOffset = rawSize;
+      }
+    }
+    fb.readOffset = 0;
+    fb.mappedOffset += headerSize + payloadSize;
+    return RR_Success;
+  }
+
+  /**
+   * Returns a `ReadResult` enum value, where 0 is success and any
+   * non-zero indicates failure.
+   * Throwing anywhere in here means a corrupted file, and depending
+   * on the code returned it can also mean a corrupted file.
+   */
+  template <typename T>
+  int readObject(FILE* f, FrameBuffer& fb, T& out) {
+    if (fb.readOffset >= fb.writeOffset) {
+      int rf = readFrame(f, fb);
+      if (rf != RR_Success) {
+        return rf;
+      }
+    }
+    const char* inptr = fb.frame + fb.readOffset;
+    size_t avail = fb.writeOffset - fb.readOffset;
+    size_t used = logkv::serializer<T>::read(inptr, avail, out);
+    if (used > avail) {
+      // Broken object deserializer code trying to read beyond its frame
+      return RR_Object_Corrupted;
+    }
+    fb.readOffset += used;
+    return RR_Success;
+  }
+
+  /**
+   * Reads a key like `readObject()`, or a front-coded key if `fb.frontCoded`.
+   */
+  int readKey(FILE* f, FrameBuffer& fb, key_type& key) {
+    if (!fb.frontCoded) {
+      return readObject(f, fb, key);
+    }
+    if (fb.readOffset >= fb.writeOffset) {
+      int rf = readFrame(f, fb);
+      if (rf != RR_Success) {
+        return rf;
+      }
+    }
+    size_t avail = fb.writeOffset - fb.readOffset;
+    size_t used = readKey(fb.frame + fb.readOffset, avail, key, &fb.lastKey);
+    if (used > avail) {
+      return RR_Object_Corrupted;
+    }
+    fb.readOffset += used;
+    return RR_Success;
+  }
+
+  /**
+   * Reads a key from `src` like `serializer<K>::read()` or, if `lastKey` is
+   * given, a front-coded key (see `writeFrontCoded()`) that follows the key
+   * in `lastKey`, which is then updated to the key read.
+   * @throws std::runtime_error if the front-coded key is corrupted.
+   */
+  static size_t readKey(const char* src, size_t size, key_type& key,
+                        std::vector<char>* lastKey) {
+    if constexpr (frontCodableKeys) {
+      if (lastKey) {
+        VarUint<uint64_t> shared, suffix;
+        size_t n = logkv::serializer<VarUint<uint64_t>>::read(src, size,
+                                                              shared);
+        if (n > size) {
+          return n;
+        }
+        size_t m = logkv::serializer<VarUint<uint64_t>>::read(
+          src + n, size - n, suffix);
+        if (m > size - n) {
+          return n + m;
+        }
+        n += m;
+        if (shared.value > lastKey->size() ||
+            suffix.value > MAX_AUTOSER_BYTES - shared.value) {
+          throw std::runtime_error("corrupted front-coded key");
+        }
+        if (size - n < suffix.value) {
+          return n + suffix.value;
+        }
+        lastKey->resize(shared.value + suffix.value);
+        if (suffix.value) {
+          std::memcpy(lastKey->data() + shared.value, src + n, suffix.value);
+        }
+        key.resize(lastKey->size());
+        if (!lastKey->empty()) {
+          std::memcpy(key.data(), lastKey->data(), lastKey->size());
+        }
+        return n + suffix.value;
+      }
+    }
+    return logkv::serializer<key_type>::read(src, size, key);
+  }
+
+  /**
+   * Sink that serializes objects into a frame buffer for `writeObjects()`.
+   * If the objects overflow the current frame, the frame before them is
+   * sealed and they are moved to the start of the buffer. If they don't fit
+   * in the whole buffer either, they are written as a frame chain (see
+   * `writeChainSegment()`) when frame chaining is enabled, or else the
+   * buffer grows. With `cancelOnSeal`, the objects are instead dropped once
+   * the frame before them is sealed (see `cancelled()`).
+   */
+  class FrameSink : public Sink {
+  public:
+    FrameSink(Store& store, FileWriter* f, FrameBuffer& fb,
+              bool cancelOnSeal = false)
+        : Sink(fb.data, fb.writeOffset, MaxBufferSize), store_(store), f_(f),
+          fb_(fb), bufferSize_(fb.data.size()), cancelOnSeal_(cancelOnSeal) {
+      split_ = store.frameChaining_;
+    }
+
+    /**
+     * @return `true` if the objects were dropped after sealing the frame
+     * before them, so the caller must write them again, at the start of the
+     * next frame (and `finish()` must not be called).
+     */
+    bool cancelled() const { return cancelled_; }
+
+    /**
+     * Completes the objects.
+     * @return Their serialized size.
+     */
+    size_t finish() {
+      if (chained_) {
+        store_.writeChainSegment(f_, fb_, ChainEnd, drained_, dest_, pos_);
+        fb_.writeOffset = 0;
+      } else {
+        fb_.writeOffset = offset_ + pos_;
+      }
+      if (fb_.data.size() > bufferSize_) {
+        if (split_) {
+          fb_.data.resize(bufferSize_);
+          fb_.data.shrink_to_fit();
+        } else {
+          size_t targetSz = bufferSize_;
+          while (targetSz < fb_.writeOffset) {
+            targetSz *= 2;
+          }
+          fb_.data.resize(targetSz);
+        }
+      }
+      return size();
+    }
+
+    /**
+     * Discards the objects after serialization failed. A started chain is
+     * ended with a `ChainAbort` segment so readers skip it.
+     */
+    void abort() {
+      if (chained_) {
+        const char none = 0;
+        store_.writeChainSegment(f_, fb_, ChainAbort, drained_, &none, 1);
+      }
+      if (split_ && fb_.data.size() > bufferSize_) {
+        fb_.data.resize(bufferSize_);
+        fb_.data.shrink_to_fit();
+      }
     }
-    writeOffset_ = 0;
-    try {
-      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(true));
-      for (auto& [k, v] : objects_) {
-        writeUpdate(sf, k, v);
+
+  protected:
+    bool overflow(size_t n) override {
+      if (cancelled_) {
+        return false; // the rest is only counted
       }
-      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_logkvStoreSnapshot(false));
-      flush(sf, true);
-    } catch (std::exception& ex) {
-      closeFile(sf);
-      try {
-        std::filesystem::remove(tempPath);
-      } catch (...) {
+      if (offset_ > 0) {
+        store_.writeFrame(f_, fb_);
+        if (cancelOnSeal_) {
+          cancelled_ = true;
+          split_ = false;
+          return false;
+        }
+        drain(0, 0);
+        if (pos_ + n <= capacity_) {
+          return true;
+        }
       }
-      throw ex;
+      if (split_ && pos_ > 0) {
+        store_.writeChainSegment(f_, fb_, ChainSegment, drained_, dest_, pos_);
+        chained_ = true;
+        drain(pos_, 0);
+        if (n <= capacity_) {
+          return true;
+        }
+      }
+      if (store_.stats_) {
+        store_.stats_->bufferResizes.fetch_add(1, std::memory_order_relaxed);
+      }
+      return grow(pos_ + n); // a contiguous write larger than the buffer
     }
-    closeFile(sf);
+
+  private:
+    Store& store_;
+    FileWriter* f_;
+    FrameBuffer& fb_;
+    const size_t bufferSize_;
+    const bool cancelOnSeal_;
+    bool chained_ = false;
+    bool cancelled_ = false;
+  };
+
+  /**
+   * Serializes the given objects into the current frame in a single pass, so
+   * that they (e.g. a K,V pair) never span frames (see `FrameSink`).
+   */
+  template <typename... Ts>
+  size_t writeObjects(FileWriter* f, FrameBuffer& fb, const Ts&... objs) {
+    FrameSink sink(*this, f, fb);
     try {
-      std::filesystem::rename(tempPath, snapshotPath);
-    } catch (const std::exception& e) {
-      try {
-        std::filesystem::remove(tempPath);
-      } catch (...) {
-      }
-      throw std::runtime_error(std::string("failed to rename snapshot: ") +
-                               e.what());
+      (logkv::write_to(sink, objs), ...);
+    } catch (...) {
+      sink.abort();
+      throw;
     }
+    return sink.finish();
   }
 
-  void deleteOldSnapshotsAndEvents(uint64_t keepSnapshotTime) {
-    auto snapshotStem = pad(keepSnapshotTime);
-    std::vector<std::filesystem::path> toDelete;
-    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
-      if (!entry.is_regular_file())
-        continue;
-      const auto& path = entry.path();
-      auto stem = path.stem().string();
-      if (!std::all_of(stem.begin(), stem.end(), ::isdigit))
-        continue;
-      auto ext = path.extension().string();
-      uint64_t fileNum = std::stoull(stem);
-      if (ext == ".events") {
-        if (fileNum < keepSnapshotTime) {
-          toDelete.push_back(path);
+  bool replay(FILE* f, bool snapshot = false) {
+    return replay(f, objects_, buffer_, snapshot);
+  }
+
+  /**
+   * Replays a snapshot or events file into `objects`, adding the replayed keys
+   * to `dirty` if given.
+   */
+  bool replay(FILE* f, map_type& objects, FrameBuffer& fb, bool snapshot,
+              dirty_map_type* dirty = nullptr) {
+    StatsClock::time_point start;
+    if (stats_) {
+      start = StatsClock::now();
+    }
+    fb.padding.reset();
+    fb.frontCoded = false;
+    std::optional<SnapshotInfo> info;
+    if (snapshot) {
+      if (readSnapshotInfo(f, info) != RR_Success ||
+          (info && (info->keyVersion != serializerVersion<key_type>() ||
+                    info->valueVersion != serializerVersion<mapped_type>()))) {
+        return false;
+      }
+      if (info) {
+        if constexpr (requires { objects.reserve(size_t()); }) {
+          if (objects.empty()) {
+            objects.reserve(info->entries);
+          }
         }
-      } else if (ext == ".snapshot") {
-        if (fileNum < keepSnapshotTime) {
-          toDelete.push_back(path);
+        if (info->keyRestart) {
+          if (!frontCodableKeys) {
+            return false;
+          }
+          fb.frontCoded = true;
+          fb.lastKey.clear();
         }
       }
     }
-    for (const auto& p : toDelete) {
-      try {
-        std::filesystem::remove(p);
-      } catch (...) {
+    // `logkv::Lazy` values keep pointing into the mapping after replay.
+    constexpr bool lazyValues =
+      requires { mapped_type::_logkvReplaySource(nullptr); };
+    std::shared_ptr<MappedFile> mf;
+    if (mappedReplay_ || lazyValues) {
+      mf = std::make_shared<MappedFile>(f);
+      if (mf->isMapped()) {
+        fb.mapped = mf->data() ? mf->data() : ""; // empty files have no view
+        fb.mappedSize = mf->size();
+        fb.mappedOffset = 0;
       }
     }
-  }
-
-  void writeFrame(FILE* f) {
-    if (writeOffset_ == 0)
-      return;
-    const uint32_t payloadSize = static_cast<uint32_t>(writeOffset_);
-    char headerBuf[8];
-    size_t headerIdx = 1;
-    /**
-     * First byte is the control byte:
-     * Bits 0-4: first 5 bits of the frame size.
-     * Bit 5: 1 = CRC32 (4 bytes), 0 = CRC16 (2 bytes).
-     * Bits 6-7: extra size bytes (0 to 3 bytes).
-     */
-    uint8_t control = payloadSize & 0x1F;
-    uint32_t extra = payloadSize >> 5;
-    bool isCRC32 = forceCRC32_ || (payloadSize >= MinCRC32PayloadSize);
-    if (isCRC32) {
-      control |= 0x20;
+    if constexpr (lazyValues) {
+      mapped_type::_logkvReplaySource(mf && mf->data() ? mf : nullptr);
     }
-    if (extra > 0) {
-      if (extra <= 0xFF) {
-        control |= 0x40; // 01 (1 extra byte)
-        headerBuf[headerIdx++] = static_cast<char>(extra);
-      } else if (extra <= 0xFFFF) {
-        control |= 0x80; // 10 (2 extra bytes)
-        uint16_t e = static_cast<uint16_t>(extra);
-        std::memcpy(headerBuf + headerIdx, &e, 2);
-        headerIdx += 2;
-      } else {
-        control |= 0xC0; // 11 (3 extra bytes)
-        std::memcpy(headerBuf + headerIdx, &extra, 3);
-        headerIdx += 3;
-      }
+    if (info && !fb.mapped && info->maxFrameSize > fb.data.size() &&
+        info->maxFrameSize <= MaxBufferSize) {
+      fb.data.resize(info->maxFrameSize); // instead of growing per frame
     }
-    headerBuf[0] = control;
-    if (isCRC32) {
-      uint32_t checksum = logkv::computeCRC32(buffer_.data(), payloadSize);
-      std::memcpy(headerBuf + headerIdx, &checksum, 4);
-      headerIdx += 4;
+    // Partial-serializable values are patched in place by events, so they
+    // can only be decoded into fresh values when replaying a snapshot.
+    constexpr bool readsInPlace =
+      requires { mapped_type::_logkvStoreSnapshot(false); };
+    bool ok;
+    if (replayWorkers_ > 0 && (snapshot || !readsInPlace)) {
+      ok = replayPipelined(f, objects, fb, snapshot, dirty);
     } else {
-      uint16_t checksum = logkv::computeCRC16(buffer_.data(), payloadSize);
-      std::memcpy(headerBuf + headerIdx, &checksum, 2);
-      headerIdx += 2;
+      ok = replayFrames(f, objects, fb, dirty);
+    }
+    if constexpr (lazyValues) {
+      mapped_type::_logkvReplaySource(nullptr);
     }
-    if (fwrite(headerBuf, 1, headerIdx, f) != headerIdx ||
-        fwrite(buffer_.data(), 1, payloadSize, f) != payloadSize ||
-        fflush(f) != 0) {
-      throw std::runtime_error("file write error");
+    fb.mapped = nullptr;
+    fb.frame = nullptr;
+    fb.frontCoded = false;
+    releaseChain(fb);
+    if (&fb == &buffer_ && fb.data.size() > bufferSize_) {
+      // Shrink back after reading frames larger than the buffer.
+      fb.data.resize(bufferSize_);
+      fb.data.shrink_to_fit();
     }
-    if (f == events_) {
-      eventsFileSize_ += headerIdx + payloadSize;
+    if (stats_) {
+      stats_->replayedFiles.fetch_add(1, std::memory_order_relaxed);
+      stats_->replay.record(elapsedNanos(start));
     }
-    writeOffset_ = 0;
+    return ok;
   }
 
   /**
-   * Reads a frame from disk into the buffer and verifies integrity.
-   * Returns a `ReadResult` enum value, where 0 is success and any
-   * non-zero indicates failure.
+   * A frame that is being decoded by the `replayPipelined()` workers.
    */
-  int readFrame(FILE* f) {
+  struct ReplayBatch {
+    std::vector<char> payload;
+    const char* data = nullptr;
+    uint32_t size = 0;
     uint8_t control = 0;
-    if (fread(&control, 1, 1, f) != 1) {
-      return RR_Frame_EOF;
-    }
-    const int extraLenBytes = (control >> 6) & 0x03;
-    const bool isCRC32 = (control & 0x20);
-    const int crcBytes = isCRC32 ? 4 : 2;
-    const int remainingHeaderSize = extraLenBytes + crcBytes;
-    char headerBuf[8];
-    if (fread(headerBuf, 1, remainingHeaderSize, f) !=
-        (size_t)remainingHeaderSize) {
-      return RR_Frame_Underflow; // truncated frame header
+    uint32_t crc = 0;
+    uint8_t codec = 0;
+    uint32_t rawSize = 0;
+    std::vector<char> raw; // decompressed payload
+    bool verified = false;     // reassembled frame chain, already verified
+    int result = RR_Success;   // frame read/verification result
+    bool decodeOk = true;      // speculative decode from a K,V boundary
+    bool decoded = false;      // ready for the applier
+    bool trailingKey = false;  // frame ends with a key whose value follows
+    bool frontCoded = false;   // front-coded keys, the first one in full
+    key_type lastKey{};
+    std::vector<std::pair<key_type, mapped_type>> entries;
+  };
+
+  /**
+   * Verifies and decodes a frame into a batch, assuming it starts at a K,V
+   * boundary.
+   */
+  static void decodeBatch(ReplayBatch& b) {
+    if (!b.verified && !checkFrameCRC(b.control, b.data, b.size, b.crc)) {
+      b.result = RR_Frame_Corrupted;
+      return;
     }
-    uint32_t payloadSize = (control & 0x1F);
-    if (extraLenBytes > 0) {
-      uint32_t extraValue = 0;
-      std::memcpy(&extraValue, headerBuf, extraLenBytes);
-      payloadSize |= (extraValue << 5);
+    if (b.codec) {
+      if (!decompressFrame(b.codec, b.data, b.size, b.rawSize, b.raw)) {
+        b.result = RR_Frame_Corrupted;
+        return;
+      }
+      b.data = b.raw.data();
+      b.size = b.rawSize;
     }
-    uint32_t diskCRC = 0;
-    std::memcpy(&diskCRC, headerBuf + extraLenBytes, crcBytes);
-    if (buffer_.size() < payloadSize) {
-      buffer_.resize(payloadSize);
+    try {
+      size_t off = 0;
+      std::vector<char> frontCodedKey;
+      while (off < b.size) {
+        key_type key;
+        size_t avail = b.size - off;
+        size_t used = readKey(b.data + off, avail, key,
+                              b.frontCoded ? &frontCodedKey : nullptr);
+        if (used > avail) {
+          b.decodeOk = false;
+          return;
+        }
+        off += used;
+        if (off == b.size) {
+          if (b.frontCoded) {
+            b.decodeOk = false; // front-coded pairs are never split
+            return;
+          }
+          b.trailingKey = true;
+          b.lastKey = std::move(key);
+          return;
+        }
+        mapped_type value;
+        avail = b.size - off;
+        used = logkv::serializer<mapped_type>::read(b.data + off, avail, value);
+        if (used > avail) {
+          b.decodeOk = false;
+          return;
+        }
+        off += used;
+        b.entries.emplace_back(std::move(key), std::move(value));
+      }
+    } catch (...) {
+      b.decodeOk = false;
     }
-    if (fread(buffer_.data(), 1, payloadSize, f) != payloadSize) {
-      return RR_Frame_Underflow; // truncated frame payload
+  }
+
+  /**
+   * Prepares the key that replay reads each entry into. Keys whose serializer
+   * replaces the whole contents on read (e.g. `Bytes`, `SmallBytes<N>`) are
+   * reused as is, so a key that is already in the map (and thus not moved
+   * out) lends its storage to the next read instead of being freed and
+   * reallocated. Other keys are reset to a fresh `key_type`.
+   */
+  static void resetScratchKey(key_type& key) {
+    if constexpr (!requires {
+                    requires logkv::serializer<key_type>::replaces_on_read;
+                  }) {
+      key = key_type();
     }
-    if (isCRC32) {
-      uint32_t calcCRC = logkv::computeCRC32(buffer_.data(), payloadSize);
-      if (calcCRC != diskCRC) {
-        return RR_Frame_Corrupted;
+  }
+
+  /**
+   * Reads a value for `key` at `data + off` and applies it like
+   * `replayFrames()` does. Returns `false` if the value is corrupted.
+   */
+  static bool applyValue(map_type& objects, key_type& key, const char* data,
+                         size_t size, size_t& off) {
+    size_t avail = size - off;
+    size_t used;
+    auto it = objects.find(key);
+    if (it != objects.end()) {
+      used = logkv::serializer<mapped_type>::read(data + off, avail,
+                                                  it->second);
+      if (used > avail) {
+        return false;
+      }
+      if (logkv::serializer<mapped_type>::is_empty(it->second)) {
+        objects.erase(it);
       }
     } else {
-      uint16_t calcCRC = logkv::computeCRC16(buffer_.data(), payloadSize);
-      if (calcCRC != static_cast<uint16_t>(diskCRC)) {
-        return RR_Frame_Corrupted;
+      mapped_type value;
+      used = logkv::serializer<mapped_type>::read(data + off, avail, value);
+      if (used > avail) {
+        return false;
+      }
+      if (!logkv::serializer<mapped_type>::is_empty(value)) {
+        objects[std::move(key)] = std::move(value);
       }
     }
-    writeOffset_ = payloadSize;
-    readOffset_ = 0;
-    return RR_Success;
+    off += used;
+    return true;
   }
 
   /**
-   * Returns a `ReadResult` enum value, where 0 is success and any
-   * non-zero indicates failure.
-   * Throwing anywhere in here means a corrupted file, and depending
-   * on the code returned it can also mean a corrupted file.
+   * Pipelined replay: an I/O thread splits the file into frames, a pool of
+   * `replayWorkers_` threads verifies and decodes frames into K,V batches, and
+   * the calling thread applies the batches to `objects` in file order.
+   * A frame that starts with the value of a K,V pair split across frames (as
+   * written by older versions) is decoded serially by the applier instead.
    */
-  template <typename T> int readObject(FILE* f, T& out) {
-    if (readOffset_ >= writeOffset_) {
-      int rf = readFrame(f);
-      if (rf != RR_Success) {
+  bool replayPipelined(FILE* f, map_type& objects, FrameBuffer& fb,
+                       bool snapshot, dirty_map_type* dirty) {
+    if (!fb.mapped && fseek(f, 0, SEEK_SET) != 0) {
+      return false;
+    }
+    const size_t maxInFlight = replayWorkers_ * 4;
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<ReplayBatch>> window; // batches in file order
+    size_t undecoded = 0; // index in `window` of the next batch to decode
+    bool eof = false;
+    bool stop = false;
+
+    auto readBatch = [&](ReplayBatch& b) -> int {
+      b.frontCoded = fb.frontCoded;
+      // Frame chains are verified and reassembled by this thread.
+      auto takeChain = [&](int rc) {
+        b.payload.swap(fb.chain);
+        b.data = b.payload.data();
+        b.size = static_cast<uint32_t>(b.payload.size());
+        b.codec = CompressionCodec::noCompression;
+        b.verified = true;
+        return rc;
+      };
+      if (fb.mapped) {
+        int rf = readMappedFrame(fb, false);
+        if (fb.frameCodec == ChainEnd) {
+          fb.frameCodec = CompressionCodec::noCompression;
+          return takeChain(rf);
+        }
+        b.data = fb.frame;
+        b.size = static_cast<uint32_t>(fb.writeOffset);
+        b.control = fb.frameControl;
+        b.crc = fb.frameCRC;
+        b.codec = fb.frameCodec;
+        b.rawSize = fb.frameRawSize;
         return rf;
       }
+      uint8_t control = 0;
+      int rp;
+      bool skipped;
+      do {
+        skipped = false;
+        if (fread(&control, 1, 1, f) != 1) {
+          return RR_Frame_EOF;
+        }
+        if (control == 0) {
+          return readPadding(f, fb);
+        }
+        rp = readCompressedPrefix(f, control, b.codec, b.rawSize);
+        if (rp == RR_Success && isSnapshotRecord(b.codec)) {
+          rp = skipSnapshotRecord(f, fb);
+          skipped = rp == RR_Success;
+        } else if (rp == RR_Success && b.codec >= ChainSegment) {
+          rp = fseek(f, -7, SEEK_CUR) == 0 ? readChain(f, fb, fb.chain)
+                                           : RR_Frame_Corrupted;
+          if (rp != RR_Chain_Aborted) {
+            return takeChain(rp);
+          }
+          skipped = true;
+        }
+      } while (skipped);
+      if (rp != RR_Success) {
+        return rp;
+      }
+      const size_t remainingHeaderSize = frameHeaderSize(control);
+      char headerBuf[8];
+      if (fread(headerBuf, 1, remainingHeaderSize, f) != remainingHeaderSize) {
+        return RR_Frame_Underflow;
+      }
+      decodeFrameHeader(control, headerBuf, b.size, b.crc);
+      b.control = control;
+      b.payload.resize(b.size);
+      if (fread(b.payload.data(), 1, b.size, f) != b.size) {
+        return RR_Frame_Underflow;
+      }
+      b.data = b.payload.data();
+      return RR_Success;
+    };
+
+    std::thread reader([&]() {
+      while (true) {
+        auto b = std::make_unique<ReplayBatch>();
+        int rf = readBatch(*b);
+        std::unique_lock lock(m);
+        cv.wait(lock, [&]() { return stop || window.size() < maxInFlight; });
+        if (stop || rf == RR_Frame_EOF) {
+          eof = true;
+          cv.notify_all();
+          return;
+        }
+        if (rf != RR_Success) {
+          b->result = rf;
+          b->decoded = true; // nothing for the workers to do
+        }
+        window.push_back(std::move(b));
+        if (rf != RR_Success) {
+          eof = true;
+        }
+        cv.notify_all();
+        if (eof) {
+          return;
+        }
+      }
+    });
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < replayWorkers_; ++i) {
+      workers.emplace_back([&]() {
+        if (snapshot) {
+          IF_CONSTEXPR_REQUIRES_EXPR_EXPR(
+            mapped_type::_logkvStoreSnapshot(true));
+        }
+        std::unique_lock lock(m);
+        while (true) {
+          cv.wait(lock, [&]() {
+            return stop || eof || undecoded < window.size();
+          });
+          if (stop || undecoded >= window.size()) {
+            break;
+          }
+          ReplayBatch* b = window[undecoded++].get();
+          if (b->decoded) {
+            continue;
+          }
+          lock.unlock();
+          decodeBatch(*b);
+          lock.lock();
+          b->decoded = true;
+          cv.notify_all();
+        }
+        if (snapshot) {
+          IF_CONSTEXPR_REQUIRES_EXPR_EXPR(
+            mapped_type::_logkvStoreSnapshot(false));
+        }
+      });
     }
-    const char* inptr = buffer_.data() + readOffset_;
-    size_t avail = writeOffset_ - readOffset_;
-    size_t used = logkv::serializer<T>::read(inptr, avail, out);
-    if (used > avail) {
-      // Broken object deserializer code trying to read beyond its frame
-      return RR_Object_Corrupted;
-    }
-    readOffset_ += used;
-    return RR_Success;
-  }
 
-  template <typename T> size_t writeObject(FILE* f, const T& obj) {
-    size_t avail = buffer_.size() - writeOffset_;
-    size_t used =
-      logkv::serializer<T>::write(buffer_.data() + writeOffset_, avail, obj);
-    if (used > avail) {
-      writeFrame(f);
-      if (buffer_.size() < used) {
-        size_t targetSz = buffer_.size() * 2;
-        while (targetSz < used) {
-          targetSz *= 2;
+    bool ok = true;
+    bool pending = false;
+    key_type pendingKey{};
+    try {
+      while (true) {
+        std::unique_ptr<ReplayBatch> b;
+        {
+          std::unique_lock lock(m);
+          cv.wait(lock, [&]() {
+            return (!window.empty() && window.front()->decoded) ||
+                   (eof && window.empty());
+          });
+          if (window.empty()) {
+            break;
+          }
+          b = std::move(window.front());
+          window.pop_front();
+          --undecoded;
+          cv.notify_all();
+        }
+        if (b->result != RR_Success) {
+          ok = false;
+          break;
+        }
+        if (pending) {
+          size_t off = 0;
+          if (b->size == 0) {
+            continue;
+          }
+          if (dirty) {
+            (*dirty)[pendingKey] = true;
+          }
+          if (!applyValue(objects, pendingKey, b->data, b->size, off)) {
+            ok = false;
+            break;
+          }
+          pending = false;
+          key_type key;
+          while (off < b->size) {
+            resetScratchKey(key);
+            size_t avail = b->size - off;
+            size_t used = logkv::serializer<key_type>::read(b->data + off,
+                                                            avail, key);
+            if (used > avail) {
+              ok = false;
+              break;
+            }
+            off += used;
+            if (off == b->size) {
+              pending = true;
+              pendingKey = std::move(key);
+              break;
+            }
+            if (dirty) {
+              (*dirty)[key] = true;
+            }
+            if (!applyValue(objects, key, b->data, b->size, off)) {
+              ok = false;
+              break;
+            }
+          }
+          if (!ok) {
+            break;
+          }
+          continue;
+        }
+        if (!b->decodeOk) {
+          ok = false;
+          break;
+        }
+        for (auto& [key, value] : b->entries) {
+          if (dirty) {
+            (*dirty)[key] = true;
+          }
+          if (logkv::serializer<mapped_type>::is_empty(value)) {
+            objects.erase(key);
+          } else {
+            objects.insert_or_assign(std::move(key), std::move(value));
+          }
+        }
+        if (b->trailingKey) {
+          pending = true;
+          pendingKey = std::move(b->lastKey);
         }
-        buffer_.resize(targetSz);
       }
-      return writeObject(f, obj);
+    } catch (...) {
+      ok = false;
+    }
+    {
+      std::unique_lock lock(m);
+      stop = true;
+      cv.notify_all();
     }
-    writeOffset_ += used;
-    return used;
+    reader.join();
+    for (auto& w : workers) {
+      w.join();
+    }
+    return ok && !pending; // a trailing key without a value is corrupted
   }
 
-  bool replay(FILE* f) {
-    writeOffset_ = 0;
-    readOffset_ = 0;
+  bool replayFrames(FILE* f, map_type& objects, FrameBuffer& fb,
+                    dirty_map_type* dirty = nullptr) {
+    fb.writeOffset = 0;
+    fb.readOffset = 0;
     try {
       if (fseek(f, 0, SEEK_SET) != 0) {
         return false;
       }
+      key_type key;
       while (true) {
-        if (readOffset_ >= writeOffset_) {
+        if (fb.readOffset >= fb.writeOffset) {
           // buffer empty; read next frame
-          int rf = readFrame(f);
+          int rf = readFrame(f, fb);
           if (rf == RR_Frame_EOF) {
             break; // EOF reached cleanly between objects; replay done.
           } else if (rf != RR_Success) {
             return false;
           }
         }
-        key_type key;
-        if (readObject(f, key) != RR_Success) {
+        if (!replayObject(f, objects, fb, key, dirty)) {
           return false;
         }
-        auto it = objects_.find(key);
-        if (it != objects_.end()) {
-          if (readObject(f, it->second) != RR_Success) {
-            return false;
-          }
-          if (logkv::serializer<mapped_type>::is_empty(it->second)) {
-            objects_.erase(it);
-          }
-        } else {
-          mapped_type value;
-          if (readObject(f, value) != RR_Success) {
-            return false;
-          }
-          if (!logkv::serializer<mapped_type>::is_empty(value)) {
-            objects_[std::move(key)] = std::move(value);
-          }
-        }
       }
     } catch (...) {
       return false;
@@ -848,13 +4269,134 @@ private:
     return true;
   }
 
-  void writeUpdate(FILE* f, const key_type& key, const mapped_type& value) {
-    writeObject(f, key);
-    writeObject(f, value);
+  /**
+   * Reads the next K,V pair from the current frame and applies it to
+   * `objects`, adding the key to `dirty` if given.
+   * @return `false` if the object is corrupted.
+   */
+  bool replayObject(FILE* f, map_type& objects, FrameBuffer& fb,
+                    key_type& key, dirty_map_type* dirty) {
+    resetScratchKey(key);
+    if (readKey(f, fb, key) != RR_Success) {
+      return false;
+    }
+    if (dirty) {
+      (*dirty)[key] = true;
+    }
+    auto it = objects.find(key);
+    if (it != objects.end()) {
+      if (readObject(f, fb, it->second) != RR_Success) {
+        return false;
+      }
+      if (logkv::serializer<mapped_type>::is_empty(it->second)) {
+        objects.erase(it);
+      }
+    } else {
+      mapped_type value;
+      if (readObject(f, fb, value) != RR_Success) {
+        return false;
+      }
+      if (!logkv::serializer<mapped_type>::is_empty(value)) {
+        objects[std::move(key)] = std::move(value);
+      }
+    }
+    return true;
+  }
+
+  // Value types that can log an update as a diff against the value it
+  // replaces (see `logkv/partial.h`).
+  static constexpr bool diffsUpdates =
+    requires { mapped_type::_logkvStoreBase(nullptr); };
+
+  // Key types that snapshots can front-code (see `setSnapshotFrontCoding()`).
+  static constexpr bool frontCodableKeys =
+    requires { requires logkv::serializer<key_type>::byte_string; };
+
+  /**
+   * Writes an update event. `base`, if given, is the value being replaced,
+   * which the value serializer may diff against. Members marked dirty with
+   * `V::_setDirtyMembers()` only apply to this event, so they're cleared.
+   */
+  void writeUpdate(FileWriter* f, const key_type& key,
+                   const mapped_type& value,
+                   const mapped_type* base = nullptr) {
+    if constexpr (diffsUpdates) {
+      mapped_type::_logkvStoreBase(base);
+      try {
+        writeUpdate(f, buffer_, key, value);
+      } catch (...) {
+        mapped_type::_logkvStoreBase(nullptr);
+        IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_setDirtyMembers(0));
+        throw;
+      }
+      mapped_type::_logkvStoreBase(nullptr);
+      IF_CONSTEXPR_REQUIRES_EXPR_EXPR(mapped_type::_setDirtyMembers(0));
+    } else {
+      writeUpdate(f, buffer_, key, value);
+    }
+  }
+
+  void writeUpdate(FileWriter* f, FrameBuffer& fb, const key_type& key,
+                   const mapped_type& value) {
+    if constexpr (frontCodableKeys) {
+      if (fb.keyRestart) {
+        writeFrontCoded(f, fb, key, value);
+        ++fb.entries;
+        return;
+      }
+    }
+    writeObjects(f, fb, key, value);
+    ++fb.entries;
+    if (isEventsFile(f, fb)) {
+      ++writeSeq_;
+    }
+  }
+
+  void writeErase(FileWriter* f, const key_type& key) {
+    writeUpdate(f, buffer_, key, emptyValue_);
   }
 
-  void writeErase(FILE* f, const key_type& key) {
-    writeUpdate(f, key, emptyValue_);
+  /**
+   * Writes a snapshot K,V pair with a front-coded key: the number of leading
+   * bytes it shares with the previous key and the number of the remaining
+   * ones (two VarUints), then the remaining bytes. The first key of a frame
+   * and every `fb.keyRestart`-th key share none, so if the frame before the
+   * pair is sealed while writing it, the pair is written again in full.
+   */
+  void writeFrontCoded(FileWriter* f, FrameBuffer& fb, const key_type& key,
+                       const mapped_type& value) {
+    const size_t size = key.size();
+    if (size > MAX_AUTOSER_BYTES) {
+      throw std::runtime_error("autoser byte size limit exceeded");
+    }
+    const char* bytes = reinterpret_cast<const char*>(key.data());
+    size_t shared = 0;
+    if (fb.writeOffset > 0 && fb.restartKeys < fb.keyRestart) {
+      const size_t n = std::min(size, fb.lastKey.size());
+      shared = std::mismatch(bytes, bytes + n, fb.lastKey.data()).first - bytes;
+    }
+    while (true) {
+      FrameSink sink(*this, f, fb, shared > 0);
+      try {
+        logkv::write_to(sink, VarUint<uint64_t>(shared));
+        logkv::write_to(sink, VarUint<uint64_t>(size - shared));
+        sink.append(bytes + shared, size - shared);
+        logkv::write_to(sink, value);
+      } catch (...) {
+        sink.abort();
+        throw;
+      }
+      if (!sink.cancelled()) {
+        sink.finish();
+        break;
+      }
+      shared = 0;
+    }
+    fb.restartKeys = shared ? fb.restartKeys + 1 : 1;
+    fb.lastKey.resize(size);
+    if (size > shared) {
+      std::memcpy(fb.lastKey.data() + shared, bytes + shared, size - shared);
+    }
   }
 };
 
@@ -13,3 +13,13 @@ rm -f forktest2
 rm -rf forktest2data
 rm -f mode
 rm -f testcrc
+rm -f testpersistentmap
+rm -f testcompress
+rm -f readbench
+rm -rf readbenchdata
+rm -f testhex
+rm -f hashbench
+rm -f storebench
+rm -rf storebenchdata
+rm -f testreplication
+rm -f testasyncdurable
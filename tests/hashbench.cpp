@@ -0,0 +1,99 @@
+#include <logkv/bytes.h>
+using namespace logkv;
+
+#include <boost/unordered/unordered_flat_map.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+constexpr size_t NUM_KEYS = 1'000'000;
+constexpr size_t LOOKUP_ROUNDS = 4;
+
+// The FNV-1a `hash_value(const Bytes&)`, as used by `std::hash<Bytes>`.
+struct FnvBytesHash {
+  size_t operator()(const Bytes& b) const noexcept { return hash_value(b); }
+};
+
+Bytes randomBytes(size_t len, std::mt19937_64& rng) {
+  Bytes b(len);
+  for (size_t i = 0; i < len; ++i) {
+    b[i] = static_cast<char>(rng() % 256);
+  }
+  return b;
+}
+
+struct Result {
+  double insertsPerSec;
+  double lookupsPerSec;
+};
+
+/**
+ * Inserts all `keys` into an empty map, then looks each of them up
+ * `LOOKUP_ROUNDS` times in a shuffled order.
+ */
+template <typename Hasher>
+Result run(const std::vector<Bytes>& keys, const std::vector<size_t>& order) {
+  using Clock = std::chrono::steady_clock;
+  boost::unordered_flat_map<Bytes, uint64_t, Hasher> map;
+
+  auto start = Clock::now();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    map.emplace(keys[i], i);
+  }
+  std::chrono::duration<double> insertTime = Clock::now() - start;
+
+  uint64_t sum = 0;
+  start = Clock::now();
+  for (size_t r = 0; r < LOOKUP_ROUNDS; ++r) {
+    for (size_t i : order) {
+      sum += map.find(keys[i])->second;
+    }
+  }
+  std::chrono::duration<double> lookupTime = Clock::now() - start;
+
+  const uint64_t expected =
+    LOOKUP_ROUNDS * (uint64_t(keys.size()) * (keys.size() - 1) / 2);
+  if (map.size() != keys.size() || sum != expected) {
+    std::cerr << "ERROR: map contents do not match the inserted keys\n";
+    std::exit(1);
+  }
+  return {keys.size() / insertTime.count(),
+          LOOKUP_ROUNDS * keys.size() / lookupTime.count()};
+}
+
+int main() {
+  std::mt19937_64 rng(18);
+  std::vector<size_t> order(NUM_KEYS);
+  for (size_t i = 0; i < NUM_KEYS; ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), rng);
+
+  std::cout << "Keys: " << NUM_KEYS << ", lookups: " << LOOKUP_ROUNDS
+            << " x keys, boost::unordered_flat_map<Bytes, uint64_t>\n";
+  std::cout << "Throughput in M ops/s\n\n";
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "key bytes |  FNV insert  lookup |  Fast insert  lookup\n";
+  std::cout << "----------+---------------------+---------------------\n";
+
+  for (size_t keySize : {8, 16, 32, 64, 128, 256}) {
+    std::vector<Bytes> keys(NUM_KEYS);
+    for (auto& k : keys) {
+      k = randomBytes(keySize, rng);
+    }
+    Result fnv = run<FnvBytesHash>(keys, order);
+    Result fast = run<FastBytesHash>(keys, order);
+    std::cout << std::setw(9) << keySize << " | " << std::setw(11)
+              << fnv.insertsPerSec / 1e6 << std::setw(8)
+              << fnv.lookupsPerSec / 1e6 << " | " << std::setw(12)
+              << fast.insertsPerSec / 1e6 << std::setw(8)
+              << fast.lookupsPerSec / 1e6 << "\n";
+  }
+  return 0;
+}
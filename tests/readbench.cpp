@@ -0,0 +1,147 @@
+#include <logkv/persistentmap.h>
+#include <logkv/store.h>
+using namespace logkv;
+
+#include <logkv/autoser/bytes.h>
+#include <logkv/bytes.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+constexpr size_t NUM_KEYS = 200'000;
+constexpr size_t KEY_SIZE = 16;
+constexpr size_t VAL_SIZE = 64;
+constexpr size_t MAX_READERS = 8;
+constexpr auto RUN_TIME = std::chrono::milliseconds(1000);
+
+using PStore = Store<PersistentMap, Bytes, Bytes>;
+
+Bytes randomBytes(size_t len, std::mt19937_64& rng) {
+  Bytes b(len);
+  for (size_t i = 0; i < len; ++i) {
+    b[i] = static_cast<char>(rng() % 256);
+  }
+  return b;
+}
+
+/**
+ * Runs `readers` threads calling `lookup(reader, key)` and one writer thread
+ * calling `write(key, value)` for `RUN_TIME`.
+ * @return Total lookups per second.
+ */
+template <typename MakeReader, typename Lookup, typename Write>
+double run(size_t readers, const std::vector<Bytes>& keys,
+           const std::vector<Bytes>& values, MakeReader makeReader,
+           Lookup lookup, Write write, uint64_t& writes) {
+  std::atomic<bool> done = false;
+  std::atomic<uint64_t> reads = 0;
+  std::vector<std::thread> threads;
+  for (size_t r = 0; r < readers; ++r) {
+    threads.emplace_back([&, r]() {
+      auto reader = makeReader();
+      uint64_t n = 0, found = 0;
+      size_t i = r * 7919;
+      while (!done.load(std::memory_order_relaxed)) {
+        for (int j = 0; j < 256; ++j) {
+          found += lookup(reader, keys[i++ % keys.size()]);
+        }
+        n += 256;
+      }
+      reads += n + (found > n); // keep `found` alive
+    });
+  }
+  std::thread writer([&]() {
+    uint64_t n = 0;
+    while (!done.load(std::memory_order_relaxed)) {
+      write(keys[(n * 31) % keys.size()], values[n % values.size()]);
+      ++n;
+    }
+    writes = n;
+  });
+  std::this_thread::sleep_for(RUN_TIME);
+  done = true;
+  writer.join();
+  for (auto& t : threads) {
+    t.join();
+  }
+  return reads / std::chrono::duration<double>(RUN_TIME).count();
+}
+
+int main() {
+  const std::string dirStr = "./readbenchdata";
+  std::mt19937_64 rng(42);
+  std::vector<Bytes> keys(NUM_KEYS);
+  for (auto& k : keys) {
+    k = randomBytes(KEY_SIZE, rng);
+  }
+  std::vector<Bytes> values(1024);
+  for (auto& v : values) {
+    v = randomBytes(VAL_SIZE, rng);
+  }
+
+  PStore store(dirStr, StoreFlags::createDir | StoreFlags::deleteData);
+  for (size_t i = 0; i < NUM_KEYS; ++i) {
+    store.getObjects()[keys[i]] = values[i % values.size()];
+  }
+  store.save();
+  std::cout << "Read scaling: " << NUM_KEYS << " keys, 1 writer thread, "
+            << RUN_TIME.count() << "ms per run ("
+            << std::thread::hardware_concurrency() << " hardware threads)"
+            << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "readers  shared_mutex Mreads/s  Reader Mreads/s  "
+               "(writes)"
+            << std::endl;
+
+  int exitcode = 0;
+  for (size_t readers = 1; readers <= MAX_READERS; readers *= 2) {
+    // Baseline: every read and write goes through one reader/writer lock.
+    store.setConcurrentReads(false);
+    std::shared_mutex mutex;
+    uint64_t lockedWrites = 0;
+    double locked = run(
+      readers, keys, values, []() { return 0; },
+      [&](int, const Bytes& k) {
+        std::shared_lock lock(mutex);
+        return store.find(k) != store.end();
+      },
+      [&](const Bytes& k, const Bytes& v) {
+        std::unique_lock lock(mutex);
+        store.update(k, v);
+      },
+      lockedWrites);
+
+    store.setConcurrentReads(true);
+    uint64_t rcuWrites = 0;
+    double rcu = run(
+      readers, keys, values, [&]() { return PStore::Reader(store); },
+      [](PStore::Reader& reader, const Bytes& k) {
+        return reader.find(k) != nullptr;
+      },
+      [&](const Bytes& k, const Bytes& v) { store.update(k, v); }, rcuWrites);
+
+    std::cout << std::setw(7) << readers << std::setw(24) << locked / 1e6
+              << std::setw(17) << rcu / 1e6 << "  (" << lockedWrites << " / "
+              << rcuWrites << ")" << std::endl;
+    if (rcu == 0) {
+      exitcode = 1;
+    }
+  }
+  store.flush();
+
+  PStore store2(dirStr, StoreFlags::deferLoad);
+  if (!store2.load() || store2.getObjects().size() != NUM_KEYS) {
+    std::cout << "ERROR: reloaded store doesn't match." << std::endl;
+    exitcode = 1;
+  }
+  std::filesystem::remove_all(dirStr);
+  return exitcode;
+}
@@ -0,0 +1 @@
+runtest.sh readbench --release
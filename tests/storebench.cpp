@@ -0,0 +1,480 @@
+#include <boost/unordered/unordered_flat_map.hpp>
+
+#include <logkv/store.h>
+using namespace logkv;
+
+#include <logkv/autoser/bytes.h>
+#include <logkv/autoser/pushback.h>
+#include <logkv/bytes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Parameterized Store benchmark. Runs one workload of updates and erases,
+ * timing each operation and each flush, then times `save()` in each of the
+ * selected modes and a `load()` of the result, and reports throughput,
+ * latency percentiles and bytes written per operation.
+ *
+ * Options (all `--name=value`):
+ *   --ops=N            update/erase operations (default 1000000)
+ *   --keys=N           distinct keys (default 100000)
+ *   --key-size=D       key size distribution (default 32)
+ *   --value-size=D     value size distribution (default 0-4096)
+ *   --erase-ratio=R    fraction of operations that are erases (default 0)
+ *   --flush-every=N    flush after every N operations, 0 = never (default 0)
+ *   --sync             flush with `flush(true)` (fsync)
+ *   --map=M            std | unordered | flat (default flat)
+ *   --value=T          bytes | record (AutoSerializableObject) (default bytes)
+ *   --crc32            force CRC32 frames (`setForceCRC32(true)`)
+ *   --saves=L          comma-separated save modes: sync, async, fork, delta
+ *                      (default sync,async,fork,delta)
+ *   --json=FILE        also write the results as JSON to FILE (- = stdout)
+ *   --seed=N           random seed (default 42)
+ *
+ * A size distribution D is `N` (fixed), `A-B` (uniform) or `exp:MEAN`
+ * (exponential, capped at 16 * MEAN).
+ */
+
+struct SizeDist {
+  enum Kind { Fixed, Uniform, Exponential } kind = Fixed;
+  size_t a = 0;
+  size_t b = 0;
+
+  static SizeDist parse(const std::string& s) {
+    SizeDist d;
+    if (s.rfind("exp:", 0) == 0) {
+      d.kind = Exponential;
+      d.a = std::stoull(s.substr(4));
+    } else if (auto dash = s.find('-'); dash != std::string::npos) {
+      d.kind = Uniform;
+      d.a = std::stoull(s.substr(0, dash));
+      d.b = std::stoull(s.substr(dash + 1));
+      if (d.b < d.a) {
+        throw std::invalid_argument("bad size range: " + s);
+      }
+    } else {
+      d.a = std::stoull(s);
+    }
+    return d;
+  }
+
+  size_t sample(std::mt19937_64& rng) const {
+    switch (kind) {
+    case Uniform:
+      return a + rng() % (b - a + 1);
+    case Exponential: {
+      std::exponential_distribution<double> exp(1.0 / std::max<size_t>(a, 1));
+      return std::min<size_t>(exp(rng), a * 16);
+    }
+    default:
+      return a;
+    }
+  }
+
+  std::string str() const {
+    switch (kind) {
+    case Uniform:
+      return std::to_string(a) + "-" + std::to_string(b);
+    case Exponential:
+      return "exp:" + std::to_string(a);
+    default:
+      return std::to_string(a);
+    }
+  }
+};
+
+struct Options {
+  size_t ops = 1'000'000;
+  size_t keys = 100'000;
+  SizeDist keySize = SizeDist::parse("32");
+  SizeDist valueSize = SizeDist::parse("0-4096");
+  double eraseRatio = 0;
+  size_t flushEvery = 0;
+  bool syncFlush = false;
+  std::string map = "flat";
+  std::string value = "bytes";
+  bool forceCRC32 = false;
+  std::vector<std::string> saves = {"sync", "async", "fork", "delta"};
+  std::string json;
+  uint64_t seed = 42;
+  std::string dir = "./storebenchdata";
+};
+
+// An autoser-heavy value type.
+struct BenchRecord : public AutoSerializableObject<BenchRecord> {
+  uint64_t id = 0;
+  VarUint<uint64_t> version = 0;
+  std::string name;
+  std::vector<uint32_t> samples;
+  std::vector<std::string> tags;
+  AUTO_SERIALIZABLE_MEMBERS(id, version, name, samples, tags)
+  bool operator==(const BenchRecord&) const = default;
+};
+
+Bytes randomBytes(size_t len, std::mt19937_64& rng) {
+  Bytes b(len);
+  for (size_t i = 0; i < len; ++i) {
+    b[i] = static_cast<char>(rng() % 256);
+  }
+  return b;
+}
+
+template <typename V> V makeValue(size_t size, std::mt19937_64& rng);
+
+template <> Bytes makeValue<Bytes>(size_t size, std::mt19937_64& rng) {
+  return randomBytes(size, rng);
+}
+
+// A record of about `size` serialized bytes; empty if `size` is 0.
+template <>
+BenchRecord makeValue<BenchRecord>(size_t size, std::mt19937_64& rng) {
+  BenchRecord r;
+  if (size == 0) {
+    return r;
+  }
+  r.id = rng();
+  r.version = rng() % 100000;
+  r.name.assign(size / 2, 'n');
+  r.samples.resize(size / 16);
+  for (auto& s : r.samples) {
+    s = static_cast<uint32_t>(rng());
+  }
+  for (size_t i = 0; i < 4; ++i) {
+    r.tags.emplace_back(size / 32, static_cast<char>('a' + i));
+  }
+  return r;
+}
+
+struct Latencies {
+  uint64_t count = 0;
+  double p50 = 0, p99 = 0, p999 = 0, max = 0; // microseconds
+
+  static Latencies of(std::vector<uint64_t>& ns) {
+    Latencies l;
+    l.count = ns.size();
+    if (ns.empty()) {
+      return l;
+    }
+    std::sort(ns.begin(), ns.end());
+    auto at = [&](double q) {
+      return ns[std::min(ns.size() - 1, size_t(q * ns.size()))] / 1000.0;
+    };
+    l.p50 = at(0.50);
+    l.p99 = at(0.99);
+    l.p999 = at(0.999);
+    l.max = ns.back() / 1000.0;
+    return l;
+  }
+};
+
+struct SaveResult {
+  std::string mode;
+  double seconds = 0;
+  uint64_t dirBytes = 0; // data directory size after the save
+};
+
+struct Result {
+  double seconds = 0;
+  double opsPerSec = 0;
+  Latencies update;
+  Latencies flush;
+  uint64_t eventsBytes = 0;
+  std::vector<SaveResult> saves;
+  double loadSeconds = 0;
+  uint64_t loadedKeys = 0;
+  bool verified = false;
+};
+
+uint64_t directorySize(const std::string& dir) {
+  uint64_t total = 0;
+  for (const auto& e : std::filesystem::directory_iterator(dir)) {
+    if (e.is_regular_file()) {
+      total += e.file_size();
+    }
+  }
+  return total;
+}
+
+int saveMode(const std::string& name) {
+  if (name == "sync") {
+    return StoreSaveMode::syncSave;
+  } else if (name == "async") {
+    return StoreSaveMode::asyncClear;
+  } else if (name == "fork") {
+    return StoreSaveMode::forkSave;
+  } else if (name == "delta") {
+    return StoreSaveMode::deltaSave;
+  }
+  throw std::invalid_argument("unknown save mode: " + name);
+}
+
+template <template <typename...> class M, typename V>
+Result run(const Options& opt) {
+  using S = Store<M, Bytes, V>;
+  using Clock = std::chrono::steady_clock;
+  auto elapsedNs = [](Clock::time_point start) {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now() - start)
+                      .count());
+  };
+  Result res;
+  std::mt19937_64 rng(opt.seed);
+
+  std::vector<Bytes> keys(opt.keys);
+  for (auto& k : keys) {
+    k = randomBytes(std::max<size_t>(opt.keySize.sample(rng), 1), rng);
+  }
+  const size_t numValues = std::min<size_t>(opt.ops, 65536);
+  std::vector<V> values(std::max<size_t>(numValues, 1));
+  for (auto& v : values) {
+    v = makeValue<V>(opt.valueSize.sample(rng), rng);
+  }
+
+  S store(opt.dir, StoreFlags::createDir | StoreFlags::deleteData);
+  store.setForceCRC32(opt.forceCRC32);
+
+  std::vector<uint64_t> updateNs;
+  std::vector<uint64_t> flushNs;
+  updateNs.reserve(opt.ops);
+  std::uniform_real_distribution<double> coin(0, 1);
+  auto start = Clock::now();
+  for (size_t i = 0; i < opt.ops; ++i) {
+    const Bytes& k = keys[rng() % keys.size()];
+    const bool erase = opt.eraseRatio > 0 && coin(rng) < opt.eraseRatio;
+    const V& v = values[i % values.size()];
+    auto t = Clock::now();
+    if (erase) {
+      store.erase(k);
+    } else {
+      store.update(k, v);
+    }
+    updateNs.push_back(elapsedNs(t));
+    if (opt.flushEvery && (i + 1) % opt.flushEvery == 0) {
+      t = Clock::now();
+      store.flush(opt.syncFlush);
+      flushNs.push_back(elapsedNs(t));
+    }
+  }
+  store.flush(opt.syncFlush);
+  res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  res.opsPerSec = opt.ops / res.seconds;
+  res.eventsBytes = store.getEventsFileSize();
+  res.update = Latencies::of(updateNs);
+  res.flush = Latencies::of(flushNs);
+
+  // Each save follows a churn of updates to 5% of the keys, so delta saves
+  // have something to write.
+  for (const auto& name : opt.saves) {
+    const int mode = saveMode(name);
+    if (mode == StoreSaveMode::deltaSave && !store.getMaxDeltaSnapshots()) {
+      store.setMaxDeltaSnapshots(8);
+      store.save(StoreSaveMode::syncSave); // base for the deltas
+    }
+    for (size_t i = 0; i < std::max<size_t>(keys.size() / 20, 1); ++i) {
+      store.update(keys[rng() % keys.size()], values[rng() % values.size()]);
+    }
+    auto t = Clock::now();
+    store.save(mode);
+    SaveResult s;
+    s.mode = name;
+    s.seconds = std::chrono::duration<double>(Clock::now() - t).count();
+    s.dirBytes = directorySize(opt.dir);
+    res.saves.push_back(s);
+  }
+  store.flush();
+
+  auto t = Clock::now();
+  S loaded(opt.dir, StoreFlags::deferLoad);
+  const bool ok = loaded.load();
+  res.loadSeconds = std::chrono::duration<double>(Clock::now() - t).count();
+  res.loadedKeys = loaded.getObjects().size();
+
+  // Empty values are kept by update() but not stored in snapshots.
+  size_t nonEmpty = 0;
+  res.verified = ok;
+  for (const auto& [k, v] : store.getObjects()) {
+    if (serializer<V>::is_empty(v)) {
+      continue;
+    }
+    ++nonEmpty;
+    auto it = loaded.getObjects().find(k);
+    if (it == loaded.getObjects().end() || !(it->second == v)) {
+      res.verified = false;
+      break;
+    }
+  }
+  if (nonEmpty != loaded.getObjects().size()) {
+    res.verified = false;
+  }
+  return res;
+}
+
+template <typename V> Result runMap(const Options& opt) {
+  if (opt.map == "std") {
+    return run<std::map, V>(opt);
+  } else if (opt.map == "unordered") {
+    return run<std::unordered_map, V>(opt);
+  } else if (opt.map == "flat") {
+    return run<boost::unordered_flat_map, V>(opt);
+  }
+  throw std::invalid_argument("unknown map type: " + opt.map);
+}
+
+std::string toJson(const Options& opt, const Result& r) {
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(3);
+  auto lat = [&](const Latencies& l) {
+    os << "{\"count\": " << l.count << ", \"p50_us\": " << l.p50
+       << ", \"p99_us\": " << l.p99 << ", \"p999_us\": " << l.p999
+       << ", \"max_us\": " << l.max << "}";
+  };
+  os << "{\n  \"config\": {\"ops\": " << opt.ops << ", \"keys\": " << opt.keys
+     << ", \"key_size\": \"" << opt.keySize.str() << "\", \"value_size\": \""
+     << opt.valueSize.str() << "\", \"erase_ratio\": " << opt.eraseRatio
+     << ", \"flush_every\": " << opt.flushEvery
+     << ", \"sync\": " << (opt.syncFlush ? "true" : "false") << ", \"map\": \""
+     << opt.map << "\", \"value\": \"" << opt.value
+     << "\", \"crc32\": " << (opt.forceCRC32 ? "true" : "false")
+     << ", \"seed\": " << opt.seed << "},\n";
+  os << "  \"updates\": {\"seconds\": " << r.seconds
+     << ", \"ops_per_sec\": " << r.opsPerSec << ", \"latency\": ";
+  lat(r.update);
+  os << "},\n  \"flush\": {\"latency\": ";
+  lat(r.flush);
+  os << "},\n  \"events_bytes\": " << r.eventsBytes
+     << ",\n  \"bytes_per_op\": " << double(r.eventsBytes) / opt.ops
+     << ",\n  \"saves\": [";
+  for (size_t i = 0; i < r.saves.size(); ++i) {
+    os << (i ? ", " : "") << "{\"mode\": \"" << r.saves[i].mode
+       << "\", \"seconds\": " << std::setprecision(6) << r.saves[i].seconds
+       << std::setprecision(3) << ", \"dir_bytes\": " << r.saves[i].dirBytes
+       << "}";
+  }
+  os << "],\n  \"load\": {\"seconds\": " << std::setprecision(6)
+     << r.loadSeconds << ", \"keys\": " << r.loadedKeys
+     << ", \"verified\": " << (r.verified ? "true" : "false") << "}\n}\n";
+  return os.str();
+}
+
+void printResult(const Options& opt, const Result& r) {
+  auto lat = [](const char* name, const Latencies& l) {
+    std::cout << std::setw(8) << name << std::setw(10) << l.count
+              << std::setw(10) << l.p50 << std::setw(10) << l.p99
+              << std::setw(10) << l.p999 << std::setw(12) << l.max << "\n";
+  };
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Workload:   " << opt.ops << " ops, " << opt.keys
+            << " keys, key size " << opt.keySize.str() << ", value size "
+            << opt.valueSize.str() << ", erase ratio " << opt.eraseRatio
+            << "\n            map " << opt.map << ", value " << opt.value
+            << ", flush every " << opt.flushEvery
+            << (opt.syncFlush ? " (sync)" : "")
+            << (opt.forceCRC32 ? ", CRC32 frames" : "") << "\n\n";
+  std::cout << "Throughput: " << r.opsPerSec / 1e6 << " M ops/s ("
+            << r.seconds << " s)\n";
+  std::cout << "Written:    " << r.eventsBytes << " event bytes, "
+            << double(r.eventsBytes) / opt.ops << " bytes/op\n\n";
+  std::cout << "  op         count   p50 us    p99 us   p999 us      max us\n";
+  lat("update", r.update);
+  lat("flush", r.flush);
+  std::cout << "\n" << std::setprecision(6);
+  for (const auto& s : r.saves) {
+    std::cout << "save(" << s.mode << "): " << s.seconds << " s, "
+              << s.dirBytes << " bytes in data directory\n";
+  }
+  std::cout << "load():     " << r.loadSeconds << " s, " << r.loadedKeys
+            << " keys, " << (r.verified ? "verified" : "MISMATCH") << "\n";
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    std::string name = arg, value;
+    if (auto eq = arg.find('='); eq != std::string::npos) {
+      name = arg.substr(0, eq);
+      value = arg.substr(eq + 1);
+    }
+    if (name == "--ops") {
+      opt.ops = std::stoull(value);
+    } else if (name == "--keys") {
+      opt.keys = std::max<size_t>(std::stoull(value), 1);
+    } else if (name == "--key-size") {
+      opt.keySize = SizeDist::parse(value);
+    } else if (name == "--value-size") {
+      opt.valueSize = SizeDist::parse(value);
+    } else if (name == "--erase-ratio") {
+      opt.eraseRatio = std::stod(value);
+    } else if (name == "--flush-every") {
+      opt.flushEvery = std::stoull(value);
+    } else if (name == "--sync") {
+      opt.syncFlush = true;
+    } else if (name == "--map") {
+      opt.map = value;
+    } else if (name == "--value") {
+      opt.value = value;
+    } else if (name == "--crc32") {
+      opt.forceCRC32 = true;
+    } else if (name == "--saves") {
+      opt.saves.clear();
+      std::stringstream ss(value);
+      for (std::string mode; std::getline(ss, mode, ',');) {
+        saveMode(mode); // validate
+        opt.saves.push_back(mode);
+      }
+    } else if (name == "--json") {
+      opt.json = value;
+    } else if (name == "--seed") {
+      opt.seed = std::stoull(value);
+    } else {
+      throw std::invalid_argument("unknown option: " + arg);
+    }
+  }
+  return opt;
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  try {
+    opt = parseOptions(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << "\n";
+    return 2;
+  }
+
+  Result res;
+  if (opt.value == "bytes") {
+    res = runMap<Bytes>(opt);
+  } else if (opt.value == "record") {
+    res = runMap<BenchRecord>(opt);
+  } else {
+    std::cerr << "ERROR: unknown value type: " << opt.value << "\n";
+    return 2;
+  }
+
+  if (opt.json != "-") {
+    printResult(opt, res);
+  }
+  if (!opt.json.empty()) {
+    const std::string json = toJson(opt, res);
+    if (opt.json == "-") {
+      std::cout << json;
+    } else {
+      std::ofstream(opt.json) << json;
+    }
+  }
+  std::filesystem::remove_all(opt.dir);
+  return res.verified ? 0 : 1;
+}
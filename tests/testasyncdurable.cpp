@@ -0,0 +1,158 @@
+#include <logkv/asyncdurable.h>
+#include <logkv/store.h>
+
+#include <logkv/autoser/bytes.h>
+#include <logkv/bytes.h>
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/use_future.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+using TestStore = logkv::Store<std::map, logkv::Bytes, logkv::Bytes>;
+
+const std::string TEST_BASE_DIR = "logkv_asyncdurable_test_run_data";
+
+std::string setup_test_directory(const std::string& name) {
+  auto path = std::filesystem::path(TEST_BASE_DIR) / name;
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  return path.string();
+}
+
+logkv::Bytes key(int i) {
+  return logkv::makeBytes("key" + std::to_string(i));
+}
+
+logkv::Bytes val(int i) {
+  return logkv::makeBytes("value" + std::to_string(i));
+}
+
+void test_async_durable_handler() {
+  std::cout << "Running test_async_durable_handler..." << std::endl;
+  std::string dir = setup_test_directory("handler");
+  {
+    TestStore store(dir, logkv::createDir | logkv::deleteData);
+    store.setGroupCommit(true);
+    boost::asio::io_context io;
+    uint64_t seq = store.update(key(1), val(1));
+    bool done = false;
+    std::thread::id thread;
+    logkv::asyncDurable(store, seq,
+                        boost::asio::bind_executor(
+                          io, [&](std::exception_ptr error) {
+                            assert(!error);
+                            assert(store.getDurableSequence() >= seq);
+                            thread = std::this_thread::get_id();
+                            done = true;
+                          }));
+    // The completion is posted to the handler's executor, not run by the
+    // flusher, and the pending wait keeps the io_context running.
+    io.run();
+    assert(done && thread == std::this_thread::get_id());
+
+    // Already durable: completes on the next run of the io_context.
+    done = false;
+    logkv::asyncDurable(store, seq,
+                        boost::asio::bind_executor(
+                          io, [&](std::exception_ptr error) {
+                            assert(!error);
+                            done = true;
+                          }));
+    assert(!done);
+    io.restart();
+    io.run();
+    assert(done);
+
+    // Futures work too (errors are rethrown by `get()`).
+    seq = store.erase(key(1));
+    auto future = logkv::asyncDurable(store, seq, boost::asio::use_future);
+    future.get();
+    assert(store.getDurableSequence() >= seq);
+    store.setGroupCommit(false);
+
+    // Without group commit, the caller syncs.
+    seq = store.update(key(2), val(2));
+    assert(store.getDurableSequence() < seq);
+    done = false;
+    logkv::asyncDurable(store, seq,
+                        boost::asio::bind_executor(
+                          io, [&](std::exception_ptr error) {
+                            assert(!error);
+                            done = true;
+                          }));
+    assert(store.getDurableSequence() >= seq);
+    io.restart();
+    io.run();
+    assert(done);
+  }
+  TestStore store(dir);
+  assert(store.getObjects().size() == 1);
+  std::filesystem::remove_all(dir);
+  std::cout << "test_async_durable_handler PASSED." << std::endl;
+}
+
+void test_async_durable_coroutines() {
+  std::cout << "Running test_async_durable_coroutines..." << std::endl;
+  std::string dir = setup_test_directory("coroutines");
+  constexpr int Clients = 16;
+  constexpr int Requests = 50;
+  {
+    TestStore store(dir, logkv::createDir | logkv::deleteData);
+    store.setGroupCommit(true);
+    boost::asio::thread_pool pool(4);
+    std::atomic<int> acked = 0;
+    std::atomic<bool> failed = false;
+    for (int c = 0; c < Clients; ++c) {
+      boost::asio::co_spawn(
+        pool,
+        [&, c]() -> boost::asio::awaitable<void> {
+          for (int r = 0; r < Requests; ++r) {
+            int i = c * Requests + r;
+            uint64_t seq = store.update(key(i), val(i));
+            co_await logkv::asyncDurable(store, seq,
+                                         boost::asio::use_awaitable);
+            if (store.getDurableSequence() < seq) {
+              failed = true;
+            }
+            ++acked;
+          }
+        },
+        boost::asio::detached);
+    }
+    pool.join();
+    assert(!failed);
+    assert(acked == Clients * Requests);
+    store.setGroupCommit(false);
+  }
+  TestStore store(dir);
+  assert(store.getObjects().size() == size_t(Clients * Requests));
+  std::filesystem::remove_all(dir);
+  std::cout << "test_async_durable_coroutines PASSED." << std::endl;
+}
+
+int main() {
+  try {
+    test_async_durable_handler();
+    test_async_durable_coroutines();
+    std::filesystem::remove_all(TEST_BASE_DIR);
+    std::cout << "\nALL asyncdurable tests PASSED successfully!" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "An asyncdurable test FAILED with exception: " << e.what()
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
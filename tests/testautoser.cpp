@@ -200,6 +200,24 @@ struct EmptyPfrAggregate {
   auto operator<=>(const EmptyPfrAggregate&) const = default;
 };
 
+struct FixedPfrAggregate {
+  uint8_t kind;
+  int32_t x;
+  std::array<uint16_t, 3> rgb;
+  auto operator<=>(const FixedPfrAggregate&) const = default;
+};
+
+class FixedObject : public logkv::AutoSerializableObject<FixedObject> {
+public:
+  int64_t id = 0;
+  std::pair<uint32_t, uint8_t> version;
+  std::tuple<int16_t, FixedPfrAggregate> extra;
+  std::array<char, 5> tag{};
+
+  AUTO_SERIALIZABLE_MEMBERS(id, version, extra, tag)
+  auto operator<=>(const FixedObject&) const = default;
+};
+
 // -----------------------------------------------------------------------------
 // Test helpers
 // -----------------------------------------------------------------------------
@@ -310,6 +328,107 @@ void test_varuint_read_value_overflow() {
                std::runtime_error);
 }
 
+template <typename T> void check_varuint_kernels(uint64_t v) {
+  const std::vector<char> expected = encode_varuint(v);
+  std::vector<char> buffer(expected.size() + 16, static_cast<char>(0xAB));
+  size_t written = logkv::serializer<logkv::VarUint<T>>::write(
+    buffer.data(), buffer.size(), static_cast<T>(v));
+  ASSERT_EQ(written, expected.size());
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), buffer.begin()));
+  ASSERT_EQ(buffer[written], static_cast<char>(0xAB));
+  // Padded and exact-size input
+  for (size_t size : {buffer.size(), expected.size()}) {
+    logkv::VarUint<T> decoded;
+    ASSERT_EQ(logkv::serializer<logkv::VarUint<T>>::read(buffer.data(), size,
+                                                         decoded),
+              expected.size());
+    ASSERT_EQ(decoded.value, v);
+  }
+}
+
+void test_varuint_word_kernels() {
+  std::vector<uint64_t> values = {0, 1, 127, 128, 255, 256, 16383, 16384};
+  for (int bits = 7; bits < 64; bits += 7) {
+    values.push_back((1ull << bits) - 1);
+    values.push_back(1ull << bits);
+    values.push_back((1ull << bits) + 1);
+  }
+  values.push_back(std::numeric_limits<uint64_t>::max());
+  uint64_t x = 0x9E3779B97F4A7C15ull;
+  for (int i = 0; i < 1000; ++i) {
+    x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+    values.push_back(x >> (x % 64));
+  }
+  for (uint64_t v : values) {
+    check_varuint_kernels<uint64_t>(v);
+    if (v <= std::numeric_limits<uint32_t>::max()) {
+      check_varuint_kernels<uint32_t>(v);
+    }
+    if (v <= std::numeric_limits<uint16_t>::max()) {
+      check_varuint_kernels<uint16_t>(v);
+    }
+  }
+
+  // Overflows are detected with input past the end of the value too.
+  std::vector<char> too_long(16, static_cast<char>(0x80));
+  too_long[5] = 0x01;
+  logkv::VarUint<uint32_t> val32;
+  ASSERT_THROW(logkv::serializer<logkv::VarUint<uint32_t>>::read(
+                 too_long.data(), too_long.size(), val32),
+               std::runtime_error);
+  std::vector<char> too_large = {(char)0x80, (char)0x80, (char)0x80,
+                                 (char)0x80, (char)0x10, 0, 0, 0};
+  ASSERT_THROW(logkv::serializer<logkv::VarUint<uint32_t>>::read(
+                 too_large.data(), too_large.size(), val32),
+               std::runtime_error);
+  // Truncated input asks for more bytes.
+  std::vector<char> truncated(8, static_cast<char>(0x80));
+  logkv::VarUint<uint64_t> val64;
+  ASSERT_TRUE(logkv::serializer<logkv::VarUint<uint64_t>>::read(
+                truncated.data(), truncated.size(), val64) > truncated.size());
+}
+
+void test_varuint_bulk_containers() {
+  std::vector<logkv::VarUint<uint32_t>> vec;
+  uint32_t x = 12345;
+  for (int i = 0; i < 1000; ++i) {
+    x = x * 1103515245u + 12345u;
+    vec.push_back(x >> (x % 32));
+  }
+  test_type_serialization(vec);
+  test_type_serialization(std::deque<logkv::VarUint<uint64_t>>(vec.begin(),
+                                                                vec.end()));
+  // Values longer than a word in between short ones
+  std::vector<logkv::VarUint<uint64_t>> mixed;
+  for (int i = 0; i < 100; ++i) {
+    mixed.push_back(i % 3 ? i : std::numeric_limits<uint64_t>::max() - i);
+  }
+  test_type_serialization(mixed);
+
+  // Same bytes as encoding the elements one by one.
+  std::vector<char> buffer(
+    logkv::serializer<decltype(vec)>::get_size(vec));
+  logkv::serializer<decltype(vec)>::write(buffer.data(), buffer.size(), vec);
+  std::vector<char> expected = encode_varuint(vec.size());
+  for (const auto& v : vec) {
+    std::vector<char> e = encode_varuint(v.value);
+    expected.insert(expected.end(), e.begin(), e.end());
+  }
+  ASSERT_TRUE(buffer == expected);
+
+  // An element that overflows its type is detected.
+  std::vector<char> bad = {4, 1, 2, (char)0xFF, (char)0xFF, 0x7F, 3, 0, 0, 0};
+  std::vector<logkv::VarUint<uint16_t>> vec16;
+  ASSERT_THROW(logkv::serializer<decltype(vec16)>::read(bad.data(),
+                                                        bad.size(), vec16),
+               std::runtime_error);
+
+  // Truncated input asks for more bytes.
+  decltype(vec) out;
+  ASSERT_TRUE(logkv::serializer<decltype(vec)>::read(
+                buffer.data(), buffer.size() - 1, out) > buffer.size() - 1);
+}
+
 void test_container_std_string() {
   test_type_serialization<std::string>("");
   test_type_serialization<std::string>("hello world");
@@ -317,6 +436,40 @@ void test_container_std_string() {
   test_type_serialization<std::string>(std::string("hello\0world", 11));
 }
 
+void test_container_small_bytes() {
+  using SB = logkv::SmallBytes<16>;
+  test_type_serialization<SB>(SB());
+  test_type_serialization<SB>(SB("hello", 5));
+  test_type_serialization<SB>(SB(std::string(16, 'x').data(), 16));
+  test_type_serialization<SB>(SB(std::string(250, 'a').data(), 250));
+
+  // Inline up to N bytes, heap beyond; moves leave the source empty.
+  SB a("0123456789abcdef", 16);
+  ASSERT_EQ(a.capacity(), 16u);
+  a.push_back('!');
+  ASSERT_TRUE(a.capacity() > 16u);
+  ASSERT_EQ(std::string(a.begin(), a.end()), "0123456789abcdef!");
+  SB b(std::move(a));
+  ASSERT_TRUE(a.empty());
+  ASSERT_EQ(b.size(), 17u);
+  SB c("xyz", 3);
+  SB d = c;
+  ASSERT_EQ(c, d);
+  d = std::move(b);
+  ASSERT_EQ(d.size(), 17u);
+  ASSERT_TRUE(d < c);
+  ASSERT_TRUE(SB("ab", 2) < SB("abc", 3));
+  ASSERT_TRUE(SB("\x01", 1) < SB("\xff", 1));
+  ASSERT_EQ(std::hash<SB>{}(c), logkv::hash_value(SB("xyz", 3)));
+
+  // Reading into a used object replaces its contents.
+  std::vector<char> buffer(64);
+  size_t n = logkv::serializer<SB>::write(buffer.data(), buffer.size(), c);
+  logkv::serializer<SB>::read(buffer.data(), n, d);
+  ASSERT_EQ(d, c);
+  static_assert(logkv::serializer<SB>::replaces_on_read);
+}
+
 void test_container_read_size_limits() {
   {
     uint64_t large_size = logkv::MAX_AUTOSER_BYTES + 1;
@@ -636,6 +789,140 @@ void test_pfr_automatic_serialization() {
   test_type_serialization(EmptyPfrAggregate{});
 }
 
+void test_fixed_size_composites() {
+  using logkv::fixed_size_serializable;
+  using logkv::serializer;
+  static_assert(serializer<int16_t>::fixed_size == 2);
+  static_assert(serializer<std::array<uint64_t, 3>>::fixed_size == 24);
+  static_assert(serializer<std::pair<uint32_t, uint8_t>>::fixed_size == 5);
+  static_assert(serializer<FixedPfrAggregate>::fixed_size == 11);
+  static_assert(serializer<FixedObject>::fixed_size == 8 + 5 + 2 + 11 + 5);
+  static_assert(serializer<EmptyPfrAggregate>::fixed_size == 0);
+  static_assert(!fixed_size_serializable<std::string>);
+  static_assert(!fixed_size_serializable<logkv::VarUint<uint32_t>>);
+  static_assert(!fixed_size_serializable<std::tuple<int32_t, std::string>>);
+  static_assert(!fixed_size_serializable<std::array<std::string, 2>>);
+  static_assert(!fixed_size_serializable<SimplePfrAggregate>);
+  static_assert(!fixed_size_serializable<std::vector<int32_t>>);
+
+  FixedObject obj;
+  obj.id = -1234567890123LL;
+  obj.version = {7, 200};
+  obj.extra = {-2, FixedPfrAggregate{3, -40000, {0x0102, 0xFFFF, 0}}};
+  obj.tag = {'a', 'b', 'c', 'd', 'e'};
+  test_type_serialization(obj);
+  test_type_serialization(FixedPfrAggregate{1, 2, {3, 4, 5}});
+  test_type_serialization(std::make_tuple(int8_t(-1), uint64_t(1) << 63));
+  test_type_serialization(std::array<FixedPfrAggregate, 2>{
+    FixedPfrAggregate{1, -1, {1, 2, 3}}, FixedPfrAggregate{}});
+
+  // Same bytes as writing the members one by one.
+  std::vector<char> buffer(serializer<FixedObject>::get_size(obj));
+  serializer<FixedObject>::write(buffer.data(), buffer.size(), obj);
+  std::vector<char> expected(buffer.size());
+  logkv::Writer writer(expected.data(), expected.size());
+  writer.write(obj.id);
+  writer.write(obj.version.first);
+  writer.write(obj.version.second);
+  writer.write(std::get<0>(obj.extra));
+  const FixedPfrAggregate& agg = std::get<1>(obj.extra);
+  writer.write(agg.kind);
+  writer.write(agg.x);
+  for (uint16_t c : agg.rgb) {
+    writer.write(c);
+  }
+  writer.write(obj.tag);
+  ASSERT_EQ(writer.bytes_processed(), expected.size());
+  ASSERT_TRUE(buffer == expected);
+
+  // Sinks get the same bytes, and count them once full.
+  std::vector<char> grown;
+  logkv::Sink sink(grown, 3);
+  logkv::write_to(sink, obj);
+  ASSERT_EQ(sink.size(), buffer.size());
+  ASSERT_TRUE(std::equal(buffer.begin(), buffer.end(), grown.begin() + 3));
+  std::vector<char> small(10);
+  logkv::Sink fixed(small.data(), small.size());
+  logkv::write_to(fixed, obj);
+  logkv::write_to(fixed, obj);
+  ASSERT_EQ(fixed.size(), 2 * buffer.size());
+}
+
+// Big-endian bytes of `vals`, encoded one by one.
+template <typename T> std::vector<char> encode_big_endian(const T& vals) {
+  std::vector<char> result;
+  for (auto v : vals) {
+    for (size_t i = sizeof(v); i-- > 0;) {
+      result.push_back(static_cast<char>(
+        static_cast<std::make_unsigned_t<decltype(v)>>(v) >> (i * 8)));
+    }
+  }
+  return result;
+}
+
+template <typename T> void check_bulk_integral_vector(size_t n) {
+  std::vector<T> vec(n);
+  uint64_t x = 88172645463325252ULL + n;
+  for (auto& v : vec) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    v = static_cast<T>(x);
+  }
+  test_type_serialization(vec);
+
+  std::vector<char> buffer(logkv::serializer<std::vector<T>>::get_size(vec));
+  logkv::serializer<std::vector<T>>::write(buffer.data(), buffer.size(), vec);
+  std::vector<char> expected = encode_varuint(n);
+  std::vector<char> body = encode_big_endian(vec);
+  expected.insert(expected.end(), body.begin(), body.end());
+  ASSERT_TRUE(buffer == expected);
+
+  // The element-by-element path of other sequences reads the same bytes.
+  std::deque<T> deq;
+  ASSERT_EQ(logkv::serializer<std::deque<T>>::read(buffer.data(),
+                                                   buffer.size(), deq),
+            buffer.size());
+  ASSERT_TRUE(std::equal(deq.begin(), deq.end(), vec.begin(), vec.end()));
+
+  if (n > 0) {
+    std::vector<T> out;
+    ASSERT_EQ(logkv::serializer<std::vector<T>>::read(
+                buffer.data(), buffer.size() - 1, out),
+              buffer.size());
+    ASSERT_TRUE(out.empty());
+  }
+}
+
+void test_bulk_integral_containers() {
+  for (size_t n : {0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 100, 1000, 5000}) {
+    check_bulk_integral_vector<int16_t>(n);
+    check_bulk_integral_vector<uint16_t>(n);
+    check_bulk_integral_vector<int32_t>(n);
+    check_bulk_integral_vector<uint32_t>(n);
+    check_bulk_integral_vector<int64_t>(n);
+    check_bulk_integral_vector<uint64_t>(n);
+  }
+
+  std::array<uint32_t, 37> arr;
+  for (size_t i = 0; i < arr.size(); ++i) {
+    arr[i] = static_cast<uint32_t>(i * 0x01020304u);
+  }
+  test_type_serialization(arr);
+  std::vector<char> buffer(arr.size() * 4);
+  logkv::serializer<decltype(arr)>::write(buffer.data(), buffer.size(), arr);
+  ASSERT_TRUE(buffer == encode_big_endian(arr));
+
+  // `dest` may be the same as `src`.
+  std::vector<uint64_t> vals = {1, 2, 0x0102030405060708ULL, 4, 5};
+  std::vector<uint64_t> swapped = vals;
+  logkv::big_endian_copy<uint64_t>(swapped.data(), swapped.data(),
+                                   swapped.size());
+  logkv::big_endian_copy<uint64_t>(swapped.data(), swapped.data(),
+                                   swapped.size());
+  ASSERT_TRUE(swapped == vals);
+}
+
 void test_variant_type() {
     using TestVariant = std::variant<int32_t, std::string, OpaqueComposite>;
     test_type_serialization<TestVariant>(TestVariant{int32_t(-12345)});
@@ -667,8 +954,11 @@ int main() {
   RUN_TEST(test_varuint_max_value);
   RUN_TEST(test_varuint_read_overflow);
   RUN_TEST(test_varuint_read_value_overflow);
+  RUN_TEST(test_varuint_word_kernels);
+  RUN_TEST(test_varuint_bulk_containers);
 
   RUN_TEST(test_container_std_string);
+  RUN_TEST(test_container_small_bytes);
   RUN_TEST(test_container_read_size_limits);
   RUN_TEST(test_container_std_array);
   RUN_TEST(test_container_std_array_complex);
@@ -693,6 +983,9 @@ int main() {
 
   RUN_TEST(test_pfr_automatic_serialization);
 
+  RUN_TEST(test_fixed_size_composites);
+  RUN_TEST(test_bulk_integral_containers);
+
   RUN_TEST(test_variant_type);
 
   std::cout << "========================================\n"
@@ -0,0 +1,89 @@
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <logkv/compress.h>
+
+bool roundtrip(const std::string& in) {
+  std::vector<char> packed(logkv::compressBound(logkv::lz4Compression,
+                                                in.size()));
+  size_t n = logkv::compress(logkv::lz4Compression, in.data(), in.size(),
+                             packed.data(), packed.size());
+  if (n == 0) {
+    return false;
+  }
+  std::string out(in.size(), '\0');
+  if (!logkv::decompress(logkv::lz4Compression, packed.data(), n, out.data(),
+                         out.size())) {
+    return false;
+  }
+  // The wrong uncompressed size is rejected.
+  std::string longer(in.size() + 1, '\0');
+  if (logkv::decompress(logkv::lz4Compression, packed.data(), n,
+                        longer.data(), longer.size())) {
+    return false;
+  }
+  return out == in;
+}
+
+int test_lz4_roundtrip() {
+  std::cout << "[ Testing LZ4 block codec ]\n";
+  std::mt19937 rng(7);
+  for (size_t len = 0; len < 300; ++len) {
+    std::string random(len, '\0'), runs(len, '\0');
+    for (size_t i = 0; i < len; ++i) {
+      random[i] = static_cast<char>(rng());
+      runs[i] = static_cast<char>('a' + (i / 7) % 3);
+    }
+    if (!roundtrip(random) || !roundtrip(runs)) {
+      std::cout << "Result:     FAIL (length " << len << ")\n\n";
+      return 1;
+    }
+  }
+  std::string json;
+  while (json.size() < 200000) {
+    json += "{\"id\":" + std::to_string(rng() % 1000) +
+            ",\"name\":\"item\",\"tags\":[\"a\",\"b\"]}";
+  }
+  std::string zeros(100000, '\0');
+  if (!roundtrip(json) || !roundtrip(zeros)) {
+    std::cout << "Result:     FAIL (large input)\n\n";
+    return 1;
+  }
+  std::vector<char> packed(logkv::lz4::compressBound(json.size()));
+  size_t n = logkv::lz4::compress(json.data(), json.size(), packed.data(),
+                                  packed.size());
+  std::cout << "JSON-ish:   " << json.size() << " -> " << n << " bytes\n";
+  if (n == 0 || n * 3 > json.size()) {
+    std::cout << "Result:     FAIL (poor ratio)\n\n";
+    return 1;
+  }
+  // Malformed input (truncated or with garbage) is rejected, not overrun.
+  std::string out(json.size(), '\0');
+  for (size_t cut : {size_t(1), n / 2, n - 1}) {
+    if (logkv::lz4::decompress(packed.data(), cut, out.data(), out.size())) {
+      std::cout << "Result:     FAIL (truncated input accepted)\n\n";
+      return 1;
+    }
+  }
+  for (int i = 0; i < 200; ++i) {
+    std::vector<char> bad(packed.begin(), packed.begin() + n);
+    bad[rng() % n] ^= static_cast<char>(1 + rng() % 255);
+    logkv::lz4::decompress(bad.data(), bad.size(), out.data(), out.size());
+  }
+  std::cout << "Result:     PASS\n\n";
+  return 0;
+}
+
+int main() {
+  int failures = 0;
+  failures += test_lz4_roundtrip();
+  if (failures == 0) {
+    std::cout << "All compression tests passed.\n";
+    return 0;
+  }
+  std::cout << failures << " compression test(s) failed.\n";
+  return 1;
+}
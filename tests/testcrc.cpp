@@ -1,5 +1,8 @@
+#include <chrono>
+#include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -52,9 +55,83 @@ int test_crc16() {
   }
 }
 
+int test_crc16_dispatch() {
+  std::cout << "[ Cross-checking CRC-16 (XMODEM) against the table ]\n";
+
+  std::mt19937_64 rng(16);
+  std::vector<uint8_t> buf(4096 + 16);
+  for (auto& b : buf) {
+    b = static_cast<uint8_t>(rng());
+  }
+  int failures = 0;
+  auto check = [&](size_t offset, size_t len, uint16_t seed) {
+    const uint8_t* p = buf.data() + offset;
+    uint16_t expected = logkv::crc16::detail::xmodem_table(p, len, seed);
+    uint16_t result = logkv::crc16::xmodem_upd(p, len, seed);
+    if (result != expected && ++failures <= 5) {
+      std::cout << "Mismatch:   offset " << std::dec << offset << " length "
+                << len << " seed 0x" << std::hex << seed << "\n";
+    }
+  };
+  // Every length around the block and dispatch boundaries, at every
+  // alignment, then random lengths and seeds.
+  for (size_t len = 0; len <= 300; ++len) {
+    for (size_t offset = 0; offset < 16; ++offset) {
+      check(offset, len, 0);
+    }
+  }
+  for (int i = 0; i < 10000; ++i) {
+    check(rng() % 16, rng() % 4096, static_cast<uint16_t>(rng()));
+  }
+  // The seed continues a CRC over split input.
+  const uint8_t* p = buf.data();
+  uint16_t whole = logkv::crc16::xmodem(p, 1000);
+  uint16_t first = logkv::crc16::xmodem(p, 333);
+  uint16_t seed = static_cast<uint16_t>((first >> 8) | (first << 8));
+  if (logkv::crc16::xmodem_upd(p + 333, 1000 - 333, seed) != whole) {
+    std::cout << "Mismatch:   split input\n";
+    ++failures;
+  }
+
+  std::cout << "Result:     " << (failures ? "FAIL" : "PASS") << "\n\n";
+  return failures ? 1 : 0;
+}
+
+void bench_crc16() {
+  std::cout << "[ CRC-16 (XMODEM) throughput, table vs dispatched ]\n";
+  std::vector<uint8_t> buf(1 << 16);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = static_cast<uint8_t>(i * 131);
+  }
+  auto measure = [&](size_t len, auto&& crc) {
+    const size_t iters = (64 << 20) / len;
+    uint16_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i) {
+      sink ^= crc(buf.data() + (i * 64) % (buf.size() - len), len, sink);
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    volatile uint16_t keep = sink;
+    (void)keep;
+    return iters * len / t.count() / (1 << 20);
+  };
+  std::cout << std::dec << std::fixed << std::setprecision(0)
+            << std::setfill(' ');
+  std::cout << "   bytes   table MB/s   dispatched MB/s\n";
+  for (size_t len : {16, 32, 64, 128, 256, 511, 4096}) {
+    double table = measure(len, logkv::crc16::detail::xmodem_table);
+    double dispatched = measure(len, logkv::crc16::xmodem_upd);
+    std::cout << std::setw(8) << len << std::setw(13) << table
+              << std::setw(18) << dispatched << "\n";
+  }
+  std::cout << "\n";
+}
+
 int main() {
   int crc32_status = test_crc32();
   int crc16_status = test_crc16();
+  crc16_status |= test_crc16_dispatch();
+  bench_crc16();
 
   if (crc32_status == 0 && crc16_status == 0) {
     std::cout << "All Tests Passed.\n";
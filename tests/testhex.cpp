@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <logkv/hex.h>
+
+int test_hex_roundtrip() {
+  std::cout << "[ Cross-checking hex encode/decode against the scalar loop ]\n";
+
+  std::mt19937_64 rng(17);
+  std::vector<char> src(1024 + 16);
+  for (auto& b : src) {
+    b = static_cast<char>(rng());
+  }
+  int failures = 0;
+  auto fail = [&](const char* what, size_t offset, size_t len) {
+    if (++failures <= 5) {
+      std::cout << "Mismatch:   " << what << " offset=" << offset
+                << " len=" << len << "\n";
+    }
+  };
+  for (size_t len = 0; len <= 300; ++len) {
+    for (size_t offset = 0; offset < 4; ++offset) {
+      const char* p = src.data() + offset;
+      for (bool upper : {false, true}) {
+        std::string expected(len * 2, '\0');
+        logkv_detail::encodeHexScalar(expected.data(), p, len, 0, upper);
+        std::string hex(len * 2 + offset, '\0');
+        logkv::encodeHex(hex.data() + offset, len * 2, p, len, upper);
+        if (hex.compare(offset, len * 2, expected) != 0) {
+          fail("encode", offset, len);
+        }
+        std::vector<char> back(len);
+        logkv::decodeHex(back.data(), back.size(), hex.data() + offset,
+                         len * 2);
+        if (len && std::memcmp(back.data(), p, len) != 0) {
+          fail("decode", offset, len);
+        }
+      }
+    }
+  }
+
+  std::cout << "Result:     " << (failures ? "FAIL" : "PASS") << "\n\n";
+  return failures ? 1 : 0;
+}
+
+int test_hex_validation() {
+  std::cout << "[ Rejecting non-hex characters at every position ]\n";
+
+  int failures = 0;
+  for (size_t len : {1, 15, 16, 17, 31, 32, 33, 64, 100}) {
+    std::string hex(len * 2, '0');
+    for (size_t i = 0; i < hex.size(); ++i) {
+      hex[i] = "0123456789abcdefABCDEF"[i % 22];
+    }
+    std::vector<char> out(len);
+    logkv::decodeHex(out.data(), out.size(), hex.data(), hex.size());
+    // Characters just outside each accepted range, plus high-bit bytes.
+    for (char bad : {'/', ':', '@', 'G', '`', 'g', ' ', '\0', '\x80', '\xC1',
+                     '\xE6', '\xFF'}) {
+      for (size_t pos = 0; pos < hex.size(); ++pos) {
+        std::string corrupt = hex;
+        corrupt[pos] = bad;
+        bool threw = false;
+        try {
+          logkv::decodeHex(out.data(), out.size(), corrupt.data(),
+                           corrupt.size());
+        } catch (const std::invalid_argument&) {
+          threw = true;
+        }
+        if (!threw && ++failures <= 5) {
+          std::cout << "Accepted:   0x" << std::hex
+                    << int(static_cast<unsigned char>(bad)) << std::dec
+                    << " at " << pos << " of " << hex.size() << "\n";
+        }
+      }
+    }
+  }
+
+  std::cout << "Result:     " << (failures ? "FAIL" : "PASS") << "\n\n";
+  return failures ? 1 : 0;
+}
+
+void bench_hex() {
+  std::cout << "[ Hex throughput, scalar vs dispatched ]\n";
+  std::vector<char> bin(1 << 16);
+  for (size_t i = 0; i < bin.size(); ++i) {
+    bin[i] = static_cast<char>(i * 131);
+  }
+  std::vector<char> hex(bin.size() * 2);
+  logkv::encodeHex(hex.data(), hex.size(), bin.data(), bin.size());
+  std::vector<char> out(bin.size() * 2);
+
+  auto measure = [&](size_t len, auto&& fn) {
+    const size_t iters = (64 << 20) / len;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i) {
+      fn((i * 64) % (bin.size() - len), len);
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    return iters * len / t.count() / (1 << 20);
+  };
+  auto encScalar = [&](size_t off, size_t len) {
+    logkv_detail::encodeHexScalar(out.data(), bin.data() + off, len, 0, false);
+  };
+  auto encFast = [&](size_t off, size_t len) {
+    logkv::encodeHex(out.data(), out.size(), bin.data() + off, len);
+  };
+  auto decScalar = [&](size_t off, size_t len) {
+    logkv_detail::decodeHexScalar(out.data(), hex.data() + off * 2, len, 0);
+  };
+  auto decFast = [&](size_t off, size_t len) {
+    logkv::decodeHex(out.data(), out.size(), hex.data() + off * 2, len * 2);
+  };
+
+  std::cout << std::fixed << std::setprecision(0);
+  std::cout << "   bytes   encode scalar/simd MB/s   decode scalar/simd MB/s\n";
+  for (size_t len : {16, 32, 64, 256, 4096}) {
+    std::cout << std::setw(8) << len << std::setw(14) << measure(len, encScalar)
+              << std::setw(12) << measure(len, encFast) << std::setw(14)
+              << measure(len, decScalar) << std::setw(12)
+              << measure(len, decFast) << "\n";
+  }
+  std::cout << "\n";
+}
+
+int main() {
+  int status = test_hex_roundtrip();
+  status |= test_hex_validation();
+  bench_hex();
+
+  if (status == 0) {
+    std::cout << "All Tests Passed.\n";
+  } else {
+    std::cout << "Some Tests Failed.\n";
+  }
+
+  return status;
+}
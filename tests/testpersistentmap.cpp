@@ -0,0 +1,142 @@
+#include <logkv/persistentmap.h>
+
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Hash with few distinct values, to exercise deep tries and collision nodes.
+ */
+struct WeakHash {
+  size_t operator()(int k) const { return static_cast<size_t>(k % 7); }
+};
+
+template <typename M, typename R>
+bool same_contents(const M& m, const R& ref) {
+  if (m.size() != ref.size()) {
+    return false;
+  }
+  size_t n = 0;
+  for (const auto& kv : m) {
+    auto it = ref.find(kv.first);
+    if (it == ref.end() || it->second != kv.second) {
+      return false;
+    }
+    ++n;
+  }
+  return n == ref.size();
+}
+
+template <typename M> void test_persistent_map_random(const char* name) {
+  std::cout << "Running test_persistent_map_random<" << name << ">..."
+            << std::endl;
+  std::mt19937 rng(12345);
+  M m;
+  std::unordered_map<int, std::string> ref;
+  std::vector<std::pair<M, std::unordered_map<int, std::string>>> frozen;
+  for (int step = 0; step < 20000; ++step) {
+    int key = static_cast<int>(rng() % 3000);
+    switch (rng() % 6) {
+    case 0:
+      m[key] = std::to_string(step);
+      ref[key] = std::to_string(step);
+      break;
+    case 1:
+      m.insert_or_assign(key, "a" + std::to_string(step));
+      ref.insert_or_assign(key, "a" + std::to_string(step));
+      break;
+    case 2: {
+      auto a = m.try_emplace(key, "t");
+      auto b = ref.try_emplace(key, "t");
+      assert(a.second == b.second);
+      assert(a.first->second == b.first->second);
+      break;
+    }
+    case 3:
+      assert(m.erase(key) == ref.erase(key));
+      break;
+    case 4: {
+      auto it = m.find(key);
+      assert((it == m.end()) == (ref.find(key) == ref.end()));
+      if (it != m.end()) {
+        it->second += "x"; // mutate through the iterator
+        ref[key] += "x";
+      }
+      break;
+    }
+    default: {
+      auto it = m.find(key);
+      if (it != m.end()) {
+        it = m.erase(it);
+        ref.erase(key);
+      }
+      break;
+    }
+    }
+    if (step % 2500 == 0) {
+      frozen.emplace_back(m.snapshot(), ref);
+    }
+  }
+  assert(same_contents(m, ref));
+  for (const auto& [snap, snapRef] : frozen) {
+    assert(same_contents(snap, snapRef));
+  }
+
+  // Erasing everything through iterators visits every entry exactly once.
+  size_t erased = 0;
+  for (auto it = m.begin(); it != m.end();) {
+    it = m.erase(it);
+    ++erased;
+  }
+  assert(erased == ref.size());
+  assert(m.empty() && m.begin() == m.end());
+  for (const auto& [snap, snapRef] : frozen) {
+    assert(same_contents(snap, snapRef));
+  }
+  std::cout << "test_persistent_map_random<" << name << "> PASSED."
+            << std::endl;
+}
+
+void test_persistent_map_concurrent_snapshot() {
+  std::cout << "Running test_persistent_map_concurrent_snapshot..."
+            << std::endl;
+  logkv::PersistentMap<int, std::string> m;
+  for (int i = 0; i < 50000; ++i) {
+    m[i] = std::to_string(i);
+  }
+  // A reader walks a frozen copy while the original is rewritten.
+  auto view = m.snapshot();
+  std::thread reader([&view]() {
+    size_t n = 0;
+    for (const auto& kv : view) {
+      assert(kv.second == std::to_string(kv.first));
+      ++n;
+    }
+    assert(n == 50000);
+  });
+  for (int i = 0; i < 50000; i += 2) {
+    m[i] = "changed";
+    m.erase(i + 1);
+  }
+  for (int i = 50000; i < 60000; ++i) {
+    m[i] = "new";
+  }
+  reader.join();
+  assert(m.size() == 35000);
+  assert(view.size() == 50000 && view.at(1) == "1");
+  assert(m.at(0) == "changed" && !m.contains(1));
+  std::cout << "test_persistent_map_concurrent_snapshot PASSED." << std::endl;
+}
+
+int main() {
+  test_persistent_map_random<logkv::PersistentMap<int, std::string>>("std");
+  test_persistent_map_random<logkv::PersistentMap<int, std::string, WeakHash>>(
+    "weak");
+  test_persistent_map_concurrent_snapshot();
+  std::cout << "\nALL PersistentMap tests PASSED successfully!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,307 @@
+#include <logkv/replication.h>
+#include <logkv/store.h>
+
+#include <logkv/autoser/bytes.h>
+#include <logkv/bytes.h>
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+using TestStore = logkv::Store<std::map, logkv::Bytes, logkv::Bytes>;
+using Follower = logkv::ReplicationFollower<TestStore>;
+
+const std::string TEST_BASE_DIR = "logkv_replication_test_run_data";
+constexpr auto TIMEOUT = std::chrono::seconds(20);
+
+std::string setup_test_directory(const std::string& name) {
+  auto path = std::filesystem::path(TEST_BASE_DIR) / name;
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  return path.string();
+}
+
+logkv::Bytes key(int i) {
+  return logkv::makeBytes("key" + std::to_string(i));
+}
+
+logkv::Bytes val(int i, size_t size = 16) {
+  logkv::Bytes v(size);
+  for (size_t j = 0; j < size; ++j) {
+    v[j] = static_cast<char>('a' + (i + j) % 26);
+  }
+  return v;
+}
+
+std::shared_ptr<logkv::ReplicationLeader> make_leader(TestStore& store) {
+  auto leader = std::make_shared<logkv::ReplicationLeader>(
+    store.getDirectory(),
+    boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(),
+                                   0));
+  store.setObserver(leader);
+  return leader;
+}
+
+/**
+ * Waits for the follower to apply everything the leader's store sealed, and
+ * checks that the replica has the same map.
+ */
+void check_synced(TestStore& store, logkv::ReplicationLeader& leader,
+                  Follower& follower) {
+  store.flush();
+  bool synced = follower.waitForPosition(leader.getPosition(), TIMEOUT);
+  assert(synced);
+  assert(follower.getPosition() == leader.getPosition());
+  bool same = follower.read([&](const TestStore& replica) {
+    return replica.getObjects() == store.getObjects();
+  });
+  assert(same);
+}
+
+void test_apply_events() {
+  std::cout << "Running test_apply_events..." << std::endl;
+  std::string dir = setup_test_directory("apply_events");
+  std::string replica_dir = setup_test_directory("apply_events_replica");
+  {
+    TestStore store(dir, logkv::createDir | logkv::deleteData, 128);
+    for (int i = 0; i < 50; ++i) {
+      store.update(key(i % 20), val(i, i % 7 == 0 ? 1000 : 16));
+      if (i % 3 == 0) {
+        store.erase(key(i % 11));
+      }
+      if (i % 10 == 0) {
+        store.flush();
+      }
+    }
+    store.flush();
+
+    std::ifstream in(std::filesystem::path(dir) / (std::string(19, '0') +
+                                                   "0.events"),
+                     std::ios::binary);
+    std::string events((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+    assert(events.size() == store.getEventsFileSize());
+
+    // Bytes arrive in small pieces; only complete frames are applied.
+    TestStore replica(replica_dir, logkv::createDir | logkv::deleteData);
+    std::string pending;
+    size_t applied = 0;
+    for (size_t pos = 0; pos < events.size(); pos += 7) {
+      pending += events.substr(pos, 7);
+      size_t n = replica.applyEvents(pending.data(), pending.size());
+      pending.erase(0, n);
+      applied += n;
+    }
+    assert(pending.empty() && applied == events.size());
+    assert(replica.getObjects() == store.getObjects());
+    assert(replica.getEventsFileSize() == 0);
+
+    std::string corrupted = events;
+    corrupted[corrupted.size() / 2] ^= 0x55;
+    bool threw = false;
+    try {
+      replica.applyEvents(corrupted.data(), corrupted.size());
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    assert(threw);
+  }
+  std::filesystem::remove_all(dir);
+  std::filesystem::remove_all(replica_dir);
+  std::cout << "test_apply_events PASSED." << std::endl;
+}
+
+void test_replication_stream() {
+  std::cout << "Running test_replication_stream..." << std::endl;
+  std::string dir = setup_test_directory("stream");
+  std::string replica_dir = setup_test_directory("stream_replica");
+  {
+    TestStore store(dir, logkv::createDir | logkv::deleteData, 256);
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.save();
+    for (int i = 100; i < 150; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.flush();
+
+    // Bootstrap from the snapshot and events files, then stream.
+    auto leader = make_leader(store);
+    TestStore replica(replica_dir, logkv::createDir | logkv::deleteData);
+    Follower follower(replica, "127.0.0.1", leader->getPort());
+    check_synced(store, *leader, follower);
+    assert(follower.isBootstrapped());
+
+    for (int i = 0; i < 200; ++i) {
+      store.update(key(i % 170), val(i * 3));
+      if (i % 5 == 0) {
+        store.erase(key(i % 13));
+      }
+      if (i % 50 == 0) {
+        store.flush();
+      }
+    }
+    // Frame chains and switching events files.
+    store.update(key(1000), val(1000, 5000));
+    check_synced(store, *leader, follower);
+    store.save();
+    store.update(key(1001), val(1001));
+    check_synced(store, *leader, follower);
+    store.setMaxDeltaSnapshots(4);
+    store.update(key(1002), val(1002));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    store.update(key(1003), val(1003));
+    check_synced(store, *leader, follower);
+
+    // The follower reports its position.
+    auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+    while (true) {
+      auto replicas = leader->getReplicas();
+      assert(replicas.size() == 1);
+      if (replicas[0].applied == leader->getPosition()) {
+        assert(!replicas[0].bootstrapping);
+        break;
+      }
+      assert(std::chrono::steady_clock::now() < deadline);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // A follower behind the backlog bootstraps, including the events of the
+    // current file that were trimmed from the backlog.
+    leader->setMaxBacklogBytes(0);
+    store.update(key(2000), val(2000));
+    store.flush();
+    std::string late_dir = setup_test_directory("stream_late_replica");
+    {
+      TestStore late(late_dir, logkv::createDir | logkv::deleteData);
+      Follower lateFollower(late, "127.0.0.1", leader->getPort());
+      check_synced(store, *leader, lateFollower);
+      leader->setMaxBacklogBytes(
+        logkv::ReplicationLeader::DefaultMaxBacklogBytes);
+      store.update(key(2001), val(2001));
+      check_synced(store, *leader, lateFollower);
+    }
+    std::filesystem::remove_all(late_dir);
+
+    // The first follower fell behind while the backlog was empty.
+    check_synced(store, *leader, follower);
+
+    // Reloading the leader's store makes followers bootstrap again.
+    store.clear();
+    store.update(key(3000), val(3000));
+    check_synced(store, *leader, follower);
+    store.load();
+    store.update(key(3001), val(3001));
+    check_synced(store, *leader, follower);
+
+    follower.stop();
+    leader->stop();
+  }
+  std::filesystem::remove_all(dir);
+  std::filesystem::remove_all(replica_dir);
+  std::cout << "test_replication_stream PASSED." << std::endl;
+}
+
+void test_replication_reconnect() {
+  std::cout << "Running test_replication_reconnect..." << std::endl;
+  std::string dir = setup_test_directory("reconnect");
+  std::string replica_dir = setup_test_directory("reconnect_replica");
+  {
+    TestStore replica(replica_dir, logkv::createDir | logkv::deleteData);
+    uint16_t port;
+    {
+      TestStore store(dir, logkv::createDir | logkv::deleteData);
+      auto leader = make_leader(store);
+      port = leader->getPort();
+      store.update(key(1), val(1));
+      store.flush();
+      Follower follower(replica, "127.0.0.1", port);
+      check_synced(store, *leader, follower);
+      follower.stop();
+      store.setObserver(nullptr);
+    }
+    // A follower that starts before its leader connects once it's up.
+    Follower follower(replica, "127.0.0.1", port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    TestStore store(dir);
+    store.update(key(2), val(2));
+    auto leader = std::make_shared<logkv::ReplicationLeader>(
+      dir, boost::asio::ip::tcp::endpoint(
+             boost::asio::ip::address_v4::loopback(), port));
+    store.setObserver(leader);
+    check_synced(store, *leader, follower);
+    assert(follower.read([](const TestStore& r) {
+      return r.getObjects().size() == 2;
+    }));
+    store.setObserver(nullptr);
+  }
+  std::filesystem::remove_all(dir);
+  std::filesystem::remove_all(replica_dir);
+  std::cout << "test_replication_reconnect PASSED." << std::endl;
+}
+
+void test_replication_segments() {
+  std::cout << "Running test_replication_segments..." << std::endl;
+  std::string dir = setup_test_directory("segments");
+  std::string replica_dir = setup_test_directory("segments_replica");
+  {
+    TestStore store(dir, logkv::createDir | logkv::deleteData, 256);
+    store.setEventsSegmentSize(2048);
+    auto leader = make_leader(store);
+    leader->setMaxBacklogBytes(0);
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), val(i, 40));
+    }
+    store.save();
+    // The follower bootstraps from the preallocated segments, which read as
+    // zeros past the events that the store flushed.
+    store.setGroupCommit(true);
+    for (int i = 0; i < 300; ++i) {
+      store.update(key(i % 120), val(i * 5, 40));
+    }
+    store.flush();
+    for (int i = 0; i < 20; ++i) {
+      store.update(key(i), val(i));
+    }
+    assert(std::filesystem::exists(std::filesystem::path(dir) /
+                                   (std::string(19, '0') + "1.events.3")));
+    TestStore replica(replica_dir, logkv::createDir | logkv::deleteData);
+    Follower follower(replica, "127.0.0.1", leader->getPort());
+    check_synced(store, *leader, follower);
+    leader->setMaxBacklogBytes(
+      logkv::ReplicationLeader::DefaultMaxBacklogBytes);
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), val(i * 11, 40));
+    }
+    check_synced(store, *leader, follower);
+    follower.stop();
+    leader->stop();
+    store.setObserver(nullptr);
+  }
+  std::filesystem::remove_all(dir);
+  std::filesystem::remove_all(replica_dir);
+  std::cout << "test_replication_segments PASSED." << std::endl;
+}
+
+int main() {
+  try {
+    test_apply_events();
+    test_replication_stream();
+    test_replication_reconnect();
+    test_replication_segments();
+    std::filesystem::remove_all(TEST_BASE_DIR);
+    std::cout << "\nALL replication tests PASSED successfully!" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "A replication test FAILED with exception: " << e.what()
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
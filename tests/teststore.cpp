@@ -7,11 +7,19 @@
 #include <logkv/autoser/pushback.h>
 
 #include <logkv/bytes.h>
+#include <logkv/lazy.h>
+#include <logkv/persistentmap.h>
+#include <logkv/shardedstore.h>
 
 #include <iostream>
+#include <thread>
 
 #include <boost/unordered/unordered_flat_map.hpp>
 
+#if LOGKV_URING
+#include <sys/resource.h>
+#endif
+
 using TestStore = logkv::Store<std::map, logkv::Bytes, logkv::Bytes>;
 
 const std::string TEST_BASE_DIR = "logkv_store_test_run_data";
@@ -1138,6 +1146,2429 @@ void test_store_macro_partial_serialization() {
   std::cout << "test_store_macro_partial_serialization PASSED." << std::endl;
 }
 
+struct WidePartialObj
+    : public logkv::AutoPartialSerializableObject<WidePartialObj> {
+  uint64_t id = 0;
+  std::string name;
+  std::string description;
+  uint64_t f0 = 0, f1 = 0, f2 = 0, f3 = 0, f4 = 0, f5 = 0, f6 = 0, f7 = 0;
+  uint32_t counter = 0;
+
+  auto operator<=>(const WidePartialObj&) const = default;
+
+  AUTO_SERIALIZABLE_MEMBERS(id, name, description, f0, f1, f2, f3, f4, f5, f6,
+                            f7, counter)
+
+  AUTO_PARTIAL_SERIALIZABLE_MEMBERS(id)
+};
+
+void test_store_masked_partial_serialization() {
+  std::cout << "Running test_store_masked_partial_serialization..."
+            << std::endl;
+  std::string dir_path = setup_test_directory("masked_partial_serialization");
+
+  using WideStore = logkv::Store<std::map, uint64_t, WidePartialObj>;
+
+  auto makeObj = [](uint64_t i) {
+    WidePartialObj o;
+    o.id = i;
+    o.name = "name_" + std::to_string(i);
+    o.description = std::string(200, 'd');
+    o.f0 = i + 1;
+    o.f3 = i * 3;
+    o.f7 = ~i;
+    return o;
+  };
+
+  const int numKeys = 50;
+  const int rounds = 20;
+  std::map<uint64_t, WidePartialObj> expected;
+  uint64_t diffEventsSize = 0;
+
+  WidePartialObj::_setDiffSerialization(true);
+  {
+    WideStore store(dir_path, logkv::createDir | logkv::deleteData);
+    for (int k = 0; k < numKeys; ++k) {
+      expected[k] = makeObj(k);
+      store.update(k, expected[k]);
+    }
+    store.flush();
+    const uint64_t initialSize = store.getEventsFileSize();
+
+    // One different member changes per update; each update logs the header,
+    // the mask and that member only.
+    for (int r = 0; r < rounds; ++r) {
+      for (int k = 0; k < numKeys; ++k) {
+        WidePartialObj o = store.getObjects().at(k);
+        switch ((r + k) % 4) {
+        case 0:
+          o.counter++;
+          break;
+        case 1:
+          o.f5 = r * 1000 + k;
+          break;
+        case 2:
+          o.name = "renamed_" + std::to_string(r);
+          break;
+        default:
+          o.f1 += 7;
+          break;
+        }
+        expected[k] = o;
+        auto it = store.find(k);
+        store.update(it, o);
+      }
+    }
+    store.flush();
+    diffEventsSize = store.getEventsFileSize() - initialSize;
+  }
+  WidePartialObj::_setDiffSerialization(false);
+
+  {
+    WideStore store(dir_path);
+    assert(store.getObjects() == expected);
+  }
+
+  // Same updates logged in full are an order of magnitude larger.
+  {
+    std::string full_path = setup_test_directory("masked_partial_full");
+    WidePartialObj::_setFullSerialization(true);
+    WideStore store(full_path, logkv::createDir | logkv::deleteData);
+    for (const auto& [k, v] : expected) {
+      store.update(k, v);
+    }
+    store.flush();
+    const uint64_t fullSize = store.getEventsFileSize() * rounds;
+    WidePartialObj::_setFullSerialization(false);
+    assert(diffEventsSize * 10 < fullSize);
+    cleanup_test_directory(full_path);
+  }
+
+  // Caller-selected members: only those are logged, whatever else changed.
+  {
+    WideStore store(dir_path);
+    WidePartialObj o = store.getObjects().at(3);
+    o.f2 = 222;
+    o.description = "NOT_LOGGED";
+    WidePartialObj::_setDirtyMembers(logkv::member_mask(o, o.f2));
+    store.update(3, o);
+    assert(WidePartialObj::_getDirtyMembers() == 0); // only for that update
+    WidePartialObj::_setDiffSerialization(true);
+    WidePartialObj p = store.getObjects().at(4);
+    p.f5 = 555;
+    store.update(4, p); // diffed, not masked like the last one
+    WidePartialObj::_setDiffSerialization(false);
+    store.flush();
+    expected[3].f2 = 222;
+    expected[4].f5 = 555;
+  }
+  {
+    WideStore store(dir_path);
+    assert(store.getObjects() == expected);
+  }
+
+  // Wire format: header 0x03, VarUint mask, then the selected members.
+  {
+    WidePartialObj o = makeObj(9);
+    const uint64_t mask = logkv::member_mask(o, o.counter, o.id);
+    assert(mask == ((1ull << 11) | 1ull));
+    WidePartialObj::_setDirtyMembers(mask);
+    std::vector<char> buffer(
+      logkv::serializer<WidePartialObj>::get_size(o));
+    size_t written = logkv::serializer<WidePartialObj>::write(
+      buffer.data(), buffer.size(), o);
+    WidePartialObj::_setDirtyMembers(0);
+    assert(written == buffer.size());
+    assert(written == 1 + 2 + 8 + 4);
+    assert(buffer[0] == logkv::ObjectEncoding::mask);
+
+    WidePartialObj patched = makeObj(1);
+    patched.counter = 5;
+    size_t used = logkv::serializer<WidePartialObj>::read(
+      buffer.data(), buffer.size(), patched);
+    assert(used == written);
+    assert(patched.id == 9 && patched.counter == 0);
+    assert(patched.name == "name_1");
+
+    // Mask bits past the last member are rejected.
+    std::vector<char> bad = {logkv::ObjectEncoding::mask, (char)0x80, 0x40};
+    bool threw = false;
+    try {
+      logkv::serializer<WidePartialObj>::read(bad.data(), bad.size(),
+                                              patched);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    assert(threw);
+  }
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_masked_partial_serialization PASSED." << std::endl;
+}
+
+void test_store_group_commit() {
+  std::cout << "Running test_store_group_commit..." << std::endl;
+  std::string test_name = "group_commit";
+  std::string dir_path = setup_test_directory(test_name);
+
+  const int numThreads = 8;
+  const int updatesPerThread = 200;
+
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir);
+    store.setGroupCommit(true);
+    assert(store.isGroupCommit());
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < numThreads; ++t) {
+      writers.emplace_back([&store, t]() {
+        for (int i = 0; i < updatesPerThread; ++i) {
+          std::string k = "gc_" + std::to_string(t) + "_" + std::to_string(i);
+          uint64_t seq =
+            store.update(logkv::makeBytes(k), logkv::makeBytes("v" + k));
+          store.waitDurable(seq);
+          assert(store.getDurableSequence() >= seq);
+        }
+      });
+    }
+    for (auto& w : writers) {
+      w.join();
+    }
+
+    assert(store.getWriteSequence() == numThreads * updatesPerThread);
+    assert(store.getDurableSequence() == store.getWriteSequence());
+    assert(store.getObjects().size() == numThreads * updatesPerThread);
+
+    // Everything waited on is already durable; no flush() needed here.
+    store.setGroupCommit(false);
+    assert(!store.isGroupCommit());
+  }
+
+  {
+    TestStore store_load(dir_path, logkv::StoreFlags::none);
+    assert(store_load.getObjects().size() == numThreads * updatesPerThread);
+    assert(store_load.getObjects().at(logkv::makeBytes("gc_3_17")) ==
+           logkv::makeBytes("vgc_3_17"));
+
+    // Group commit survives save() closing and reopening the events file.
+    store_load.setGroupCommit(true);
+    uint64_t seq = store_load.update(logkv::makeBytes("after_save_a"),
+                                     logkv::makeBytes("a"));
+    store_load.save();
+    assert(store_load.getDurableSequence() >= seq);
+    seq = store_load.update(logkv::makeBytes("after_save_b"),
+                            logkv::makeBytes("b"));
+    store_load.waitDurable(seq);
+  }
+
+  {
+    TestStore store_load2(dir_path, logkv::StoreFlags::none);
+    assert(store_load2.getObjects().size() ==
+           numThreads * updatesPerThread + 2);
+    assert(store_load2.getObjects().at(logkv::makeBytes("after_save_b")) ==
+           logkv::makeBytes("b"));
+  }
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_group_commit PASSED." << std::endl;
+}
+
+void test_store_sharded_snapshot() {
+  std::cout << "Running test_store_sharded_snapshot..." << std::endl;
+  std::string test_name = "sharded_snapshot";
+  std::string dir_path = setup_test_directory(test_name);
+  std::filesystem::path dir = dir_path;
+
+  const int numEntries = 1000;
+  auto key = [](int i) { return logkv::makeBytes("sk_" + std::to_string(i)); };
+  auto val = [](int i) { return logkv::makeBytes("sv_" + std::to_string(i)); };
+
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir);
+    store.setSnapshotShards(4);
+    assert(store.getSnapshotShards() == 4);
+    for (int i = 0; i < numEntries; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.save();
+
+    assert(std::filesystem::exists(dir / (test_pad_filename(1) + ".snapshot")));
+    for (int s = 1; s < 4; ++s) {
+      assert(std::filesystem::exists(
+        dir / (test_pad_filename(1) + ".snapshot." + std::to_string(s))));
+    }
+    assert(!std::filesystem::exists(dir / (test_pad_filename(1) +
+                                           ".snapshot.4")));
+
+    store.erase(key(7));
+    store.update(key(8), logkv::makeBytes("changed"));
+    store.flush();
+  }
+
+  {
+    TestStore store_load(dir_path, logkv::StoreFlags::none);
+    assert(store_load.getObjects().size() == numEntries - 1);
+    assert(store_load.getObjects().count(key(7)) == 0);
+    assert(store_load.getObjects().at(key(8)) == logkv::makeBytes("changed"));
+    assert(store_load.getObjects().at(key(999)) == val(999));
+
+    // Unsharded save replaces the shard set and cleans up the old shards.
+    store_load.save();
+    assert(std::filesystem::exists(dir / (test_pad_filename(2) + ".snapshot")));
+    assert(!std::filesystem::exists(dir / (test_pad_filename(1) +
+                                           ".snapshot.1")));
+    assert(!std::filesystem::exists(dir / (test_pad_filename(2) +
+                                           ".snapshot.1")));
+  }
+
+  {
+    TestStore store_load2(dir_path, logkv::StoreFlags::none);
+    assert(store_load2.getObjects().size() == numEntries - 1);
+    store_load2.setSnapshotShards(3);
+    store_load2.save();
+  }
+
+  // A shard set with a missing shard is a corrupted snapshot.
+  std::filesystem::remove(dir / (test_pad_filename(3) + ".snapshot.1"));
+  bool threw = false;
+  try {
+    TestStore store_bad(dir_path, logkv::StoreFlags::none);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_sharded_snapshot PASSED." << std::endl;
+}
+
+void test_store_mapped_replay() {
+  std::cout << "Running test_store_mapped_replay..." << std::endl;
+  std::string test_name = "mapped_replay";
+  std::string dir_path = setup_test_directory(test_name);
+  auto key = [](int i) { return logkv::makeBytes("mk_" + std::to_string(i)); };
+  auto val = [](int i) {
+    return logkv::Bytes(static_cast<size_t>((i * 37) % 700 + 1),
+                        char('a' + i % 26));
+  };
+
+  {
+    // Small buffer so that frames of all sizes (CRC16 and CRC32) are written
+    // and some K,V pairs are split across frames.
+    TestStore store(dir_path, logkv::StoreFlags::createDir, 256);
+    for (int i = 0; i < 300; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.save();
+    for (int i = 0; i < 300; i += 3) {
+      store.update(key(i), val(i + 1));
+      if (i % 9 == 0) {
+        store.flush();
+      }
+    }
+    store.erase(key(1));
+    store.flush();
+  }
+
+  auto loadStore = [&](bool mapped, bool& ok) {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setMappedReplay(mapped);
+    assert(store.isMappedReplay() == mapped);
+    ok = store.load();
+    return store.getObjects();
+  };
+
+  bool okStdio = false, okMapped = false;
+  auto stdioObjects = loadStore(false, okStdio);
+  auto mappedObjects = loadStore(true, okMapped);
+  assert(okStdio && okMapped);
+  assert(stdioObjects.size() == 299);
+  assert(mappedObjects == stdioObjects);
+  assert(mappedObjects.at(key(3)) == val(4));
+
+  // Truncated and corrupted tails are reported the same way as stdio replay.
+  for (int damage = 0; damage < 2; ++damage) {
+    std::string test_sub = test_name + "_damage" + std::to_string(damage);
+    std::string sub_path = setup_test_directory(test_sub);
+    {
+      TestStore store(sub_path, logkv::StoreFlags::createDir);
+      for (int i = 0; i < 50; ++i) {
+        store.update(key(i), val(i));
+        store.flush();
+      }
+    }
+    std::filesystem::path sub_events =
+      std::filesystem::path(sub_path) / (test_pad_filename(0) + ".events");
+    auto size = std::filesystem::file_size(sub_events);
+    if (damage == 0) {
+      std::filesystem::resize_file(sub_events, size - 3);
+    } else {
+      std::fstream fs(sub_events, std::ios::in | std::ios::out |
+                                    std::ios::binary);
+      fs.seekp(size - 2);
+      fs.put('\x7f');
+    }
+    std::filesystem::path copy_path = sub_path + "_copy";
+    std::filesystem::remove_all(copy_path);
+    std::filesystem::copy(sub_path, copy_path);
+
+    TestStore stdioStore(sub_path, logkv::StoreFlags::deferLoad);
+    TestStore mappedStore(copy_path.string(), logkv::StoreFlags::deferLoad);
+    mappedStore.setMappedReplay(true);
+    assert(!stdioStore.load());
+    assert(!mappedStore.load());
+    assert(stdioStore.getObjects().size() == 49);
+    assert(mappedStore.getObjects() == stdioStore.getObjects());
+    cleanup_test_directory(copy_path.string());
+    cleanup_test_directory(sub_path);
+  }
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_mapped_replay PASSED." << std::endl;
+}
+
+void write_raw_crc16_frame(std::ofstream& out, const std::string& payload) {
+  assert(payload.size() < 32);
+  char control = static_cast<char>(payload.size());
+  uint16_t crc = logkv::computeCRC16(payload.data(), payload.size());
+  out.write(&control, 1);
+  out.write(reinterpret_cast<const char*>(&crc), 2);
+  out.write(payload.data(), payload.size());
+}
+
+std::string serialize_bytes(const std::string& str) {
+  logkv::Bytes b = logkv::makeBytes(str);
+  std::string out(logkv::serializer<logkv::Bytes>::get_size(b), '\0');
+  logkv::serializer<logkv::Bytes>::write(out.data(), out.size(), b);
+  return out;
+}
+
+void test_store_pipelined_replay() {
+  std::cout << "Running test_store_pipelined_replay..." << std::endl;
+  std::string test_name = "pipelined_replay";
+  std::string dir_path = setup_test_directory(test_name);
+
+  auto key = [](int i) { return logkv::makeBytes("pk_" + std::to_string(i)); };
+  auto val = [](int i) {
+    return logkv::Bytes(static_cast<size_t>((i * 53) % 900 + 1),
+                        char('A' + i % 26));
+  };
+
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir, 1024);
+    for (int i = 0; i < 2000; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.save();
+    for (int i = 0; i < 2000; i += 7) {
+      store.update(key(i), val(i + 3));
+      store.erase(key(i + 1));
+      if (i % 70 == 0) {
+        store.flush();
+      }
+    }
+    store.flush();
+  }
+
+  auto loadStore = [&](const std::string& path, size_t workers, bool mapped,
+                       bool& ok) {
+    TestStore store(path, logkv::StoreFlags::deferLoad);
+    store.setReplayWorkers(workers);
+    store.setMappedReplay(mapped);
+    assert(store.getReplayWorkers() == workers);
+    ok = store.load();
+    return store.getObjects();
+  };
+
+  bool ok1 = false, ok2 = false, ok3 = false;
+  auto serialObjects = loadStore(dir_path, 0, false, ok1);
+  auto pipelinedObjects = loadStore(dir_path, 3, false, ok2);
+  auto pipelinedMappedObjects = loadStore(dir_path, 2, true, ok3);
+  assert(ok1 && ok2 && ok3);
+  assert(serialObjects.size() == 2000 - 286);
+  assert(pipelinedObjects == serialObjects);
+  assert(pipelinedMappedObjects == serialObjects);
+  assert(pipelinedObjects.at(key(7)) == val(10));
+  cleanup_test_directory(dir_path);
+
+  // K,V pairs split across frames (written by older versions) still replay.
+  std::string split_path = setup_test_directory(test_name + "_split");
+  {
+    std::ofstream out(std::filesystem::path(split_path) /
+                        (test_pad_filename(0) + ".events"),
+                      std::ios::binary);
+    write_raw_crc16_frame(out, serialize_bytes("k1") + serialize_bytes("v1") +
+                                 serialize_bytes("k2"));
+    write_raw_crc16_frame(out, serialize_bytes("v2") + serialize_bytes("k3"));
+    write_raw_crc16_frame(out, serialize_bytes("v3"));
+    write_raw_crc16_frame(out, serialize_bytes("k1") + serialize_bytes(""));
+  }
+  std::filesystem::path split_copy = split_path + "_copy";
+  std::filesystem::copy(split_path, split_copy);
+  bool okSplitSerial = false, okSplitPipelined = false;
+  auto splitSerial = loadStore(split_path, 0, false, okSplitSerial);
+  auto splitPipelined =
+    loadStore(split_copy.string(), 2, false, okSplitPipelined);
+  assert(okSplitSerial && okSplitPipelined);
+  assert(splitSerial.size() == 2);
+  assert(splitSerial.at(logkv::makeBytes("k3")) == logkv::makeBytes("v3"));
+  assert(splitPipelined == splitSerial);
+  cleanup_test_directory(split_copy.string());
+  cleanup_test_directory(split_path);
+
+  // A truncated tail is detected like in serial replay.
+  std::string trunc_path = setup_test_directory(test_name + "_truncated");
+  {
+    TestStore store(trunc_path, logkv::StoreFlags::createDir);
+    for (int i = 0; i < 40; ++i) {
+      store.update(key(i), val(i));
+      store.flush();
+    }
+  }
+  std::filesystem::path trunc_events =
+    std::filesystem::path(trunc_path) / (test_pad_filename(0) + ".events");
+  std::filesystem::resize_file(trunc_events,
+                               std::filesystem::file_size(trunc_events) - 5);
+  bool okTrunc = true;
+  auto truncObjects = loadStore(trunc_path, 4, false, okTrunc);
+  assert(!okTrunc);
+  assert(truncObjects.size() == 39);
+  cleanup_test_directory(trunc_path);
+
+  std::cout << "test_store_pipelined_replay PASSED." << std::endl;
+}
+
+void test_store_uring_write() {
+  std::cout << "Running test_store_uring_write..." << std::endl;
+  std::string test_name = "uring_write";
+  std::string dir_path = setup_test_directory(test_name);
+  auto key = [](int i) { return logkv::makeBytes("uk_" + std::to_string(i)); };
+  auto val = [](int i) {
+    return logkv::Bytes(static_cast<size_t>((i * 41) % 5000 + 1),
+                        char('a' + i % 26));
+  };
+
+  // Enough data to cycle through all the staging buffers several times.
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir, 4096);
+    store.setWriteMode(logkv::StoreWriteMode::uringWrite);
+    assert(store.getWriteMode() == logkv::StoreWriteMode::uringWrite);
+    for (int i = 0; i < 3000; ++i) {
+      store.update(key(i), val(i));
+      if (i % 500 == 0) {
+        store.flush();
+      }
+    }
+    store.save();
+    for (int i = 0; i < 3000; i += 2) {
+      store.update(key(i), val(i + 1));
+    }
+    store.erase(key(1));
+    store.flush();
+    store.setGroupCommit(true);
+    store.waitDurable(store.update(key(1), val(7)));
+  }
+  {
+    TestStore store(dir_path);
+    assert(store.getObjects().size() == 3000);
+    assert(store.getObjects().at(key(0)) == val(1));
+    assert(store.getObjects().at(key(1)) == val(7));
+    assert(store.getObjects().at(key(3)) == val(3));
+  }
+
+#if LOGKV_URING
+  // An unclosed direct I/O file ends in zero padding up to the block size.
+  std::filesystem::path raw = std::filesystem::path(dir_path) / "raw.bin";
+  std::string data(5000, 'x');
+  {
+    auto w = logkv::UringFileWriter::open(raw, false);
+    assert(w);
+    w->write(data.data(), 10);
+    w->flush();
+    assert(std::filesystem::file_size(raw) ==
+           logkv::UringFileWriter::Alignment);
+    w->close();
+    assert(std::filesystem::file_size(raw) == 10);
+    w = logkv::UringFileWriter::open(raw, true);
+    assert(w && w->size() == 10);
+    w->write(data.data(), data.size());
+    w->close();
+    assert(std::filesystem::file_size(raw) == 5010);
+    std::ifstream in(raw, std::ios::binary);
+    std::string back((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    assert(back == std::string(5010, 'x'));
+  }
+
+  // If the ring can't be set up after the file is opened (here, for lack of
+  // file descriptors), the file is left as it was and the store falls back
+  // to stdio writes.
+  {
+    TestStore store(dir_path);
+    store.update(key(5000), val(5000));
+    store.flush();
+    auto events = std::filesystem::path(dir_path) /
+                  (test_pad_filename(store.getTime()) + ".events");
+    const auto size = std::filesystem::file_size(events);
+    assert(size > 0);
+    struct rlimit saved;
+    assert(getrlimit(RLIMIT_NOFILE, &saved) == 0);
+    int lowest = dup(0); // the file gets this one, the ring none
+    assert(lowest >= 0);
+    ::close(lowest);
+    struct rlimit limit = saved;
+    limit.rlim_cur = static_cast<rlim_t>(lowest) + 1;
+    assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    auto w = logkv::UringFileWriter::open(events, true);
+    assert(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+    assert(!w);
+    assert(std::filesystem::file_size(events) == size);
+    // Reopening the events file reuses its descriptor, leaving none.
+    limit.rlim_cur = static_cast<rlim_t>(lowest);
+    assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    store.setWriteMode(logkv::StoreWriteMode::uringWrite);
+    assert(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+    assert(std::filesystem::file_size(events) == size);
+    store.update(key(5001), val(5001));
+    store.flush();
+  }
+  {
+    TestStore store(dir_path);
+    assert(store.getObjects().at(key(5000)) == val(5000));
+    assert(store.getObjects().at(key(5001)) == val(5001));
+  }
+#endif
+
+  // A zero tail ends the log: it is dropped and new events are appended at
+  // the log end. Non-zero bytes after a zero control byte are corruption.
+  for (int garbage = 0; garbage < 2; ++garbage) {
+    for (int mapped = 0; mapped < 2; ++mapped) {
+      std::string sub_path = setup_test_directory(
+        test_name + "_pad" + std::to_string(garbage) + std::to_string(mapped));
+      {
+        TestStore store(sub_path, logkv::StoreFlags::createDir);
+        for (int i = 0; i < 20; ++i) {
+          store.update(key(i), val(i));
+          store.flush();
+        }
+      }
+      std::filesystem::path events =
+        std::filesystem::path(sub_path) / (test_pad_filename(0) + ".events");
+      auto size = std::filesystem::file_size(events);
+      {
+        std::ofstream out(events, std::ios::binary | std::ios::app);
+        std::string zeros(3001, '\0');
+        if (garbage) {
+          zeros[2000] = 1;
+        }
+        out.write(zeros.data(), zeros.size());
+      }
+      {
+        TestStore store(sub_path, logkv::StoreFlags::deferLoad);
+        store.setMappedReplay(mapped);
+        assert(store.load() == !garbage);
+        assert(store.getObjects().size() == 20);
+        if (!garbage) {
+          assert(std::filesystem::file_size(events) == size);
+        }
+        store.update(key(100), val(1));
+        store.flush();
+      }
+      TestStore store(sub_path);
+      assert(store.getObjects().size() == 21);
+    }
+  }
+  std::cout << "test_store_uring_write PASSED." << std::endl;
+}
+
+void test_store_background_save() {
+  std::cout << "Running test_store_background_save..." << std::endl;
+  using PersistentStore =
+    logkv::Store<logkv::PersistentMap, logkv::Bytes, logkv::Bytes>;
+  std::string test_name = "background_save";
+  std::string dir_path = setup_test_directory(test_name);
+  std::string frozen_path = setup_test_directory(test_name + "_frozen");
+  auto key = [](int i) { return logkv::makeBytes("bk_" + std::to_string(i)); };
+  auto val = [](int i) { return logkv::makeBytes("v" + std::to_string(i)); };
+
+  logkv::PersistentMap<logkv::Bytes, logkv::Bytes> atSave, live;
+  {
+    PersistentStore store(dir_path, logkv::StoreFlags::createDir);
+    for (int i = 0; i < 20000; ++i) {
+      store.update(key(i), val(i));
+    }
+    atSave = store.getObjects();
+    assert(store.save(logkv::StoreSaveMode::backgroundSave) == 0);
+    // Keep updating (and erasing) while the snapshot is being written.
+    for (int i = 0; i < 20000; i += 3) {
+      store.update(key(i), val(i + 1));
+      store.erase(key(i + 1));
+    }
+    store.waitSave();
+    assert(!store.isSaving());
+    std::string snapshot_name = test_pad_filename(1) + ".snapshot";
+    std::filesystem::copy_file(
+      std::filesystem::path(dir_path) / snapshot_name,
+      std::filesystem::path(frozen_path) / snapshot_name);
+    assert(!std::filesystem::exists(std::filesystem::path(dir_path) /
+                                    (test_pad_filename(0) + ".events")));
+    // A second background save waits for nothing and keeps the chain valid.
+    store.setSnapshotShards(3);
+    store.save(logkv::StoreSaveMode::backgroundSave);
+    store.update(key(1), val(1));
+    store.flush();
+    live = store.getObjects();
+  }
+  {
+    PersistentStore store(frozen_path);
+    assert(store.getObjects() == atSave);
+  }
+  {
+    PersistentStore store(dir_path);
+    assert(store.getObjects() == live);
+    assert(store.getObjects().size() == 20000 - 6667 + 1);
+  }
+
+  std::cout << "test_store_background_save PASSED." << std::endl;
+}
+
+void test_store_compression() {
+  std::cout << "Running test_store_compression..." << std::endl;
+  std::string test_name = "compression";
+  std::string dir_path = setup_test_directory(test_name);
+  std::string plain_path = setup_test_directory(test_name + "_plain");
+
+  auto key = [](int i) { return logkv::makeBytes("ck_" + std::to_string(i)); };
+  auto val = [](int i) {
+    std::string s;
+    while (s.size() < static_cast<size_t>(100 + (i * 37) % 700)) {
+      s += "{\"id\":" + std::to_string(i) + ",\"name\":\"item\"}";
+    }
+    return logkv::makeBytes(s);
+  };
+  auto fill = [&](TestStore& store) {
+    for (int i = 0; i < 500; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.save();
+    for (int i = 0; i < 500; i += 3) {
+      store.update(key(i), val(i + 1));
+      store.erase(key(i + 1));
+      if (i % 30 == 0) {
+        store.flush();
+      }
+    }
+    store.flush();
+  };
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir, 4096);
+    assert(store.getCompression() == logkv::noCompression);
+    store.setCompression(logkv::lz4Compression, 256);
+    assert(store.getCompression() == logkv::lz4Compression);
+    assert(store.getCompressionThreshold() == 256);
+    fill(store);
+  }
+  {
+    TestStore store(plain_path, logkv::StoreFlags::createDir, 4096);
+    fill(store);
+  }
+  auto dirSize = [](const std::string& path) {
+    uintmax_t total = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+      total += entry.file_size();
+    }
+    return total;
+  };
+  assert(dirSize(dir_path) * 2 < dirSize(plain_path));
+
+  auto loadStore = [&](const std::string& path, size_t workers, bool mapped,
+                       bool& ok) {
+    TestStore store(path, logkv::StoreFlags::deferLoad);
+    store.setReplayWorkers(workers);
+    store.setMappedReplay(mapped);
+    ok = store.load();
+    return store.getObjects();
+  };
+  bool ok1 = false, ok2 = false, ok3 = false, ok4 = false, ok5 = false;
+  auto expected = loadStore(plain_path, 0, false, ok1);
+  assert(ok1 && expected.size() == 500 - 167);
+  assert(expected.at(key(3)) == val(4));
+  assert(loadStore(dir_path, 0, false, ok2) == expected);
+  assert(loadStore(dir_path, 0, true, ok3) == expected);
+  assert(loadStore(dir_path, 3, false, ok4) == expected);
+  assert(loadStore(dir_path, 2, true, ok5) == expected);
+  assert(ok2 && ok3 && ok4 && ok5);
+
+  // Sharded snapshots compress each shard's frames as well.
+  {
+    TestStore store(dir_path);
+    store.setCompression(logkv::lz4Compression, 256);
+    store.setSnapshotShards(3);
+    store.save();
+  }
+  bool okSharded = false;
+  assert(loadStore(dir_path, 0, false, okSharded) == expected);
+  assert(okSharded);
+
+  // A damaged compressed payload fails the CRC check.
+  std::string bad_path = setup_test_directory(test_name + "_corrupt");
+  {
+    TestStore store(bad_path, logkv::StoreFlags::createDir);
+    store.setCompression(logkv::lz4Compression, 256);
+    store.update(key(1), val(1));
+    store.flush();
+    store.update(key(2), val(2));
+    store.flush();
+  }
+  std::filesystem::path bad_events =
+    std::filesystem::path(bad_path) / (test_pad_filename(0) + ".events");
+  {
+    std::fstream f(bad_events, std::ios::in | std::ios::out |
+                                 std::ios::binary);
+    auto pos = std::filesystem::file_size(bad_events) - 10;
+    f.seekg(pos);
+    char c = static_cast<char>(f.get() ^ 0x55);
+    f.seekp(pos);
+    f.put(c);
+  }
+  bool okBad = true;
+  auto badObjects = loadStore(bad_path, 0, false, okBad);
+  assert(!okBad);
+  assert(badObjects.size() == 1);
+  assert(badObjects.at(key(1)) == val(1));
+  cleanup_test_directory(bad_path);
+
+  bool threw = false;
+  try {
+    TestStore store(plain_path);
+    store.setCompression(99);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  cleanup_test_directory(plain_path);
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_compression PASSED." << std::endl;
+}
+
+void test_store_delta_snapshot() {
+  std::cout << "Running test_store_delta_snapshot..." << std::endl;
+  std::string test_name = "delta_snapshot";
+  std::string dir_path = setup_test_directory(test_name);
+  auto key = [](int i) { return logkv::makeBytes("dk_" + std::to_string(i)); };
+  auto val = [](int i) {
+    return logkv::makeBytes("value_" + std::to_string(i) +
+                            std::string(50, 'x'));
+  };
+  auto path = [&](uint64_t t, const std::string& ext) {
+    return std::filesystem::path(dir_path) / (test_pad_filename(t) + ext);
+  };
+  auto countFiles = [&](const std::string& ext) {
+    size_t n = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
+      n += entry.path().extension() == ext;
+    }
+    return n;
+  };
+  auto loadStore = [&](std::map<logkv::Bytes, logkv::Bytes>& objects) {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setMaxDeltaSnapshots(3);
+    bool ok = store.load();
+    objects = store.getObjects();
+    return ok;
+  };
+
+  std::map<logkv::Bytes, logkv::Bytes> expected;
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir);
+    store.setMaxDeltaSnapshots(3);
+    assert(store.getMaxDeltaSnapshots() == 3);
+    for (int i = 0; i < 1000; ++i) {
+      store.update(key(i), val(i));
+    }
+    // No base snapshot yet, so this writes a full one.
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(store.getTime() == 1);
+    assert(std::filesystem::exists(path(1, ".snapshot")));
+    assert(store.getDirtyKeyCount() == 0);
+
+    for (int i = 0; i < 10; ++i) {
+      store.update(key(i), val(i + 5000));
+    }
+    for (int i = 10; i < 15; ++i) {
+      store.erase(key(i));
+    }
+    store.erase(key(5000)); // not in the map, not dirty
+    auto it = store.find(key(20));
+    it->second = val(20000);
+    store.persist(it);
+    store.getObjects()[key(21)] = val(21000); // untracked direct change
+    store.markDirty(key(21));
+    assert(store.getDirtyKeyCount() == 17);
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(store.getTime() == 2);
+    assert(store.getDeltaSnapshotCount() == 1);
+    assert(store.getDirtyKeyCount() == 0);
+    assert(std::filesystem::exists(path(1, ".snapshot")));
+    assert(std::filesystem::exists(path(2, ".delta")));
+    assert(!std::filesystem::exists(path(1, ".events")));
+    assert(std::filesystem::file_size(path(2, ".delta")) * 20 <
+           std::filesystem::file_size(path(1, ".snapshot")));
+
+    // Events written after the delta are replayed on top of it.
+    store.update(key(30), val(30000));
+    store.erase(key(31));
+    store.flush();
+    expected = store.getObjects();
+  }
+  {
+    std::map<logkv::Bytes, logkv::Bytes> loaded;
+    assert(loadStore(loaded));
+    assert(loaded == expected);
+    assert(loaded.size() == 1000 - 5 - 1);
+    assert(loaded.at(key(3)) == val(5003));
+    assert(loaded.at(key(21)) == val(21000));
+    assert(loaded.count(key(12)) == 0);
+  }
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setMaxDeltaSnapshots(3);
+    assert(store.load());
+    assert(store.getDeltaSnapshotCount() == 1);
+    assert(store.getDirtyKeyCount() == 2); // keys of the replayed events
+    store.save(logkv::StoreSaveMode::deltaSave);
+    store.update(key(40), val(40000));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(store.getDeltaSnapshotCount() == 3);
+    assert(countFiles(".delta") == 3);
+    expected = store.getObjects();
+  }
+  {
+    std::map<logkv::Bytes, logkv::Bytes> loaded;
+    assert(loadStore(loaded));
+    assert(loaded == expected);
+  }
+  {
+    // The delta limit folds the deltas into a new full snapshot.
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setMaxDeltaSnapshots(3);
+    assert(store.load());
+    store.update(key(50), val(50000));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(store.getDeltaSnapshotCount() == 0);
+    assert(countFiles(".delta") == 0);
+    assert(countFiles(".snapshot") == 1);
+    assert(std::filesystem::exists(path(store.getTime(), ".snapshot")));
+
+    // So does changing at least half of the keys.
+    for (int i = 0; i < 600; ++i) {
+      store.update(key(i), val(i + 7000));
+    }
+    uint64_t t = store.getTime();
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(std::filesystem::exists(path(t + 1, ".snapshot")));
+    assert(countFiles(".delta") == 0);
+
+    // Enabling tracking after changes were made also needs a full snapshot.
+    store.setMaxDeltaSnapshots(0);
+    store.update(key(60), val(60000));
+    store.setMaxDeltaSnapshots(2);
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(std::filesystem::exists(path(t + 2, ".snapshot")));
+
+    store.erase(key(61));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    store.update(key(62), val(62000));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    assert(countFiles(".delta") == 2);
+    expected = store.getObjects();
+  }
+  {
+    std::map<logkv::Bytes, logkv::Bytes> loaded;
+    assert(loadStore(loaded));
+    assert(loaded == expected);
+    assert(loaded.at(key(62)) == val(62000));
+  }
+
+  // A missing delta in the middle of the chain is a corrupted snapshot.
+  {
+    std::vector<std::filesystem::path> deltas;
+    for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
+      if (entry.path().extension() == ".delta") {
+        deltas.push_back(entry.path());
+      }
+    }
+    std::sort(deltas.begin(), deltas.end());
+    std::filesystem::remove(deltas.front());
+  }
+  bool threw = false;
+  try {
+    std::map<logkv::Bytes, logkv::Bytes> loaded;
+    loadStore(loaded);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_delta_snapshot PASSED." << std::endl;
+}
+
+void test_store_compaction() {
+  std::cout << "Running test_store_compaction..." << std::endl;
+  std::string test_name = "compaction";
+  std::string dir_path = setup_test_directory(test_name);
+  auto key = [](int i) { return logkv::makeBytes("ck_" + std::to_string(i)); };
+  auto val = [](int i) {
+    return logkv::makeBytes("v" + std::to_string(i) + std::string(40, 'c'));
+  };
+  auto path = [&](uint64_t t, const std::string& ext) {
+    return std::filesystem::path(dir_path) / (test_pad_filename(t) + ext);
+  };
+  auto loadStore = [&](size_t workers, bool& ok) {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setReplayWorkers(workers);
+    ok = store.load();
+    return store.getObjects();
+  };
+
+  std::map<logkv::Bytes, logkv::Bytes> expected;
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir);
+    assert(!store.compact()); // nothing to compact
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), val(i));
+    }
+    store.save();
+    assert(!store.compact());
+    for (int round = 0; round < 40; ++round) {
+      for (int i = 0; i < 20; ++i) {
+        store.update(key(i), val(i * 1000 + round));
+      }
+      store.flush();
+    }
+    store.erase(key(50)); // erased snapshot key stays erased
+    store.update(key(200), val(200));
+    store.erase(key(200));
+    store.flush();
+    uint64_t t = store.getTime();
+    auto eventsSize = std::filesystem::file_size(path(t, ".events"));
+    assert(store.compact());
+    // Updates continue while the compaction runs.
+    store.update(key(300), val(300));
+    store.flush();
+    store.waitSave();
+    assert(!store.isSaving());
+    assert(store.getTime() == t + 1);
+    assert(!std::filesystem::exists(path(t, ".events")));
+    assert(std::filesystem::exists(path(t, ".snapshot")));
+    assert(std::filesystem::file_size(path(t + 1, ".delta")) * 20 <
+           eventsSize);
+    expected = store.getObjects();
+  }
+  bool ok1 = false, ok2 = false;
+  assert(loadStore(0, ok1) == expected);
+  assert(loadStore(2, ok2) == expected);
+  assert(ok1 && ok2);
+  assert(expected.size() == 100);
+  assert(expected.at(key(7)) == val(7039));
+  assert(expected.count(key(50)) == 0);
+  assert(expected.at(key(300)) == val(300));
+  {
+    // Compactions and delta snapshots extend the same delta chain.
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setMaxDeltaSnapshots(8);
+    assert(store.load());
+    assert(store.getDeltaSnapshotCount() == 1);
+    assert(store.compact());
+    store.update(key(1), val(1));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    store.erase(key(2));
+    store.flush();
+    assert(store.compact());
+    store.waitSave();
+    assert(store.getDeltaSnapshotCount() == 4);
+    assert(!store.compact());
+    expected = store.getObjects();
+  }
+  bool ok3 = false;
+  assert(loadStore(0, ok3) == expected);
+  assert(ok3);
+  assert(expected.at(key(1)) == val(1));
+  assert(expected.count(key(2)) == 0);
+
+  // A full snapshot folds the compacted deltas.
+  {
+    TestStore store(dir_path);
+    store.save();
+    for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
+      assert(entry.path().extension() != ".delta");
+    }
+  }
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_compaction PASSED." << std::endl;
+}
+
+void test_store_sharded_store() {
+  std::cout << "Running test_store_sharded_store..." << std::endl;
+  std::string test_name = "sharded_store";
+  std::string dir_path = setup_test_directory(test_name);
+  using Sharded = logkv::ShardedStore<std::map, logkv::Bytes, logkv::Bytes, 4>;
+  auto key = [](int t, int i) {
+    return logkv::makeBytes("sk_" + std::to_string(t) + "_" +
+                            std::to_string(i));
+  };
+  auto val = [](int i) { return logkv::makeBytes("sv_" + std::to_string(i)); };
+  constexpr int threads = 8;
+  constexpr int perThread = 500;
+
+  std::map<logkv::Bytes, logkv::Bytes> expected;
+  {
+    Sharded store(dir_path, logkv::StoreFlags::createDir);
+    static_assert(Sharded::shardCount() == 4);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t) {
+      writers.emplace_back([&, t]() {
+        for (int i = 0; i < perThread; ++i) {
+          store.update(key(t, i), val(i));
+          if (i % 5 == 0) {
+            store.erase(key(t, i));
+          }
+          if (i % 7 == 0) {
+            store.withShard(key(t, i), [&](Sharded::store_type& s) {
+              auto it = s.find(key(t, i));
+              if (it != s.end()) {
+                it->second = val(i + 1);
+                s.persist(it);
+              }
+            });
+          }
+        }
+      });
+    }
+    for (auto& w : writers) {
+      w.join();
+    }
+    store.flush();
+    assert(store.size() == threads * (perThread - perThread / 5));
+    assert(!store.get(key(0, 5)));
+    assert(*store.get(key(3, 7)) == val(8));
+    for (int t = 0; t < threads; ++t) {
+      for (int i = 0; i < perThread; ++i) {
+        if (auto v = store.get(key(t, i))) {
+          expected[key(t, i)] = *v;
+        }
+      }
+    }
+    size_t populated = 0;
+    for (size_t i = 0; i < Sharded::shardCount(); ++i) {
+      populated += !store.shard(i).getObjects().empty();
+      for (const auto& [k, v] : store.shard(i).getObjects()) {
+        assert(Sharded::shardIndex(k) == i);
+      }
+    }
+    assert(populated == Sharded::shardCount());
+  }
+  auto loadAll = [&](Sharded& store) {
+    std::map<logkv::Bytes, logkv::Bytes> all;
+    for (size_t i = 0; i < Sharded::shardCount(); ++i) {
+      for (const auto& [k, v] : store.shard(i).getObjects()) {
+        all[k] = v;
+      }
+    }
+    return all;
+  };
+  {
+    Sharded store(dir_path); // replays the shards' events
+    assert(loadAll(store) == expected);
+    store.save();
+    store.update(key(9, 9), val(9));
+    store.flush(true);
+    expected[key(9, 9)] = val(9);
+  }
+  {
+    Sharded store(dir_path, logkv::StoreFlags::deferLoad);
+    assert(store.load());
+    assert(loadAll(store) == expected);
+    for (size_t i = 0; i < Sharded::shardCount(); ++i) {
+      assert(std::filesystem::exists(std::filesystem::path(dir_path) /
+                                     ("shard" + std::to_string(i)) /
+                                     (test_pad_filename(1) + ".snapshot")));
+    }
+  }
+  bool threw = false;
+  try {
+    logkv::ShardedStore<std::map, logkv::Bytes, logkv::Bytes, 2> fewer(
+      dir_path);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_sharded_store PASSED." << std::endl;
+}
+
+void test_store_concurrent_reads() {
+  std::cout << "Running test_store_concurrent_reads..." << std::endl;
+  std::string test_name = "concurrent_reads";
+  std::string dir_path = setup_test_directory(test_name);
+  using PStore = logkv::Store<logkv::PersistentMap, logkv::Bytes, logkv::Bytes>;
+  auto key = [](int i) { return logkv::makeBytes("rk_" + std::to_string(i)); };
+  auto counter = [](const logkv::Bytes& b) {
+    return std::stoi(std::string(b.data(), b.size()));
+  };
+  constexpr int keys = 64;
+  constexpr int rounds = 200;
+
+  bool threw = false;
+  try {
+    TestStore plain(dir_path + "_plain", logkv::StoreFlags::createDir);
+    plain.setConcurrentReads(true);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+  cleanup_test_directory(dir_path + "_plain");
+
+  {
+    PStore store(dir_path, logkv::StoreFlags::createDir);
+    PStore::Reader early(store);
+    threw = false;
+    try {
+      early.view();
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    assert(threw);
+    for (int i = 0; i < keys; ++i) {
+      store.update(key(i), logkv::makeBytes("0"));
+    }
+    store.setConcurrentReads(true);
+    assert(store.isConcurrentReads());
+
+    // Readers see every key's counter only move forward, and snapshots are
+    // consistent: a key written later in a round is never ahead of an
+    // earlier one.
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+      readers.emplace_back([&]() {
+        PStore::Reader reader(store);
+        std::vector<int> last(keys, 0);
+        while (!done) {
+          const auto& view = reader.view();
+          int first = -1;
+          for (int i = 0; i < keys; ++i) {
+            auto it = view.find(key(i));
+            if (it == view.end()) {
+              ++failures;
+              continue;
+            }
+            int c = counter(it->second);
+            if (c < last[i] || (first >= 0 && c > first)) {
+              ++failures;
+            }
+            if (first < 0) {
+              first = c;
+            }
+            last[i] = c;
+          }
+        }
+      });
+    }
+    for (int round = 1; round <= rounds; ++round) {
+      for (int i = 0; i < keys; ++i) {
+        store.update(key(i), logkv::makeBytes(std::to_string(round)));
+      }
+      if (round % 50 == 0) {
+        store.flush();
+      }
+    }
+    done = true;
+    for (auto& r : readers) {
+      r.join();
+    }
+    assert(failures == 0);
+
+    PStore::Reader reader(store);
+    assert(counter(*reader.find(key(5))) == rounds);
+    store.erase(key(5));
+    assert(reader.find(key(5)) == nullptr);
+    store.getObjects()[key(6)] = logkv::makeBytes("-1");
+    assert(counter(*reader.find(key(6))) == rounds); // not published yet
+    store.publishReads();
+    assert(counter(*reader.find(key(6))) == -1);
+    store.flush();
+  }
+  {
+    PStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setConcurrentReads(true);
+    PStore::Reader reader(store);
+    assert(store.load());
+    assert(reader.view().size() == keys - 1);
+    assert(counter(*reader.find(key(7))) == rounds);
+    store.setConcurrentReads(false);
+    threw = false;
+    try {
+      reader.view();
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    assert(threw);
+  }
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_concurrent_reads PASSED." << std::endl;
+}
+
+void test_store_write_batch() {
+  std::cout << "Running test_store_write_batch..." << std::endl;
+  std::string test_name = "write_batch";
+  std::string dir_path = setup_test_directory(test_name);
+  auto key = [](int i) { return logkv::makeBytes("wb_" + std::to_string(i)); };
+  auto val = [](int i, size_t n = 20) {
+    return logkv::Bytes(n, char('a' + i % 26));
+  };
+  auto events =
+    std::filesystem::path(dir_path) / (test_pad_filename(0) + ".events");
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir, 256);
+    store.update(key(0), val(0));
+    store.update(key(1), val(1));
+
+    TestStore::WriteBatch batch;
+    assert(batch.empty());
+    for (int i = 2; i < 40; ++i) {
+      batch.update(key(i), val(i));
+    }
+    batch.erase(key(1));
+    batch.update(key(2), val(99)); // later ops win
+    assert(batch.size() == 40);
+    uint64_t seq = store.write(batch);
+    assert(seq == 42);
+    assert(store.getBufferSize() == 256); // shrunk after fitting the batch
+    assert(store.getObjects().size() == 39);
+    assert(store.getObjects().count(key(1)) == 0);
+    assert(store.getObjects().at(key(2)) == val(99));
+    store.write(TestStore::WriteBatch());
+    assert(store.getWriteSequence() == 42);
+
+    // A batch that fits in the current frame shares it.
+    TestStore::WriteBatch small;
+    small.update(key(100), val(100));
+    small.update(key(101), val(101));
+    small.update(key(102), logkv::Bytes()); // kept, as by `update()`
+    store.write(small);
+    assert(store.getObjects().count(key(102)) == 1);
+    store.flush();
+  }
+  {
+    TestStore store(dir_path);
+    assert(store.getObjects().size() == 41);
+    assert(store.getObjects().at(key(2)) == val(99));
+    assert(store.getObjects().at(key(101)) == val(101));
+  }
+  // Truncating the batch's frame drops the whole batch, not a prefix of it.
+  std::filesystem::remove_all(dir_path);
+  {
+    TestStore store(dir_path, logkv::StoreFlags::createDir, 64);
+    store.update(key(0), val(0));
+    store.flush();
+    TestStore::WriteBatch batch;
+    for (int i = 1; i < 20; ++i) {
+      batch.update(key(i), val(i, 100));
+    }
+    store.write(batch);
+    store.flush();
+  }
+  std::filesystem::resize_file(events, std::filesystem::file_size(events) - 1);
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    assert(!store.load());
+    assert(store.getObjects().size() == 1);
+  }
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_write_batch PASSED." << std::endl;
+}
+
+// Serializer without write_to(), to check the write() fallback
+struct LegacyBlob {
+  std::string s;
+  bool operator==(const LegacyBlob&) const = default;
+};
+namespace logkv {
+template <> struct serializer<LegacyBlob> {
+  static size_t get_size(const LegacyBlob& b) {
+    return serializer<std::string>::get_size(b.s);
+  }
+  static bool is_empty(const LegacyBlob& b) { return b.s.empty(); }
+  static size_t write(char* dest, size_t size, const LegacyBlob& b) {
+    return serializer<std::string>::write(dest, size, b.s);
+  }
+  static size_t read(const char* src, size_t size, LegacyBlob& b) {
+    return serializer<std::string>::read(src, size, b.s);
+  }
+};
+} // namespace logkv
+
+void test_store_single_pass_write() {
+  std::cout << "Running test_store_single_pass_write..." << std::endl;
+
+  using Nested =
+    std::map<std::string, std::vector<std::tuple<uint32_t, std::string>>>;
+  using Value = std::tuple<Nested, std::variant<std::monostate, uint64_t,
+                                                std::string>,
+                           LegacyBlob, logkv::VarUint<uint64_t>>;
+  Nested nested;
+  for (uint32_t i = 0; i < 20; ++i) {
+    auto& vec = nested["key" + std::to_string(i)];
+    for (uint32_t j = 0; j < i; ++j) {
+      vec.emplace_back(j, std::string(j, 'a' + j % 26));
+    }
+  }
+  Value value(nested, std::string("variant"), LegacyBlob{"legacy"}, 300);
+  const size_t size = logkv::serializer<Value>::get_size(value);
+
+  // A growable sink produces the same bytes as write().
+  std::vector<char> expected(size);
+  assert(logkv::serializer<Value>::write(expected.data(), size, value) ==
+         size);
+  std::vector<char> grown(3, 'x');
+  logkv::Sink sink(grown, 3);
+  logkv::write_to(sink, value);
+  assert(sink.size() == size);
+  assert(grown.size() >= size + 3);
+  assert(std::string(grown.data(), 3) == "xxx");
+  assert(std::equal(expected.begin(), expected.end(), grown.begin() + 3));
+
+  // A fixed sink that is too small reports the required size.
+  std::vector<char> small(size / 2);
+  logkv::Sink fixed(small.data(), small.size());
+  logkv::write_to(fixed, value);
+  assert(fixed.size() == size);
+  assert(logkv::serializer<Value>::write(small.data(), small.size(), value) ==
+         size);
+  Value readBack;
+  assert(logkv::serializer<Value>::read(expected.data(), size, readBack) ==
+         size);
+  assert(readBack == value);
+
+  // Store writes that overflow the frame move to the next frame, and without
+  // frame chaining ones larger than the buffer grow it; everything reloads
+  // intact.
+  std::string dir = setup_test_directory("single_pass_write");
+  using BlobStore = logkv::Store<std::map, std::string, LegacyBlob>;
+  std::map<std::string, LegacyBlob> model;
+  {
+    TestStore store(dir, logkv::StoreFlags::none, 64);
+    BlobStore blobs(dir + "_blobs", logkv::StoreFlags::createDir, 64);
+    store.setFrameChaining(false);
+    blobs.setFrameChaining(false);
+    for (size_t i = 0; i < 200; ++i) {
+      logkv::Bytes k = logkv::makeBytes("k" + std::to_string(i % 50));
+      logkv::Bytes v =
+        logkv::makeBytes(std::string((i * 37) % 300, 'a' + i % 26));
+      store.update(k, v);
+      const std::string bk = "b" + std::to_string(i % 30);
+      model[bk] = LegacyBlob{std::string((i * 53) % 200, 'z' - i % 26)};
+      blobs.update(bk, model[bk]);
+    }
+    store.flush();
+    blobs.flush();
+    for (size_t sz : {store.getBufferSize(), blobs.getBufferSize()}) {
+      assert(sz > 64 && (sz & (sz - 1)) == 0);
+    }
+  }
+  {
+    TestStore store(dir);
+    assert(store.getObjects().size() == 50);
+    for (size_t i = 150; i < 200; ++i) {
+      logkv::Bytes k = logkv::makeBytes("k" + std::to_string(i % 50));
+      logkv::Bytes v =
+        logkv::makeBytes(std::string((i * 37) % 300, 'a' + i % 26));
+      if (v.empty()) {
+        assert(store.find(k) == store.end());
+      } else {
+        assert(store.getObjects().at(k) == v);
+      }
+    }
+    BlobStore blobs(dir + "_blobs");
+    for (const auto& [k, v] : model) {
+      if (v.s.empty()) {
+        assert(blobs.find(k) == blobs.end());
+      } else {
+        assert(blobs.getObjects().at(k) == v);
+      }
+    }
+  }
+  cleanup_test_directory(dir);
+  cleanup_test_directory(dir + "_blobs");
+
+  std::cout << "test_store_single_pass_write PASSED." << std::endl;
+}
+
+// Value whose serializer can fail after writing part of the object
+struct FailingBlob {
+  std::string s;
+  bool fail = false;
+  bool operator==(const FailingBlob& o) const { return s == o.s; }
+};
+namespace logkv {
+template <> struct serializer<FailingBlob> {
+  static size_t get_size(const FailingBlob& b) {
+    return serializer<std::string>::get_size(b.s);
+  }
+  static bool is_empty(const FailingBlob& b) { return b.s.empty(); }
+  static size_t write(char* dest, size_t size, const FailingBlob& b) {
+    return write_with_sink(dest, size, b);
+  }
+  static void write_to(Sink& sink, const FailingBlob& b) {
+    serializer<std::string>::write_to(sink, b.s);
+    if (b.fail) {
+      throw std::runtime_error("FailingBlob");
+    }
+  }
+  static size_t read(const char* src, size_t size, FailingBlob& b) {
+    return serializer<std::string>::read(src, size, b.s);
+  }
+};
+} // namespace logkv
+
+void test_store_frame_chaining() {
+  std::cout << "Running test_store_frame_chaining..." << std::endl;
+  std::string dir = setup_test_directory("frame_chaining");
+  constexpr size_t bufferSize = 4096;
+
+  std::map<logkv::Bytes, logkv::Bytes> model;
+  auto value = [](size_t i, size_t size) {
+    logkv::Bytes v(size);
+    for (size_t j = 0; j < size; ++j) {
+      v[j] = static_cast<char>((i * 131 + j * 7) % 251);
+    }
+    return v;
+  };
+  {
+    TestStore store(dir, logkv::StoreFlags::none, bufferSize);
+    assert(store.isFrameChaining());
+    for (size_t i = 0; i < 40; ++i) {
+      logkv::Bytes k = logkv::makeBytes("key" + std::to_string(i % 15));
+      // Mix small values, values that overflow the frame, and values many
+      // times larger than the buffer.
+      const size_t size = (i % 3 == 0) ? 100 * 1000 + i : (i * 997) % 6000;
+      model[k] = value(i, size);
+      store.update(k, model[k]);
+      assert(store.getBufferSize() == bufferSize);
+    }
+    store.flush();
+  }
+  auto check = [&](TestStore& store) {
+    assert(store.getObjects().size() == model.size());
+    for (const auto& [k, v] : model) {
+      assert(store.getObjects().at(k) == v);
+    }
+    assert(store.getBufferSize() == bufferSize);
+  };
+  for (int mode = 0; mode < 4; ++mode) {
+    TestStore store(dir, logkv::StoreFlags::deferLoad, bufferSize);
+    store.setMappedReplay(mode & 1);
+    store.setReplayWorkers((mode & 2) ? 2 : 0);
+    assert(store.load());
+    check(store);
+  }
+
+  // Snapshots chain large entries too.
+  {
+    TestStore store(dir, logkv::StoreFlags::none, bufferSize);
+    store.save();
+    logkv::Bytes k = logkv::makeBytes("after");
+    model[k] = value(99, 50 * 1000);
+    store.update(k, model[k]);
+    store.flush();
+  }
+  {
+    TestStore store(dir, logkv::StoreFlags::none, bufferSize);
+    check(store);
+  }
+
+  // A value that fails to serialize halfway through a chain is dropped,
+  // and the events around it are kept.
+  std::string dir2 = setup_test_directory("frame_chaining_abort");
+  using FailStore = logkv::Store<std::map, std::string, FailingBlob>;
+  {
+    FailStore store(dir2, logkv::StoreFlags::none, bufferSize);
+    store.update("a", FailingBlob{"before"});
+    bool threw = false;
+    try {
+      store.update("b", FailingBlob{std::string(20000, 'x'), true});
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    assert(threw);
+    store.update("c", FailingBlob{std::string(10000, 'y')});
+    store.flush();
+  }
+  for (int mode = 0; mode < 4; ++mode) {
+    FailStore store(dir2, logkv::StoreFlags::deferLoad, bufferSize);
+    store.setMappedReplay(mode & 1);
+    store.setReplayWorkers((mode & 2) ? 2 : 0);
+    assert(store.load());
+    assert(store.getObjects().size() == 2);
+    assert(store.getObjects().at("a").s == "before");
+    assert(store.getObjects().at("c").s == std::string(10000, 'y'));
+    assert(store.find("b") == store.end());
+  }
+
+  // A corrupted chain segment is detected.
+  std::filesystem::path eventsPath;
+  for (const auto& entry : std::filesystem::directory_iterator(dir2)) {
+    if (entry.path().extension() == ".events") {
+      eventsPath = entry.path();
+    }
+  }
+  {
+    std::fstream fs(eventsPath,
+                    std::ios::in | std::ios::out | std::ios::binary);
+    fs.seekp(-5000, std::ios::end);
+    fs.put('z');
+  }
+  {
+    FailStore store(dir2, logkv::StoreFlags::deferLoad, bufferSize);
+    assert(!store.load());
+  }
+
+  cleanup_test_directory(dir);
+  cleanup_test_directory(dir2);
+  std::cout << "test_store_frame_chaining PASSED." << std::endl;
+}
+
+void test_store_small_bytes() {
+  std::cout << "Running test_store_small_bytes..." << std::endl;
+  std::string dir = setup_test_directory("small_bytes");
+  using SB = logkv::SmallBytes<24>;
+  using SmallStore = logkv::Store<boost::unordered_flat_map, SB, SB>;
+
+  // Keys and values both below and above the inline capacity, with repeated
+  // keys so that replay reuses its scratch key across found entries.
+  std::map<SB, SB> model;
+  auto bytes = [](size_t i, size_t size) {
+    SB b(size);
+    for (size_t j = 0; j < size; ++j) {
+      b[j] = static_cast<char>((i * 31 + j) % 256);
+    }
+    return b;
+  };
+  {
+    SmallStore store(dir, logkv::createDir | logkv::deleteData);
+    for (size_t i = 0; i < 500; ++i) {
+      SB k = bytes(i % 50, (i % 50) % 2 ? 8 : 40);
+      SB v = bytes(i, i % 7 == 0 ? 0 : (i * 13) % 60);
+      store.update(k, v);
+      if (v.empty()) {
+        model.erase(k);
+      } else {
+        model[k] = v;
+      }
+      if (i == 250) {
+        store.save();
+      }
+    }
+    store.flush();
+  }
+  for (int mode = 0; mode < 4; ++mode) {
+    SmallStore store(dir, logkv::StoreFlags::deferLoad);
+    store.setMappedReplay(mode & 1);
+    store.setReplayWorkers((mode & 2) ? 2 : 0);
+    assert(store.load());
+    assert(store.getObjects().size() == model.size());
+    for (const auto& [k, v] : model) {
+      assert(store.getObjects().at(k) == v);
+    }
+  }
+
+  cleanup_test_directory(dir);
+  std::cout << "test_store_small_bytes PASSED." << std::endl;
+}
+
+void test_store_lazy_values() {
+  std::cout << "Running test_store_lazy_values..." << std::endl;
+  std::string dir = setup_test_directory("lazy_values");
+  using LazyStore =
+    logkv::Store<std::map, logkv::Bytes, logkv::Lazy<logkv::Bytes>>;
+  auto& cache = logkv::LazyCache<logkv::Bytes>::instance();
+  cache.setCapacity(4);
+
+  std::map<logkv::Bytes, logkv::Bytes> model;
+  auto value = [](size_t i) {
+    logkv::Bytes v(200 + i * 37 % 3000);
+    for (size_t j = 0; j < v.size(); ++j) {
+      v[j] = static_cast<char>((i * 17 + j) % 251);
+    }
+    return v;
+  };
+  auto check = [&](LazyStore& store, bool resident) {
+    assert(store.getObjects().size() == model.size());
+    for (const auto& [k, v] : model) {
+      const auto& lazy = store.getObjects().at(k);
+      assert(lazy.isResident() == resident);
+      assert(*lazy.get() == v);
+    }
+    assert(cache.size() <= 4);
+  };
+  {
+    LazyStore store(dir, logkv::createDir | logkv::deleteData);
+    for (size_t i = 0; i < 100; ++i) {
+      logkv::Bytes k = logkv::makeBytes("key" + std::to_string(i % 40));
+      model[k] = value(i);
+      store.update(k, model[k]);
+    }
+    store.erase(logkv::makeBytes("key3"));
+    model.erase(logkv::makeBytes("key3"));
+    check(store, true);
+    store.flush();
+  }
+  // Replaying the events leaves values in the mapped events file.
+  {
+    LazyStore store(dir);
+    check(store, false);
+    // Unchanged values are copied from the events file into the snapshot.
+    store.save();
+    logkv::Bytes k = logkv::makeBytes("key5");
+    model[k] = value(1000);
+    store.update(k, model[k]);
+    assert(store.getObjects().at(k).isResident());
+    store.flush();
+  }
+  {
+    LazyStore store(dir);
+    check(store, false);
+  }
+  // Compressed frames are not in the file as is, so they are decoded.
+  {
+    LazyStore store(dir);
+    store.setCompression(logkv::CompressionCodec::lz4Compression, 64);
+    store.save();
+  }
+  {
+    LazyStore store(dir);
+    check(store, true);
+  }
+  cache.setCapacity(logkv::LazyCache<logkv::Bytes>::DefaultCapacity);
+  cache.clear();
+
+  cleanup_test_directory(dir);
+  std::cout << "test_store_lazy_values PASSED." << std::endl;
+}
+
+struct RecordingObserver : logkv::StoreObserver {
+  std::vector<std::string> calls;
+  void onSnapshotStart(uint64_t snapshotTime, bool delta) override {
+    calls.push_back("start " + std::to_string(snapshotTime) +
+                    (delta ? " delta" : ""));
+  }
+  void onSnapshotFinish(uint64_t snapshotTime, bool delta, uint64_t,
+                        bool ok) override {
+    calls.push_back("finish " + std::to_string(snapshotTime) +
+                    (delta ? " delta" : "") + (ok ? "" : " failed"));
+  }
+  void onCorruptedEvents(const std::filesystem::path& path) override {
+    calls.push_back("corrupted " + path.filename().string());
+  }
+};
+
+void test_store_stats() {
+  std::cout << "Running test_store_stats..." << std::endl;
+  std::string dir_path = setup_test_directory("stats");
+
+  logkv::LatencyHistogram h;
+  assert(h.percentile(0.5) == 0);
+  for (uint64_t ns : {1, 100, 100, 100, 5000}) {
+    h.record(ns);
+  }
+  assert(h.count() == 5 && h.sum() == 5301 && h.max() == 5000);
+  assert(h.bucketCount(0) == 1 && h.bucketCount(6) == 3);
+  assert(h.percentile(0.5) == 128);
+  assert(h.percentile(1.0) == 5000);
+  h.reset();
+  assert(h.count() == 0 && h.max() == 0);
+
+  auto stats = std::make_shared<logkv::StoreStats>();
+  auto observer = std::make_shared<RecordingObserver>();
+  auto key = [](int i) { return logkv::makeBytes("key" + std::to_string(i)); };
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData, 256);
+    store.setStats(stats);
+    store.setObserver(observer);
+    assert(store.getStats() == stats);
+
+    store.update(key(1), logkv::makeBytes("small"));
+    store.flush();
+    store.setForceCRC32(true);
+    store.update(key(2), logkv::makeBytes("small"));
+    store.flush(true);
+    store.setForceCRC32(false);
+    assert(stats->frames == 2);
+    assert(stats->crc16Frames == 1 && stats->crc32Frames == 1);
+    assert(stats->frameBytes == store.getEventsFileSize());
+    assert(stats->writeFrame.count() == 2);
+    assert(stats->syncs == 1 && stats->syncFlush.count() == 1);
+
+    // A value larger than the buffer grows it or is written as a chain.
+    logkv::Bytes big(1000, 'b');
+    store.setFrameChaining(false);
+    store.update(key(3), big);
+    store.flush();
+    assert(stats->bufferResizes == 1);
+    assert(stats->crc32Frames == 2);
+    store.setFrameChaining(true);
+    store.setBufferSize(256);
+    store.update(key(4), big);
+    store.flush();
+    assert(stats->chainSegments > 1);
+    assert(stats->frames == 3 + stats->chainSegments);
+    assert(stats->frameBytes == store.getEventsFileSize());
+
+    store.save();
+    assert(stats->snapshots == 1 && stats->writeSnapshot.count() == 1);
+    assert(stats->deleteOld.count() == 1 && stats->deletedFiles == 1);
+    assert(observer->calls.size() == 2);
+    assert(observer->calls[0] == "start 1" && observer->calls[1] == "finish 1");
+
+    // Disabled stats are left alone.
+    const uint64_t syncs = stats->syncs;
+    store.setStats(nullptr);
+    store.update(key(5), logkv::makeBytes("small"));
+    store.flush(true);
+    assert(stats->frames == 3 + stats->chainSegments + 1); // the snapshot
+    assert(stats->syncs == syncs);
+  }
+  auto events = std::filesystem::path(dir_path) / (test_pad_filename(1) +
+                                                   ".events");
+  std::filesystem::resize_file(events, std::filesystem::file_size(events) - 1);
+  stats->reset();
+  assert(stats->frames == 0 && stats->writeSnapshot.count() == 0);
+  observer->calls.clear();
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setStats(stats);
+    store.setObserver(observer);
+    assert(!store.load());
+    assert(store.getObjects().size() == 4);
+    assert(stats->corruptedFiles == 1);
+    assert(stats->replayedFiles == 2 && stats->replay.count() == 2);
+    // The recovery save after the corrupted events file.
+    assert(stats->snapshots == 1);
+    assert(observer->calls.size() == 3);
+    assert(observer->calls[0] ==
+           "corrupted " + test_pad_filename(1) + ".events");
+    assert(observer->calls[1] == "start 2");
+  }
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_stats PASSED." << std::endl;
+}
+
+// Same encoding as std::string, with a declared serializer format version
+template <uint32_t N> struct VersionedBlob {
+  std::string s;
+  bool operator==(const VersionedBlob&) const = default;
+};
+namespace logkv {
+template <uint32_t N> struct serializer<VersionedBlob<N>> {
+  static constexpr uint32_t format_version = N;
+  static size_t get_size(const VersionedBlob<N>& b) {
+    return serializer<std::string>::get_size(b.s);
+  }
+  static bool is_empty(const VersionedBlob<N>& b) { return b.s.empty(); }
+  static size_t write(char* dest, size_t size, const VersionedBlob<N>& b) {
+    return serializer<std::string>::write(dest, size, b.s);
+  }
+  static size_t read(const char* src, size_t size, VersionedBlob<N>& b) {
+    return serializer<std::string>::read(src, size, b.s);
+  }
+};
+} // namespace logkv
+
+void test_store_snapshot_info() {
+  std::cout << "Running test_store_snapshot_info..." << std::endl;
+  std::string dir_path = setup_test_directory("snapshot_info");
+  constexpr size_t recordSize = 44; // snapshot header or footer record
+  auto key = [](int i) { return logkv::makeBytes("key" + std::to_string(i)); };
+  auto snapshotPath = [&](uint64_t t, const char* ext = ".snapshot") {
+    return std::filesystem::path(dir_path) / (test_pad_filename(t) + ext);
+  };
+  auto readFile = [](const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+  };
+  auto writeFile = [](const std::filesystem::path& path,
+                      const std::string& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+  };
+
+  logkv::Bytes big(1000, 'b');
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData, 256);
+    store.setFrameChaining(false);
+    store.setMaxDeltaSnapshots(2);
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), i % 10 ? logkv::makeBytes("value") : big);
+    }
+    store.save();
+    auto info = TestStore::readSnapshotInfo(snapshotPath(1));
+    assert(info && info->version == 1);
+    assert(info->entries == 100);
+    assert(info->maxFrameSize > 1000 && info->maxFrameSize < 2000);
+    assert(info->payloadBytes > 10 * 1000);
+    assert(info->keyVersion == 0 && info->valueVersion == 0);
+
+    store.update(key(1), logkv::makeBytes("changed"));
+    store.erase(key(2));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    auto delta = TestStore::readSnapshotInfo(snapshotPath(2, ".delta"));
+    assert(delta && delta->entries == 2);
+  }
+
+  // The buffer is sized for the largest frame before replay.
+  auto stats = std::make_shared<logkv::StoreStats>();
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    store.setStats(stats);
+    store.load();
+    assert(store.getObjects().size() == 99);
+    assert(store.getObjects().at(key(1)) == logkv::makeBytes("changed"));
+    assert(stats->bufferResizes == 0);
+  }
+
+  // Headerless snapshots of older versions still load.
+  std::string data = readFile(snapshotPath(1));
+  writeFile(snapshotPath(1),
+            data.substr(recordSize, data.size() - 2 * recordSize));
+  assert(!TestStore::readSnapshotInfo(snapshotPath(1)));
+  stats->reset();
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    store.setStats(stats);
+    store.load();
+    assert(store.getObjects().size() == 99);
+    assert(stats->bufferResizes > 0);
+  }
+
+  // A snapshot with a header but no footer is incomplete.
+  writeFile(snapshotPath(1), data.substr(0, data.size() - recordSize));
+  bool threw = false;
+  try {
+    TestStore::readSnapshotInfo(snapshotPath(1));
+  } catch (const std::runtime_error& e) {
+    threw = std::string(e.what()) == "incomplete snapshot";
+  }
+  assert(threw);
+  threw = false;
+  try {
+    TestStore store(dir_path);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // Sharded and mapped snapshots.
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData);
+    store.setSnapshotShards(3);
+    for (int i = 0; i < 30; ++i) {
+      store.update(key(i), logkv::makeBytes("value"));
+    }
+    store.save();
+    auto shard = TestStore::readSnapshotInfo(snapshotPath(1, ".snapshot.2"));
+    assert(shard && shard->entries == 10);
+  }
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad);
+    store.setMappedReplay(true);
+    store.setReplayWorkers(2);
+    store.load();
+    assert(store.getObjects().size() == 30);
+  }
+
+  // Snapshots of other serializer versions are rejected.
+  {
+    logkv::Store<std::map, logkv::Bytes, VersionedBlob<1>> store(
+      dir_path, logkv::createDir | logkv::deleteData);
+    store.update(key(1), VersionedBlob<1>{"one"});
+    store.save();
+    auto info = decltype(store)::readSnapshotInfo(snapshotPath(1));
+    assert(info && info->valueVersion == 1);
+  }
+  {
+    logkv::Store<std::map, logkv::Bytes, VersionedBlob<1>> store(dir_path);
+    assert(store.getObjects().at(key(1)).s == "one");
+  }
+  threw = false;
+  try {
+    logkv::Store<std::map, logkv::Bytes, VersionedBlob<2>> store(dir_path);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_snapshot_info PASSED." << std::endl;
+}
+
+void test_store_events_segments() {
+  std::cout << "Running test_store_events_segments..." << std::endl;
+  std::string dir_path = setup_test_directory("events_segments");
+  constexpr uint64_t segmentSize = 1024;
+  auto key = [](int i) { return logkv::makeBytes("key" + std::to_string(i)); };
+  auto value = [](int i, size_t size = 60) {
+    return logkv::Bytes(size, static_cast<char>('a' + i % 26));
+  };
+  auto segmentPath = [&](uint64_t t, size_t segment) {
+    auto name = test_pad_filename(t) + ".events";
+    if (segment) {
+      name += "." + std::to_string(segment);
+    }
+    return std::filesystem::path(dir_path) / name;
+  };
+  auto countSegments = [&](uint64_t t) {
+    size_t n = 0;
+    while (std::filesystem::exists(segmentPath(t, n))) {
+      ++n;
+    }
+    return n;
+  };
+  auto logSize = [&](uint64_t t) {
+    uint64_t size = 0;
+    for (size_t i = 0; i < countSegments(t); ++i) {
+      size += std::filesystem::file_size(segmentPath(t, i));
+    }
+    return size;
+  };
+
+  std::map<logkv::Bytes, logkv::Bytes> expected;
+  auto stats = std::make_shared<logkv::StoreStats>();
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData, 256);
+    store.setStats(stats);
+    store.setEventsSegmentSize(segmentSize);
+    assert(store.getEventsSegmentSize() == segmentSize);
+    for (int i = 0; i < 200; ++i) {
+      store.update(key(i % 70), value(i));
+      if (i % 5 == 0) {
+        store.erase(key(i % 13));
+      }
+    }
+    // A frame chain is written whole to the segment it starts in.
+    store.update(key(1000), value(1000, 3000));
+    store.update(key(1001), value(1001));
+    store.flush();
+    expected = store.getObjects();
+
+    const size_t segments = countSegments(0);
+    assert(segments > 5);
+    assert(stats->eventsSegments == segments - 1);
+    for (size_t i = 0; i + 1 < segments; ++i) {
+      assert(std::filesystem::file_size(segmentPath(0, i)) >= segmentSize);
+    }
+    assert(std::filesystem::file_size(segmentPath(0, segments - 1)) ==
+           segmentSize); // preallocated
+    assert(store.getEventsFileSize() <
+           logSize(0)); // counts the logged bytes, not the zero tail
+  }
+  // Closing the store truncates the preallocated tail.
+  {
+    const uint64_t closedSize = logSize(0);
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    store.setEventsSegmentSize(segmentSize);
+    assert(store.load());
+    assert(store.getObjects() == expected);
+    assert(store.getEventsFileSize() == closedSize);
+
+    // Appending resumes in the last segment.
+    const size_t segments = countSegments(0);
+    store.update(key(2000), value(2000));
+    store.flush();
+    expected = store.getObjects();
+    assert(countSegments(0) == segments);
+  }
+  // A crash leaves the zero tail of the last segment, which load drops.
+  std::filesystem::resize_file(segmentPath(0, countSegments(0) - 1),
+                               segmentSize * 4);
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    assert(store.load());
+    assert(store.getObjects() == expected);
+    assert(store.getEventsFileSize() == logSize(0));
+  }
+
+  // Compaction folds all the segments into a delta, and saves delete them.
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    store.setEventsSegmentSize(segmentSize, false);
+    store.setMaxDeltaSnapshots(4);
+    assert(store.load());
+    store.save();
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), value(i * 7));
+    }
+    store.flush();
+    assert(countSegments(1) > 3);
+    assert(std::filesystem::file_size(segmentPath(1, countSegments(1) - 1)) <
+           segmentSize); // not preallocated
+    assert(store.compact());
+    store.waitSave();
+    assert(countSegments(1) == 0);
+    assert(std::filesystem::exists(std::filesystem::path(dir_path) /
+                                   (test_pad_filename(2) + ".delta")));
+    store.update(key(3000), value(3000));
+    for (int i = 0; i < 50; ++i) {
+      store.update(key(i), value(i));
+    }
+    store.flush();
+    expected = store.getObjects();
+  }
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    assert(store.load());
+    assert(store.getObjects() == expected);
+    store.save();
+    assert(countSegments(2) == 0 && countSegments(3) == 1);
+  }
+
+  // A missing segment is reported as corruption.
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    store.setEventsSegmentSize(segmentSize);
+    assert(store.load());
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i), value(i * 3));
+    }
+    store.flush();
+    assert(countSegments(3) > 3);
+  }
+  std::filesystem::remove(segmentPath(3, 1));
+  {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    assert(!store.load());
+  }
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_events_segments PASSED." << std::endl;
+}
+
+struct OverlapObserver : logkv::StoreObserver {
+  std::atomic<int> active = 0;
+  std::atomic<int> maxActive = 0;
+  std::atomic<int> finished = 0;
+  void onSnapshotStart(uint64_t, bool) override {
+    int n = ++active;
+    int max = maxActive;
+    while (n > max && !maxActive.compare_exchange_weak(max, n)) {
+    }
+  }
+  void onSnapshotFinish(uint64_t, bool, uint64_t, bool) override {
+    --active;
+    ++finished;
+  }
+};
+
+void test_store_snapshot_policy() {
+  std::cout << "Running test_store_snapshot_policy..." << std::endl;
+  using PStore = logkv::Store<logkv::PersistentMap, logkv::Bytes, logkv::Bytes>;
+  std::string dir_path = setup_test_directory("snapshot_policy");
+  auto key = [](int i) { return logkv::makeBytes("key" + std::to_string(i)); };
+  auto value = [](int i) { return logkv::Bytes(100, 'a' + i % 26); };
+  auto stats = std::make_shared<logkv::StoreStats>();
+
+  // Saves by events log size, on the writing thread.
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData, 512);
+    store.setStats(stats);
+    assert(!store.getSaveFuture().valid());
+    logkv::SnapshotPolicy policy;
+    policy.eventsBytes = 4096;
+    policy.mode = logkv::StoreSaveMode::syncSave;
+    store.setSnapshotPolicy(policy);
+    for (int i = 0; i < 500; ++i) {
+      store.update(key(i % 50), value(i));
+      assert(store.getUnsavedEventsBytes() < 4096 + 1024);
+    }
+    assert(store.getTime() > 5);
+    assert(stats->scheduledSaves == store.getTime());
+    auto done = store.getSaveFuture();
+    assert(done.valid() &&
+           done.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    assert(done.get() == store.getTime());
+
+    // Nothing is due below the minimum, and no policy saves nothing.
+    policy.minEventsBytes = 1 << 20;
+    store.setSnapshotPolicy(policy);
+    const uint64_t time = store.getTime();
+    for (int i = 0; i < 100; ++i) {
+      store.update(key(i % 50), value(i));
+    }
+    store.flush();
+    assert(store.getTime() == time && !store.scheduleSave());
+    store.setSnapshotPolicy(logkv::SnapshotPolicy());
+    assert(!store.scheduleSave() && store.getTime() == time);
+
+    // A manual save resets the count; by wall time, polled while idle.
+    store.save();
+    assert(store.getUnsavedEventsBytes() == 0);
+    policy = logkv::SnapshotPolicy();
+    policy.interval = std::chrono::milliseconds(20);
+    policy.mode = logkv::StoreSaveMode::asyncClear;
+    store.setSnapshotPolicy(policy);
+    assert(!store.scheduleSave()); // nothing logged
+    store.update(key(1), value(1));
+    store.flush();
+    assert(store.getTime() == time + 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    assert(store.scheduleSave());
+    assert(store.getSaveFuture().get() == time + 2);
+    assert(!store.isSaving());
+    store.setSnapshotPolicy(logkv::SnapshotPolicy());
+  }
+
+  // Background saves by replay cost never overlap.
+  {
+    PStore store(dir_path, logkv::createDir | logkv::deleteData, 512);
+    auto observer = std::make_shared<OverlapObserver>();
+    store.setObserver(observer);
+    for (int i = 0; i < 2000; ++i) {
+      store.update(key(i), value(i));
+    }
+    store.save();
+    logkv::SnapshotPolicy policy;
+    policy.replayRatio = 0.05;
+    store.setSnapshotPolicy(policy);
+    for (int i = 0; i < 5000; ++i) {
+      store.update(key(i % 2500), value(i * 3));
+    }
+    store.flush();
+    uint64_t time = store.getSaveFuture().get();
+    assert(time > 1 && time <= store.getTime());
+    store.waitSave();
+    assert(observer->maxActive == 1 && observer->finished > 2);
+    store.setObserver(nullptr);
+
+    // Writers wait for the running save once `stallBytes` are logged.
+    policy.stallBytes = 1;
+    store.setSnapshotPolicy(policy);
+    for (int i = 0; i < 5000; ++i) {
+      store.update(key(i % 2500), value(i * 7));
+    }
+    store.flush();
+    store.waitSave();
+    auto objects = store.getObjects();
+    store.setSnapshotPolicy(logkv::SnapshotPolicy());
+    assert(store.load());
+    assert(store.getObjects() == objects);
+  }
+
+  // With group commit, a save() never overlaps one that a writer started.
+  {
+    PStore store(dir_path, logkv::createDir | logkv::deleteData, 512);
+    auto observer = std::make_shared<OverlapObserver>();
+    store.setObserver(observer);
+    store.setGroupCommit(true);
+    logkv::SnapshotPolicy policy;
+    policy.eventsBytes = 1;
+    store.setSnapshotPolicy(policy);
+    std::atomic<bool> writing = true;
+    std::thread saver([&]() {
+      while (writing) {
+        store.save(logkv::StoreSaveMode::backgroundSave);
+      }
+    });
+    for (int i = 0; i < 2000; ++i) {
+      store.update(key(i % 50), value(i));
+      store.flush();
+    }
+    writing = false;
+    saver.join();
+    store.waitSave();
+    assert(observer->maxActive == 1);
+    store.setObserver(nullptr);
+    store.setSnapshotPolicy(logkv::SnapshotPolicy());
+    store.setGroupCommit(false);
+    auto objects = store.getObjects();
+    assert(store.load());
+    assert(store.getObjects() == objects);
+  }
+
+  // A scheduled save that fails isn't thrown by the write that started it:
+  // the store keeps logging, and `waitSave()` reports the error.
+  {
+    std::map<logkv::Bytes, logkv::Bytes> objects;
+    {
+      TestStore store(dir_path, logkv::createDir | logkv::deleteData, 512);
+      store.update(key(0), value(0));
+      store.save();
+      // A directory in the way of the next snapshot fails its rename.
+      auto blocker = std::filesystem::path(dir_path) /
+                     (test_pad_filename(store.getTime() + 1) + ".snapshot");
+      std::filesystem::create_directories(blocker / "x");
+      logkv::SnapshotPolicy policy;
+      policy.eventsBytes = 4096;
+      policy.mode = logkv::StoreSaveMode::syncSave;
+      store.setSnapshotPolicy(policy);
+      for (int i = 0; i < 100; ++i) {
+        store.update(key(i % 50), value(i));
+      }
+      store.flush();
+      auto done = store.getSaveFuture();
+      assert(done.wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready);
+      bool thrown = false;
+      try {
+        done.get();
+      } catch (const std::exception&) {
+        thrown = true;
+      }
+      assert(thrown);
+      thrown = false;
+      try {
+        store.waitSave();
+      } catch (const std::exception&) {
+        thrown = true;
+      }
+      assert(thrown);
+      store.waitSave(); // reported once
+      std::filesystem::remove_all(blocker);
+      store.setSnapshotPolicy(logkv::SnapshotPolicy());
+      store.flush();
+      objects = store.getObjects();
+    }
+    TestStore store(dir_path);
+    assert(store.getObjects() == objects);
+  }
+
+#if !LOGKV_WINDOWS
+  // Forked saves are reaped by the store, one child at a time.
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData, 512);
+    logkv::SnapshotPolicy policy;
+    policy.eventsBytes = 8192;
+    policy.mode = logkv::StoreSaveMode::forkSave;
+    store.setSnapshotPolicy(policy);
+    for (int i = 0; i < 500; ++i) {
+      store.update(key(i % 50), value(i));
+    }
+    store.flush();
+    store.waitSave();
+    assert(!store.isSaving());
+    assert(store.getTime() > 0 &&
+           store.getSaveFuture().get() == store.getTime());
+    store.setSnapshotPolicy(logkv::SnapshotPolicy());
+    auto objects = store.getObjects();
+    assert(store.load());
+    assert(store.getObjects() == objects);
+  }
+#endif
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_snapshot_policy PASSED." << std::endl;
+}
+
+void test_store_front_coding() {
+  std::cout << "Running test_store_front_coding..." << std::endl;
+  std::string dir_path = setup_test_directory("front_coding");
+  auto key = [](int i) {
+    return logkv::makeBytes("/data/users/group" + std::to_string(i / 100) +
+                            "/profile/item" + std::to_string(i));
+  };
+  auto value = [](int i) {
+    return logkv::Bytes(i % 97 == 0 ? 600 : 8 + i % 5, 'a' + i % 26);
+  };
+  auto snapshotSize = [&](uint64_t t, const char* ext = ".snapshot") {
+    return std::filesystem::file_size(std::filesystem::path(dir_path) /
+                                      (test_pad_filename(t) + ext));
+  };
+
+  std::map<logkv::Bytes, logkv::Bytes> expected;
+  uint64_t plainSize;
+  {
+    TestStore store(dir_path, logkv::createDir | logkv::deleteData, 256);
+    store.setMaxDeltaSnapshots(2);
+    for (int i = 0; i < 1000; ++i) {
+      store.update(key(i), value(i));
+      expected[key(i)] = value(i);
+    }
+    store.save();
+    plainSize = snapshotSize(1);
+    assert(TestStore::readSnapshotInfo(std::filesystem::path(dir_path) /
+                                       (test_pad_filename(1) + ".snapshot"))
+             ->version == 1);
+
+    // Frames start with a full key, including frames sealed while writing a
+    // pair and frame chains (the 600-byte values).
+    store.setSnapshotFrontCoding(16);
+    assert(store.getSnapshotFrontCoding() == 16);
+    store.save();
+    auto info = TestStore::readSnapshotInfo(
+      std::filesystem::path(dir_path) / (test_pad_filename(2) + ".snapshot"));
+    assert(info && info->version == 2 && info->keyRestart == 16);
+    assert(info->entries == 1000);
+    assert(snapshotSize(2) < plainSize * 3 / 4);
+
+    // Delta snapshots are front-coded too.
+    for (int i = 0; i < 1000; i += 7) {
+      store.update(key(i), value(i + 1));
+      expected[key(i)] = value(i + 1);
+    }
+    store.erase(key(500));
+    expected.erase(key(500));
+    store.save(logkv::StoreSaveMode::deltaSave);
+    auto delta = TestStore::readSnapshotInfo(
+      std::filesystem::path(dir_path) / (test_pad_filename(3) + ".delta"));
+    assert(delta && delta->keyRestart == 16);
+  }
+  auto check = [&](size_t workers, bool mapped) {
+    TestStore store(dir_path, logkv::StoreFlags::deferLoad, 256);
+    store.setReplayWorkers(workers);
+    store.setMappedReplay(mapped);
+    store.load();
+    assert(store.getObjects() == expected);
+  };
+  check(0, false);
+  check(3, false);
+  check(0, true);
+  check(2, true);
+
+  // Sharded snapshots, background saves and a restart interval of 1.
+  {
+    TestStore store(dir_path, logkv::StoreFlags::none, 256);
+    store.setSnapshotFrontCoding(1);
+    store.setSnapshotShards(3);
+    store.save(logkv::StoreSaveMode::backgroundSave);
+    store.waitSave();
+    assert(TestStore::readSnapshotInfo(std::filesystem::path(dir_path) /
+                                       (test_pad_filename(4) + ".snapshot.2"))
+             ->keyRestart == 1);
+  }
+  check(0, false);
+  check(2, true);
+
+  // Only byte string keys can be front-coded.
+  {
+    logkv::Store<std::map, int, logkv::Bytes> store(
+      dir_path, logkv::createDir | logkv::deleteData);
+    bool threw = false;
+    try {
+      store.setSnapshotFrontCoding(16);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    assert(threw && store.getSnapshotFrontCoding() == 0);
+  }
+
+  cleanup_test_directory(dir_path);
+  std::cout << "test_store_front_coding PASSED." << std::endl;
+}
+
 int main() {
 
   if (!std::filesystem::exists(TEST_BASE_DIR)) {
@@ -1157,6 +3588,28 @@ int main() {
     test_store_iterators();
     test_store_partial_serialization();
     test_store_macro_partial_serialization();
+    test_store_masked_partial_serialization();
+    test_store_group_commit();
+    test_store_sharded_snapshot();
+    test_store_mapped_replay();
+    test_store_pipelined_replay();
+    test_store_uring_write();
+    test_store_background_save();
+    test_store_compression();
+    test_store_delta_snapshot();
+    test_store_compaction();
+    test_store_sharded_store();
+    test_store_concurrent_reads();
+    test_store_write_batch();
+    test_store_single_pass_write();
+    test_store_frame_chaining();
+    test_store_small_bytes();
+    test_store_lazy_values();
+    test_store_stats();
+    test_store_snapshot_info();
+    test_store_events_segments();
+    test_store_snapshot_policy();
+    test_store_front_coding();
 
     std::cout << "\nALL Store tests PASSED successfully!" << std::endl;
 